@@ -1,8 +1,7 @@
--- Copyright (c) 2019 <dev@brigid.jp>
+-- Copyright (c) 2019,2026 <dev@brigid.jp>
 -- This software is released under the MIT License.
 -- https://opensource.org/licenses/mit-license.php
 
-local sha256 = ...
 local brigid = require "brigid"
 
 local password = "password"
@@ -10,8 +9,8 @@ local password = "password"
 assert(io.read(8) == "Salted__")
 local salt = io.read(8)
 
-local key = sha256(password .. salt)
-local iv = sha256(key .. password .. salt):sub(1, 16)
+-- openssl enc -md sha256 uses EVP_BytesToKey with one iteration.
+local key, iv = brigid.bytes_to_key("sha256", password, salt, 1, 32, 16)
 
 local plaintext
 local decryptor = brigid.decryptor("aes-256-cbc", key, iv, function (out)
@@ -5,8 +5,10 @@
 .SUFFIXES: .java .class
 
 CLASSES = \
+	jp/brigid/AEADCryptor.class \
 	jp/brigid/AESCryptor.class \
 	jp/brigid/Hasher.class \
+	jp/brigid/Hmac.class \
 	jp/brigid/HttpAuthenticator.class \
 	jp/brigid/HttpTask.class
 
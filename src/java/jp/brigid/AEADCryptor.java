@@ -0,0 +1,88 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+package jp.brigid;
+
+import java.nio.ByteBuffer;
+import java.security.SecureRandom;
+import java.security.spec.AlgorithmParameterSpec;
+import javax.crypto.Cipher;
+import javax.crypto.spec.GCMParameterSpec;
+import javax.crypto.spec.IvParameterSpec;
+import javax.crypto.spec.SecretKeySpec;
+
+public class AEADCryptor {
+  public AEADCryptor(boolean encrypt, byte[] transformation, byte[] algorithm, byte[] key, byte[] iv) throws Exception {
+    name = new String(algorithm, "UTF-8");
+    this.transformation = new String(transformation, "UTF-8");
+    cipher = Cipher.getInstance(this.transformation);
+    this.encrypt = encrypt;
+    this.key = new SecretKeySpec(key, name);
+    init(iv);
+  }
+
+  public void reset(byte[] key, byte[] iv) throws Exception {
+    if (key != null) {
+      this.key = new SecretKeySpec(key, name);
+    }
+    tag = null;
+    if (encrypt) {
+      // Cipher rejects the key and the nonce of the last encryption, which a
+      // reset may repeat. A new instance does not remember them.
+      cipher = Cipher.getInstance(transformation);
+    }
+    init(iv);
+  }
+
+  private void init(byte[] iv) throws Exception {
+    AlgorithmParameterSpec spec = name.equals("AES") ? new GCMParameterSpec(TAG_SIZE * 8, iv) : new IvParameterSpec(iv);
+    cipher.init(encrypt ? Cipher.ENCRYPT_MODE : Cipher.DECRYPT_MODE, key, spec);
+  }
+
+  public void updateAAD(ByteBuffer in) throws Exception {
+    cipher.updateAAD(in);
+  }
+
+  // Cipher appends the tag to the ciphertext and expects it at the end of
+  // the ciphertext. It is split off and passed separately here.
+  public int update(ByteBuffer in, ByteBuffer out, boolean padding) throws Exception {
+    if (!padding) {
+      return cipher.update(in, out);
+    }
+    if (encrypt) {
+      int size = cipher.doFinal(in, out) - TAG_SIZE;
+      tag = new byte[TAG_SIZE];
+      out.position(out.position() - TAG_SIZE);
+      out.get(tag);
+      return size;
+    } else {
+      int size = cipher.update(in, out);
+      return size + cipher.doFinal(ByteBuffer.wrap(tag), out);
+    }
+  }
+
+  public byte[] getTag() {
+    return tag;
+  }
+
+  public void setTag(byte[] tag) {
+    this.tag = tag;
+  }
+
+  // Fills the rest of the buffer for salts and nonces.
+  public static void nextBytes(ByteBuffer out) {
+    byte[] bytes = new byte[out.remaining()];
+    RANDOM.nextBytes(bytes);
+    out.put(bytes);
+  }
+
+  private static final int TAG_SIZE = 16;
+  private static final SecureRandom RANDOM = new SecureRandom();
+  private Cipher cipher;
+  private String transformation;
+  private String name;
+  private SecretKeySpec key;
+  private boolean encrypt;
+  private byte[] tag;
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019 <dev@brigid.jp>
+// Copyright (c) 2019,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -12,7 +12,16 @@ import javax.crypto.spec.SecretKeySpec;
 public class AESCryptor {
   public AESCryptor(boolean encrypt, byte[] key, byte[] iv) throws Exception {
     cipher = Cipher.getInstance("AES/CBC/PKCS5Padding");
-    cipher.init(encrypt ? Cipher.ENCRYPT_MODE : Cipher.DECRYPT_MODE, new SecretKeySpec(key, "AES"), new IvParameterSpec(iv));
+    mode = encrypt ? Cipher.ENCRYPT_MODE : Cipher.DECRYPT_MODE;
+    this.key = new SecretKeySpec(key, "AES");
+    cipher.init(mode, this.key, new IvParameterSpec(iv));
+  }
+
+  public void reset(byte[] key, byte[] iv) throws Exception {
+    if (key != null) {
+      this.key = new SecretKeySpec(key, "AES");
+    }
+    cipher.init(mode, this.key, new IvParameterSpec(iv));
   }
 
   public int update(ByteBuffer in, ByteBuffer out, boolean padding) throws Exception {
@@ -24,4 +33,6 @@ public class AESCryptor {
   }
 
   private Cipher cipher;
+  private int mode;
+  private SecretKeySpec key;
 }
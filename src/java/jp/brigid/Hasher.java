@@ -1,4 +1,4 @@
-// Copyright (c) 2019,2024 <dev@brigid.jp>
+// Copyright (c) 2019,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -12,6 +12,10 @@ public class Hasher {
     messageDigest = MessageDigest.getInstance(new String(algorithm, "UTF-8"));
   }
 
+  public Hasher(Hasher that) throws Exception {
+    messageDigest = (MessageDigest) that.messageDigest.clone();
+  }
+
   public void update(ByteBuffer in) throws Exception {
     messageDigest.update(in);
   }
@@ -20,5 +24,9 @@ public class Hasher {
     return messageDigest.digest();
   }
 
+  public void reset() {
+    messageDigest.reset();
+  }
+
   private MessageDigest messageDigest;
 }
@@ -0,0 +1,40 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+package jp.brigid;
+
+import java.nio.ByteBuffer;
+import javax.crypto.Mac;
+import javax.crypto.spec.SecretKeySpec;
+
+public class Hmac {
+  public Hmac(byte[] algorithm, byte[] key) throws Exception {
+    String name = new String(algorithm, "UTF-8");
+    mac = Mac.getInstance(name);
+    if (key.length == 0) {
+      // SecretKeySpec rejects an empty key, which is padded to the same
+      // block as a single zero byte.
+      key = new byte[1];
+    }
+    mac.init(new SecretKeySpec(key, name));
+  }
+
+  public Hmac(Hmac that) throws Exception {
+    mac = (Mac) that.mac.clone();
+  }
+
+  public void update(ByteBuffer in) throws Exception {
+    mac.update(in);
+  }
+
+  public byte[] digest() throws Exception {
+    return mac.doFinal();
+  }
+
+  public void reset() {
+    mac.reset();
+  }
+
+  private Mac mac;
+}
@@ -0,0 +1,414 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "crypto.hpp"
+#include "noncopyable.hpp"
+#include "worker_pool.hpp"
+
+#include <lua.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BRIGID_BLAKE3_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace brigid {
+  namespace {
+    // BLAKE3 with a 32-byte output and no key. The input is split into 1 KiB
+    // chunks which are the leaves of a binary tree. Whole subtrees of 64
+    // chunks are aligned in the tree and independent of each other, so they
+    // are hashed on the worker pool and their chaining values are merged on
+    // the calling thread. The last subtree is kept in the buffer until the
+    // digest because its root may be the root of the whole tree.
+
+    const uint32_t iv[8] = {
+      0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+      0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+    };
+
+    const uint8_t schedule[7][16] = {
+      {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+      {  2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8 },
+      {  3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1 },
+      { 10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6 },
+      { 12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4 },
+      {  9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7 },
+      { 11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13 },
+    };
+
+    const uint32_t chunk_start = 1;
+    const uint32_t chunk_end = 2;
+    const uint32_t parent = 4;
+    const uint32_t root = 8;
+
+    const size_t block_size = 64;
+    const size_t chunk_size = 1024;
+    const size_t subtree_chunks = 64;
+    const size_t subtree_size = chunk_size * subtree_chunks;
+    const size_t max_depth = 54;
+
+    struct cv_t {
+      uint32_t v[8];
+    };
+
+    inline uint32_t load32(const uint8_t* p) {
+      return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    inline uint32_t rotr(uint32_t x, int n) {
+      return x >> n | x << (32 - n);
+    }
+
+    inline void g(uint32_t* s, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+      s[a] += s[b] + x;
+      s[d] = rotr(s[d] ^ s[a], 16);
+      s[c] += s[d];
+      s[b] = rotr(s[b] ^ s[c], 12);
+      s[a] += s[b] + y;
+      s[d] = rotr(s[d] ^ s[a], 8);
+      s[c] += s[d];
+      s[b] = rotr(s[b] ^ s[c], 7);
+    }
+
+    void compress(const uint32_t* cv, const uint32_t* m, uint64_t counter, uint32_t block_len, uint32_t flags, uint32_t* out) {
+      uint32_t s[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        iv[0], iv[1], iv[2], iv[3],
+        static_cast<uint32_t>(counter),
+        static_cast<uint32_t>(counter >> 32),
+        block_len,
+        flags,
+      };
+      for (int r = 0; r < 7; ++r) {
+        const uint8_t* x = schedule[r];
+        g(s, 0, 4,  8, 12, m[x[ 0]], m[x[ 1]]);
+        g(s, 1, 5,  9, 13, m[x[ 2]], m[x[ 3]]);
+        g(s, 2, 6, 10, 14, m[x[ 4]], m[x[ 5]]);
+        g(s, 3, 7, 11, 15, m[x[ 6]], m[x[ 7]]);
+        g(s, 0, 5, 10, 15, m[x[ 8]], m[x[ 9]]);
+        g(s, 1, 6, 11, 12, m[x[10]], m[x[11]]);
+        g(s, 2, 7,  8, 13, m[x[12]], m[x[13]]);
+        g(s, 3, 4,  9, 14, m[x[14]], m[x[15]]);
+      }
+      for (int i = 0; i < 8; ++i) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv[i];
+      }
+    }
+
+    void load_block(const uint8_t* p, size_t size, uint32_t* m) {
+      uint8_t block[block_size] = {};
+      if (size < block_size) {
+        memcpy(block, p, size);
+        p = block;
+      }
+      for (int i = 0; i < 16; ++i) {
+        m[i] = load32(p + i * 4);
+      }
+    }
+
+    // The last compression of a node, which is done with the root flag
+    // only if the node is the root of the tree.
+    struct output_t {
+      uint32_t cv[8];
+      uint32_t m[16];
+      uint64_t counter;
+      uint32_t block_len;
+      uint32_t flags;
+
+      cv_t chaining_value() const {
+        uint32_t out[16];
+        compress(cv, m, counter, block_len, flags, out);
+        cv_t result;
+        memcpy(result.v, out, sizeof(result.v));
+        return result;
+      }
+
+      void root_hash(char* buffer) const {
+        uint32_t out[16];
+        compress(cv, m, 0, block_len, flags | root, out);
+        for (int i = 0; i < 8; ++i) {
+          buffer[i * 4] = static_cast<char>(out[i]);
+          buffer[i * 4 + 1] = static_cast<char>(out[i] >> 8);
+          buffer[i * 4 + 2] = static_cast<char>(out[i] >> 16);
+          buffer[i * 4 + 3] = static_cast<char>(out[i] >> 24);
+        }
+      }
+    };
+
+    output_t chunk_output(const uint8_t* p, size_t size, uint64_t counter) {
+      output_t result;
+      memcpy(result.cv, iv, sizeof(iv));
+      uint32_t flags = chunk_start;
+      for (; size > block_size; p += block_size, size -= block_size) {
+        uint32_t m[16];
+        uint32_t out[16];
+        load_block(p, block_size, m);
+        compress(result.cv, m, counter, block_size, flags, out);
+        memcpy(result.cv, out, sizeof(result.cv));
+        flags = 0;
+      }
+      load_block(p, size, result.m);
+      result.counter = counter;
+      result.block_len = static_cast<uint32_t>(size);
+      result.flags = flags | chunk_end;
+      return result;
+    }
+
+    output_t parent_output(const cv_t& left, const cv_t& right) {
+      output_t result;
+      memcpy(result.cv, iv, sizeof(iv));
+      memcpy(result.m, left.v, sizeof(left.v));
+      memcpy(result.m + 8, right.v, sizeof(right.v));
+      result.counter = 0;
+      result.block_len = block_size;
+      result.flags = parent;
+      return result;
+    }
+
+#ifdef BRIGID_BLAKE3_SSE2
+    template <int T_n>
+    inline __m128i rotr4(__m128i x) {
+      return _mm_or_si128(_mm_srli_epi32(x, T_n), _mm_slli_epi32(x, 32 - T_n));
+    }
+
+    inline void g4(__m128i* s, int a, int b, int c, int d, __m128i x, __m128i y) {
+      s[a] = _mm_add_epi32(_mm_add_epi32(s[a], s[b]), x);
+      s[d] = rotr4<16>(_mm_xor_si128(s[d], s[a]));
+      s[c] = _mm_add_epi32(s[c], s[d]);
+      s[b] = rotr4<12>(_mm_xor_si128(s[b], s[c]));
+      s[a] = _mm_add_epi32(_mm_add_epi32(s[a], s[b]), y);
+      s[d] = rotr4<8>(_mm_xor_si128(s[d], s[a]));
+      s[c] = _mm_add_epi32(s[c], s[d]);
+      s[b] = rotr4<7>(_mm_xor_si128(s[b], s[c]));
+    }
+
+    inline void transpose4(__m128i* v) {
+      __m128i a = _mm_unpacklo_epi32(v[0], v[1]);
+      __m128i b = _mm_unpackhi_epi32(v[0], v[1]);
+      __m128i c = _mm_unpacklo_epi32(v[2], v[3]);
+      __m128i d = _mm_unpackhi_epi32(v[2], v[3]);
+      v[0] = _mm_unpacklo_epi64(a, c);
+      v[1] = _mm_unpackhi_epi64(a, c);
+      v[2] = _mm_unpacklo_epi64(b, d);
+      v[3] = _mm_unpackhi_epi64(b, d);
+    }
+
+    // Hashes four consecutive full chunks at once, one chunk per lane.
+    void chunk_cv4(const uint8_t* p, uint64_t counter, cv_t* out) {
+      __m128i cv[8];
+      for (int i = 0; i < 8; ++i) {
+        cv[i] = _mm_set1_epi32(static_cast<int>(iv[i]));
+      }
+      __m128i counter_low = _mm_setr_epi32(
+          static_cast<int>(counter),
+          static_cast<int>(counter + 1),
+          static_cast<int>(counter + 2),
+          static_cast<int>(counter + 3));
+      __m128i counter_high = _mm_setr_epi32(
+          static_cast<int>(counter >> 32),
+          static_cast<int>((counter + 1) >> 32),
+          static_cast<int>((counter + 2) >> 32),
+          static_cast<int>((counter + 3) >> 32));
+
+      for (size_t j = 0; j < chunk_size / block_size; ++j) {
+        __m128i m[16];
+        for (int k = 0; k < 4; ++k) {
+          for (int i = 0; i < 4; ++i) {
+            m[k * 4 + i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * chunk_size + j * block_size + k * 16));
+          }
+          transpose4(m + k * 4);
+        }
+
+        uint32_t flags = 0;
+        if (j == 0) {
+          flags |= chunk_start;
+        }
+        if (j == chunk_size / block_size - 1) {
+          flags |= chunk_end;
+        }
+        __m128i s[16] = {
+          cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+          _mm_set1_epi32(static_cast<int>(iv[0])),
+          _mm_set1_epi32(static_cast<int>(iv[1])),
+          _mm_set1_epi32(static_cast<int>(iv[2])),
+          _mm_set1_epi32(static_cast<int>(iv[3])),
+          counter_low,
+          counter_high,
+          _mm_set1_epi32(static_cast<int>(block_size)),
+          _mm_set1_epi32(static_cast<int>(flags)),
+        };
+        for (int r = 0; r < 7; ++r) {
+          const uint8_t* x = schedule[r];
+          g4(s, 0, 4,  8, 12, m[x[ 0]], m[x[ 1]]);
+          g4(s, 1, 5,  9, 13, m[x[ 2]], m[x[ 3]]);
+          g4(s, 2, 6, 10, 14, m[x[ 4]], m[x[ 5]]);
+          g4(s, 3, 7, 11, 15, m[x[ 6]], m[x[ 7]]);
+          g4(s, 0, 5, 10, 15, m[x[ 8]], m[x[ 9]]);
+          g4(s, 1, 6, 11, 12, m[x[10]], m[x[11]]);
+          g4(s, 2, 7,  8, 13, m[x[12]], m[x[13]]);
+          g4(s, 3, 4,  9, 14, m[x[14]], m[x[15]]);
+        }
+        for (int i = 0; i < 8; ++i) {
+          cv[i] = _mm_xor_si128(s[i], s[i + 8]);
+        }
+      }
+
+      transpose4(cv);
+      transpose4(cv + 4);
+      for (int i = 0; i < 4; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out[i].v), cv[i]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out[i].v + 4), cv[i + 4]);
+      }
+    }
+#endif
+
+    cv_t subtree_cv(const uint8_t* p, uint64_t counter) {
+      cv_t cvs[subtree_chunks];
+#ifdef BRIGID_BLAKE3_SSE2
+      for (size_t i = 0; i < subtree_chunks; i += 4) {
+        chunk_cv4(p + i * chunk_size, counter + i, cvs + i);
+      }
+#else
+      for (size_t i = 0; i < subtree_chunks; ++i) {
+        cvs[i] = chunk_output(p + i * chunk_size, chunk_size, counter + i).chaining_value();
+      }
+#endif
+      for (size_t n = subtree_chunks; n > 1; n /= 2) {
+        for (size_t i = 0; i < n / 2; ++i) {
+          cvs[i] = parent_output(cvs[i * 2], cvs[i * 2 + 1]).chaining_value();
+        }
+      }
+      return cvs[0];
+    }
+
+    class blake3_t {
+    public:
+      blake3_t()
+        : stack_(),
+          stack_size_(),
+          chunk_counter_() {
+        buffer_.reserve(subtree_size);
+      }
+
+      void reset() {
+        stack_size_ = 0;
+        chunk_counter_ = 0;
+        buffer_.clear();
+      }
+
+      void update(const uint8_t* p, size_t size) {
+        if (!buffer_.empty()) {
+          size_t n = std::min(size, subtree_size - buffer_.size());
+          buffer_.insert(buffer_.end(), p, p + n);
+          p += n;
+          size -= n;
+          if (size == 0) {
+            return;
+          }
+          push_subtrees(buffer_.data(), 1);
+          buffer_.clear();
+        }
+        if (size > subtree_size) {
+          size_t n = (size - 1) / subtree_size;
+          push_subtrees(p, n);
+          p += n * subtree_size;
+          size -= n * subtree_size;
+        }
+        buffer_.insert(buffer_.end(), p, p + size);
+      }
+
+      void digest(char* buffer) const {
+        cv_t stack[max_depth + subtree_chunks];
+        size_t stack_size = stack_size_;
+        memcpy(stack, stack_, sizeof(cv_t) * stack_size);
+
+        // The rest of the input is hashed in the same way as the reference
+        // implementation, chunk by chunk on the top of the stack.
+        const uint8_t* p = buffer_.data();
+        size_t size = buffer_.size();
+        uint64_t counter = chunk_counter_;
+        for (; size > chunk_size; p += chunk_size, size -= chunk_size) {
+          cv_t cv = chunk_output(p, chunk_size, counter).chaining_value();
+          for (uint64_t total = ++counter; (total & 1) == 0; total >>= 1) {
+            cv = parent_output(stack[--stack_size], cv).chaining_value();
+          }
+          stack[stack_size++] = cv;
+        }
+
+        output_t output = chunk_output(p, size, counter);
+        while (stack_size > 0) {
+          output = parent_output(stack[--stack_size], output.chaining_value());
+        }
+        output.root_hash(buffer);
+      }
+
+    private:
+      cv_t stack_[max_depth];
+      size_t stack_size_;
+      uint64_t chunk_counter_;
+      std::vector<uint8_t> buffer_;
+
+      void push_subtrees(const uint8_t* p, size_t n) {
+        std::vector<cv_t> cvs(n);
+        uint64_t counter = chunk_counter_;
+        if (n == 1) {
+          cvs[0] = subtree_cv(p, counter);
+        } else {
+          get_worker_pool()->parallel_for(n, [&](size_t i) {
+            cvs[i] = subtree_cv(p + i * subtree_size, counter + i * subtree_chunks);
+          });
+        }
+        for (size_t i = 0; i < n; ++i) {
+          cv_t cv = cvs[i];
+          chunk_counter_ += subtree_chunks;
+          for (uint64_t total = chunk_counter_ / subtree_chunks; (total & 1) == 0; total >>= 1) {
+            cv = parent_output(stack_[--stack_size_], cv).chaining_value();
+          }
+          stack_[stack_size_++] = cv;
+        }
+      }
+    };
+
+    class blake3_hasher_impl : public hasher, private noncopyable {
+    public:
+      blake3_hasher_impl() {}
+
+      explicit blake3_hasher_impl(const blake3_t& state)
+        : state_(state) {}
+
+      virtual void update(const char* data, size_t size) {
+        state_.update(reinterpret_cast<const uint8_t*>(data), size);
+      }
+
+      virtual void digest(lua_State* L) {
+        char buffer[32] = {};
+        state_.digest(buffer);
+        lua_pushlstring(L, buffer, sizeof(buffer));
+      }
+
+      virtual void reset() {
+        state_.reset();
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<blake3_hasher_impl>(L, "brigid.hasher", state_);
+      }
+
+    private:
+      blake3_t state_;
+    };
+  }
+
+  hasher* new_blake3_hasher(lua_State* L) {
+    return new_userdata<blake3_hasher_impl>(L, "brigid.hasher");
+  }
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "crypto.hpp"
+#include "noncopyable.hpp"
+
+#include <lua.hpp>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define BRIGID_CRC32C_SSE42
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#define BRIGID_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace brigid {
+  namespace {
+    // CRC-32C (Castagnoli), reflected polynomial 0x82F63B78.
+    class crc32c_table_t {
+    public:
+      crc32c_table_t() {
+        for (uint32_t i = 0; i < 256; ++i) {
+          uint32_t c = i;
+          for (int j = 0; j < 8; ++j) {
+            c = c & 1 ? (c >> 1) ^ 0x82F63B78U : c >> 1;
+          }
+          table_[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+          for (int j = 1; j < 8; ++j) {
+            table_[j][i] = (table_[j - 1][i] >> 8) ^ table_[0][table_[j - 1][i] & 0xFF];
+          }
+        }
+      }
+
+      // slicing-by-8
+      uint32_t update(uint32_t crc, const uint8_t* p, size_t size) const {
+        for (; size >= 8; p += 8, size -= 8) {
+          uint32_t a = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24);
+          crc = table_[7][a & 0xFF]
+              ^ table_[6][(a >> 8) & 0xFF]
+              ^ table_[5][(a >> 16) & 0xFF]
+              ^ table_[4][a >> 24]
+              ^ table_[3][p[4]]
+              ^ table_[2][p[5]]
+              ^ table_[1][p[6]]
+              ^ table_[0][p[7]];
+        }
+        for (; size > 0; ++p, --size) {
+          crc = (crc >> 8) ^ table_[0][(crc ^ *p) & 0xFF];
+        }
+        return crc;
+      }
+
+    private:
+      uint32_t table_[8][256];
+    };
+
+    uint32_t update_table(uint32_t crc, const uint8_t* p, size_t size) {
+      static const crc32c_table_t table;
+      return table.update(crc, p, size);
+    }
+
+#if defined(BRIGID_CRC32C_SSE42)
+    __attribute__((target("sse4.2")))
+    uint32_t update_sse42(uint32_t crc, const uint8_t* p, size_t size) {
+      uint64_t c = crc;
+      for (; size >= 8; p += 8, size -= 8) {
+        uint64_t v = 0;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+      }
+      crc = static_cast<uint32_t>(c);
+      for (; size > 0; ++p, --size) {
+        crc = _mm_crc32_u8(crc, *p);
+      }
+      return crc;
+    }
+
+    using update_t = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+    update_t select_update() {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.2") ? &update_sse42 : &update_table;
+    }
+
+    uint32_t crc32c_update(uint32_t crc, const uint8_t* p, size_t size) {
+      static const update_t f = select_update();
+      return f(crc, p, size);
+    }
+#elif defined(BRIGID_CRC32C_ARM)
+    uint32_t crc32c_update(uint32_t crc, const uint8_t* p, size_t size) {
+      for (; size >= 8; p += 8, size -= 8) {
+        uint64_t v = 0;
+        memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+      }
+      for (; size > 0; ++p, --size) {
+        crc = __crc32cb(crc, *p);
+      }
+      return crc;
+    }
+#else
+    uint32_t crc32c_update(uint32_t crc, const uint8_t* p, size_t size) {
+      return update_table(crc, p, size);
+    }
+#endif
+
+    class crc32c_hasher_impl : public hasher, private noncopyable {
+    public:
+      explicit crc32c_hasher_impl(uint32_t crc = 0xFFFFFFFF)
+        : crc_(crc) {}
+
+      virtual void update(const char* data, size_t size) {
+        crc_ = crc32c_update(crc_, reinterpret_cast<const uint8_t*>(data), size);
+      }
+
+      virtual void digest(lua_State* L) {
+        uint32_t crc = ~crc_;
+        char buffer[4] = {
+          static_cast<char>(crc >> 24),
+          static_cast<char>(crc >> 16),
+          static_cast<char>(crc >> 8),
+          static_cast<char>(crc),
+        };
+        lua_pushlstring(L, buffer, sizeof(buffer));
+      }
+
+      virtual void reset() {
+        crc_ = 0xFFFFFFFF;
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<crc32c_hasher_impl>(L, "brigid.hasher", crc_);
+      }
+
+    private:
+      uint32_t crc_;
+    };
+  }
+
+  hasher* new_crc32c_hasher(lua_State* L) {
+    return new_userdata<crc32c_hasher_impl>(L, "brigid.hasher");
+  }
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019,2021,2022,2024 <dev@brigid.jp>
+// Copyright (c) 2019,2021,2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -6,29 +6,152 @@
 #include "error.hpp"
 #include "scope_exit.hpp"
 #include "stack_guard.hpp"
+#include "task.hpp"
 #include "thread_reference.hpp"
 #include "view.hpp"
+#include "writer.hpp"
 
 #include <lua.hpp>
 
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace brigid {
   cryptor::cryptor(thread_reference&& ref)
     : in_size_(),
       out_size_(),
       ref_(std::move(ref)),
-      running_() {}
+      writer_(),
+      running_() {
+    if (lua_State* L = ref_.get()) {
+      writer_ = to_writer(L, 1);
+    }
+  }
 
   cryptor::~cryptor() {}
 
+  bool cryptor::closed() const {
+    return !ref_;
+  }
+
+  void cryptor::write(const char* data, size_t size) {
+    if (running_) {
+      throw BRIGID_LOGIC_ERROR("attempt to use a running brigid.cryptor");
+    }
+    update(data, size, false);
+  }
+
+  void cryptor::write(char data) {
+    write(&data, 1);
+  }
+
   void cryptor::update(const char* in_data, size_t in_size, bool padding) {
+    output(process(in_data, in_size, padding));
+  }
+
+  // The input is processed on the worker pool and the output is passed by
+  // task:get() on the Lua thread, or when the task is collected. The cryptor
+  // is running until then.
+  void cryptor::update_async(lua_State* L, const char* in_data, size_t in_size, bool padding, thread_reference&& ref) {
+    if (running_) {
+      throw BRIGID_LOGIC_ERROR("attempt to use a running brigid.cryptor");
+    }
+    std::shared_ptr<size_t> result = std::make_shared<size_t>();
+    new_task(L, [=]() {
+      *result = process(in_data, in_size, padding);
+      return std::vector<std::string>();
+    }, [=]() {
+      running_ = false;
+      output(*result);
+    }, std::move(ref));
+    running_ = true;
+  }
+
+  void cryptor::update_aad(const char* data, size_t size) {
+    impl_update_aad(data, size);
+  }
+
+  // Zero if the cipher is not authenticated.
+  size_t cryptor::tag_size() const {
+    return impl_tag_size();
+  }
+
+  size_t cryptor::get_tag(char* data, size_t size) const {
+    return impl_get_tag(data, size);
+  }
+
+  void cryptor::set_tag(const char* data, size_t size) {
+    impl_set_tag(data, size);
+  }
+
+  // Reinitializes the context with the initialization vector. If the key is
+  // null, the key and its schedule are kept.
+  void cryptor::reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+    if (running_) {
+      throw BRIGID_LOGIC_ERROR("attempt to use a running brigid.cryptor");
+    }
+    impl_reset(key_data, key_size, iv_data, iv_size);
+    in_size_ = 0;
+    out_size_ = 0;
+  }
+
+  size_t cryptor::calculate_buffer_size(size_t in_size) const {
+    return impl_calculate_buffer_size(in_size);
+  }
+
+  // Processes a whole message at once into the buffer, which must be large
+  // enough for calculate_buffer_size(). The output is not passed to the
+  // writer or the function. Ciphers that can be split on block boundaries
+  // process the segments on the worker pool with up to the given number of
+  // threads.
+  size_t cryptor::update_parallel(const char* in_data, size_t in_size, char* out_data, size_t out_size, size_t threads) {
+    if (in_size_ > 0) {
+      throw BRIGID_LOGIC_ERROR("cryptor is already updated");
+    }
+    in_size_ = in_size;
+    size_t result = impl_update_parallel(in_data, in_size, out_data, out_size, threads);
+    out_size_ = result;
+    return result;
+  }
+
+  void cryptor::close() {
+    ref_ = thread_reference();
+    writer_ = nullptr;
+    impl_close();
+  }
+
+  bool cryptor::running() const {
+    return running_;
+  }
+
+  void cryptor::ensure_buffer_size(size_t size) {
+    if (buffer_.size() < size) {
+      buffer_.resize(size);
+    }
+  }
+
+  size_t cryptor::process(const char* in_data, size_t in_size, bool padding) {
     in_size_ += in_size;
     ensure_buffer_size(impl_calculate_buffer_size(in_size_) - out_size_);
     size_t result = impl_update(in_data, in_size, buffer_.data(), buffer_.size(), padding);
     out_size_ += result;
+    return result;
+  }
+
+  void cryptor::output(size_t result) {
     if (result > 0) {
-      if (lua_State* L = ref_.get()) {
+      if (writer_t* writer = writer_) {
+        if (writer->closed()) {
+          throw BRIGID_LOGIC_ERROR("attempt to use a closed brigid.writer");
+        }
+        running_ = true;
+        scope_exit scope_guard([&]() {
+          running_ = false;
+        });
+        writer->write(buffer_.data(), result);
+      } else if (lua_State* L = ref_.get()) {
         stack_guard guard(L);
         lua_pushvalue(L, 1);
         view_t* view = new_view(L, buffer_.data(), result);
@@ -44,24 +167,62 @@ namespace brigid {
     }
   }
 
-  void cryptor::close() {
-    ref_ = thread_reference();
-    impl_close();
+  void cryptor::impl_update_aad(const char*, size_t) {
+    throw BRIGID_LOGIC_ERROR("not an authenticated cipher");
   }
 
-  bool cryptor::closed() const {
-    return !ref_;
+  size_t cryptor::impl_tag_size() const {
+    return 0;
   }
 
-  bool cryptor::running() const {
-    return running_;
+  size_t cryptor::impl_get_tag(char*, size_t) const {
+    throw BRIGID_LOGIC_ERROR("not an authenticated cipher");
   }
 
-  void cryptor::ensure_buffer_size(size_t size) {
-    if (buffer_.size() < size) {
-      buffer_.resize(size);
-    }
+  void cryptor::impl_set_tag(const char*, size_t) {
+    throw BRIGID_LOGIC_ERROR("not an authenticated cipher");
+  }
+
+  size_t cryptor::impl_update_parallel(const char* in_data, size_t in_size, char* out_data, size_t out_size, size_t) {
+    return impl_update(in_data, in_size, out_data, out_size, true);
   }
 
+  hasher::hasher()
+    : running_() {}
+
   hasher::~hasher() {}
+
+  bool hasher::closed() const {
+    return false;
+  }
+
+  void hasher::write(const char* data, size_t size) {
+    if (running_) {
+      throw BRIGID_LOGIC_ERROR("attempt to use a running brigid.hasher");
+    }
+    update(data, size);
+  }
+
+  void hasher::write(char data) {
+    write(&data, 1);
+  }
+
+  // The input is processed on the worker pool. The hasher is running until
+  // task:get() is called or the task is collected.
+  void hasher::update_async(lua_State* L, const char* data, size_t size, thread_reference&& ref) {
+    if (running_) {
+      throw BRIGID_LOGIC_ERROR("attempt to use a running brigid.hasher");
+    }
+    new_task(L, [=]() {
+      update(data, size);
+      return std::vector<std::string>();
+    }, [=]() {
+      running_ = false;
+    }, std::move(ref));
+    running_ = true;
+  }
+
+  bool hasher::running() const {
+    return running_;
+  }
 }
@@ -1,4 +1,4 @@
-// Copyright (c) 2021,2022,2024 <dev@brigid.jp>
+// Copyright (c) 2021,2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -7,22 +7,36 @@
 
 #include "noncopyable.hpp"
 #include "thread_reference.hpp"
+#include "writer.hpp"
 
 #include <lua.hpp>
 
 #include <stddef.h>
+#include <string>
 #include <vector>
 
 namespace brigid {
   void open_cryptor();
   void open_hasher();
 
-  class cryptor {
+  // The output is passed to a brigid.writer or a Lua function, which is
+  // kept on the stack of the referenced thread.
+  class cryptor : public writer_t {
   public:
     virtual ~cryptor() = 0;
+    virtual bool closed() const;
+    virtual void write(const char*, size_t);
+    virtual void write(char);
     void update(const char*, size_t, bool);
+    void update_async(lua_State*, const char*, size_t, bool, thread_reference&&);
+    void update_aad(const char*, size_t);
+    size_t tag_size() const;
+    size_t get_tag(char*, size_t) const;
+    void set_tag(const char*, size_t);
+    void reset(const char*, size_t, const char*, size_t);
+    size_t calculate_buffer_size(size_t) const;
+    size_t update_parallel(const char*, size_t, char*, size_t, size_t);
     void close();
-    bool closed() const;
     bool running() const;
 
   protected:
@@ -33,12 +47,21 @@ namespace brigid {
     size_t out_size_;
     std::vector<char> buffer_;
     thread_reference ref_;
+    writer_t* writer_;
     bool running_;
 
     void ensure_buffer_size(size_t);
+    size_t process(const char*, size_t, bool);
+    void output(size_t);
 
     virtual size_t impl_calculate_buffer_size(size_t) const = 0;
     virtual size_t impl_update(const char*, size_t, char*, size_t, bool) = 0;
+    virtual void impl_update_aad(const char*, size_t);
+    virtual size_t impl_tag_size() const;
+    virtual size_t impl_get_tag(char*, size_t) const;
+    virtual void impl_set_tag(const char*, size_t);
+    virtual void impl_reset(const char*, size_t, const char*, size_t) = 0;
+    virtual size_t impl_update_parallel(const char*, size_t, char*, size_t, size_t);
     virtual void impl_close() = 0;
   };
 
@@ -48,20 +71,62 @@ namespace brigid {
   cryptor* new_aes_128_cbc_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
   cryptor* new_aes_192_cbc_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
   cryptor* new_aes_256_cbc_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_128_gcm_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_256_gcm_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_chacha20_poly1305_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_128_gcm_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_256_gcm_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_chacha20_poly1305_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_128_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_192_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
+  cryptor* new_aes_256_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&);
 
   cryptor* new_encryptor(lua_State*, const char*, const char*, size_t, const char*, size_t, thread_reference&&);
   cryptor* new_decryptor(lua_State*, const char*, const char*, size_t, const char*, size_t, thread_reference&&);
 
-  class hasher {
+  class hasher : public writer_t {
   public:
     virtual ~hasher() = 0;
+    virtual bool closed() const;
+    virtual void write(const char*, size_t);
+    virtual void write(char);
     virtual void update(const char*, size_t) = 0;
     virtual void digest(lua_State*) = 0;
+    virtual void reset() = 0;
+    virtual hasher* clone(lua_State*) const = 0;
+    void update_async(lua_State*, const char*, size_t, thread_reference&&);
+    bool running() const;
+
+  protected:
+    hasher();
+
+  private:
+    bool running_;
   };
 
   hasher* new_sha1_hasher(lua_State*);
   hasher* new_sha256_hasher(lua_State*);
   hasher* new_sha512_hasher(lua_State*);
+  hasher* new_xxh3_64_hasher(lua_State*);
+  hasher* new_xxh3_128_hasher(lua_State*);
+  hasher* new_crc32c_hasher(lua_State*);
+  hasher* new_blake3_hasher(lua_State*);
+
+  hasher* new_sha1_hmac(lua_State*, const char*, size_t);
+  hasher* new_sha256_hmac(lua_State*, const char*, size_t);
+  hasher* new_sha512_hmac(lua_State*, const char*, size_t);
+
+  hasher* new_hmac(lua_State*, const char*, const char*, size_t);
+
+  // Key derivation does not touch the Lua state, so that it can be run on
+  // the worker pool.
+  std::string pbkdf2(const std::string&, const std::string&, const std::string&, size_t, size_t);
+  std::string hkdf(const std::string&, const std::string&, const std::string&, const std::string&, size_t);
+  std::string bytes_to_key(const std::string&, const std::string&, const std::string&, size_t, size_t);
+
+  // Fills the buffer from the random number generator of the backend,
+  // which is suitable for keys, salts and nonces.
+  void random_bytes(char*, size_t);
 }
 
 #endif
@@ -1,20 +1,23 @@
-// Copyright (c) 2021,2022,2024 <dev@brigid.jp>
+// Copyright (c) 2021,2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
 #include "common.hpp"
 #include "crypto.hpp"
 #include "error.hpp"
+#include "kdf.hpp"
 #include "noncopyable.hpp"
 #include "type_traits.hpp"
 
 #include <lua.hpp>
 
 #include <CommonCrypto/CommonCrypto.h>
+#include <Security/SecRandom.h>
 
 #include <stddef.h>
 #include <utility>
 #include <memory>
+#include <string>
 
 namespace brigid {
   namespace {
@@ -56,11 +59,10 @@ namespace brigid {
     public:
       aes_cryptor_impl(CCOperation operation, const char* key_data, size_t key_size, const char* iv_data, size_t buffer_size, thread_reference&& ref)
         : cryptor(std::move(ref)),
+          operation_(operation),
           cryptor_(make_cryptor_ref()),
           buffer_size_(buffer_size) {
-        CCCryptorRef cryptor = nullptr;
-        check(CCCryptorCreateWithMode(operation, kCCModeCBC, kCCAlgorithmAES, kCCOptionPKCS7Padding, iv_data, key_data, key_size, nullptr, 0, 0, 0, &cryptor));
-        cryptor_ = make_cryptor_ref(cryptor);
+        create(key_data, key_size, iv_data);
       }
 
       virtual size_t impl_calculate_buffer_size(size_t in_size) const {
@@ -77,13 +79,32 @@ namespace brigid {
         return size1 + size2;
       }
 
+      // CCCryptorReset() keeps the key schedule.
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        if (key_data) {
+          create(key_data, key_size, iv_data);
+        } else {
+          check(CCCryptorReset(cryptor_.get(), iv_data));
+        }
+      }
+
       virtual void impl_close() {
         cryptor_ = make_cryptor_ref();
       }
 
     private:
+      CCOperation operation_;
       cryptor_ref_t cryptor_;
       size_t buffer_size_;
+
+      void create(const char* key_data, size_t key_size, const char* iv_data) {
+        CCCryptorRef cryptor = nullptr;
+        check(CCCryptorCreateWithMode(operation_, kCCModeCBC, kCCAlgorithmAES, kCCOptionPKCS7Padding, iv_data, key_data, key_size, nullptr, 0, 0, 0, &cryptor));
+        cryptor_ = make_cryptor_ref(cryptor);
+      }
     };
 
     class sha1_hasher_impl : public hasher, private noncopyable {
@@ -93,6 +114,9 @@ namespace brigid {
         CC_SHA1_Init(&ctx_);
       }
 
+      explicit sha1_hasher_impl(const CC_SHA1_CTX& ctx)
+        : ctx_(ctx) {}
+
       virtual void update(const char* data, size_t size) {
         CC_SHA1_Update(&ctx_, data, size);
       }
@@ -103,6 +127,14 @@ namespace brigid {
         lua_pushlstring(L, buffer, CC_SHA1_DIGEST_LENGTH);
       }
 
+      virtual void reset() {
+        CC_SHA1_Init(&ctx_);
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<sha1_hasher_impl>(L, "brigid.hasher", ctx_);
+      }
+
     private:
       CC_SHA1_CTX ctx_;
     };
@@ -114,6 +146,9 @@ namespace brigid {
         CC_SHA256_Init(&ctx_);
       }
 
+      explicit sha256_hasher_impl(const CC_SHA256_CTX& ctx)
+        : ctx_(ctx) {}
+
       virtual void update(const char* data, size_t size) {
         CC_SHA256_Update(&ctx_, data, size);
       }
@@ -124,6 +159,14 @@ namespace brigid {
         lua_pushlstring(L, buffer, CC_SHA256_DIGEST_LENGTH);
       }
 
+      virtual void reset() {
+        CC_SHA256_Init(&ctx_);
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<sha256_hasher_impl>(L, "brigid.hasher", ctx_);
+      }
+
     private:
       CC_SHA256_CTX ctx_;
     };
@@ -135,6 +178,9 @@ namespace brigid {
         CC_SHA512_Init(&ctx_);
       }
 
+      explicit sha512_hasher_impl(const CC_SHA512_CTX& ctx)
+        : ctx_(ctx) {}
+
       virtual void update(const char* data, size_t size) {
         CC_SHA512_Update(&ctx_, data, size);
       }
@@ -145,9 +191,135 @@ namespace brigid {
         lua_pushlstring(L, buffer, CC_SHA512_DIGEST_LENGTH);
       }
 
+      virtual void reset() {
+        CC_SHA512_Init(&ctx_);
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<sha512_hasher_impl>(L, "brigid.hasher", ctx_);
+      }
+
     private:
       CC_SHA512_CTX ctx_;
     };
+
+    // CCHmacInit() keys the inner and outer states. The keyed context is
+    // kept and copied back after each digest.
+    template <CCHmacAlgorithm T_algorithm, size_t T_size>
+    class hmac_impl : public hasher, private noncopyable {
+    public:
+      hmac_impl(const char* key_data, size_t key_size)
+        : init_(),
+          ctx_() {
+        CCHmacInit(&init_, T_algorithm, key_data, key_size);
+        ctx_ = init_;
+      }
+
+      hmac_impl(const CCHmacContext& init, const CCHmacContext& ctx)
+        : init_(init),
+          ctx_(ctx) {}
+
+      virtual void update(const char* data, size_t size) {
+        CCHmacUpdate(&ctx_, data, size);
+      }
+
+      virtual void digest(lua_State* L) {
+        char buffer[T_size] = {};
+        CCHmacFinal(&ctx_, buffer);
+        ctx_ = init_;
+        lua_pushlstring(L, buffer, T_size);
+      }
+
+      virtual void reset() {
+        ctx_ = init_;
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<hmac_impl<T_algorithm, T_size> >(L, "brigid.hmac", init_, ctx_);
+      }
+
+    private:
+      CCHmacContext init_;
+      CCHmacContext ctx_;
+    };
+
+    // The hash and the hmac of the key derivation in kdf.hpp. The messages
+    // of the hash are short, so that they are buffered and hashed at once.
+    class kdf_digest : private noncopyable {
+    public:
+      explicit kdf_digest(const std::string& name) {
+        if (name == "sha1") {
+          function_ = &CC_SHA1;
+          size_ = CC_SHA1_DIGEST_LENGTH;
+        } else if (name == "sha256") {
+          function_ = &CC_SHA256;
+          size_ = CC_SHA256_DIGEST_LENGTH;
+        } else if (name == "sha512") {
+          function_ = &CC_SHA512;
+          size_ = CC_SHA512_DIGEST_LENGTH;
+        } else {
+          throw BRIGID_LOGIC_ERROR("unsupported hash");
+        }
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+      void update(const char* data, size_t size) {
+        buffer_.append(data, size);
+      }
+
+      void finish(char* data) {
+        function_(buffer_.data(), static_cast<CC_LONG>(buffer_.size()), reinterpret_cast<unsigned char*>(data));
+        buffer_.clear();
+      }
+
+    private:
+      unsigned char* (*function_)(const void*, CC_LONG, unsigned char*);
+      size_t size_;
+      std::string buffer_;
+    };
+
+    class kdf_hmac : private noncopyable {
+    public:
+      kdf_hmac(const std::string& name, const char* key_data, size_t key_size)
+        : init_(),
+          ctx_() {
+        CCHmacAlgorithm algorithm = kCCHmacAlgSHA1;
+        if (name == "sha1") {
+          size_ = CC_SHA1_DIGEST_LENGTH;
+        } else if (name == "sha256") {
+          algorithm = kCCHmacAlgSHA256;
+          size_ = CC_SHA256_DIGEST_LENGTH;
+        } else if (name == "sha512") {
+          algorithm = kCCHmacAlgSHA512;
+          size_ = CC_SHA512_DIGEST_LENGTH;
+        } else {
+          throw BRIGID_LOGIC_ERROR("unsupported hash");
+        }
+        CCHmacInit(&init_, algorithm, key_data, key_size);
+        ctx_ = init_;
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+      void update(const char* data, size_t size) {
+        CCHmacUpdate(&ctx_, data, size);
+      }
+
+      void finish(char* data) {
+        CCHmacFinal(&ctx_, data);
+        ctx_ = init_;
+      }
+
+    private:
+      size_t size_;
+      CCHmacContext init_;
+      CCHmacContext ctx_;
+    };
   }
 
   void open_cryptor() {}
@@ -191,6 +363,44 @@ namespace brigid {
     return new_aes_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
+  // Authenticated ciphers are not supported by this backend yet.
+  cryptor* new_aes_128_gcm_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_gcm_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_chacha20_poly1305_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_128_gcm_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_gcm_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_chacha20_poly1305_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  // CTR is not supported by this backend yet.
+  cryptor* new_aes_128_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_192_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
   hasher* new_sha1_hasher(lua_State* L) {
     return new_userdata<sha1_hasher_impl>(L, "brigid.hasher");
   }
@@ -202,4 +412,37 @@ namespace brigid {
   hasher* new_sha512_hasher(lua_State* L) {
     return new_userdata<sha512_hasher_impl>(L, "brigid.hasher");
   }
+
+  hasher* new_sha1_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<kCCHmacAlgSHA1, CC_SHA1_DIGEST_LENGTH> >(L, "brigid.hmac", key_data, key_size);
+  }
+
+  hasher* new_sha256_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<kCCHmacAlgSHA256, CC_SHA256_DIGEST_LENGTH> >(L, "brigid.hmac", key_data, key_size);
+  }
+
+  hasher* new_sha512_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<kCCHmacAlgSHA512, CC_SHA512_DIGEST_LENGTH> >(L, "brigid.hmac", key_data, key_size);
+  }
+
+  std::string pbkdf2(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return pbkdf2_hmac<kdf_hmac>(name, password, salt, iterations, size);
+  }
+
+  std::string hkdf(const std::string& name, const std::string& key, const std::string& salt, const std::string& info, size_t size) {
+    return hkdf_hmac<kdf_hmac>(name, key, salt, info, size);
+  }
+
+  std::string bytes_to_key(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return bytes_to_key_digest<kdf_digest>(name, password, salt, iterations, size);
+  }
+
+  void random_bytes(char* data, size_t size) {
+    if (size > 0) {
+      int code = SecRandomCopyBytes(kSecRandomDefault, size, data);
+      if (code != errSecSuccess) {
+        throw BRIGID_RUNTIME_ERROR(make_error_code("security error", code));
+      }
+    }
+  }
 }
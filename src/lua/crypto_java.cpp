@@ -1,4 +1,4 @@
-// Copyright (c) 2021,2022,2024 <dev@brigid.jp>
+// Copyright (c) 2021,2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -6,6 +6,7 @@
 #include "common_java.hpp"
 #include "crypto.hpp"
 #include "error.hpp"
+#include "kdf.hpp"
 #include "noncopyable.hpp"
 
 #include <lua.hpp>
@@ -14,6 +15,7 @@
 
 #include <stddef.h>
 #include <mutex>
+#include <string>
 #include <utility>
 
 namespace brigid {
@@ -24,17 +26,21 @@ namespace brigid {
     public:
       aes_cryptor_vtable()
         : constructor(aes_cryptor_clazz, "(Z[B[B)V"),
-          update(aes_cryptor_clazz, "update", "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;Z)I") {}
+          update(aes_cryptor_clazz, "update", "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;Z)I"),
+          reset(aes_cryptor_clazz, "reset", "([B[B)V") {}
 
       constructor_method constructor;
       method<jint> update;
+      method<void> reset;
     };
 
+    aes_cryptor_vtable* aes_cryptor_vt;
+
     class aes_cryptor_impl : public cryptor, private noncopyable {
     public:
       aes_cryptor_impl(bool encrypt, const char* key_data, size_t key_size, const char* iv_data, size_t buffer_size, thread_reference&& ref)
         : cryptor(std::move(ref)),
-          instance_(make_global_ref(vt_.constructor(
+          instance_(make_global_ref(aes_cryptor_vt->constructor(
               aes_cryptor_clazz,
               to_boolean(encrypt),
               make_byte_array(key_data, key_size),
@@ -46,51 +52,272 @@ namespace brigid {
       };
 
       virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t out_size, bool padding) {
-        return vt_.update(
+        return aes_cryptor_vt->update(
             instance_,
             make_direct_byte_buffer(const_cast<char*>(in_data), in_size),
             make_direct_byte_buffer(out_data, out_size),
             to_boolean(padding));
       }
 
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        aes_cryptor_vt->reset(
+            instance_,
+            key_data ? make_byte_array(key_data, key_size) : make_local_ref<jbyteArray>(nullptr),
+            make_byte_array(iv_data, iv_size));
+      }
+
       virtual void impl_close() {
         instance_ = make_global_ref<jobject>();
       }
 
     private:
-      aes_cryptor_vtable vt_;
       global_ref_t<jobject> instance_;
       size_t buffer_size_;
     };
 
+    jclass aead_cryptor_clazz;
+
+    class aead_cryptor_vtable : private noncopyable {
+    public:
+      aead_cryptor_vtable()
+        : constructor(aead_cryptor_clazz, "(Z[B[B[B[B)V"),
+          update_aad(aead_cryptor_clazz, "updateAAD", "(Ljava/nio/ByteBuffer;)V"),
+          update(aead_cryptor_clazz, "update", "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;Z)I"),
+          get_tag(aead_cryptor_clazz, "getTag", "()[B"),
+          set_tag(aead_cryptor_clazz, "setTag", "([B)V"),
+          reset(aead_cryptor_clazz, "reset", "([B[B)V"),
+          next_bytes(aead_cryptor_clazz, "nextBytes", "(Ljava/nio/ByteBuffer;)V") {}
+
+      constructor_method constructor;
+      method<void> update_aad;
+      method<jint> update;
+      method<jbyteArray> get_tag;
+      method<void> set_tag;
+      method<void> reset;
+      static_method<void> next_bytes;
+    };
+
+    aead_cryptor_vtable* aead_cryptor_vt;
+
+    class aead_cryptor_impl : public cryptor, private noncopyable {
+    public:
+      aead_cryptor_impl(bool encrypt, const char* transformation, const char* algorithm, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref)
+        : cryptor(std::move(ref)),
+          instance_(make_global_ref(aead_cryptor_vt->constructor(
+              aead_cryptor_clazz,
+              to_boolean(encrypt),
+              make_byte_array(transformation),
+              make_byte_array(algorithm),
+              make_byte_array(key_data, key_size),
+              make_byte_array(iv_data, iv_size)))),
+          encrypt_(encrypt),
+          tag_set_() {}
+
+      // Cipher keeps the whole plaintext of a decryptor until the tag is
+      // verified, and appends the tag to the ciphertext of an encryptor.
+      virtual size_t impl_calculate_buffer_size(size_t in_size) const {
+        return encrypt_ ? in_size + 16 : in_size;
+      };
+
+      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t out_size, bool padding) {
+        if (padding && !encrypt_ && !tag_set_) {
+          throw BRIGID_LOGIC_ERROR("tag is not set");
+        }
+        return aead_cryptor_vt->update(
+            instance_,
+            make_direct_byte_buffer(const_cast<char*>(in_data), in_size),
+            make_direct_byte_buffer(out_data, out_size),
+            to_boolean(padding));
+      }
+
+      virtual void impl_update_aad(const char* data, size_t size) {
+        aead_cryptor_vt->update_aad(instance_, make_direct_byte_buffer(const_cast<char*>(data), size));
+      }
+
+      virtual size_t impl_tag_size() const {
+        return 16;
+      }
+
+      virtual size_t impl_get_tag(char* data, size_t size) const {
+        if (!encrypt_) {
+          throw BRIGID_LOGIC_ERROR("tag is not available");
+        }
+        local_ref_t<jbyteArray> result = aead_cryptor_vt->get_tag(instance_);
+        if (!result) {
+          throw BRIGID_LOGIC_ERROR("tag is not available");
+        }
+        size_t result_size = get_array_length(result);
+        if (size > result_size) {
+          size = result_size;
+        }
+        get_byte_array_region(result, 0, size, data);
+        return size;
+      }
+
+      virtual void impl_set_tag(const char* data, size_t size) {
+        if (encrypt_) {
+          throw BRIGID_LOGIC_ERROR("tag is computed by an encryptor");
+        }
+        if (size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid tag size");
+        }
+        aead_cryptor_vt->set_tag(instance_, make_byte_array(data, size));
+        tag_set_ = true;
+      }
+
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size == 0) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        aead_cryptor_vt->reset(
+            instance_,
+            key_data ? make_byte_array(key_data, key_size) : make_local_ref<jbyteArray>(nullptr),
+            make_byte_array(iv_data, iv_size));
+        tag_set_ = false;
+      }
+
+      virtual void impl_close() {
+        instance_ = make_global_ref<jobject>();
+      }
+
+    private:
+      global_ref_t<jobject> instance_;
+      bool encrypt_;
+      bool tag_set_;
+    };
+
+    // Small updates are batched, since a JNI call and a direct ByteBuffer cost
+    // more than a copy of a few kilobytes.
+    const size_t batch_size = 4096;
+
+    template <class T>
+    void flush_batch(const T& update, const global_ref_t<jobject>& instance, std::string& batch) {
+      if (!batch.empty()) {
+        update(instance, make_direct_byte_buffer(&batch[0], batch.size()));
+        batch.clear();
+      }
+    }
+
+    template <class T>
+    void update_batch(const T& update, const global_ref_t<jobject>& instance, std::string& batch, const char* data, size_t size) {
+      if (batch.size() + size > batch_size) {
+        flush_batch(update, instance, batch);
+      }
+      if (size < batch_size) {
+        batch.append(data, size);
+      } else {
+        update(instance, make_direct_byte_buffer(const_cast<char*>(data), size));
+      }
+    }
+
     jclass hasher_clazz;
 
     class hasher_vtable : private noncopyable {
     public:
       hasher_vtable()
         : constructor(hasher_clazz, "([B)V"),
+          copy_constructor(hasher_clazz, "(Ljp/brigid/Hasher;)V"),
           update(hasher_clazz, "update", "(Ljava/nio/ByteBuffer;)V"),
-          digest(hasher_clazz, "digest", "()[B") {}
+          digest(hasher_clazz, "digest", "()[B"),
+          reset(hasher_clazz, "reset", "()V") {}
 
       constructor_method constructor;
+      constructor_method copy_constructor;
       method<void> update;
       method<jbyteArray> digest;
+      method<void> reset;
     };
 
+    hasher_vtable* hasher_vt;
+
     template <size_t T_size>
     class hasher_impl : public hasher, private noncopyable {
     public:
       hasher_impl(const char* algorithm)
-        : instance_(make_global_ref(vt_.constructor(
+        : instance_(make_global_ref(hasher_vt->constructor(
               hasher_clazz,
               make_byte_array(algorithm)))) {}
 
+      hasher_impl(const hasher_impl* that)
+        : instance_(make_global_ref(hasher_vt->copy_constructor(
+              hasher_clazz,
+              that->instance_))),
+          batch_(that->batch_) {}
+
+      virtual void update(const char* data, size_t size) {
+        update_batch(hasher_vt->update, instance_, batch_, data, size);
+      }
+
+      virtual void digest(lua_State* L) {
+        flush_batch(hasher_vt->update, instance_, batch_);
+        local_ref_t<jbyteArray> result = hasher_vt->digest(instance_);
+        if (get_array_length(result) != T_size) {
+          throw BRIGID_LOGIC_ERROR("invalid buffer size");
+        }
+        char buffer[T_size] = {};
+        get_byte_array_region(result, 0, T_size, buffer);
+        lua_pushlstring(L, buffer, T_size);
+      }
+
+      virtual void reset() {
+        batch_.clear();
+        hasher_vt->reset(instance_);
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<hasher_impl<T_size> >(L, "brigid.hasher", this);
+      }
+
+    private:
+      global_ref_t<jobject> instance_;
+      std::string batch_;
+    };
+
+    jclass hmac_clazz;
+
+    class hmac_vtable : private noncopyable {
+    public:
+      hmac_vtable()
+        : constructor(hmac_clazz, "([B[B)V"),
+          copy_constructor(hmac_clazz, "(Ljp/brigid/Hmac;)V"),
+          update(hmac_clazz, "update", "(Ljava/nio/ByteBuffer;)V"),
+          digest(hmac_clazz, "digest", "()[B"),
+          reset(hmac_clazz, "reset", "()V") {}
+
+      constructor_method constructor;
+      constructor_method copy_constructor;
+      method<void> update;
+      method<jbyteArray> digest;
+      method<void> reset;
+    };
+
+    hmac_vtable* hmac_vt;
+
+    template <size_t T_size>
+    class hmac_impl : public hasher, private noncopyable {
+    public:
+      hmac_impl(const char* algorithm, const char* key_data, size_t key_size)
+        : instance_(make_global_ref(hmac_vt->constructor(
+              hmac_clazz,
+              make_byte_array(algorithm),
+              make_byte_array(key_data, key_size)))) {}
+
+      hmac_impl(const hmac_impl* that)
+        : instance_(make_global_ref(hmac_vt->copy_constructor(
+              hmac_clazz,
+              that->instance_))),
+          batch_(that->batch_) {}
+
       virtual void update(const char* data, size_t size) {
-        vt_.update(instance_, make_direct_byte_buffer(const_cast<char*>(data), size));
+        update_batch(hmac_vt->update, instance_, batch_, data, size);
       }
 
       virtual void digest(lua_State* L) {
-        local_ref_t<jbyteArray> result = vt_.digest(instance_);
+        flush_batch(hmac_vt->update, instance_, batch_);
+        local_ref_t<jbyteArray> result = hmac_vt->digest(instance_);
         if (get_array_length(result) != T_size) {
           throw BRIGID_LOGIC_ERROR("invalid buffer size");
         }
@@ -99,19 +326,128 @@ namespace brigid {
         lua_pushlstring(L, buffer, T_size);
       }
 
+      virtual void reset() {
+        batch_.clear();
+        hmac_vt->reset(instance_);
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<hmac_impl<T_size> >(L, "brigid.hmac", this);
+      }
+
+    private:
+      global_ref_t<jobject> instance_;
+      std::string batch_;
+    };
+
+    // The hash and the hmac of the key derivation in kdf.hpp. A message is
+    // batched, so that it costs a single JNI call to update.
+    class kdf_digest : private noncopyable {
+    public:
+      explicit kdf_digest(const std::string& name)
+        : instance_(make_global_ref<jobject>()),
+          size_() {
+        const char* algorithm = nullptr;
+        if (name == "sha1") {
+          algorithm = "SHA-1";
+          size_ = 20;
+        } else if (name == "sha256") {
+          algorithm = "SHA-256";
+          size_ = 32;
+        } else if (name == "sha512") {
+          algorithm = "SHA-512";
+          size_ = 64;
+        } else {
+          throw BRIGID_LOGIC_ERROR("unsupported hash");
+        }
+        instance_ = make_global_ref(hasher_vt->constructor(
+            hasher_clazz,
+            make_byte_array(algorithm)));
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+      void update(const char* data, size_t size) {
+        update_batch(hasher_vt->update, instance_, batch_, data, size);
+      }
+
+      void finish(char* data) {
+        flush_batch(hasher_vt->update, instance_, batch_);
+        local_ref_t<jbyteArray> result = hasher_vt->digest(instance_);
+        if (get_array_length(result) != size_) {
+          throw BRIGID_LOGIC_ERROR("invalid buffer size");
+        }
+        get_byte_array_region(result, 0, size_, data);
+      }
+
+    private:
+      global_ref_t<jobject> instance_;
+      size_t size_;
+      std::string batch_;
+    };
+
+    class kdf_hmac : private noncopyable {
+    public:
+      kdf_hmac(const std::string& name, const char* key_data, size_t key_size)
+        : instance_(make_global_ref<jobject>()),
+          size_() {
+        const char* algorithm = nullptr;
+        if (name == "sha1") {
+          algorithm = "HmacSHA1";
+          size_ = 20;
+        } else if (name == "sha256") {
+          algorithm = "HmacSHA256";
+          size_ = 32;
+        } else if (name == "sha512") {
+          algorithm = "HmacSHA512";
+          size_ = 64;
+        } else {
+          throw BRIGID_LOGIC_ERROR("unsupported hash");
+        }
+        instance_ = make_global_ref(hmac_vt->constructor(
+            hmac_clazz,
+            make_byte_array(algorithm),
+            make_byte_array(key_data, key_size)));
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+      void update(const char* data, size_t size) {
+        update_batch(hmac_vt->update, instance_, batch_, data, size);
+      }
+
+      void finish(char* data) {
+        flush_batch(hmac_vt->update, instance_, batch_);
+        local_ref_t<jbyteArray> result = hmac_vt->digest(instance_);
+        if (get_array_length(result) != size_) {
+          throw BRIGID_LOGIC_ERROR("invalid buffer size");
+        }
+        get_byte_array_region(result, 0, size_, data);
+      }
+
     private:
-      hasher_vtable vt_;
       global_ref_t<jobject> instance_;
+      size_t size_;
+      std::string batch_;
     };
 
     std::mutex open_cryptor_mutex;
     std::mutex open_hasher_mutex;
   }
 
+  // The classes and their method IDs are kept for the lifetime of the
+  // process, so that no object looks them up again.
   void open_cryptor() {
     std::lock_guard<std::mutex> lock(open_cryptor_mutex);
     if (!aes_cryptor_clazz) {
       aes_cryptor_clazz = make_global_ref(find_class("jp/brigid/AESCryptor")).release();
+      aead_cryptor_clazz = make_global_ref(find_class("jp/brigid/AEADCryptor")).release();
+      aes_cryptor_vt = new aes_cryptor_vtable();
+      aead_cryptor_vt = new aead_cryptor_vtable();
     }
   }
 
@@ -119,6 +455,9 @@ namespace brigid {
     std::lock_guard<std::mutex> lock(open_hasher_mutex);
     if (!hasher_clazz) {
       hasher_clazz = make_global_ref(find_class("jp/brigid/Hasher")).release();
+      hmac_clazz = make_global_ref(find_class("jp/brigid/Hmac")).release();
+      hasher_vt = new hasher_vtable();
+      hmac_vt = new hmac_vtable();
     }
   }
 
@@ -160,6 +499,64 @@ namespace brigid {
     return new_aes_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
+  cryptor* new_aead_cryptor(lua_State* L, bool encrypt, const char* transformation, const char* algorithm, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    if (iv_size == 0) {
+      throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+    }
+    return new_userdata<aead_cryptor_impl>(L, "brigid.cryptor", encrypt, transformation, algorithm, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_gcm_cryptor(lua_State* L, bool encrypt, size_t size, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    if (key_size != size) {
+      throw BRIGID_LOGIC_ERROR("invalid key size");
+    }
+    return new_aead_cryptor(L, encrypt, "AES/GCM/NoPadding", "AES", key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_chacha20_poly1305_cryptor(lua_State* L, bool encrypt, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    if (key_size != 32) {
+      throw BRIGID_LOGIC_ERROR("invalid key size");
+    }
+    return new_aead_cryptor(L, encrypt, "ChaCha20-Poly1305", "ChaCha20", key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_128_gcm_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_gcm_cryptor(L, true, 16, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_256_gcm_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_gcm_cryptor(L, true, 32, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_chacha20_poly1305_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_chacha20_poly1305_cryptor(L, true, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_128_gcm_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_gcm_cryptor(L, false, 16, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_256_gcm_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_gcm_cryptor(L, false, 32, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_chacha20_poly1305_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_chacha20_poly1305_cryptor(L, false, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  // CTR is not supported by this backend yet.
+  cryptor* new_aes_128_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_192_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
   hasher* new_sha1_hasher(lua_State* L) {
     return new_userdata<hasher_impl<20> >(L, "brigid.hasher", "SHA-1");
   }
@@ -171,4 +568,34 @@ namespace brigid {
   hasher* new_sha512_hasher(lua_State* L) {
     return new_userdata<hasher_impl<64> >(L, "brigid.hasher", "SHA-512");
   }
+
+  hasher* new_sha1_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<20> >(L, "brigid.hmac", "HmacSHA1", key_data, key_size);
+  }
+
+  hasher* new_sha256_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<32> >(L, "brigid.hmac", "HmacSHA256", key_data, key_size);
+  }
+
+  hasher* new_sha512_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<64> >(L, "brigid.hmac", "HmacSHA512", key_data, key_size);
+  }
+
+  std::string pbkdf2(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return pbkdf2_hmac<kdf_hmac>(name, password, salt, iterations, size);
+  }
+
+  std::string hkdf(const std::string& name, const std::string& key, const std::string& salt, const std::string& info, size_t size) {
+    return hkdf_hmac<kdf_hmac>(name, key, salt, info, size);
+  }
+
+  std::string bytes_to_key(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return bytes_to_key_digest<kdf_digest>(name, password, salt, iterations, size);
+  }
+
+  void random_bytes(char* data, size_t size) {
+    if (size > 0) {
+      aead_cryptor_vt->next_bytes(aead_cryptor_clazz, make_direct_byte_buffer(data, size));
+    }
+  }
 }
@@ -1,20 +1,33 @@
-// Copyright (c) 2021,2022,2024 <dev@brigid.jp>
+// Copyright (c) 2021,2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
 #include "common.hpp"
 #include "crypto.hpp"
 #include "error.hpp"
+#include "kdf.hpp"
 #include "noncopyable.hpp"
+#include "worker_pool.hpp"
 
 #include <lua.hpp>
 
 #include <openssl/err.h>
 #include <openssl/evp.h>
+#include <openssl/rand.h>
 #include <openssl/sha.h>
 
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+#define BRIGID_OPENSSL_SHA_CTX
+#endif
+
+#include <limits.h>
 #include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -31,17 +44,141 @@ namespace brigid {
       return result;
     }
 
-    using cipher_ctx_t = std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>;
+    // Contexts of closed cryptors are reset, which erases the key schedule,
+    // and kept in a free list of the thread for the next cryptor.
+    class cipher_ctx_cache : private noncopyable {
+    public:
+      static const size_t capacity = 16;
+
+      cipher_ctx_cache()
+        : size_() {}
+
+      ~cipher_ctx_cache() {
+        for (size_t i = 0; i < size_; ++i) {
+          EVP_CIPHER_CTX_free(entries_[i]);
+        }
+      }
+
+      EVP_CIPHER_CTX* pop() {
+        if (size_ == 0) {
+          return nullptr;
+        }
+        return entries_[--size_];
+      }
+
+      bool push(EVP_CIPHER_CTX* ctx) {
+        if (size_ == capacity) {
+          return false;
+        }
+        entries_[size_++] = ctx;
+        return true;
+      }
+
+    private:
+      EVP_CIPHER_CTX* entries_[capacity];
+      size_t size_;
+    };
+
+    thread_local cipher_ctx_cache cipher_ctx_cache_instance;
+
+    EVP_CIPHER_CTX* acquire_cipher_ctx() {
+      if (EVP_CIPHER_CTX* ctx = cipher_ctx_cache_instance.pop()) {
+        return ctx;
+      }
+      return check(EVP_CIPHER_CTX_new());
+    }
+
+    void release_cipher_ctx(EVP_CIPHER_CTX* ctx) {
+      if (!EVP_CIPHER_CTX_reset(ctx) || !cipher_ctx_cache_instance.push(ctx)) {
+        EVP_CIPHER_CTX_free(ctx);
+      }
+    }
+
+    using cipher_ctx_t = std::unique_ptr<EVP_CIPHER_CTX, decltype(&release_cipher_ctx)>;
 
     cipher_ctx_t make_cipher_ctx(EVP_CIPHER_CTX* ctx = nullptr) {
-      return cipher_ctx_t(ctx, &EVP_CIPHER_CTX_free);
+      return cipher_ctx_t(ctx, &release_cipher_ctx);
+    }
+
+    void reset_cipher_ctx(EVP_CIPHER_CTX* ctx, const char* key_data, size_t key_size, const char* iv_data) {
+      if (key_data && key_size != static_cast<size_t>(EVP_CIPHER_CTX_key_length(ctx))) {
+        throw BRIGID_LOGIC_ERROR("invalid key size");
+      }
+      check(EVP_CipherInit_ex(ctx, nullptr, nullptr, reinterpret_cast<const unsigned char*>(key_data), reinterpret_cast<const unsigned char*>(iv_data), -1));
+    }
+
+    // EVP_CipherUpdate() takes the sizes as int, so that a large input is
+    // passed in chunks.
+    size_t update_cipher_ctx(EVP_CIPHER_CTX* ctx, const char* in_data, size_t in_size, char* out_data) {
+      static const size_t chunk_size = 1 << 30;
+      size_t result = 0;
+      do {
+        size_t size = std::min(in_size, chunk_size);
+        int out_size = 0;
+        check(EVP_CipherUpdate(ctx, reinterpret_cast<unsigned char*>(out_data + result), &out_size, reinterpret_cast<const unsigned char*>(in_data), size));
+        in_data += size;
+        in_size -= size;
+        result += out_size;
+      } while (in_size > 0);
+      return result;
+    }
+
+    // A segment is processed by a copy of the context, which shares the key
+    // schedule, with its own initialization vector. Every segment but the
+    // last is processed without padding. The size of a segment is a multiple
+    // of the block size and at least 64 KiB.
+    template <class T>
+    size_t update_segments(const EVP_CIPHER_CTX* ctx, const char* in_data, size_t in_size, char* out_data, size_t, size_t threads, T set_iv) {
+      size_t n = std::min(threads, in_size / 65536);
+      if (n < 2) {
+        return 0;
+      }
+      size_t segment_size = in_size / n / 16 * 16;
+
+      std::vector<size_t> results(n);
+      std::vector<std::exception_ptr> errors(n);
+      get_worker_pool()->parallel_for(n, [&](size_t i) {
+        try {
+          size_t offset = segment_size * i;
+          bool last = i == n - 1;
+          size_t size = last ? in_size - offset : segment_size;
+          unsigned char iv[16] = {};
+          set_iv(offset, iv);
+
+          cipher_ctx_t segment_ctx = make_cipher_ctx(acquire_cipher_ctx());
+          check(EVP_CIPHER_CTX_copy(segment_ctx.get(), ctx));
+          check(EVP_CipherInit_ex(segment_ctx.get(), nullptr, nullptr, nullptr, iv, -1));
+          if (!last) {
+            check(EVP_CIPHER_CTX_set_padding(segment_ctx.get(), 0));
+          }
+
+          size_t result = update_cipher_ctx(segment_ctx.get(), in_data + offset, size, out_data + offset);
+          if (last) {
+            int final_size = 0;
+            check(EVP_CipherFinal_ex(segment_ctx.get(), reinterpret_cast<unsigned char*>(out_data + offset + result), &final_size));
+            result += final_size;
+          }
+          results[i] = result;
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+
+      size_t result = 0;
+      for (size_t i = 0; i < n; ++i) {
+        if (errors[i]) {
+          std::rethrow_exception(errors[i]);
+        }
+        result += results[i];
+      }
+      return result;
     }
 
     class aes_encryptor_impl : public cryptor, private noncopyable {
     public:
       aes_encryptor_impl(const EVP_CIPHER* cipher, const char* key_data, size_t key_size, const char* iv_data, thread_reference&& ref)
         : cryptor(std::move(ref)),
-          ctx_(make_cipher_ctx(check(EVP_CIPHER_CTX_new()))) {
+          ctx_(make_cipher_ctx(acquire_cipher_ctx())) {
         check(EVP_EncryptInit_ex(ctx_.get(), cipher, nullptr, reinterpret_cast<const unsigned char*>(key_data), reinterpret_cast<const unsigned char*>(iv_data)));
         check(EVP_CIPHER_CTX_set_key_length(ctx_.get(), key_size));
       }
@@ -50,15 +187,21 @@ namespace brigid {
         return in_size + 16;
       };
 
-      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t out_size, bool padding) {
-        int size1 = out_size;
-        int size2 = 0;
-        check(EVP_EncryptUpdate(ctx_.get(), reinterpret_cast<unsigned char*>(out_data), &size1, reinterpret_cast<const unsigned char*>(in_data), in_size));
+      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t, bool padding) {
+        size_t result = update_cipher_ctx(ctx_.get(), in_data, in_size, out_data);
         if (padding) {
-          size2 = out_size - size1;
-          check(EVP_EncryptFinal_ex(ctx_.get(), reinterpret_cast<unsigned char*>(out_data + size1), &size2));
+          int size = 0;
+          check(EVP_EncryptFinal_ex(ctx_.get(), reinterpret_cast<unsigned char*>(out_data + result), &size));
+          result += size;
+        }
+        return result;
+      }
+
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
         }
-        return size1 + size2;
+        reset_cipher_ctx(ctx_.get(), key_data, key_size, iv_data);
       }
 
       virtual void impl_close() {
@@ -73,24 +216,45 @@ namespace brigid {
     public:
       aes_decryptor_impl(const EVP_CIPHER* cipher, const char* key_data, size_t key_size, const char* iv_data, thread_reference&& ref)
         : cryptor(std::move(ref)),
-          ctx_(make_cipher_ctx(check(EVP_CIPHER_CTX_new()))) {
+          ctx_(make_cipher_ctx(acquire_cipher_ctx())) {
         check(EVP_DecryptInit_ex(ctx_.get(), cipher, nullptr, reinterpret_cast<const unsigned char*>(key_data), reinterpret_cast<const unsigned char*>(iv_data)));
         check(EVP_CIPHER_CTX_set_key_length(ctx_.get(), key_size));
+        memcpy(iv_, iv_data, 16);
       }
 
       virtual size_t impl_calculate_buffer_size(size_t in_size) const {
         return in_size;
       };
 
-      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t out_size, bool padding) {
-        int size1 = out_size;
-        int size2 = 0;
-        check(EVP_DecryptUpdate(ctx_.get(), reinterpret_cast<unsigned char*>(out_data), &size1, reinterpret_cast<const unsigned char*>(in_data), in_size));
+      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t, bool padding) {
+        size_t result = update_cipher_ctx(ctx_.get(), in_data, in_size, out_data);
         if (padding) {
-          size2 = out_size - size1;
-          check(EVP_DecryptFinal_ex(ctx_.get(), reinterpret_cast<unsigned char*>(out_data + size1), &size2));
+          int size = 0;
+          check(EVP_DecryptFinal_ex(ctx_.get(), reinterpret_cast<unsigned char*>(out_data + result), &size));
+          result += size;
         }
-        return size1 + size2;
+        return result;
+      }
+
+      // The initialization vector of a segment is the last block of the
+      // previous segment.
+      virtual size_t impl_update_parallel(const char* in_data, size_t in_size, char* out_data, size_t out_size, size_t threads) {
+        if (in_size % 16 == 0) {
+          if (size_t result = update_segments(ctx_.get(), in_data, in_size, out_data, out_size, threads, [&](size_t offset, unsigned char* iv) {
+            memcpy(iv, offset == 0 ? iv_ : reinterpret_cast<const unsigned char*>(in_data + offset - 16), 16);
+          })) {
+            return result;
+          }
+        }
+        return impl_update(in_data, in_size, out_data, out_size, true);
+      }
+
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        reset_cipher_ctx(ctx_.get(), key_data, key_size, iv_data);
+        memcpy(iv_, iv_data, 16);
       }
 
       virtual void impl_close() {
@@ -99,77 +263,571 @@ namespace brigid {
 
     private:
       cipher_ctx_t ctx_;
+      unsigned char iv_[16];
     };
 
-    class sha1_hasher_impl : public hasher, private noncopyable {
+    // The counter is the initialization vector as a 128-bit big-endian
+    // integer, so that a segment can start at any block. Encryption and
+    // decryption are the same operation.
+    class aes_ctr_cryptor_impl : public cryptor, private noncopyable {
     public:
-      sha1_hasher_impl()
+      aes_ctr_cryptor_impl(const EVP_CIPHER* cipher, const char* key_data, const char* iv_data, thread_reference&& ref)
+        : cryptor(std::move(ref)),
+          ctx_(make_cipher_ctx(acquire_cipher_ctx())) {
+        check(EVP_EncryptInit_ex(ctx_.get(), cipher, nullptr, reinterpret_cast<const unsigned char*>(key_data), reinterpret_cast<const unsigned char*>(iv_data)));
+        memcpy(iv_, iv_data, 16);
+      }
+
+      virtual size_t impl_calculate_buffer_size(size_t in_size) const {
+        return in_size;
+      };
+
+      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t, bool padding) {
+        size_t result = update_cipher_ctx(ctx_.get(), in_data, in_size, out_data);
+        if (padding) {
+          int size = 0;
+          check(EVP_EncryptFinal_ex(ctx_.get(), reinterpret_cast<unsigned char*>(out_data + result), &size));
+          result += size;
+        }
+        return result;
+      }
+
+      virtual size_t impl_update_parallel(const char* in_data, size_t in_size, char* out_data, size_t out_size, size_t threads) {
+        if (size_t result = update_segments(ctx_.get(), in_data, in_size, out_data, out_size, threads, [&](size_t offset, unsigned char* iv) {
+          memcpy(iv, iv_, 16);
+          size_t carry = offset / 16;
+          for (size_t i = 16; i > 0 && carry > 0; --i) {
+            carry += iv[i - 1];
+            iv[i - 1] = carry & 0xFF;
+            carry >>= 8;
+          }
+        })) {
+          return result;
+        }
+        return impl_update(in_data, in_size, out_data, out_size, true);
+      }
+
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        reset_cipher_ctx(ctx_.get(), key_data, key_size, iv_data);
+        memcpy(iv_, iv_data, 16);
+      }
+
+      virtual void impl_close() {
+        ctx_ = make_cipher_ctx();
+      }
+
+    private:
+      cipher_ctx_t ctx_;
+      unsigned char iv_[16];
+    };
+
+    // GCM and ChaCha20-Poly1305 encrypt in a single pass. The tag is
+    // computed by the final update of an encryptor and must be set before
+    // the final update of a decryptor, which fails if it does not match. The
+    // tag is always 16 bytes, as on the Java backend.
+    class aead_cryptor_impl : public cryptor, private noncopyable {
+    public:
+      aead_cryptor_impl(const EVP_CIPHER* cipher, bool encrypt, const char* key_data, const char* iv_data, size_t iv_size, thread_reference&& ref)
+        : cryptor(std::move(ref)),
+          ctx_(make_cipher_ctx(acquire_cipher_ctx())),
+          encrypt_(encrypt),
+          tag_(),
+          tag_size_() {
+        int mode = encrypt ? 1 : 0;
+        check(EVP_CipherInit_ex(ctx_.get(), cipher, nullptr, nullptr, nullptr, mode));
+        check(EVP_CIPHER_CTX_ctrl(ctx_.get(), EVP_CTRL_GCM_SET_IVLEN, iv_size, nullptr));
+        check(EVP_CipherInit_ex(ctx_.get(), nullptr, nullptr, reinterpret_cast<const unsigned char*>(key_data), reinterpret_cast<const unsigned char*>(iv_data), mode));
+      }
+
+      virtual size_t impl_calculate_buffer_size(size_t in_size) const {
+        return in_size;
+      };
+
+      virtual size_t impl_update(const char* in_data, size_t in_size, char* out_data, size_t, bool padding) {
+        size_t result = update_cipher_ctx(ctx_.get(), in_data, in_size, out_data);
+        if (padding) {
+          if (!encrypt_ && tag_size_ == 0) {
+            throw BRIGID_LOGIC_ERROR("tag is not set");
+          }
+          int size = 0;
+          if (!EVP_CipherFinal_ex(ctx_.get(), reinterpret_cast<unsigned char*>(out_data + result), &size)) {
+            if (!encrypt_) {
+              ERR_clear_error();
+              throw BRIGID_RUNTIME_ERROR("authentication failed");
+            }
+            check(0);
+          }
+          result += size;
+          if (encrypt_) {
+            check(EVP_CIPHER_CTX_ctrl(ctx_.get(), EVP_CTRL_GCM_GET_TAG, sizeof(tag_), tag_));
+            tag_size_ = sizeof(tag_);
+          }
+        }
+        return result;
+      }
+
+      virtual void impl_update_aad(const char* data, size_t size) {
+        int result = 0;
+        check(EVP_CipherUpdate(ctx_.get(), nullptr, &result, reinterpret_cast<const unsigned char*>(data), size));
+      }
+
+      virtual size_t impl_tag_size() const {
+        return sizeof(tag_);
+      }
+
+      virtual size_t impl_get_tag(char* data, size_t size) const {
+        if (!encrypt_ || tag_size_ == 0) {
+          throw BRIGID_LOGIC_ERROR("tag is not available");
+        }
+        if (size > tag_size_) {
+          size = tag_size_;
+        }
+        memcpy(data, tag_, size);
+        return size;
+      }
+
+      virtual void impl_set_tag(const char* data, size_t size) {
+        if (encrypt_) {
+          throw BRIGID_LOGIC_ERROR("tag is computed by an encryptor");
+        }
+        if (size != sizeof(tag_)) {
+          throw BRIGID_LOGIC_ERROR("invalid tag size");
+        }
+        memcpy(tag_, data, size);
+        check(EVP_CIPHER_CTX_ctrl(ctx_.get(), EVP_CTRL_GCM_SET_TAG, size, tag_));
+        tag_size_ = size;
+      }
+
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size == 0) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        check(EVP_CIPHER_CTX_ctrl(ctx_.get(), EVP_CTRL_GCM_SET_IVLEN, iv_size, nullptr));
+        reset_cipher_ctx(ctx_.get(), key_data, key_size, iv_data);
+        tag_size_ = 0;
+      }
+
+      virtual void impl_close() {
+        ctx_ = make_cipher_ctx();
+      }
+
+    private:
+      cipher_ctx_t ctx_;
+      bool encrypt_;
+      unsigned char tag_[16];
+      size_t tag_size_;
+    };
+
+    // The algorithms are fetched once and kept until the process exits,
+    // because OpenSSL 3 looks up the providers whenever an implicitly fetched
+    // algorithm such as EVP_sha256() is used to initialize a context.
+    class md_t : private noncopyable {
+    public:
+      explicit md_t(const EVP_MD* md)
+        : md_(md) {}
+
+      const EVP_MD* get() const {
+        return md_;
+      }
+
+      EVP_MD_CTX* acquire();
+      void release(EVP_MD_CTX* ctx);
+
+    private:
+      const EVP_MD* md_;
+    };
+
+    // Contexts of destroyed hashers are kept in a free list of the thread,
+    // so that no lock is taken to reuse them. When the algorithm is the
+    // same, EVP_DigestInit_ex() reinitializes a context in place.
+    class md_ctx_cache : private noncopyable {
+    public:
+      static const size_t capacity = 16;
+
+      md_ctx_cache()
+        : size_() {}
+
+      ~md_ctx_cache() {
+        for (size_t i = 0; i < size_; ++i) {
+          EVP_MD_CTX_free(entries_[i].ctx);
+        }
+      }
+
+      EVP_MD_CTX* pop(const md_t* md) {
+        for (size_t i = size_; i > 0; --i) {
+          entry_t& entry = entries_[i - 1];
+          if (entry.md == md) {
+            EVP_MD_CTX* ctx = entry.ctx;
+            entry = entries_[--size_];
+            return ctx;
+          }
+        }
+        return nullptr;
+      }
+
+      bool push(const md_t* md, EVP_MD_CTX* ctx) {
+        if (size_ == capacity) {
+          return false;
+        }
+        entry_t& entry = entries_[size_++];
+        entry.md = md;
+        entry.ctx = ctx;
+        return true;
+      }
+
+    private:
+      struct entry_t {
+        const md_t* md;
+        EVP_MD_CTX* ctx;
+      };
+
+      entry_t entries_[capacity];
+      size_t size_;
+    };
+
+    thread_local md_ctx_cache md_ctx_cache_instance;
+
+    EVP_MD_CTX* md_t::acquire() {
+      if (EVP_MD_CTX* ctx = md_ctx_cache_instance.pop(this)) {
+        return ctx;
+      }
+      return check(EVP_MD_CTX_new());
+    }
+
+    void md_t::release(EVP_MD_CTX* ctx) {
+      if (!md_ctx_cache_instance.push(this, ctx)) {
+        EVP_MD_CTX_free(ctx);
+      }
+    }
+
+#ifdef BRIGID_OPENSSL_SHA_CTX
+    // Before OpenSSL 3, the low level functions keep the state in the
+    // userdata. They are deprecated by OpenSSL 3.
+    template <class T, int (*T_init)(T*), int (*T_update)(T*, const void*, size_t), int (*T_final)(unsigned char*, T*), size_t T_size>
+    class sha_hasher_impl : public hasher, private noncopyable {
+    public:
+      sha_hasher_impl()
         : ctx_() {
-        check(SHA1_Init(&ctx_));
+        check(T_init(&ctx_));
+      }
+
+      explicit sha_hasher_impl(const T& ctx)
+        : ctx_(ctx) {}
+
+      virtual ~sha_hasher_impl() {
+        OPENSSL_cleanse(&ctx_, sizeof(ctx_));
       }
 
       virtual void update(const char* data, size_t size) {
-        check(SHA1_Update(&ctx_, data, size));
+        check(T_update(&ctx_, data, size));
       }
 
       virtual void digest(lua_State* L) {
-        char buffer[SHA_DIGEST_LENGTH] = {};
-        check(SHA1_Final(reinterpret_cast<unsigned char*>(buffer), &ctx_));
-        lua_pushlstring(L, buffer, SHA_DIGEST_LENGTH);
+        unsigned char buffer[T_size] = {};
+        check(T_final(buffer, &ctx_));
+        lua_pushlstring(L, reinterpret_cast<const char*>(buffer), T_size);
+      }
+
+      virtual void reset() {
+        check(T_init(&ctx_));
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<sha_hasher_impl>(L, "brigid.hasher", ctx_);
       }
 
     private:
-      SHA_CTX ctx_;
+      T ctx_;
     };
 
-    class sha256_hasher_impl : public hasher, private noncopyable {
+    using sha1_hasher_impl = sha_hasher_impl<SHA_CTX, SHA1_Init, SHA1_Update, SHA1_Final, SHA_DIGEST_LENGTH>;
+    using sha256_hasher_impl = sha_hasher_impl<SHA256_CTX, SHA256_Init, SHA256_Update, SHA256_Final, SHA256_DIGEST_LENGTH>;
+    using sha512_hasher_impl = sha_hasher_impl<SHA512_CTX, SHA512_Init, SHA512_Update, SHA512_Final, SHA512_DIGEST_LENGTH>;
+#else
+    class md_hasher_impl : public hasher, private noncopyable {
     public:
-      sha256_hasher_impl()
-        : ctx_() {
-        check(SHA256_Init(&ctx_));
+      explicit md_hasher_impl(md_t* md)
+        : md_(md),
+          ctx_(md->acquire()) {
+        if (!EVP_DigestInit_ex(ctx_, md_->get(), nullptr)) {
+          md_->release(ctx_);
+          check(0);
+        }
+      }
+
+      md_hasher_impl(md_t* md, const EVP_MD_CTX* ctx)
+        : md_(md),
+          ctx_(md->acquire()) {
+        if (!EVP_MD_CTX_copy_ex(ctx_, ctx)) {
+          md_->release(ctx_);
+          check(0);
+        }
+      }
+
+      virtual ~md_hasher_impl() {
+        md_->release(ctx_);
       }
 
       virtual void update(const char* data, size_t size) {
-        check(SHA256_Update(&ctx_, data, size));
+        check(EVP_DigestUpdate(ctx_, data, size));
       }
 
       virtual void digest(lua_State* L) {
-        char buffer[SHA256_DIGEST_LENGTH] = {};
-        check(SHA256_Final(reinterpret_cast<unsigned char*>(buffer), &ctx_));
-        lua_pushlstring(L, buffer, SHA256_DIGEST_LENGTH);
+        unsigned char buffer[EVP_MAX_MD_SIZE] = {};
+        unsigned int size = 0;
+        check(EVP_DigestFinal_ex(ctx_, buffer, &size));
+        lua_pushlstring(L, reinterpret_cast<const char*>(buffer), size);
+      }
+
+      virtual void reset() {
+        check(EVP_DigestInit_ex(ctx_, md_->get(), nullptr));
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<md_hasher_impl>(L, "brigid.hasher", md_, ctx_);
       }
 
     private:
-      SHA256_CTX ctx_;
+      md_t* md_;
+      EVP_MD_CTX* ctx_;
     };
+#endif
 
-    class sha512_hasher_impl : public hasher, private noncopyable {
+    // The inner and outer contexts are keyed once. Each message starts from
+    // a copy of the inner context, so that only the two finalizations are
+    // left for a digest.
+    class md_hmac_impl : public hasher, private noncopyable {
     public:
-      sha512_hasher_impl()
-        : ctx_() {
-        check(SHA512_Init(&ctx_));
+      md_hmac_impl(md_t* md, const char* key_data, size_t key_size)
+        : md_(md),
+          ictx_(md->acquire()),
+          octx_(md->acquire()),
+          ctx_(md->acquire()) {
+        try {
+          const EVP_MD* type = md_->get();
+          std::vector<unsigned char> block(EVP_MD_block_size(type));
+          if (key_size > block.size()) {
+            unsigned int size = 0;
+            check(EVP_DigestInit_ex(ctx_, type, nullptr));
+            check(EVP_DigestUpdate(ctx_, key_data, key_size));
+            check(EVP_DigestFinal_ex(ctx_, block.data(), &size));
+          } else if (key_size > 0) {
+            memcpy(block.data(), key_data, key_size);
+          }
+
+          for (size_t i = 0; i < block.size(); ++i) {
+            block[i] ^= 0x36;
+          }
+          check(EVP_DigestInit_ex(ictx_, type, nullptr));
+          check(EVP_DigestUpdate(ictx_, block.data(), block.size()));
+
+          for (size_t i = 0; i < block.size(); ++i) {
+            block[i] ^= 0x36 ^ 0x5C;
+          }
+          check(EVP_DigestInit_ex(octx_, type, nullptr));
+          check(EVP_DigestUpdate(octx_, block.data(), block.size()));
+
+          OPENSSL_cleanse(block.data(), block.size());
+          check(EVP_MD_CTX_copy_ex(ctx_, ictx_));
+        } catch (...) {
+          release();
+          throw;
+        }
+      }
+
+      explicit md_hmac_impl(const md_hmac_impl* that)
+        : md_(that->md_),
+          ictx_(md_->acquire()),
+          octx_(md_->acquire()),
+          ctx_(md_->acquire()) {
+        try {
+          check(EVP_MD_CTX_copy_ex(ictx_, that->ictx_));
+          check(EVP_MD_CTX_copy_ex(octx_, that->octx_));
+          check(EVP_MD_CTX_copy_ex(ctx_, that->ctx_));
+        } catch (...) {
+          release();
+          throw;
+        }
+      }
+
+      virtual ~md_hmac_impl() {
+        release();
       }
 
       virtual void update(const char* data, size_t size) {
-        check(SHA512_Update(&ctx_, data, size));
+        check(EVP_DigestUpdate(ctx_, data, size));
       }
 
       virtual void digest(lua_State* L) {
-        char buffer[SHA512_DIGEST_LENGTH] = {};
-        check(SHA512_Final(reinterpret_cast<unsigned char*>(buffer), &ctx_));
-        lua_pushlstring(L, buffer, SHA512_DIGEST_LENGTH);
+        char buffer[EVP_MAX_MD_SIZE] = {};
+        finish(buffer);
+        lua_pushlstring(L, buffer, size());
+      }
+
+      virtual void reset() {
+        check(EVP_MD_CTX_copy_ex(ctx_, ictx_));
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<md_hmac_impl>(L, "brigid.hmac", this);
+      }
+
+      size_t size() const {
+        return EVP_MD_size(md_->get());
+      }
+
+      void finish(char* data) {
+        unsigned char* buffer = reinterpret_cast<unsigned char*>(data);
+        unsigned int size = 0;
+        check(EVP_DigestFinal_ex(ctx_, buffer, &size));
+        check(EVP_MD_CTX_copy_ex(ctx_, octx_));
+        check(EVP_DigestUpdate(ctx_, buffer, size));
+        check(EVP_DigestFinal_ex(ctx_, buffer, &size));
+        check(EVP_MD_CTX_copy_ex(ctx_, ictx_));
+      }
+
+    private:
+      md_t* md_;
+      EVP_MD_CTX* ictx_;
+      EVP_MD_CTX* octx_;
+      EVP_MD_CTX* ctx_;
+
+      void release() {
+        md_->release(ictx_);
+        md_->release(octx_);
+        md_->release(ctx_);
+      }
+    };
+
+    const EVP_CIPHER* aes_128_cbc = nullptr;
+    const EVP_CIPHER* aes_192_cbc = nullptr;
+    const EVP_CIPHER* aes_256_cbc = nullptr;
+    const EVP_CIPHER* aes_128_ctr = nullptr;
+    const EVP_CIPHER* aes_192_ctr = nullptr;
+    const EVP_CIPHER* aes_256_ctr = nullptr;
+    const EVP_CIPHER* aes_128_gcm = nullptr;
+    const EVP_CIPHER* aes_256_gcm = nullptr;
+    const EVP_CIPHER* chacha20_poly1305 = nullptr;
+    md_t* sha1 = nullptr;
+    md_t* sha256 = nullptr;
+    md_t* sha512 = nullptr;
+
+    md_t* get_md(const std::string& name) {
+      if (name == "sha1") {
+        return sha1;
+      } else if (name == "sha256") {
+        return sha256;
+      } else if (name == "sha512") {
+        return sha512;
+      }
+      throw BRIGID_LOGIC_ERROR("unsupported hash");
+    }
+
+    // The hash and the hmac of the key derivation in kdf.hpp.
+    class kdf_digest : private noncopyable {
+    public:
+      explicit kdf_digest(const std::string& name)
+        : md_(get_md(name)),
+          ctx_(md_->acquire()) {
+        if (!EVP_DigestInit_ex(ctx_, md_->get(), nullptr)) {
+          md_->release(ctx_);
+          check(0);
+        }
+      }
+
+      ~kdf_digest() {
+        md_->release(ctx_);
+      }
+
+      size_t size() const {
+        return EVP_MD_size(md_->get());
+      }
+
+      void update(const char* data, size_t size) {
+        check(EVP_DigestUpdate(ctx_, data, size));
+      }
+
+      void finish(char* data) {
+        unsigned int size = 0;
+        check(EVP_DigestFinal_ex(ctx_, reinterpret_cast<unsigned char*>(data), &size));
+        check(EVP_DigestInit_ex(ctx_, md_->get(), nullptr));
       }
 
     private:
-      SHA512_CTX ctx_;
+      md_t* md_;
+      EVP_MD_CTX* ctx_;
     };
+
+    class kdf_hmac : public md_hmac_impl {
+    public:
+      kdf_hmac(const std::string& name, const char* key_data, size_t key_size)
+        : md_hmac_impl(get_md(name), key_data, key_size) {}
+    };
+
+    std::mutex open_cryptor_mutex;
+    std::mutex open_hasher_mutex;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    const EVP_CIPHER* fetch_cipher(const char* name) {
+      return check(EVP_CIPHER_fetch(nullptr, name, nullptr));
+    }
+
+    const EVP_MD* fetch_md(const char* name) {
+      return check(EVP_MD_fetch(nullptr, name, nullptr));
+    }
+#endif
   }
 
   void open_cryptor() {
-    ERR_load_crypto_strings();
+    std::lock_guard<std::mutex> lock(open_cryptor_mutex);
+    if (!aes_128_cbc) {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+      ERR_load_crypto_strings();
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      aes_192_cbc = fetch_cipher("AES-192-CBC");
+      aes_256_cbc = fetch_cipher("AES-256-CBC");
+      aes_128_ctr = fetch_cipher("AES-128-CTR");
+      aes_192_ctr = fetch_cipher("AES-192-CTR");
+      aes_256_ctr = fetch_cipher("AES-256-CTR");
+      aes_128_gcm = fetch_cipher("AES-128-GCM");
+      aes_256_gcm = fetch_cipher("AES-256-GCM");
+      chacha20_poly1305 = EVP_CIPHER_fetch(nullptr, "ChaCha20-Poly1305", nullptr);
+      ERR_clear_error();
+      aes_128_cbc = fetch_cipher("AES-128-CBC");
+#else
+      aes_192_cbc = EVP_aes_192_cbc();
+      aes_256_cbc = EVP_aes_256_cbc();
+      aes_128_ctr = EVP_aes_128_ctr();
+      aes_192_ctr = EVP_aes_192_ctr();
+      aes_256_ctr = EVP_aes_256_ctr();
+      aes_128_gcm = EVP_aes_128_gcm();
+      aes_256_gcm = EVP_aes_256_gcm();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
+      chacha20_poly1305 = EVP_chacha20_poly1305();
+#endif
+      aes_128_cbc = EVP_aes_128_cbc();
+#endif
+    }
   }
 
-  void open_hasher() {}
+  void open_hasher() {
+    std::lock_guard<std::mutex> lock(open_hasher_mutex);
+    if (!sha1) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      sha256 = new md_t(fetch_md("SHA2-256"));
+      sha512 = new md_t(fetch_md("SHA2-512"));
+      sha1 = new md_t(fetch_md("SHA1"));
+#else
+      sha256 = new md_t(EVP_sha256());
+      sha512 = new md_t(EVP_sha512());
+      sha1 = new md_t(EVP_sha1());
+#endif
+    }
+  }
 
   cryptor* new_aes_cbc_encryptor(lua_State* L, const EVP_CIPHER* cipher, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
     if (iv_size != 16) {
@@ -179,15 +837,15 @@ namespace brigid {
   }
 
   cryptor* new_aes_128_cbc_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
-    return new_aes_cbc_encryptor(L, EVP_aes_128_cbc(), key_data, key_size, iv_data, iv_size, std::move(ref));
+    return new_aes_cbc_encryptor(L, aes_128_cbc, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
   cryptor* new_aes_192_cbc_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
-    return new_aes_cbc_encryptor(L, EVP_aes_192_cbc(), key_data, key_size, iv_data, iv_size, std::move(ref));
+    return new_aes_cbc_encryptor(L, aes_192_cbc, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
   cryptor* new_aes_256_cbc_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
-    return new_aes_cbc_encryptor(L, EVP_aes_256_cbc(), key_data, key_size, iv_data, iv_size, std::move(ref));
+    return new_aes_cbc_encryptor(L, aes_256_cbc, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
   cryptor* new_aes_cbc_decryptor(lua_State* L, const EVP_CIPHER* cipher, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
@@ -198,17 +856,101 @@ namespace brigid {
   }
 
   cryptor* new_aes_128_cbc_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
-    return new_aes_cbc_decryptor(L, EVP_aes_128_cbc(), key_data, key_size, iv_data, iv_size, std::move(ref));
+    return new_aes_cbc_decryptor(L, aes_128_cbc, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
   cryptor* new_aes_192_cbc_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
-    return new_aes_cbc_decryptor(L, EVP_aes_192_cbc(), key_data, key_size, iv_data, iv_size, std::move(ref));
+    return new_aes_cbc_decryptor(L, aes_192_cbc, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
   cryptor* new_aes_256_cbc_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
-    return new_aes_cbc_decryptor(L, EVP_aes_256_cbc(), key_data, key_size, iv_data, iv_size, std::move(ref));
+    return new_aes_cbc_decryptor(L, aes_256_cbc, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aead_cryptor(lua_State* L, const EVP_CIPHER* cipher, bool encrypt, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    if (!cipher) {
+      throw BRIGID_LOGIC_ERROR("unsupported cipher");
+    }
+    if (key_size != static_cast<size_t>(EVP_CIPHER_key_length(cipher))) {
+      throw BRIGID_LOGIC_ERROR("invalid key size");
+    }
+    if (iv_size == 0) {
+      throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+    }
+    return new_userdata<aead_cryptor_impl>(L, "brigid.cryptor", cipher, encrypt, key_data, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_128_gcm_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aead_cryptor(L, aes_128_gcm, true, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_256_gcm_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aead_cryptor(L, aes_256_gcm, true, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_chacha20_poly1305_encryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aead_cryptor(L, chacha20_poly1305, true, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_128_gcm_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aead_cryptor(L, aes_128_gcm, false, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_256_gcm_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aead_cryptor(L, aes_256_gcm, false, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_chacha20_poly1305_decryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aead_cryptor(L, chacha20_poly1305, false, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_ctr_cryptor(lua_State* L, const EVP_CIPHER* cipher, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    if (key_size != static_cast<size_t>(EVP_CIPHER_key_length(cipher))) {
+      throw BRIGID_LOGIC_ERROR("invalid key size");
+    }
+    if (iv_size != 16) {
+      throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+    }
+    return new_userdata<aes_ctr_cryptor_impl>(L, "brigid.cryptor", cipher, key_data, iv_data, std::move(ref));
+  }
+
+  cryptor* new_aes_128_ctr_cryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_ctr_cryptor(L, aes_128_ctr, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_192_ctr_cryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_ctr_cryptor(L, aes_192_ctr, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  cryptor* new_aes_256_ctr_cryptor(lua_State* L, const char* key_data, size_t key_size, const char* iv_data, size_t iv_size, thread_reference&& ref) {
+    return new_aes_ctr_cryptor(L, aes_256_ctr, key_data, key_size, iv_data, iv_size, std::move(ref));
+  }
+
+  std::string pbkdf2(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    const EVP_MD* md = get_md(name)->get();
+    std::string result(size, '\0');
+    check(PKCS5_PBKDF2_HMAC(password.data(), password.size(), reinterpret_cast<const unsigned char*>(salt.data()), salt.size(), iterations, md, size, reinterpret_cast<unsigned char*>(&result[0])));
+    return result;
+  }
+
+  std::string hkdf(const std::string& name, const std::string& key, const std::string& salt, const std::string& info, size_t size) {
+    return hkdf_hmac<kdf_hmac>(name, key, salt, info, size);
+  }
+
+  std::string bytes_to_key(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return bytes_to_key_digest<kdf_digest>(name, password, salt, iterations, size);
+  }
+
+  void random_bytes(char* data, size_t size) {
+    while (size > 0) {
+      int n = static_cast<int>(std::min<size_t>(size, INT_MAX));
+      check(RAND_bytes(reinterpret_cast<unsigned char*>(data), n) == 1);
+      data += n;
+      size -= n;
+    }
   }
 
+#ifdef BRIGID_OPENSSL_SHA_CTX
   hasher* new_sha1_hasher(lua_State* L) {
     return new_userdata<sha1_hasher_impl>(L, "brigid.hasher");
   }
@@ -220,4 +962,29 @@ namespace brigid {
   hasher* new_sha512_hasher(lua_State* L) {
     return new_userdata<sha512_hasher_impl>(L, "brigid.hasher");
   }
+#else
+  hasher* new_sha1_hasher(lua_State* L) {
+    return new_userdata<md_hasher_impl>(L, "brigid.hasher", sha1);
+  }
+
+  hasher* new_sha256_hasher(lua_State* L) {
+    return new_userdata<md_hasher_impl>(L, "brigid.hasher", sha256);
+  }
+
+  hasher* new_sha512_hasher(lua_State* L) {
+    return new_userdata<md_hasher_impl>(L, "brigid.hasher", sha512);
+  }
+#endif
+
+  hasher* new_sha1_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<md_hmac_impl>(L, "brigid.hmac", sha1, key_data, key_size);
+  }
+
+  hasher* new_sha256_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<md_hmac_impl>(L, "brigid.hmac", sha256, key_data, key_size);
+  }
+
+  hasher* new_sha512_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<md_hmac_impl>(L, "brigid.hmac", sha512, key_data, key_size);
+  }
 }
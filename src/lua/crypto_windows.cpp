@@ -1,4 +1,4 @@
-// Copyright (c) 2021,2022,2024 <dev@brigid.jp>
+// Copyright (c) 2021,2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -6,6 +6,7 @@
 #include "common_windows.hpp"
 #include "crypto.hpp"
 #include "error.hpp"
+#include "kdf.hpp"
 #include "noncopyable.hpp"
 #include "type_traits.hpp"
 
@@ -93,17 +94,7 @@ namespace brigid {
             0));
         key_buffer_.resize(size);
 
-        BCRYPT_KEY_HANDLE key = nullptr;
-        check(BCryptGenerateSymmetricKey(
-            alg_.get(),
-            &key,
-            key_buffer_.data(),
-            static_cast<ULONG>(key_buffer_.size()),
-            reinterpret_cast<PUCHAR>(const_cast<char*>(key_data)),
-            static_cast<ULONG>(key_size),
-            0));
-        key_ = make_key_handle(key);
-
+        generate_key(key_data, key_size);
         memmove(iv_.data(), iv_data, 16);
       }
 
@@ -159,6 +150,17 @@ namespace brigid {
         return result;
       }
 
+      virtual void impl_reset(const char* key_data, size_t key_size, const char* iv_data, size_t iv_size) {
+        if (iv_size != 16) {
+          throw BRIGID_LOGIC_ERROR("invalid initialization vector size");
+        }
+        if (key_data) {
+          generate_key(key_data, key_size);
+        }
+        memmove(iv_.data(), iv_data, 16);
+        in_position_ = 0;
+      }
+
       virtual void impl_close() {
         alg_ = make_alg_handle();
         key_ = make_key_handle();
@@ -173,6 +175,20 @@ namespace brigid {
       std::vector<UCHAR> iv_;
       std::vector<char> in_buffer_;
       size_t in_position_;
+
+      void generate_key(const char* key_data, size_t key_size) {
+        key_ = make_key_handle();
+        BCRYPT_KEY_HANDLE key = nullptr;
+        check(BCryptGenerateSymmetricKey(
+            alg_.get(),
+            &key,
+            key_buffer_.data(),
+            static_cast<ULONG>(key_buffer_.size()),
+            reinterpret_cast<PUCHAR>(const_cast<char*>(key_data)),
+            static_cast<ULONG>(key_size),
+            0));
+        key_ = make_key_handle(key);
+      }
     };
 
     class aes_encryptor_impl : public aes_cryptor_impl, private noncopyable {
@@ -231,12 +247,78 @@ namespace brigid {
     class hasher_impl : public hasher, private noncopyable {
     public:
       explicit hasher_impl(LPCWSTR algorithm)
-        : alg_(make_alg_handle()),
+        : algorithm_(algorithm),
+          alg_(make_alg_handle()),
+          hash_(make_hash_handle()) {
+        open_algorithm();
+        create_hash();
+      }
+
+      hasher_impl(LPCWSTR algorithm, BCRYPT_HASH_HANDLE that)
+        : algorithm_(algorithm),
+          alg_(make_alg_handle()),
           hash_(make_hash_handle()) {
+        open_algorithm();
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        check(BCryptDuplicateHash(
+            that,
+            &hash,
+            hash_buffer_.data(),
+            static_cast<ULONG>(hash_buffer_.size()),
+            0));
+        hash_ = make_hash_handle(hash);
+      }
+
+      virtual void update(const char* data, size_t size) {
+        check(BCryptHashData(
+            hash_.get(),
+            reinterpret_cast<PUCHAR>(const_cast<char*>(data)),
+            static_cast<ULONG>(size),
+            0));
+      }
+
+      virtual void digest(lua_State* L) {
+        DWORD size = 0;
+        DWORD result = 0;
+        check(BCryptGetProperty(
+            alg_.get(),
+            BCRYPT_HASH_LENGTH,
+            reinterpret_cast<PUCHAR>(&size),
+            sizeof(size),
+            &result,
+            0));
+        if (size != T_size) {
+          throw BRIGID_LOGIC_ERROR("invalid buffer size");
+        }
+        char buffer[T_size] = {};
+        check(BCryptFinishHash(
+            hash_.get(),
+            reinterpret_cast<PUCHAR>(buffer),
+            static_cast<ULONG>(T_size),
+            0));
+        lua_pushlstring(L, buffer, T_size);
+      }
+
+      virtual void reset() {
+        hash_ = make_hash_handle();
+        create_hash();
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<hasher_impl<T_size> >(L, "brigid.hasher", algorithm_, hash_.get());
+      }
+
+    private:
+      LPCWSTR algorithm_;
+      alg_handle_t alg_;
+      std::vector<UCHAR> hash_buffer_;
+      hash_handle_t hash_;
+
+      void open_algorithm() {
         BCRYPT_ALG_HANDLE alg = nullptr;
         check(BCryptOpenAlgorithmProvider(
             &alg,
-            algorithm,
+            algorithm_,
             nullptr,
             0));
         alg_ = make_alg_handle(alg);
@@ -251,7 +333,9 @@ namespace brigid {
             &result,
             0));
         hash_buffer_.resize(size);
+      }
 
+      void create_hash() {
         BCRYPT_HASH_HANDLE hash = nullptr;
         check(BCryptCreateHash(
             alg_.get(),
@@ -263,6 +347,41 @@ namespace brigid {
             0));
         hash_ = make_hash_handle(hash);
       }
+    };
+
+    // The keyed hash object is kept and duplicated for each message, so that
+    // the padded key is hashed only once.
+    template <size_t T_size>
+    class hmac_impl : public hasher, private noncopyable {
+    public:
+      hmac_impl(LPCWSTR algorithm, const char* key_data, size_t key_size)
+        : algorithm_(algorithm),
+          alg_(make_alg_handle()),
+          init_(make_hash_handle()),
+          hash_(make_hash_handle()) {
+        open_algorithm();
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        check(BCryptCreateHash(
+            alg_.get(),
+            &hash,
+            init_buffer_.data(),
+            static_cast<ULONG>(init_buffer_.size()),
+            reinterpret_cast<PUCHAR>(const_cast<char*>(key_data)),
+            static_cast<ULONG>(key_size),
+            0));
+        init_ = make_hash_handle(hash);
+        reset();
+      }
+
+      hmac_impl(LPCWSTR algorithm, BCRYPT_HASH_HANDLE init, BCRYPT_HASH_HANDLE that)
+        : algorithm_(algorithm),
+          alg_(make_alg_handle()),
+          init_(make_hash_handle()),
+          hash_(make_hash_handle()) {
+        open_algorithm();
+        init_ = duplicate_hash(init, init_buffer_);
+        hash_ = duplicate_hash(that, hash_buffer_);
+      }
 
       virtual void update(const char* data, size_t size) {
         check(BCryptHashData(
@@ -273,31 +392,179 @@ namespace brigid {
       }
 
       virtual void digest(lua_State* L) {
+        char buffer[T_size] = {};
+        check(BCryptFinishHash(
+            hash_.get(),
+            reinterpret_cast<PUCHAR>(buffer),
+            T_size,
+            0));
+        reset();
+        lua_pushlstring(L, buffer, T_size);
+      }
+
+      virtual void reset() {
+        hash_ = make_hash_handle();
+        hash_ = duplicate_hash(init_.get(), hash_buffer_);
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<hmac_impl<T_size> >(L, "brigid.hmac", algorithm_, init_.get(), hash_.get());
+      }
+
+    private:
+      LPCWSTR algorithm_;
+      alg_handle_t alg_;
+      std::vector<UCHAR> init_buffer_;
+      std::vector<UCHAR> hash_buffer_;
+      hash_handle_t init_;
+      hash_handle_t hash_;
+
+      void open_algorithm() {
+        BCRYPT_ALG_HANDLE alg = nullptr;
+        check(BCryptOpenAlgorithmProvider(
+            &alg,
+            algorithm_,
+            nullptr,
+            BCRYPT_ALG_HANDLE_HMAC_FLAG));
+        alg_ = make_alg_handle(alg);
+
         DWORD size = 0;
         DWORD result = 0;
         check(BCryptGetProperty(
             alg_.get(),
-            BCRYPT_HASH_LENGTH,
+            BCRYPT_OBJECT_LENGTH,
             reinterpret_cast<PUCHAR>(&size),
             sizeof(size),
             &result,
             0));
-        if (size != T_size) {
-          throw BRIGID_LOGIC_ERROR("invalid buffer size");
+        init_buffer_.resize(size);
+        hash_buffer_.resize(size);
+      }
+
+      hash_handle_t duplicate_hash(BCRYPT_HASH_HANDLE source, std::vector<UCHAR>& buffer) {
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        check(BCryptDuplicateHash(
+            source,
+            &hash,
+            buffer.data(),
+            static_cast<ULONG>(buffer.size()),
+            0));
+        return make_hash_handle(hash);
+      }
+    };
+
+    // The hash and the hmac of the key derivation in kdf.hpp. The initial
+    // hash object is kept and duplicated for each message.
+    class kdf_hasher : private noncopyable {
+    public:
+      kdf_hasher(const std::string& name, ULONG flags, const char* key_data, size_t key_size)
+        : alg_(make_alg_handle()),
+          init_(make_hash_handle()),
+          hash_(make_hash_handle()),
+          size_() {
+        LPCWSTR algorithm = nullptr;
+        if (name == "sha1") {
+          algorithm = BCRYPT_SHA1_ALGORITHM;
+        } else if (name == "sha256") {
+          algorithm = BCRYPT_SHA256_ALGORITHM;
+        } else if (name == "sha512") {
+          algorithm = BCRYPT_SHA512_ALGORITHM;
+        } else {
+          throw BRIGID_LOGIC_ERROR("unsupported hash");
         }
-        char buffer[T_size] = {};
+
+        BCRYPT_ALG_HANDLE alg = nullptr;
+        check(BCryptOpenAlgorithmProvider(
+            &alg,
+            algorithm,
+            nullptr,
+            flags));
+        alg_ = make_alg_handle(alg);
+
+        DWORD size = 0;
+        DWORD result = 0;
+        check(BCryptGetProperty(
+            alg_.get(),
+            BCRYPT_OBJECT_LENGTH,
+            reinterpret_cast<PUCHAR>(&size),
+            sizeof(size),
+            &result,
+            0));
+        init_buffer_.resize(size);
+        hash_buffer_.resize(size);
+        check(BCryptGetProperty(
+            alg_.get(),
+            BCRYPT_HASH_LENGTH,
+            reinterpret_cast<PUCHAR>(&size_),
+            sizeof(size_),
+            &result,
+            0));
+
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        check(BCryptCreateHash(
+            alg_.get(),
+            &hash,
+            init_buffer_.data(),
+            static_cast<ULONG>(init_buffer_.size()),
+            reinterpret_cast<PUCHAR>(const_cast<char*>(key_data)),
+            static_cast<ULONG>(key_size),
+            0));
+        init_ = make_hash_handle(hash);
+        reset();
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+      void update(const char* data, size_t size) {
+        check(BCryptHashData(
+            hash_.get(),
+            reinterpret_cast<PUCHAR>(const_cast<char*>(data)),
+            static_cast<ULONG>(size),
+            0));
+      }
+
+      void finish(char* data) {
         check(BCryptFinishHash(
             hash_.get(),
-            reinterpret_cast<PUCHAR>(buffer),
-            static_cast<ULONG>(T_size),
+            reinterpret_cast<PUCHAR>(data),
+            size_,
             0));
-        lua_pushlstring(L, buffer, T_size);
+        reset();
       }
 
     private:
       alg_handle_t alg_;
+      std::vector<UCHAR> init_buffer_;
       std::vector<UCHAR> hash_buffer_;
+      hash_handle_t init_;
       hash_handle_t hash_;
+      DWORD size_;
+
+      void reset() {
+        hash_ = make_hash_handle();
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        check(BCryptDuplicateHash(
+            init_.get(),
+            &hash,
+            hash_buffer_.data(),
+            static_cast<ULONG>(hash_buffer_.size()),
+            0));
+        hash_ = make_hash_handle(hash);
+      }
+    };
+
+    class kdf_digest : public kdf_hasher {
+    public:
+      explicit kdf_digest(const std::string& name)
+        : kdf_hasher(name, 0, nullptr, 0) {}
+    };
+
+    class kdf_hmac : public kdf_hasher {
+    public:
+      kdf_hmac(const std::string& name, const char* key_data, size_t key_size)
+        : kdf_hasher(name, BCRYPT_ALG_HANDLE_HMAC_FLAG, key_data, key_size) {}
     };
   }
 
@@ -342,6 +609,44 @@ namespace brigid {
     return new_aes_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref));
   }
 
+  // Authenticated ciphers are not supported by this backend yet.
+  cryptor* new_aes_128_gcm_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_gcm_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_chacha20_poly1305_encryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_128_gcm_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_gcm_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_chacha20_poly1305_decryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  // CTR is not supported by this backend yet.
+  cryptor* new_aes_128_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_192_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
+  cryptor* new_aes_256_ctr_cryptor(lua_State*, const char*, size_t, const char*, size_t, thread_reference&&) {
+    throw BRIGID_LOGIC_ERROR("unsupported cipher");
+  }
+
   hasher* new_sha1_hasher(lua_State* L) {
     return new_userdata<hasher_impl<20> >(L, "brigid.hasher", BCRYPT_SHA1_ALGORITHM);
   }
@@ -353,4 +658,37 @@ namespace brigid {
   hasher* new_sha512_hasher(lua_State* L) {
     return new_userdata<hasher_impl<64> >(L, "brigid.hasher", BCRYPT_SHA512_ALGORITHM);
   }
+
+  hasher* new_sha1_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<20> >(L, "brigid.hmac", BCRYPT_SHA1_ALGORITHM, key_data, key_size);
+  }
+
+  hasher* new_sha256_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<32> >(L, "brigid.hmac", BCRYPT_SHA256_ALGORITHM, key_data, key_size);
+  }
+
+  hasher* new_sha512_hmac(lua_State* L, const char* key_data, size_t key_size) {
+    return new_userdata<hmac_impl<64> >(L, "brigid.hmac", BCRYPT_SHA512_ALGORITHM, key_data, key_size);
+  }
+
+  std::string pbkdf2(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return pbkdf2_hmac<kdf_hmac>(name, password, salt, iterations, size);
+  }
+
+  std::string hkdf(const std::string& name, const std::string& key, const std::string& salt, const std::string& info, size_t size) {
+    return hkdf_hmac<kdf_hmac>(name, key, salt, info, size);
+  }
+
+  std::string bytes_to_key(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    return bytes_to_key_digest<kdf_digest>(name, password, salt, iterations, size);
+  }
+
+  void random_bytes(char* data, size_t size) {
+    while (size > 0) {
+      ULONG n = static_cast<ULONG>(std::min<size_t>(size, 0x40000000));
+      check(BCryptGenRandom(nullptr, reinterpret_cast<PUCHAR>(data), n, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+      data += n;
+      size -= n;
+    }
+  }
 }
@@ -1,4 +1,4 @@
-// Copyright (c) 2019-2022,2024 <dev@brigid.jp>
+// Copyright (c) 2019-2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -7,12 +7,15 @@
 #include "data.hpp"
 #include "error.hpp"
 #include "function.hpp"
+#include "task.hpp"
 #include "thread_reference.hpp"
+#include "writer.hpp"
 
 #include <lua.hpp>
 
 #include <stddef.h>
 #include <utility>
+#include <vector>
 
 namespace brigid {
   namespace {
@@ -49,18 +52,65 @@ namespace brigid {
       self->update(source.data(), source.size(), padding);
     }
 
-    void impl_encryptor(lua_State* L) {
-      const char* name = luaL_checkstring(L, 1);
-      data_t key = check_data(L, 2);
-      data_t iv = check_data(L, 3);
+    void impl_update_async(lua_State* L) {
+      cryptor* self = check_cryptor(L, 1);
+      thread_reference ref(L);
+      lua_pushvalue(L, 1);
+      lua_xmove(L, ref.get(), 1);
+      data_t source = pin_data(L, 2, ref);
+      bool padding = lua_toboolean(L, 3);
+      self->update_async(L, source.data(), source.size(), padding, std::move(ref));
+    }
 
+    void impl_update_aad(lua_State* L) {
+      cryptor* self = check_cryptor(L, 1);
+      data_t source = check_data(L, 2);
+      self->update_aad(source.data(), source.size());
+    }
+
+    void impl_get_tag(lua_State* L) {
+      cryptor* self = check_cryptor(L, 1, check_validate_not_running);
+      char buffer[16] = {};
+      size_t size = self->get_tag(buffer, sizeof(buffer));
+      lua_pushlstring(L, buffer, size);
+    }
+
+    void impl_set_tag(lua_State* L) {
+      cryptor* self = check_cryptor(L, 1);
+      data_t source = check_data(L, 2);
+      self->set_tag(source.data(), source.size());
+    }
+
+    void impl_reset(lua_State* L) {
+      cryptor* self = check_cryptor(L, 1);
+      data_t iv = check_data(L, 2);
+      data_t key;
+      if (!lua_isnoneornil(L, 3)) {
+        key = check_data(L, 3);
+      }
+      self->reset(key.data(), key.size(), iv.data(), iv.size());
+    }
+
+    // The output is a brigid.writer, which is written in C++, or a function
+    // which is called with a brigid.view.
+    thread_reference check_output(lua_State* L, int arg) {
       thread_reference ref;
-      if (!lua_isnoneornil(L, 4)) {
+      if (!lua_isnoneornil(L, arg)) {
+        if (!lua_isfunction(L, arg)) {
+          check_writer(L, arg);
+        }
         ref = thread_reference(L);
-        lua_pushvalue(L, 4);
+        lua_pushvalue(L, arg);
         lua_xmove(L, ref.get(), 1);
       }
+      return ref;
+    }
 
+    void impl_encryptor(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      data_t key = check_data(L, 2);
+      data_t iv = check_data(L, 3);
+      thread_reference ref = check_output(L, 4);
       new_encryptor(L, name, key.data(), key.size(), iv.data(), iv.size(), std::move(ref));
     }
 
@@ -68,16 +118,84 @@ namespace brigid {
       const char* name = luaL_checkstring(L, 1);
       data_t key = check_data(L, 2);
       data_t iv = check_data(L, 3);
+      thread_reference ref = check_output(L, 4);
+      new_decryptor(L, name, key.data(), key.size(), iv.data(), iv.size(), std::move(ref));
+    }
 
-      thread_reference ref;
-      if (!lua_isnoneornil(L, 4)) {
-        ref = thread_reference(L);
-        lua_pushvalue(L, 4);
-        lua_xmove(L, ref.get(), 1);
+    // The options table may have the number of threads. Segments of a large
+    // message are processed on the worker pool if the cipher can be split on
+    // block boundaries: CBC decryption and CTR.
+    size_t check_threads(lua_State* L, int arg) {
+      size_t threads = 1;
+      if (!lua_isnoneornil(L, arg)) {
+        luaL_checktype(L, arg, LUA_TTABLE);
+        if (get_field(L, arg, "threads") != LUA_TNIL) {
+          threads = check_integer<size_t>(L, -1);
+          if (threads < 1) {
+            luaL_argerror(L, arg, "invalid number of threads");
+          }
+        }
+        lua_pop(L, 1);
       }
+      return threads;
+    }
 
-      new_decryptor(L, name, key.data(), key.size(), iv.data(), iv.size(), std::move(ref));
+    // The tag of an authenticated cipher follows the ciphertext.
+    void encrypt_all(lua_State* L, cryptor* self, const data_t& source, size_t threads) {
+      if (!self) {
+        throw BRIGID_LOGIC_ERROR("unsupported cipher");
+      }
+      size_t tag_size = self->tag_size();
+      std::vector<char> buffer(self->calculate_buffer_size(source.size()) + tag_size);
+      size_t size = self->update_parallel(source.data(), source.size(), buffer.data(), buffer.size() - tag_size, threads);
+      if (tag_size > 0) {
+        size += self->get_tag(buffer.data() + size, tag_size);
+      }
+      self->close();
+      lua_pop(L, 1);
+      lua_pushlstring(L, buffer.data(), size);
+    }
+
+    void decrypt_all(lua_State* L, cryptor* self, const data_t& source, size_t threads) {
+      if (!self) {
+        throw BRIGID_LOGIC_ERROR("unsupported cipher");
+      }
+      size_t source_size = source.size();
+      if (size_t tag_size = self->tag_size()) {
+        if (source_size < tag_size) {
+          throw BRIGID_RUNTIME_ERROR("authentication failed");
+        }
+        source_size -= tag_size;
+        self->set_tag(source.data() + source_size, tag_size);
+      }
+      std::vector<char> buffer(self->calculate_buffer_size(source_size));
+      size_t size = self->update_parallel(source.data(), source_size, buffer.data(), buffer.size(), threads);
+      self->close();
+      lua_pop(L, 1);
+      lua_pushlstring(L, buffer.data(), size);
+    }
+
+    void impl_encrypt(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      data_t key = check_data(L, 2);
+      data_t iv = check_data(L, 3);
+      data_t source = check_data(L, 4);
+      size_t threads = check_threads(L, 5);
+      encrypt_all(L, new_encryptor(L, name, key.data(), key.size(), iv.data(), iv.size(), thread_reference()), source, threads);
     }
+
+    void impl_decrypt(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      data_t key = check_data(L, 2);
+      data_t iv = check_data(L, 3);
+      data_t source = check_data(L, 4);
+      size_t threads = check_threads(L, 5);
+      decrypt_all(L, new_decryptor(L, name, key.data(), key.size(), iv.data(), iv.size(), thread_reference()), source, threads);
+    }
+  }
+
+  writer_t* to_writer_cryptor(lua_State* L, int arg) {
+    return to_udata<cryptor>(L, arg, "brigid.cryptor");
   }
 
   void initialize_cryptor(lua_State* L) {
@@ -98,11 +216,19 @@ namespace brigid {
       lua_pop(L, 1);
 
       decltype(function<impl_update>())::set_field(L, -1, "update");
+      decltype(function<impl_update_async>())::set_field(L, -1, "update_async");
+      decltype(function<impl_update_aad>())::set_field(L, -1, "update_aad");
+      decltype(function<impl_get_tag>())::set_field(L, -1, "get_tag");
+      decltype(function<impl_set_tag>())::set_field(L, -1, "set_tag");
+      decltype(function<impl_reset>())::set_field(L, -1, "reset");
       decltype(function<impl_close>())::set_field(L, -1, "close");
+      initialize_writer(L);
     }
     lua_setfield(L, -2, "cryptor");
 
     decltype(function<impl_encryptor>())::set_field(L, -1, "encryptor");
     decltype(function<impl_decryptor>())::set_field(L, -1, "decryptor");
+    decltype(function<impl_encrypt>())::set_field(L, -1, "encrypt");
+    decltype(function<impl_decrypt>())::set_field(L, -1, "decrypt");
   }
 }
@@ -0,0 +1,516 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "crypto.hpp"
+#include "data.hpp"
+#include "error.hpp"
+#include "function.hpp"
+#include "noncopyable.hpp"
+#include "stack_guard.hpp"
+#include "thread_reference.hpp"
+#include "worker_pool.hpp"
+#include "writer.hpp"
+
+#include <lua.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace brigid {
+  namespace {
+    // An encrypted container consists of a header and segments.
+    //
+    //   header (40 bytes)
+    //     "BRIGID"     magic
+    //     uint8        version (2)
+    //     uint8        cipher (1: aes-256-gcm, 2: chacha20-poly1305)
+    //     uint32       segment size
+    //     uint8        key derivation (1: PBKDF2-HMAC-SHA256)
+    //     uint32       iterations of the key derivation
+    //     uint8[7]     nonce prefix
+    //     uint8[16]    salt
+    //   segment
+    //     ciphertext   segment size bytes, or less for the last segment
+    //     tag          16 bytes
+    //
+    // Integers are big-endian. The key of a container is derived from the
+    // key and the salt with the iterations of the header, which are limited
+    // so that a forged header cannot stall the reader. The nonce of a segment is the nonce prefix, the index
+    // as uint32 and 1 for the last segment or 0 for the others, so that
+    // reordered and truncated segments fail authentication. The header is
+    // the additional authenticated data of every segment.
+    static const size_t header_size = 40;
+    static const size_t tag_size = 16;
+    static const size_t max_segment_size = 16 * 1024 * 1024;
+    static const uint64_t max_segment_count = 0x100000000;
+    static const size_t default_iterations = 600000;
+    static const size_t max_iterations = 10000000;
+
+    const char* get_cipher_name(int cipher) {
+      switch (cipher) {
+        case 1: return "aes-256-gcm";
+        case 2: return "chacha20-poly1305";
+      }
+      return nullptr;
+    }
+
+    int get_cipher(const char* name) {
+      for (int cipher = 1; const char* cipher_name = get_cipher_name(cipher); ++cipher) {
+        if (strcmp(name, cipher_name) == 0) {
+          return cipher;
+        }
+      }
+      return 0;
+    }
+
+    uint32_t decode_uint32(const char* data) {
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+      return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+    }
+
+    void encode_uint32(char* data, uint32_t source) {
+      data[0] = static_cast<char>(source >> 24);
+      data[1] = static_cast<char>(source >> 16);
+      data[2] = static_cast<char>(source >> 8);
+      data[3] = static_cast<char>(source);
+    }
+
+    class header_t {
+    public:
+      explicit header_t(const char* data)
+        : cipher_name_(),
+          segment_size_(),
+          iterations_() {
+        memcpy(data_, data, header_size);
+        if (memcmp(data_, "BRIGID", 6) != 0 || data_[6] != 2) {
+          throw BRIGID_RUNTIME_ERROR("invalid header");
+        }
+        cipher_name_ = get_cipher_name(data_[7]);
+        segment_size_ = decode_uint32(data_ + 8);
+        iterations_ = decode_uint32(data_ + 13);
+        if (!cipher_name_ || segment_size_ < 1 || segment_size_ > max_segment_size || data_[12] != 1 || iterations_ < 1 || iterations_ > max_iterations) {
+          throw BRIGID_RUNTIME_ERROR("invalid header");
+        }
+      }
+
+      header_t(int cipher, size_t segment_size, size_t iterations)
+        : cipher_name_(get_cipher_name(cipher)),
+          segment_size_(segment_size),
+          iterations_(iterations) {
+        memcpy(data_, "BRIGID", 6);
+        data_[6] = 2;
+        data_[7] = cipher;
+        encode_uint32(data_ + 8, static_cast<uint32_t>(segment_size));
+        data_[12] = 1;
+        encode_uint32(data_ + 13, static_cast<uint32_t>(iterations));
+        random_bytes(data_ + 17, header_size - 17);
+      }
+
+      const char* data() const {
+        return data_;
+      }
+
+      const char* cipher_name() const {
+        return cipher_name_;
+      }
+
+      size_t segment_size() const {
+        return segment_size_;
+      }
+
+      std::string derive_key(const char* key_data, size_t key_size) const {
+        return pbkdf2("sha256", std::string(key_data, key_size), std::string(data_ + 24, 16), iterations_, 32);
+      }
+
+      // The cryptor is pushed onto the stack.
+      cryptor* new_cryptor(lua_State* L, bool encrypt, const std::string& key, size_t index, bool last) const {
+        char nonce[12] = {};
+        memcpy(nonce, data_ + 17, 7);
+        encode_uint32(nonce + 7, static_cast<uint32_t>(index));
+        nonce[11] = last ? 1 : 0;
+        cryptor* result = encrypt
+          ? new_encryptor(L, cipher_name_, key.data(), key.size(), nonce, sizeof(nonce), thread_reference())
+          : new_decryptor(L, cipher_name_, key.data(), key.size(), nonce, sizeof(nonce), thread_reference());
+        result->update_aad(data_, header_size);
+        return result;
+      }
+
+    private:
+      char data_[header_size];
+      const char* cipher_name_;
+      size_t segment_size_;
+      size_t iterations_;
+    };
+
+    // The output is kept on the stack of the referenced thread, which is
+    // also used to create the cryptors of the segments. A full segment is
+    // held until more data is written, because the last segment is not
+    // known until the writer is closed.
+    class encrypted_writer_t : public writer_t, private noncopyable {
+    public:
+      encrypted_writer_t(thread_reference&& ref, const header_t& header, std::string key)
+        : ref_(std::move(ref)),
+          writer_(to_writer(ref_.get(), 1)),
+          header_(header),
+          key_(std::move(key)),
+          index_() {
+        buffer_.reserve(header_.segment_size());
+        write_output(header_.data(), header_size);
+      }
+
+      virtual bool closed() const {
+        return !ref_;
+      }
+
+      virtual void write(const char* data, size_t size) {
+        size_t segment_size = header_.segment_size();
+        while (size > 0) {
+          if (buffer_.size() == segment_size) {
+            flush(false);
+          }
+          size_t n = std::min(size, segment_size - buffer_.size());
+          buffer_.insert(buffer_.end(), data, data + n);
+          data += n;
+          size -= n;
+        }
+      }
+
+      virtual void write(char data) {
+        write(&data, 1);
+      }
+
+      void close() {
+        flush(true);
+        ref_ = thread_reference();
+        writer_ = nullptr;
+      }
+
+    private:
+      thread_reference ref_;
+      writer_t* writer_;
+      header_t header_;
+      std::string key_;
+      size_t index_;
+      std::vector<char> buffer_;
+      std::vector<char> out_buffer_;
+
+      void write_output(const char* data, size_t size) {
+        if (writer_->closed()) {
+          throw BRIGID_LOGIC_ERROR("attempt to use a closed brigid.writer");
+        }
+        writer_->write(data, size);
+      }
+
+      void flush(bool last) {
+        if (index_ >= max_segment_count) {
+          throw BRIGID_LOGIC_ERROR("too many segments");
+        }
+        lua_State* L = ref_.get();
+        stack_guard guard(L);
+        cryptor* encryptor = header_.new_cryptor(L, true, key_, index_, last);
+        out_buffer_.resize(encryptor->calculate_buffer_size(buffer_.size()) + tag_size);
+        size_t size = encryptor->update_parallel(buffer_.data(), buffer_.size(), out_buffer_.data(), out_buffer_.size() - tag_size, 1);
+        size += encryptor->get_tag(out_buffer_.data() + size, tag_size);
+        encryptor->close();
+        write_output(out_buffer_.data(), size);
+        buffer_.clear();
+        ++index_;
+      }
+    };
+
+    // The data is kept on the stack of the referenced thread and must not be
+    // modified while the reader is used.
+    class encrypted_reader_t : private noncopyable {
+    public:
+      encrypted_reader_t(thread_reference&& ref, const header_t& header, std::string key, size_t encoded_size)
+        : ref_(std::move(ref)),
+          header_(header),
+          key_(std::move(key)),
+          encoded_size_(encoded_size),
+          segment_count_(),
+          size_() {
+        size_t segment_size = header_.segment_size();
+        size_t body_size = encoded_size - header_size;
+        segment_count_ = (body_size + segment_size + tag_size - 1) / (segment_size + tag_size);
+        if (segment_count_ < 1 || segment_count_ > max_segment_count) {
+          throw BRIGID_RUNTIME_ERROR("invalid size");
+        }
+        size_t last_size = body_size - (segment_count_ - 1) * (segment_size + tag_size);
+        if (last_size < tag_size) {
+          throw BRIGID_RUNTIME_ERROR("invalid size");
+        }
+        size_ = (segment_count_ - 1) * segment_size + last_size - tag_size;
+      }
+
+      bool closed() const {
+        return !ref_;
+      }
+
+      void close() {
+        ref_ = thread_reference();
+      }
+
+      size_t size() const {
+        return size_;
+      }
+
+      // The segments are created on the stack of L in batches and decrypted
+      // on up to the given number of threads.
+      void read(lua_State* L, size_t position, size_t size, size_t threads) {
+        position = std::min(position, size_);
+        size = std::min(size, size_ - position);
+        if (size == 0) {
+          lua_pushliteral(L, "");
+          return;
+        }
+
+        data_t source = to_data(ref_.get(), 1);
+        if (!source.data() || source.size() != encoded_size_) {
+          throw BRIGID_LOGIC_ERROR("attempt to use a modified brigid.data");
+        }
+
+        size_t segment_size = header_.segment_size();
+        size_t first = position / segment_size;
+        size_t n = (position + size - 1) / segment_size - first + 1;
+        std::vector<char> buffer(n * segment_size);
+
+        static const size_t batch_size = 64;
+        for (size_t i = 0; i < n; i += batch_size) {
+          size_t m = std::min(batch_size, n - i);
+          stack_guard guard(L);
+          luaL_checkstack(L, static_cast<int>(m), nullptr);
+
+          std::vector<cryptor*> decryptors(m);
+          std::vector<const char*> in_data(m);
+          std::vector<size_t> in_size(m);
+          for (size_t j = 0; j < m; ++j) {
+            size_t index = first + i + j;
+            bool last = index == segment_count_ - 1;
+            in_data[j] = source.data() + header_size + index * (segment_size + tag_size);
+            in_size[j] = last ? size_ - index * segment_size : segment_size;
+            decryptors[j] = header_.new_cryptor(L, false, key_, index, last);
+            decryptors[j]->set_tag(in_data[j] + in_size[j], tag_size);
+          }
+
+          size_t k = std::min(threads, m);
+          std::vector<std::exception_ptr> errors(m);
+          get_worker_pool()->parallel_for(k, [&](size_t t) {
+            for (size_t j = t; j < m; j += k) {
+              try {
+                char* out_data = buffer.data() + (i + j) * segment_size;
+                decryptors[j]->update_parallel(in_data[j], in_size[j], out_data, segment_size, 1);
+              } catch (...) {
+                errors[j] = std::current_exception();
+              }
+            }
+          });
+          for (size_t j = 0; j < m; ++j) {
+            decryptors[j]->close();
+          }
+          for (size_t j = 0; j < m; ++j) {
+            if (errors[j]) {
+              std::rethrow_exception(errors[j]);
+            }
+          }
+        }
+
+        lua_pushlstring(L, buffer.data() + position - first * segment_size, size);
+      }
+
+    private:
+      thread_reference ref_;
+      header_t header_;
+      std::string key_;
+      size_t encoded_size_;
+      size_t segment_count_;
+      size_t size_;
+    };
+
+    encrypted_writer_t* check_encrypted_writer(lua_State* L, int arg, int validate = check_validate_all) {
+      encrypted_writer_t* self = check_udata<encrypted_writer_t>(L, arg, "brigid.encrypted_writer");
+      if (validate & check_validate_not_closed) {
+        if (self->closed()) {
+          luaL_argerror(L, arg, "attempt to use a closed brigid.encrypted_writer");
+        }
+      }
+      return self;
+    }
+
+    encrypted_reader_t* check_encrypted_reader(lua_State* L, int arg, int validate = check_validate_all) {
+      encrypted_reader_t* self = check_udata<encrypted_reader_t>(L, arg, "brigid.encrypted_reader");
+      if (validate & check_validate_not_closed) {
+        if (self->closed()) {
+          luaL_argerror(L, arg, "attempt to use a closed brigid.encrypted_reader");
+        }
+      }
+      return self;
+    }
+
+    // A writer collected without close() still writes its last segment, so
+    // that the output is complete. A finalizer cannot raise an error, so
+    // that an error is ignored and the output is left truncated.
+    void impl_writer_gc(lua_State* L) {
+      encrypted_writer_t* self = check_encrypted_writer(L, 1, check_validate_none);
+      if (!self->closed()) {
+        try {
+          self->close();
+        } catch (...) {}
+      }
+      self->~encrypted_writer_t();
+    }
+
+    void impl_writer_close(lua_State* L) {
+      encrypted_writer_t* self = check_encrypted_writer(L, 1, check_validate_none);
+      if (!self->closed()) {
+        self->close();
+      }
+    }
+
+    void impl_writer_write(lua_State* L) {
+      encrypted_writer_t* self = check_encrypted_writer(L, 1);
+      data_t data = check_data(L, 2);
+      self->write(data.data(), data.size());
+    }
+
+    void impl_writer_call(lua_State* L) {
+      data_t key = check_data(L, 2);
+      check_writer(L, 3);
+
+      int cipher = 1;
+      size_t segment_size = 65536;
+      size_t iterations = default_iterations;
+      if (!lua_isnoneornil(L, 4)) {
+        luaL_checktype(L, 4, LUA_TTABLE);
+        if (get_field(L, 4, "cipher") != LUA_TNIL) {
+          cipher = get_cipher(luaL_checkstring(L, -1));
+          if (cipher == 0) {
+            luaL_argerror(L, 4, "unsupported cipher");
+          }
+        }
+        lua_pop(L, 1);
+        if (get_field(L, 4, "segment_size") != LUA_TNIL) {
+          segment_size = check_integer<size_t>(L, -1);
+          if (segment_size < 1 || segment_size > max_segment_size) {
+            luaL_argerror(L, 4, "invalid segment size");
+          }
+        }
+        lua_pop(L, 1);
+        if (get_field(L, 4, "iterations") != LUA_TNIL) {
+          iterations = check_integer<size_t>(L, -1);
+          if (iterations < 1 || iterations > max_iterations) {
+            luaL_argerror(L, 4, "invalid iterations");
+          }
+        }
+        lua_pop(L, 1);
+      }
+
+      header_t header(cipher, segment_size, iterations);
+      std::string derived_key = header.derive_key(key.data(), key.size());
+      {
+        stack_guard guard(L);
+        header.new_cryptor(L, true, derived_key, 0, false)->close();
+      }
+
+      thread_reference ref(L);
+      lua_pushvalue(L, 3);
+      lua_xmove(L, ref.get(), 1);
+      new_userdata<encrypted_writer_t>(L, "brigid.encrypted_writer", std::move(ref), header, std::move(derived_key));
+    }
+
+    void impl_reader_gc(lua_State* L) {
+      check_encrypted_reader(L, 1, check_validate_none)->~encrypted_reader_t();
+    }
+
+    void impl_reader_close(lua_State* L) {
+      encrypted_reader_t* self = check_encrypted_reader(L, 1, check_validate_none);
+      if (!self->closed()) {
+        self->close();
+      }
+    }
+
+    void impl_reader_get_size(lua_State* L) {
+      encrypted_reader_t* self = check_encrypted_reader(L, 1);
+      push_integer(L, self->size());
+    }
+
+    void impl_reader_read(lua_State* L) {
+      encrypted_reader_t* self = check_encrypted_reader(L, 1);
+      size_t position = opt_integer<size_t>(L, 2, 0);
+      size_t size = opt_integer<size_t>(L, 3, self->size());
+      size_t threads = 1;
+      if (!lua_isnoneornil(L, 4)) {
+        luaL_checktype(L, 4, LUA_TTABLE);
+        if (get_field(L, 4, "threads") != LUA_TNIL) {
+          threads = check_integer<size_t>(L, -1);
+          if (threads < 1) {
+            luaL_argerror(L, 4, "invalid number of threads");
+          }
+        }
+        lua_pop(L, 1);
+      }
+      self->read(L, position, size, threads);
+    }
+
+    void impl_reader_call(lua_State* L) {
+      data_t key = check_data(L, 2);
+      data_t source = check_data(L, 3);
+      if (source.size() < header_size) {
+        throw BRIGID_RUNTIME_ERROR("invalid header");
+      }
+
+      header_t header(source.data());
+      std::string derived_key = header.derive_key(key.data(), key.size());
+
+      thread_reference ref(L);
+      lua_pushvalue(L, 3);
+      lua_xmove(L, ref.get(), 1);
+      new_userdata<encrypted_reader_t>(L, "brigid.encrypted_reader", std::move(ref), header, std::move(derived_key), source.size());
+    }
+  }
+
+  writer_t* to_writer_encrypted_writer(lua_State* L, int arg) {
+    return to_udata<encrypted_writer_t>(L, arg, "brigid.encrypted_writer");
+  }
+
+  void initialize_encrypted(lua_State* L) {
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.encrypted_writer");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_writer_gc>())::set_field(L, -1, "__gc");
+      decltype(function<impl_writer_close>())::set_field(L, -1, "__close");
+      lua_pop(L, 1);
+
+      decltype(function<impl_writer_call>())::set_metafield(L, -1, "__call");
+      decltype(function<impl_writer_write>())::set_field(L, -1, "write");
+      decltype(function<impl_writer_close>())::set_field(L, -1, "close");
+      initialize_writer(L);
+    }
+    lua_setfield(L, -2, "encrypted_writer");
+
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.encrypted_reader");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_reader_gc>())::set_field(L, -1, "__gc");
+      decltype(function<impl_reader_close>())::set_field(L, -1, "__close");
+      lua_pop(L, 1);
+
+      decltype(function<impl_reader_call>())::set_metafield(L, -1, "__call");
+      decltype(function<impl_reader_get_size>())::set_field(L, -1, "get_size");
+      decltype(function<impl_reader_read>())::set_field(L, -1, "read");
+      decltype(function<impl_reader_close>())::set_field(L, -1, "close");
+    }
+    lua_setfield(L, -2, "encrypted_reader");
+  }
+}
@@ -2,27 +2,37 @@
 #line 1 "hasher.rl"
 // vim: syntax=ragel:
 
-// Copyright (c) 2022,2024 <dev@brigid.jp>
+// Copyright (c) 2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
 #include "common.hpp"
 #include "crypto.hpp"
 #include "data.hpp"
+#include "error.hpp"
 #include "function.hpp"
+#include "stack_guard.hpp"
+#include "stdio.hpp"
+#include "task.hpp"
+#include "thread_reference.hpp"
+#include "writer.hpp"
 
 #include <lua.hpp>
 
+#include <stddef.h>
+#include <stdio.h>
 #include <exception>
+#include <memory>
+#include <utility>
 
 namespace brigid {
   namespace {
     
-#line 22 "hasher.cxx"
+#line 32 "hasher.cxx"
 static const int hasher_name_chooser_start = 1;
 
 
-#line 30 "hasher.rl"
+#line 48 "hasher.rl"
 
 
 #ifdef __GNUC__
@@ -33,24 +43,28 @@ static const int hasher_name_chooser_start = 1;
     hasher* new_hasher(lua_State* L, const char* name) {
       int cs = 0;
       
-#line 37 "hasher.cxx"
+#line 47 "hasher.cxx"
 	{
 	cs = hasher_name_chooser_start;
 	}
 
-#line 40 "hasher.rl"
+#line 58 "hasher.rl"
       const char* p = name;
       const char* pe = nullptr;
       
-#line 46 "hasher.cxx"
+#line 56 "hasher.cxx"
 	{
 	if ( p == pe )
 		goto _test_eof;
 	switch ( cs )
 	{
 case 1:
-	if ( (*p) == 115 )
-		goto st2;
+	switch( (*p) ) {
+		case 98: goto st2;
+		case 99: goto st8;
+		case 115: goto st14;
+		case 120: goto st24;
+	}
 	goto st0;
 st0:
 cs = 0;
@@ -59,7 +73,7 @@ st2:
 	if ( ++p == pe )
 		goto _test_eof2;
 case 2:
-	if ( (*p) == 104 )
+	if ( (*p) == 108 )
 		goto st3;
 	goto st0;
 st3:
@@ -73,97 +87,291 @@ st4:
 	if ( ++p == pe )
 		goto _test_eof4;
 case 4:
-	switch( (*p) ) {
-		case 49: goto st5;
-		case 50: goto st6;
-		case 53: goto st9;
-	}
+	if ( (*p) == 107 )
+		goto st5;
 	goto st0;
 st5:
 	if ( ++p == pe )
 		goto _test_eof5;
 case 5:
-	if ( (*p) == 0 )
-		goto tr7;
-	goto st0;
-tr7:
-#line 23 "hasher.rl"
-	{ return new_sha1_hasher(L); }
-	goto st12;
-tr10:
-#line 25 "hasher.rl"
-	{ return new_sha256_hasher(L); }
-	goto st12;
-tr13:
-#line 27 "hasher.rl"
-	{ return new_sha512_hasher(L); }
-	goto st12;
-st12:
-	if ( ++p == pe )
-		goto _test_eof12;
-case 12:
-#line 106 "hasher.cxx"
+	if ( (*p) == 101 )
+		goto st6;
 	goto st0;
 st6:
 	if ( ++p == pe )
 		goto _test_eof6;
 case 6:
-	if ( (*p) == 53 )
+	if ( (*p) == 51 )
 		goto st7;
 	goto st0;
 st7:
 	if ( ++p == pe )
 		goto _test_eof7;
 case 7:
-	if ( (*p) == 54 )
-		goto st8;
+	if ( (*p) == 0 )
+		goto tr10;
+	goto st0;
+tr10:
+#line 45 "hasher.rl"
+	{ return new_blake3_hasher(L); }
+	goto st34;
+tr16:
+#line 43 "hasher.rl"
+	{ return new_crc32c_hasher(L); }
+	goto st34;
+tr22:
+#line 33 "hasher.rl"
+	{ return new_sha1_hasher(L); }
+	goto st34;
+tr25:
+#line 35 "hasher.rl"
+	{ return new_sha256_hasher(L); }
+	goto st34;
+tr28:
+#line 37 "hasher.rl"
+	{ return new_sha512_hasher(L); }
+	goto st34;
+tr37:
+#line 41 "hasher.rl"
+	{ return new_xxh3_128_hasher(L); }
+	goto st34;
+tr39:
+#line 39 "hasher.rl"
+	{ return new_xxh3_64_hasher(L); }
+	goto st34;
+st34:
+	if ( ++p == pe )
+		goto _test_eof34;
+case 34:
+#line 147 "hasher.cxx"
 	goto st0;
 st8:
 	if ( ++p == pe )
 		goto _test_eof8;
 case 8:
-	if ( (*p) == 0 )
-		goto tr10;
+	if ( (*p) == 114 )
+		goto st9;
 	goto st0;
 st9:
 	if ( ++p == pe )
 		goto _test_eof9;
 case 9:
-	if ( (*p) == 49 )
+	if ( (*p) == 99 )
 		goto st10;
 	goto st0;
 st10:
 	if ( ++p == pe )
 		goto _test_eof10;
 case 10:
-	if ( (*p) == 50 )
+	if ( (*p) == 51 )
 		goto st11;
 	goto st0;
 st11:
 	if ( ++p == pe )
 		goto _test_eof11;
 case 11:
+	if ( (*p) == 50 )
+		goto st12;
+	goto st0;
+st12:
+	if ( ++p == pe )
+		goto _test_eof12;
+case 12:
+	if ( (*p) == 99 )
+		goto st13;
+	goto st0;
+st13:
+	if ( ++p == pe )
+		goto _test_eof13;
+case 13:
+	if ( (*p) == 0 )
+		goto tr16;
+	goto st0;
+st14:
+	if ( ++p == pe )
+		goto _test_eof14;
+case 14:
+	if ( (*p) == 104 )
+		goto st15;
+	goto st0;
+st15:
+	if ( ++p == pe )
+		goto _test_eof15;
+case 15:
+	if ( (*p) == 97 )
+		goto st16;
+	goto st0;
+st16:
+	if ( ++p == pe )
+		goto _test_eof16;
+case 16:
+	switch( (*p) ) {
+		case 49: goto st17;
+		case 50: goto st18;
+		case 53: goto st21;
+	}
+	goto st0;
+st17:
+	if ( ++p == pe )
+		goto _test_eof17;
+case 17:
+	if ( (*p) == 0 )
+		goto tr22;
+	goto st0;
+st18:
+	if ( ++p == pe )
+		goto _test_eof18;
+case 18:
+	if ( (*p) == 53 )
+		goto st19;
+	goto st0;
+st19:
+	if ( ++p == pe )
+		goto _test_eof19;
+case 19:
+	if ( (*p) == 54 )
+		goto st20;
+	goto st0;
+st20:
+	if ( ++p == pe )
+		goto _test_eof20;
+case 20:
+	if ( (*p) == 0 )
+		goto tr25;
+	goto st0;
+st21:
+	if ( ++p == pe )
+		goto _test_eof21;
+case 21:
+	if ( (*p) == 49 )
+		goto st22;
+	goto st0;
+st22:
+	if ( ++p == pe )
+		goto _test_eof22;
+case 22:
+	if ( (*p) == 50 )
+		goto st23;
+	goto st0;
+st23:
+	if ( ++p == pe )
+		goto _test_eof23;
+case 23:
+	if ( (*p) == 0 )
+		goto tr28;
+	goto st0;
+st24:
+	if ( ++p == pe )
+		goto _test_eof24;
+case 24:
+	if ( (*p) == 120 )
+		goto st25;
+	goto st0;
+st25:
+	if ( ++p == pe )
+		goto _test_eof25;
+case 25:
+	if ( (*p) == 104 )
+		goto st26;
+	goto st0;
+st26:
+	if ( ++p == pe )
+		goto _test_eof26;
+case 26:
+	if ( (*p) == 51 )
+		goto st27;
+	goto st0;
+st27:
+	if ( ++p == pe )
+		goto _test_eof27;
+case 27:
+	if ( (*p) == 95 )
+		goto st28;
+	goto st0;
+st28:
+	if ( ++p == pe )
+		goto _test_eof28;
+case 28:
+	switch( (*p) ) {
+		case 49: goto st29;
+		case 54: goto st32;
+	}
+	goto st0;
+st29:
+	if ( ++p == pe )
+		goto _test_eof29;
+case 29:
+	if ( (*p) == 50 )
+		goto st30;
+	goto st0;
+st30:
+	if ( ++p == pe )
+		goto _test_eof30;
+case 30:
+	if ( (*p) == 56 )
+		goto st31;
+	goto st0;
+st31:
+	if ( ++p == pe )
+		goto _test_eof31;
+case 31:
 	if ( (*p) == 0 )
-		goto tr13;
+		goto tr37;
+	goto st0;
+st32:
+	if ( ++p == pe )
+		goto _test_eof32;
+case 32:
+	if ( (*p) == 52 )
+		goto st33;
+	goto st0;
+st33:
+	if ( ++p == pe )
+		goto _test_eof33;
+case 33:
+	if ( (*p) == 0 )
+		goto tr39;
 	goto st0;
 	}
 	_test_eof2: cs = 2; goto _test_eof; 
 	_test_eof3: cs = 3; goto _test_eof; 
 	_test_eof4: cs = 4; goto _test_eof; 
 	_test_eof5: cs = 5; goto _test_eof; 
-	_test_eof12: cs = 12; goto _test_eof; 
 	_test_eof6: cs = 6; goto _test_eof; 
 	_test_eof7: cs = 7; goto _test_eof; 
+	_test_eof34: cs = 34; goto _test_eof; 
 	_test_eof8: cs = 8; goto _test_eof; 
 	_test_eof9: cs = 9; goto _test_eof; 
 	_test_eof10: cs = 10; goto _test_eof; 
 	_test_eof11: cs = 11; goto _test_eof; 
+	_test_eof12: cs = 12; goto _test_eof; 
+	_test_eof13: cs = 13; goto _test_eof; 
+	_test_eof14: cs = 14; goto _test_eof; 
+	_test_eof15: cs = 15; goto _test_eof; 
+	_test_eof16: cs = 16; goto _test_eof; 
+	_test_eof17: cs = 17; goto _test_eof; 
+	_test_eof18: cs = 18; goto _test_eof; 
+	_test_eof19: cs = 19; goto _test_eof; 
+	_test_eof20: cs = 20; goto _test_eof; 
+	_test_eof21: cs = 21; goto _test_eof; 
+	_test_eof22: cs = 22; goto _test_eof; 
+	_test_eof23: cs = 23; goto _test_eof; 
+	_test_eof24: cs = 24; goto _test_eof; 
+	_test_eof25: cs = 25; goto _test_eof; 
+	_test_eof26: cs = 26; goto _test_eof; 
+	_test_eof27: cs = 27; goto _test_eof; 
+	_test_eof28: cs = 28; goto _test_eof; 
+	_test_eof29: cs = 29; goto _test_eof; 
+	_test_eof30: cs = 30; goto _test_eof; 
+	_test_eof31: cs = 31; goto _test_eof; 
+	_test_eof32: cs = 32; goto _test_eof; 
+	_test_eof33: cs = 33; goto _test_eof; 
 
 	_test_eof: {}
 	_out: {}
 	}
 
-#line 43 "hasher.rl"
+#line 61 "hasher.rl"
       return nullptr;
     }
 
@@ -171,12 +379,18 @@ case 11:
 #pragma GCC diagnostic pop
 #endif
 
-    hasher* check_hasher(lua_State* L, int arg) {
-      return check_udata<hasher>(L, arg, "brigid.hasher");
+    hasher* check_hasher(lua_State* L, int arg, int validate = check_validate_all) {
+      hasher* self = check_udata<hasher>(L, arg, "brigid.hasher");
+      if (validate & check_validate_not_running) {
+        if (self->running()) {
+          luaL_argerror(L, arg, "attempt to use a running brigid.hasher");
+        }
+      }
+      return self;
     }
 
     void impl_gc(lua_State* L) {
-      hasher* self = check_hasher(L, 1);
+      hasher* self = check_hasher(L, 1, check_validate_none);
       self->~hasher();
     }
 
@@ -193,10 +407,140 @@ case 11:
       self->update(source.data(), source.size());
     }
 
+    void impl_update_async(lua_State* L) {
+      hasher* self = check_hasher(L, 1);
+      thread_reference ref(L);
+      lua_pushvalue(L, 1);
+      lua_xmove(L, ref.get(), 1);
+      data_t source = pin_data(L, 2, ref);
+      self->update_async(L, source.data(), source.size(), std::move(ref));
+    }
+
     void impl_digest(lua_State* L) {
       hasher* self = check_hasher(L, 1);
       self->digest(L);
     }
+
+    void impl_reset(lua_State* L) {
+      hasher* self = check_hasher(L, 1);
+      self->reset();
+    }
+
+    void impl_clone(lua_State* L) {
+      hasher* self = check_hasher(L, 1);
+      self->clone(L);
+    }
+
+    char hash_cache_key;
+
+    // One hasher per name is cached in the registry of the Lua state and
+    // reset before reuse, so that no context is created for short inputs.
+    hasher* get_cached_hasher(lua_State* L, const char* name) {
+      stack_guard guard(L);
+
+      lua_pushlightuserdata(L, &hash_cache_key);
+      lua_rawget(L, LUA_REGISTRYINDEX);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushlightuserdata(L, &hash_cache_key);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+      }
+
+      lua_getfield(L, -1, name);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        hasher* self = new_hasher(L, name);
+        if (self) {
+          lua_setfield(L, -2, name);
+        }
+        return self;
+      }
+
+      hasher* self = check_hasher(L, -1);
+      self->reset();
+      return self;
+    }
+
+    void impl_hash(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      data_t source = check_data(L, 2);
+      hasher* self = get_cached_hasher(L, name);
+      if (!self) {
+        luaL_argerror(L, 1, "unsupported hash");
+      }
+      self->update(source.data(), source.size());
+      self->digest(L);
+    }
+
+    // A batching helper: the blobs are hashed one after another with the
+    // cached hasher of brigid.hash, so that a batch costs one Lua call and
+    // no userdata per blob. The blobs are not hashed in parallel lanes; the
+    // platform library hashes each one, with the SHA instructions of the CPU
+    // where it has them.
+    void impl_hash_many(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      luaL_checktype(L, 2, LUA_TTABLE);
+      hasher* self = get_cached_hasher(L, name);
+      if (!self) {
+        luaL_argerror(L, 1, "unsupported hash");
+      }
+
+      lua_newtable(L);
+      int result = lua_gettop(L);
+      for (int i = 1; ; ++i) {
+        lua_rawgeti(L, 2, i);
+        if (lua_isnil(L, -1)) {
+          lua_pop(L, 1);
+          break;
+        }
+        data_t source = to_data(L, lua_gettop(L));
+        if (!source.data()) {
+          luaL_argerror(L, 2, "array of data expected");
+        }
+        if (i > 1) {
+          self->reset();
+        }
+        self->update(source.data(), source.size());
+        self->digest(L);
+        lua_rawseti(L, result, i);
+        lua_pop(L, 1);
+      }
+    }
+
+    // Large reads let a tree hash such as blake3 spread a read over the
+    // worker pool.
+    const size_t hash_file_buffer_size = 4 * 1024 * 1024;
+
+    void impl_hash_file(lua_State* L) {
+      const char* path = luaL_checkstring(L, 1);
+      const char* name = luaL_checkstring(L, 2);
+      hasher* self = get_cached_hasher(L, name);
+      if (!self) {
+        luaL_argerror(L, 2, "unsupported hash");
+      }
+
+      file_handle_t handle = open_file_handle(path, "rb");
+      std::unique_ptr<char[]> buffer(new char[hash_file_buffer_size]);
+      while (true) {
+        size_t size = fread(buffer.get(), 1, hash_file_buffer_size, handle.get());
+        if (size > 0) {
+          self->update(buffer.get(), size);
+        }
+        if (size < hash_file_buffer_size) {
+          if (ferror(handle.get())) {
+            throw BRIGID_SYSTEM_ERROR();
+          }
+          break;
+        }
+      }
+      self->digest(L);
+    }
+  }
+
+  writer_t* to_writer_hasher(lua_State* L, int arg) {
+    return to_udata<hasher>(L, arg, "brigid.hasher");
   }
 
   void initialize_hasher(lua_State* L) {
@@ -217,8 +561,16 @@ case 11:
 
       decltype(function<impl_call>())::set_metafield(L, -1, "__call");
       decltype(function<impl_update>())::set_field(L, -1, "update");
+      decltype(function<impl_update_async>())::set_field(L, -1, "update_async");
       decltype(function<impl_digest>())::set_field(L, -1, "digest");
+      decltype(function<impl_reset>())::set_field(L, -1, "reset");
+      decltype(function<impl_clone>())::set_field(L, -1, "clone");
+      initialize_writer(L);
     }
     lua_setfield(L, -2, "hasher");
+
+    decltype(function<impl_hash>())::set_field(L, -1, "hash");
+    decltype(function<impl_hash_many>())::set_field(L, -1, "hash_many");
+    decltype(function<impl_hash_file>())::set_field(L, -1, "hash_file");
   }
 }
@@ -1,17 +1,27 @@
 // vim: syntax=ragel:
 
-// Copyright (c) 2022,2024 <dev@brigid.jp>
+// Copyright (c) 2022,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
 #include "common.hpp"
 #include "crypto.hpp"
 #include "data.hpp"
+#include "error.hpp"
 #include "function.hpp"
+#include "stack_guard.hpp"
+#include "stdio.hpp"
+#include "task.hpp"
+#include "thread_reference.hpp"
+#include "writer.hpp"
 
 #include <lua.hpp>
 
+#include <stddef.h>
+#include <stdio.h>
 #include <exception>
+#include <memory>
+#include <utility>
 
 namespace brigid {
   namespace {
@@ -25,6 +35,14 @@ namespace brigid {
           @{ return new_sha256_hasher(L); }
         | "sha512\0"
           @{ return new_sha512_hasher(L); }
+        | "xxh3_64\0"
+          @{ return new_xxh3_64_hasher(L); }
+        | "xxh3_128\0"
+          @{ return new_xxh3_128_hasher(L); }
+        | "crc32c\0"
+          @{ return new_crc32c_hasher(L); }
+        | "blake3\0"
+          @{ return new_blake3_hasher(L); }
         );
       write data noerror nofinal noentry;
     }%%
@@ -47,12 +65,18 @@ namespace brigid {
 #pragma GCC diagnostic pop
 #endif
 
-    hasher* check_hasher(lua_State* L, int arg) {
-      return check_udata<hasher>(L, arg, "brigid.hasher");
+    hasher* check_hasher(lua_State* L, int arg, int validate = check_validate_all) {
+      hasher* self = check_udata<hasher>(L, arg, "brigid.hasher");
+      if (validate & check_validate_not_running) {
+        if (self->running()) {
+          luaL_argerror(L, arg, "attempt to use a running brigid.hasher");
+        }
+      }
+      return self;
     }
 
     void impl_gc(lua_State* L) {
-      hasher* self = check_hasher(L, 1);
+      hasher* self = check_hasher(L, 1, check_validate_none);
       self->~hasher();
     }
 
@@ -69,10 +93,140 @@ namespace brigid {
       self->update(source.data(), source.size());
     }
 
+    void impl_update_async(lua_State* L) {
+      hasher* self = check_hasher(L, 1);
+      thread_reference ref(L);
+      lua_pushvalue(L, 1);
+      lua_xmove(L, ref.get(), 1);
+      data_t source = pin_data(L, 2, ref);
+      self->update_async(L, source.data(), source.size(), std::move(ref));
+    }
+
     void impl_digest(lua_State* L) {
       hasher* self = check_hasher(L, 1);
       self->digest(L);
     }
+
+    void impl_reset(lua_State* L) {
+      hasher* self = check_hasher(L, 1);
+      self->reset();
+    }
+
+    void impl_clone(lua_State* L) {
+      hasher* self = check_hasher(L, 1);
+      self->clone(L);
+    }
+
+    char hash_cache_key;
+
+    // One hasher per name is cached in the registry of the Lua state and
+    // reset before reuse, so that no context is created for short inputs.
+    hasher* get_cached_hasher(lua_State* L, const char* name) {
+      stack_guard guard(L);
+
+      lua_pushlightuserdata(L, &hash_cache_key);
+      lua_rawget(L, LUA_REGISTRYINDEX);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushlightuserdata(L, &hash_cache_key);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+      }
+
+      lua_getfield(L, -1, name);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        hasher* self = new_hasher(L, name);
+        if (self) {
+          lua_setfield(L, -2, name);
+        }
+        return self;
+      }
+
+      hasher* self = check_hasher(L, -1);
+      self->reset();
+      return self;
+    }
+
+    void impl_hash(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      data_t source = check_data(L, 2);
+      hasher* self = get_cached_hasher(L, name);
+      if (!self) {
+        luaL_argerror(L, 1, "unsupported hash");
+      }
+      self->update(source.data(), source.size());
+      self->digest(L);
+    }
+
+    // A batching helper: the blobs are hashed one after another with the
+    // cached hasher of brigid.hash, so that a batch costs one Lua call and
+    // no userdata per blob. The blobs are not hashed in parallel lanes; the
+    // platform library hashes each one, with the SHA instructions of the CPU
+    // where it has them.
+    void impl_hash_many(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      luaL_checktype(L, 2, LUA_TTABLE);
+      hasher* self = get_cached_hasher(L, name);
+      if (!self) {
+        luaL_argerror(L, 1, "unsupported hash");
+      }
+
+      lua_newtable(L);
+      int result = lua_gettop(L);
+      for (int i = 1; ; ++i) {
+        lua_rawgeti(L, 2, i);
+        if (lua_isnil(L, -1)) {
+          lua_pop(L, 1);
+          break;
+        }
+        data_t source = to_data(L, lua_gettop(L));
+        if (!source.data()) {
+          luaL_argerror(L, 2, "array of data expected");
+        }
+        if (i > 1) {
+          self->reset();
+        }
+        self->update(source.data(), source.size());
+        self->digest(L);
+        lua_rawseti(L, result, i);
+        lua_pop(L, 1);
+      }
+    }
+
+    // Large reads let a tree hash such as blake3 spread a read over the
+    // worker pool.
+    const size_t hash_file_buffer_size = 4 * 1024 * 1024;
+
+    void impl_hash_file(lua_State* L) {
+      const char* path = luaL_checkstring(L, 1);
+      const char* name = luaL_checkstring(L, 2);
+      hasher* self = get_cached_hasher(L, name);
+      if (!self) {
+        luaL_argerror(L, 2, "unsupported hash");
+      }
+
+      file_handle_t handle = open_file_handle(path, "rb");
+      std::unique_ptr<char[]> buffer(new char[hash_file_buffer_size]);
+      while (true) {
+        size_t size = fread(buffer.get(), 1, hash_file_buffer_size, handle.get());
+        if (size > 0) {
+          self->update(buffer.get(), size);
+        }
+        if (size < hash_file_buffer_size) {
+          if (ferror(handle.get())) {
+            throw BRIGID_SYSTEM_ERROR();
+          }
+          break;
+        }
+      }
+      self->digest(L);
+    }
+  }
+
+  writer_t* to_writer_hasher(lua_State* L, int arg) {
+    return to_udata<hasher>(L, arg, "brigid.hasher");
   }
 
   void initialize_hasher(lua_State* L) {
@@ -93,8 +247,16 @@ namespace brigid {
 
       decltype(function<impl_call>())::set_metafield(L, -1, "__call");
       decltype(function<impl_update>())::set_field(L, -1, "update");
+      decltype(function<impl_update_async>())::set_field(L, -1, "update_async");
       decltype(function<impl_digest>())::set_field(L, -1, "digest");
+      decltype(function<impl_reset>())::set_field(L, -1, "reset");
+      decltype(function<impl_clone>())::set_field(L, -1, "clone");
+      initialize_writer(L);
     }
     lua_setfield(L, -2, "hasher");
+
+    decltype(function<impl_hash>())::set_field(L, -1, "hash");
+    decltype(function<impl_hash_many>())::set_field(L, -1, "hash_many");
+    decltype(function<impl_hash_file>())::set_field(L, -1, "hash_file");
   }
 }
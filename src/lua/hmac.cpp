@@ -0,0 +1,184 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "crypto.hpp"
+#include "data.hpp"
+#include "function.hpp"
+#include "stack_guard.hpp"
+#include "task.hpp"
+#include "thread_reference.hpp"
+
+#include <lua.hpp>
+
+#include <exception>
+#include <utility>
+
+namespace brigid {
+  namespace {
+    hasher* check_hmac(lua_State* L, int arg, int validate = check_validate_all) {
+      hasher* self = check_udata<hasher>(L, arg, "brigid.hmac");
+      if (validate & check_validate_not_running) {
+        if (self->running()) {
+          luaL_argerror(L, arg, "attempt to use a running brigid.hmac");
+        }
+      }
+      return self;
+    }
+
+    void impl_gc(lua_State* L) {
+      hasher* self = check_hmac(L, 1, check_validate_none);
+      self->~hasher();
+    }
+
+    void impl_call(lua_State* L) {
+      const char* name = luaL_checkstring(L, 2);
+      data_t key = check_data(L, 3);
+      if (!new_hmac(L, name, key.data(), key.size())) {
+        luaL_argerror(L, 2, "unsupported hash");
+      }
+    }
+
+    void impl_update(lua_State* L) {
+      hasher* self = check_hmac(L, 1);
+      data_t source = check_data(L, 2);
+      self->update(source.data(), source.size());
+    }
+
+    void impl_update_async(lua_State* L) {
+      hasher* self = check_hmac(L, 1);
+      thread_reference ref(L);
+      lua_pushvalue(L, 1);
+      lua_xmove(L, ref.get(), 1);
+      data_t source = pin_data(L, 2, ref);
+      self->update_async(L, source.data(), source.size(), std::move(ref));
+    }
+
+    void impl_digest(lua_State* L) {
+      hasher* self = check_hmac(L, 1);
+      self->digest(L);
+    }
+
+    void impl_reset(lua_State* L) {
+      hasher* self = check_hmac(L, 1);
+      self->reset();
+    }
+
+    void impl_clone(lua_State* L) {
+      hasher* self = check_hmac(L, 1);
+      self->clone(L);
+    }
+
+    char hmac_cache_key;
+
+    // Compares in a time that does not depend on where the digests differ.
+    bool equal_digest(lua_State* L, int index1, int index2) {
+      size_t size1 = 0;
+      size_t size2 = 0;
+      const char* data1 = lua_tolstring(L, index1, &size1);
+      const char* data2 = lua_tolstring(L, index2, &size2);
+      if (!data1 || !data2 || size1 != size2) {
+        return false;
+      }
+      unsigned char result = 0;
+      for (size_t i = 0; i < size1; ++i) {
+        result |= data1[i] ^ data2[i];
+      }
+      return result == 0;
+    }
+
+    // One hmac per name is cached in the registry of the Lua state with the
+    // SHA-256 digest of its key, so that the key itself is not kept. A
+    // signature with the same key resets the keyed contexts instead of
+    // creating them again.
+    hasher* get_cached_hmac(lua_State* L, const char* name, const data_t& key) {
+      stack_guard guard(L);
+
+      lua_pushlightuserdata(L, &hmac_cache_key);
+      lua_rawget(L, LUA_REGISTRYINDEX);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushlightuserdata(L, &hmac_cache_key);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+      }
+      int cache = lua_gettop(L);
+
+      lua_rawgeti(L, cache, 0);
+      hasher* key_hasher = to_udata<hasher>(L, -1, "brigid.hasher");
+      if (!key_hasher) {
+        key_hasher = new_sha256_hasher(L);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, cache, 0);
+      }
+      key_hasher->reset();
+      key_hasher->update(key.data(), key.size());
+      key_hasher->digest(L);
+      int key_digest = lua_gettop(L);
+
+      if (get_field(L, cache, name) == LUA_TTABLE) {
+        int entry = lua_gettop(L);
+        lua_rawgeti(L, entry, 1);
+        if (equal_digest(L, -1, key_digest)) {
+          lua_rawgeti(L, entry, 2);
+          hasher* self = check_hmac(L, -1);
+          self->reset();
+          return self;
+        }
+      }
+      lua_settop(L, key_digest);
+
+      lua_createtable(L, 2, 0);
+      hasher* self = new_hmac(L, name, key.data(), key.size());
+      if (self) {
+        lua_rawseti(L, -2, 2);
+        lua_pushvalue(L, key_digest);
+        lua_rawseti(L, -2, 1);
+        lua_setfield(L, cache, name);
+      }
+      return self;
+    }
+
+    void impl_hmac_digest(lua_State* L) {
+      const char* name = luaL_checkstring(L, 1);
+      data_t key = check_data(L, 2);
+      data_t source = check_data(L, 3);
+      hasher* self = get_cached_hmac(L, name, key);
+      if (!self) {
+        luaL_argerror(L, 1, "unsupported hash");
+      }
+      self->update(source.data(), source.size());
+      self->digest(L);
+    }
+  }
+
+  void initialize_hmac(lua_State* L) {
+    try {
+      open_hasher();
+    } catch (const std::exception& e) {
+      luaL_error(L, "%s", e.what());
+      return;
+    }
+
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.hmac");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_gc>())::set_field(L, -1, "__gc");
+      lua_pop(L, 1);
+
+      decltype(function<impl_call>())::set_metafield(L, -1, "__call");
+      decltype(function<impl_update>())::set_field(L, -1, "update");
+      decltype(function<impl_update_async>())::set_field(L, -1, "update_async");
+      decltype(function<impl_digest>())::set_field(L, -1, "digest");
+      decltype(function<impl_reset>())::set_field(L, -1, "reset");
+      decltype(function<impl_clone>())::set_field(L, -1, "clone");
+    }
+    lua_setfield(L, -2, "hmac");
+
+    decltype(function<impl_hmac_digest>())::set_field(L, -1, "hmac_digest");
+  }
+}
@@ -1,4 +1,4 @@
-// Copyright (c) 2019-2021,2024 <dev@brigid.jp>
+// Copyright (c) 2019-2021,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -12,15 +12,20 @@
 #include "stack_guard.hpp"
 #include "thread_reference.hpp"
 #include "view.hpp"
+#include "writer.hpp"
 
 #include <lua.hpp>
 
 #include <stddef.h>
+#include <algorithm>
+#include <exception>
 #include <functional>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace brigid {
   using namespace std::placeholders;
@@ -35,29 +40,77 @@ namespace brigid {
           int write_cb,
           bool credential,
           const std::string& username,
-          const std::string& password)
+          const std::string& password,
+          bool share)
         : session_(make_http_session(
             std::bind(&http_session_t::progress_cb, this, _1, _2),
             std::bind(&http_session_t::header_cb, this, _1, _2),
             std::bind(&http_session_t::write_cb, this, _1, _2),
             credential,
             username,
-            password)),
+            password,
+            share)),
           ref_(std::move(ref)),
           progress_cb_(progress_cb),
           header_cb_(header_cb),
           write_cb_(write_cb),
-          running_() {}
+          running_(),
+          requesting_(),
+          sink_() {}
+
+      ~http_session_t() {
+        if (requesting_) {
+          cancel();
+        }
+      }
 
       bool request(
           const std::string& method,
           const std::string& url,
           const std::map<std::string, std::string>& header,
           http_request_body body,
-          const char* data, size_t size) {
+          const char* data, size_t size,
+          writer_t* sink) {
+        sink_ = sink;
+        scope_exit scope_guard([&]() {
+          sink_ = nullptr;
+        });
         return session_->request(method, url, header, body, data, size);
       }
 
+      // The session is running until the completion is called. The request
+      // keeps the session on its reference, so the session is destroyed
+      // before then only when the Lua state is closed, which removes its
+      // request from the multi without calling the completion.
+      void request(
+          const std::shared_ptr<http_multi>& multi,
+          const std::string& method,
+          const std::string& url,
+          const std::map<std::string, std::string>& header,
+          http_request_body body,
+          const char* data, size_t size,
+          writer_t* sink,
+          std::function<void (bool, std::exception_ptr)> completion) {
+        multi->request(*session_, method, url, header, body, data, size, [this, completion](bool result, std::exception_ptr error) {
+          multi_.reset();
+          requesting_ = false;
+          sink_ = nullptr;
+          completion(result, error);
+        });
+        multi_ = multi;
+        requesting_ = true;
+        sink_ = sink;
+      }
+
+      void cancel() {
+        if (std::shared_ptr<http_multi> multi = multi_.lock()) {
+          multi->cancel(*session_);
+        }
+        multi_.reset();
+        requesting_ = false;
+        sink_ = nullptr;
+      }
+
       void close() {
         session_ = nullptr;
         ref_ = thread_reference();
@@ -68,7 +121,11 @@ namespace brigid {
       }
 
       bool running() const {
-        return running_;
+        return running_ || requesting_;
+      }
+
+      http_timing timing() const {
+        return session_->timing();
       }
 
     private:
@@ -78,6 +135,9 @@ namespace brigid {
       int header_cb_;
       int write_cb_;
       bool running_;
+      bool requesting_;
+      std::weak_ptr<http_multi> multi_;
+      writer_t* sink_;
 
       bool progress_cb(size_t now, size_t total) {
         if (progress_cb_) {
@@ -128,7 +188,19 @@ namespace brigid {
         return true;
       }
 
+      // The body is written to the sink of the request, then passed to the
+      // write callback.
       bool write_cb(const char* data, size_t size) {
+        if (writer_t* sink = sink_) {
+          if (sink->closed()) {
+            throw BRIGID_LOGIC_ERROR("attempt to use a closed brigid.writer");
+          }
+          running_ = true;
+          scope_exit scope_guard([&]() {
+            running_ = false;
+          });
+          sink->write(data, size);
+        }
         if (write_cb_) {
           if (lua_State* L = ref_.get()) {
             stack_guard guard(L);
@@ -188,6 +260,7 @@ namespace brigid {
       int credential = 0;
       std::string username;
       std::string password;
+      bool share = false;
 
       if (get_field(L, 2, "progress") != LUA_TNIL) {
         if (!ref) {
@@ -237,6 +310,10 @@ namespace brigid {
       }
       lua_pop(L, 1);
 
+      get_field(L, 2, "share");
+      share = lua_toboolean(L, -1);
+      lua_pop(L, 1);
+
       new_userdata<http_session_t>(L, "brigid.http_session",
           std::move(ref),
           progress_cb,
@@ -244,36 +321,48 @@ namespace brigid {
           write_cb,
           credential == 2,
           username,
-          password);
+          password,
+          share);
     }
 
-    void impl_request(lua_State* L) {
-      http_session_t* self = check_http_session(L, 1);
-      luaL_checktype(L, 2, LUA_TTABLE);
-
-      std::string method = "GET";
+    struct http_request_t {
+      std::string method;
       std::string url;
       std::map<std::string, std::string> header;
-      http_request_body body = http_request_body::none;
+      http_request_body body;
       data_t data;
+      writer_t* sink;
+      bool timing;
+    };
+
+    // Pushes the data, the file and the sink of the request table, which must
+    // be kept on the stack until the request is done.
+    http_request_t check_request(lua_State* L, int arg) {
+      luaL_checktype(L, arg, LUA_TTABLE);
+
+      http_request_t request = { "GET", std::string(), std::map<std::string, std::string>(), http_request_body::none, data_t(), nullptr, false };
 
-      if (get_field(L, 2, "method") != LUA_TNIL) {
+      if (get_field(L, arg, "method") != LUA_TNIL) {
         size_t size = 0;
         if (const char* data = lua_tolstring(L, -1, &size)) {
-          method.assign(data, size);
+          request.method.assign(data, size);
         }
       }
       lua_pop(L, 1);
 
-      if (get_field(L, 2, "url") != LUA_TNIL) {
+      if (get_field(L, arg, "url") != LUA_TNIL) {
         size_t size = 0;
         if (const char* data = lua_tolstring(L, -1, &size)) {
-          url.assign(data, size);
+          request.url.assign(data, size);
         }
       }
       lua_pop(L, 1);
 
-      if (get_field(L, 2, "header") == LUA_TTABLE) {
+      get_field(L, arg, "timing");
+      request.timing = lua_toboolean(L, -1);
+      lua_pop(L, 1);
+
+      if (get_field(L, arg, "header") == LUA_TTABLE) {
         int index = abs_index(L, -1);
         lua_pushnil(L);
         while (lua_next(L, index)) {
@@ -282,7 +371,7 @@ namespace brigid {
           if (const char* name_data = lua_tolstring(L, -1, &name_size)) {
             size_t value_size = 0;
             if (const char* value_data = lua_tolstring(L, -2, &value_size)) {
-              header.emplace(std::string(name_data, name_size), std::string(value_data, value_size));
+              request.header.emplace(std::string(name_data, name_size), std::string(value_data, value_size));
             }
           }
           lua_pop(L, 2);
@@ -290,27 +379,467 @@ namespace brigid {
       }
       lua_pop(L, 1);
 
-      if (get_field(L, 2, "data") != LUA_TNIL) {
-        body = http_request_body::data;
-        data = to_data(L, -1);
+      if (get_field(L, arg, "data") != LUA_TNIL) {
+        request.body = http_request_body::data;
+        request.data = to_data(L, -1);
+      }
+      if (get_field(L, arg, "file") != LUA_TNIL) {
+        request.body = http_request_body::file;
+        request.data = to_data(L, -1);
       }
-      if (get_field(L, 2, "file") != LUA_TNIL) {
-        body = http_request_body::file;
-        data = to_data(L, -1);
+      if (get_field(L, arg, "sink") != LUA_TNIL) {
+        request.sink = to_writer(L, -1);
+        if (!request.sink) {
+          luaL_argerror(L, arg, "sink must be a brigid.writer");
+        }
+        if (request.sink->closed()) {
+          luaL_argerror(L, arg, "attempt to use a closed brigid.writer");
+        }
       }
 
-      bool result = self->request(method, url, header, body, data.data(), data.size());
-      lua_pop(L, 2);
+      return request;
+    }
+
+    void push_timing(lua_State* L, const http_timing& timing) {
+      lua_newtable(L);
+      push_integer(L, timing.namelookup_time);
+      lua_setfield(L, -2, "namelookup_time");
+      push_integer(L, timing.connect_time);
+      lua_setfield(L, -2, "connect_time");
+      push_integer(L, timing.appconnect_time);
+      lua_setfield(L, -2, "appconnect_time");
+      push_integer(L, timing.starttransfer_time);
+      lua_setfield(L, -2, "starttransfer_time");
+      push_integer(L, timing.total_time);
+      lua_setfield(L, -2, "total_time");
+      push_integer(L, timing.size_upload);
+      lua_setfield(L, -2, "size_upload");
+      push_integer(L, timing.size_download);
+      lua_setfield(L, -2, "size_download");
+      push_integer(L, timing.redirect_count);
+      lua_setfield(L, -2, "redirect_count");
+      lua_pushboolean(L, timing.reused);
+      lua_setfield(L, -2, "reused");
+    }
+
+    // If the request has the timing option, the timing table is returned
+    // after the session.
+    void impl_request(lua_State* L) {
+      http_session_t* self = check_http_session(L, 1);
+      http_request_t request = check_request(L, 2);
+
+      bool result = self->request(request.method, request.url, request.header, request.body, request.data.data(), request.data.size(), request.sink);
+      lua_pop(L, 3);
 
       if (!result) {
         lua_pushnil(L);
         lua_pushstring(L, "canceled");
+      } else if (request.timing) {
+        lua_pushvalue(L, 1);
+        push_timing(L, self->timing());
+      }
+    }
+
+    // The result of a request is true, or false and an error message.
+    std::pair<bool, std::string> to_result(bool result, std::exception_ptr error) {
+      if (error) {
+        try {
+          std::rethrow_exception(error);
+        } catch (const std::exception& e) {
+          return std::make_pair(false, std::string(e.what()));
+        } catch (...) {
+          return std::make_pair(false, std::string("unknown error"));
+        }
+      }
+      if (result) {
+        return std::make_pair(true, std::string());
+      }
+      return std::make_pair(false, std::string("canceled"));
+    }
+
+    // brigid.http_multi(requests [, options]) runs the requests concurrently
+    // on this thread. Each request is a table for http_session:request with
+    // its session in the session field. The result of each request is true,
+    // its timing table if the request has the timing option, or an error
+    // message. At most options.max_concurrency requests are run at once.
+    void impl_http_multi(lua_State* L) {
+      int top = lua_gettop(L);
+      luaL_checktype(L, 1, LUA_TTABLE);
+
+      size_t max_concurrency = 0;
+      if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        if (get_field(L, 2, "max_concurrency") != LUA_TNIL) {
+          max_concurrency = check_integer<size_t>(L, -1);
+          if (max_concurrency < 1) {
+            luaL_argerror(L, 2, "invalid max_concurrency");
+          }
+        }
+        lua_pop(L, 1);
+      }
+
+      std::vector<http_session_t*> sessions;
+      std::vector<http_request_t> requests;
+      std::set<http_session_t*> unique_sessions;
+      for (int i = 1; ; ++i) {
+        lua_rawgeti(L, 1, i);
+        if (lua_isnil(L, -1)) {
+          lua_pop(L, 1);
+          break;
+        }
+        if (!lua_istable(L, -1)) {
+          luaL_argerror(L, 1, "array of request tables expected");
+        }
+        int index = lua_gettop(L);
+        luaL_checkstack(L, 4, nullptr);
+        get_field(L, index, "session");
+        http_session_t* session = check_http_session(L, -1);
+        if (!unique_sessions.insert(session).second) {
+          luaL_argerror(L, 1, "duplicate brigid.http_session");
+        }
+        sessions.push_back(session);
+        lua_pop(L, 1);
+        // The request table and its data are kept on the stack.
+        requests.push_back(check_request(L, index));
+      }
+
+      size_t size = requests.size();
+      if (max_concurrency == 0) {
+        max_concurrency = std::max<size_t>(size, 1);
+      }
+
+      std::vector<std::pair<bool, std::string> > results(size);
+      std::vector<http_timing> timings(size);
+      std::shared_ptr<http_multi> multi = make_http_multi();
+      scope_exit scope_guard([&]() {
+        for (http_session_t* session : sessions) {
+          session->cancel();
+        }
+      });
+
+      size_t next = 0;
+      size_t running = 0;
+      while (true) {
+        for (; next < size && running < max_concurrency; ++next) {
+          const http_request_t& request = requests[next];
+          size_t i = next;
+          sessions[i]->request(multi, request.method, request.url, request.header, request.body, request.data.data(), request.data.size(), request.sink, [&, i](bool result, std::exception_ptr error) {
+            --running;
+            results[i] = to_result(result, error);
+            timings[i] = sessions[i]->timing();
+          });
+          ++running;
+        }
+        if (running == 0) {
+          break;
+        }
+        multi->perform(1000);
+      }
+
+      lua_createtable(L, static_cast<int>(size), 0);
+      for (size_t i = 0; i < size; ++i) {
+        if (results[i].first) {
+          if (requests[i].timing) {
+            push_timing(L, timings[i]);
+          } else {
+            lua_pushboolean(L, true);
+          }
+        } else {
+          lua_pushlstring(L, results[i].second.data(), results[i].second.size());
+        }
+        lua_rawseti(L, -2, static_cast<int>(i + 1));
+      }
+      if (lua_gettop(L) > top + 1) {
+        lua_replace(L, top + 1);
+        lua_settop(L, top + 1);
+      }
+    }
+
+    int resume(lua_State* L, lua_State* from, int narg) {
+#if LUA_VERSION_NUM >= 504
+      int nresults = 0;
+      int result = lua_resume(L, from, narg, &nresults);
+      if (result == LUA_YIELD) {
+        lua_pop(L, nresults);
+      }
+      return result;
+#elif LUA_VERSION_NUM >= 502
+      int result = lua_resume(L, from, narg);
+      if (result == LUA_YIELD) {
+        lua_settop(L, 0);
+      }
+      return result;
+#else
+      (void) from;
+      int result = lua_resume(L, narg);
+      if (result == LUA_YIELD) {
+        lua_settop(L, 0);
+      }
+      return result;
+#endif
+    }
+
+    // A request started by http_session:request_async. The request keeps
+    // itself, its session, its data and its sink on the reference until it is
+    // done. A coroutine waiting for the request is resumed by brigid.http_poll.
+    class http_request_async_t : private noncopyable {
+    public:
+      explicit http_request_async_t(bool timing)
+        : done_(),
+          timing_(timing),
+          timing_value_(),
+          waiting_(),
+          waiting_ref_(LUA_NOREF) {}
+
+      ~http_request_async_t() {
+        if (waiting_) {
+          luaL_unref(waiting_, LUA_REGISTRYINDEX, waiting_ref_);
+        }
+      }
+
+      void set_reference(thread_reference&& ref) {
+        ref_ = std::move(ref);
+      }
+
+      void complete(bool result, std::exception_ptr error, const http_timing& timing) {
+        result_ = to_result(result, error);
+        timing_value_ = timing;
+        done_ = true;
       }
+
+      bool done() const {
+        return done_;
+      }
+
+      int push_result(lua_State* L) const {
+        if (result_.first) {
+          lua_pushboolean(L, true);
+          if (timing_) {
+            push_timing(L, timing_value_);
+            return 2;
+          }
+          return 1;
+        } else {
+          lua_pushnil(L);
+          lua_pushlstring(L, result_.second.data(), result_.second.size());
+          return 2;
+        }
+      }
+
+      bool waiting() const {
+        return waiting_;
+      }
+
+      // Pops the running coroutine.
+      void wait(lua_State* L) {
+        waiting_ref_ = luaL_ref(L, LUA_REGISTRYINDEX);
+        waiting_ = L;
+      }
+
+      // Resumes the waiting coroutine and releases the reference, after which
+      // the request may be collected. An error of the coroutine is kept in
+      // the message.
+      void finish(lua_State* L, std::string& message) {
+        if (lua_State* thread = waiting_) {
+          if (lua_status(thread) == LUA_YIELD) {
+            int result = resume(thread, L, push_result(thread));
+            if (result != 0 && result != LUA_YIELD) {
+              if (message.empty()) {
+                if (const char* error = lua_tostring(thread, -1)) {
+                  message = error;
+                } else {
+                  message = "error in coroutine";
+                }
+              }
+              lua_pop(thread, 1);
+            }
+          }
+          luaL_unref(L, LUA_REGISTRYINDEX, waiting_ref_);
+          waiting_ = nullptr;
+          waiting_ref_ = LUA_NOREF;
+        }
+        ref_ = thread_reference();
+      }
+
+    private:
+      thread_reference ref_;
+      bool done_;
+      bool timing_;
+      http_timing timing_value_;
+      std::pair<bool, std::string> result_;
+      lua_State* waiting_;
+      int waiting_ref_;
+    };
+
+    // One multi per Lua state drives the requests started by
+    // http_session:request_async. The requests not completed yet are counted
+    // by the multi, from which a canceled request is removed.
+    class http_async_t : private noncopyable {
+    public:
+      http_async_t()
+        : multi_(make_http_multi()) {}
+
+      const std::shared_ptr<http_multi>& multi() const {
+        return multi_;
+      }
+
+      void complete(http_request_async_t* request) {
+        completed_.push_back(request);
+      }
+
+      size_t running() const {
+        return multi_->size();
+      }
+
+      void poll(lua_State* L, int timeout) {
+        multi_->perform(timeout);
+        std::vector<http_request_async_t*> completed;
+        completed.swap(completed_);
+        std::string message;
+        for (http_request_async_t* request : completed) {
+          request->finish(L, message);
+        }
+        if (!message.empty()) {
+          throw BRIGID_RUNTIME_ERROR(message);
+        }
+      }
+
+    private:
+      std::shared_ptr<http_multi> multi_;
+      std::vector<http_request_async_t*> completed_;
+    };
+
+    char http_async_key;
+
+    http_async_t* get_http_async(lua_State* L) {
+      stack_guard guard(L);
+      lua_pushlightuserdata(L, &http_async_key);
+      lua_rawget(L, LUA_REGISTRYINDEX);
+      if (http_async_t* self = to_udata<http_async_t>(L, -1, "brigid.http_async")) {
+        return self;
+      }
+      lua_pop(L, 1);
+      lua_pushlightuserdata(L, &http_async_key);
+      http_async_t* self = new_userdata<http_async_t>(L, "brigid.http_async");
+      lua_rawset(L, LUA_REGISTRYINDEX);
+      return self;
+    }
+
+    void impl_async_gc(lua_State* L) {
+      check_udata<http_async_t>(L, 1, "brigid.http_async")->~http_async_t();
+    }
+
+    http_request_async_t* check_http_request(lua_State* L, int arg) {
+      return check_udata<http_request_async_t>(L, arg, "brigid.http_request");
+    }
+
+    void impl_request_gc(lua_State* L) {
+      check_http_request(L, 1)->~http_request_async_t();
+    }
+
+    void impl_request_ready(lua_State* L) {
+      lua_pushboolean(L, check_http_request(L, 1)->done());
+    }
+
+    // Returns the result if the request is done, followed by the timing table
+    // if the request has the timing option. Otherwise, a coroutine yields
+    // until brigid.http_poll resumes it with the result, and the main thread
+    // polls until the request is done.
+    int impl_request_wait(lua_State* L) {
+      http_request_async_t* self = check_http_request(L, 1);
+      if (!self->done()) {
+        if (!lua_pushthread(L)) {
+          if (self->waiting()) {
+            return luaL_argerror(L, 1, "brigid.http_request is already waited");
+          }
+          self->wait(L);
+          return lua_yield(L, 0);
+        }
+        lua_pop(L, 1);
+        http_async_t* async = get_http_async(L);
+        while (!self->done()) {
+          async->poll(L, 1000);
+        }
+      }
+      return self->push_result(L);
+    }
+
+    void impl_request_async(lua_State* L) {
+      int top = lua_gettop(L);
+      http_session_t* self = check_http_session(L, 1);
+      http_request_t request = check_request(L, 2);
+      http_async_t* async = get_http_async(L);
+
+      http_request_async_t* result = new_userdata<http_request_async_t>(L, "brigid.http_request", request.timing);
+      thread_reference ref(L);
+      lua_pushvalue(L, -1);
+      lua_pushvalue(L, 1);
+      lua_pushvalue(L, 2);
+      lua_pushvalue(L, top + 1);
+      lua_pushvalue(L, top + 2);
+      lua_pushvalue(L, top + 3);
+      lua_xmove(L, ref.get(), 6);
+
+      // The reference keeps the request itself, so it is set after the
+      // request is started. If the request throws, the reference is released
+      // with the local variable and the request can be collected.
+      self->request(async->multi(), request.method, request.url, request.header, request.body, request.data.data(), request.data.size(), request.sink, [self, async, result](bool done, std::exception_ptr error) {
+        result->complete(done, error, self->timing());
+        async->complete(result);
+      });
+      result->set_reference(std::move(ref));
+
+      lua_replace(L, top + 1);
+      lua_settop(L, top + 1);
+    }
+
+    // brigid.http_poll([timeout]) drives the requests started by
+    // http_session:request_async for up to the timeout in milliseconds and
+    // resumes the coroutines waiting for them. Returns the number of the
+    // requests not done yet.
+    void impl_http_poll(lua_State* L) {
+      int timeout = opt_integer<int>(L, 1, 0);
+      http_async_t* async = get_http_async(L);
+      async->poll(L, timeout);
+      push_integer(L, async->running());
+    }
+
+    // brigid.http_share(options) configures the share used by the sessions
+    // created with the share option, which keeps DNS results and TLS sessions
+    // for the process. options.max_connections is the number of the
+    // connections kept alive by each of the sessions, and by the multi of
+    // brigid.http_multi and http_session:request_async.
+    void impl_http_share(lua_State* L) {
+      luaL_checktype(L, 1, LUA_TTABLE);
+      if (get_field(L, 1, "max_connections") != LUA_TNIL) {
+        set_http_share_max_connections(check_integer<size_t>(L, -1));
+      }
+      lua_pop(L, 1);
+    }
+
+    // Returns the number of the requests of the sessions using the share, the
+    // connections opened by them and the requests which reused a connection
+    // kept by their session or their multi.
+    void impl_http_share_stats(lua_State* L) {
+      http_share_stats stats = get_http_share_stats();
+      lua_newtable(L);
+      push_integer(L, stats.requests);
+      lua_setfield(L, -2, "requests");
+      push_integer(L, stats.connections);
+      lua_setfield(L, -2, "connections");
+      push_integer(L, stats.reused);
+      lua_setfield(L, -2, "reused");
     }
   }
 
   http_session::~http_session() {}
 
+  http_timing http_session::timing() const {
+    return http_timing();
+  }
+
+  http_multi::~http_multi() {}
+
   void initialize_http(lua_State* L) {
     try {
       open_http();
@@ -330,8 +859,31 @@ namespace brigid {
 
       decltype(function<impl_call>())::set_metafield(L, -1, "__call");
       decltype(function<impl_request>())::set_field(L, -1, "request");
+      decltype(function<impl_request_async>())::set_field(L, -1, "request_async");
       decltype(function<impl_close>())::set_field(L, -1, "close");
     }
     lua_setfield(L, -2, "http_session");
+
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.http_request");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_request_gc>())::set_field(L, -1, "__gc");
+      lua_pop(L, 1);
+
+      decltype(function<impl_request_ready>())::set_field(L, -1, "ready");
+      decltype(function<impl_request_wait>())::set_field(L, -1, "wait");
+    }
+    lua_setfield(L, -2, "http_request");
+
+    new_metatable(L, "brigid.http_async");
+    decltype(function<impl_async_gc>())::set_field(L, -1, "__gc");
+    lua_pop(L, 1);
+
+    decltype(function<impl_http_multi>())::set_field(L, -1, "http_multi");
+    decltype(function<impl_http_poll>())::set_field(L, -1, "http_poll");
+    decltype(function<impl_http_share>())::set_field(L, -1, "http_share");
+    decltype(function<impl_http_share_stats>())::set_field(L, -1, "http_share_stats");
   }
 }
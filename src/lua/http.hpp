@@ -1,4 +1,4 @@
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -8,6 +8,8 @@
 #include "noncopyable.hpp"
 
 #include <stddef.h>
+#include <stdint.h>
+#include <exception>
 #include <functional>
 #include <map>
 #include <memory>
@@ -28,6 +30,20 @@ namespace brigid {
 
   void open_http();
 
+  // The times are in microseconds from the start of the request. The
+  // backends which cannot get them leave them zero.
+  struct http_timing {
+    int64_t namelookup_time;
+    int64_t connect_time;
+    int64_t appconnect_time;
+    int64_t starttransfer_time;
+    int64_t total_time;
+    int64_t size_upload;
+    int64_t size_download;
+    int64_t redirect_count;
+    bool reused;
+  };
+
   class http_session {
   public:
     virtual ~http_session() = 0;
@@ -38,15 +54,58 @@ namespace brigid {
         http_request_body,
         const char*,
         size_t) = 0;
+    // Returns the timing of the last request.
+    virtual http_timing timing() const;
   };
 
+  // The last argument makes the session use the process-wide share of DNS
+  // results, connections and TLS sessions.
   std::unique_ptr<http_session> make_http_session(
       std::function<bool (size_t, size_t)>,
       std::function<bool (int, const std::map<std::string, std::string>&)>,
       std::function<bool (const char*, size_t)>,
       bool,
       const std::string&,
-      const std::string&);
+      const std::string&,
+      bool);
+
+  struct http_share_stats {
+    size_t requests;
+    size_t connections;
+    size_t reused;
+  };
+
+  // Sets the maximum number of the connections kept by the share. Zero means
+  // the default of the backend.
+  void set_http_share_max_connections(size_t);
+  http_share_stats get_http_share_stats();
+
+  // Drives the requests of many sessions on one thread. The callbacks of a
+  // session and the completion of its request are called by perform(). The
+  // completion is called with the result of http_session::request or its
+  // exception.
+  class http_multi {
+  public:
+    virtual ~http_multi() = 0;
+    virtual void request(
+        http_session&,
+        const std::string&,
+        const std::string&,
+        const std::map<std::string, std::string>&,
+        http_request_body,
+        const char*,
+        size_t,
+        std::function<void (bool, std::exception_ptr)>) = 0;
+    // Removes the request of the session without calling its completion.
+    virtual void cancel(http_session&) = 0;
+    // Waits for the transfers up to the timeout in milliseconds and returns
+    // the number of the requests not completed yet.
+    virtual size_t perform(int) = 0;
+    // Returns the number of the requests not completed yet.
+    virtual size_t size() const = 0;
+  };
+
+  std::unique_ptr<http_multi> make_http_multi();
 }
 
 #endif
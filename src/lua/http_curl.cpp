@@ -1,4 +1,4 @@
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -12,9 +12,12 @@
 #include <stddef.h>
 #include <exception>
 #include <functional>
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 
 namespace brigid {
   namespace {
@@ -24,6 +27,18 @@ namespace brigid {
       }
     }
 
+    void check(CURLMcode code) {
+      if (code != CURLM_OK) {
+        throw BRIGID_RUNTIME_ERROR(curl_multi_strerror(code), make_error_code("curl multi error", code));
+      }
+    }
+
+    void check(CURLSHcode code) {
+      if (code != CURLSHE_OK) {
+        throw BRIGID_RUNTIME_ERROR(curl_share_strerror(code), make_error_code("curl share error", code));
+      }
+    }
+
     CURL* check(CURL* handle) {
       if (!handle) {
         check(CURLE_FAILED_INIT);
@@ -31,12 +46,122 @@ namespace brigid {
       return handle;
     }
 
+    template <class T>
+    T getinfo(CURL* handle, CURLINFO info) {
+      T result = T();
+      curl_easy_getinfo(handle, info, &result);
+      return result;
+    }
+
     using easy_t = std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>;
 
     easy_t make_easy(CURL* handle) {
       return easy_t(handle, &curl_easy_cleanup);
     }
 
+    using multi_t = std::unique_ptr<CURLM, decltype(&curl_multi_cleanup)>;
+
+    multi_t make_multi(CURLM* handle) {
+      if (!handle) {
+        check(CURLM_OUT_OF_MEMORY);
+      }
+      return multi_t(handle, &curl_multi_cleanup);
+    }
+
+    // The share of DNS results and TLS sessions for the process. The sessions
+    // may be used on different threads, so the share has a mutex for each
+    // kind of the data. Connections are not shared, since libcurl does not
+    // support sharing them between threads. A session keeps its connections
+    // in its handle, and a multi keeps the connections of its transfers.
+    class http_share : private noncopyable {
+    public:
+      http_share()
+        : handle_(curl_share_init()),
+          max_connections_(),
+          requests_(),
+          connections_(),
+          reused_() {
+        if (!handle_) {
+          check(CURLSHE_NOMEM);
+        }
+        try {
+          setopt(CURLSHOPT_LOCKFUNC, &http_share::lock_cb);
+          setopt(CURLSHOPT_UNLOCKFUNC, &http_share::unlock_cb);
+          setopt(CURLSHOPT_USERDATA, this);
+          setopt(CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+          setopt(CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        } catch (...) {
+          curl_share_cleanup(handle_);
+          throw;
+        }
+      }
+
+      ~http_share() {
+        curl_share_cleanup(handle_);
+      }
+
+      CURLSH* get() const {
+        return handle_;
+      }
+
+      void set_max_connections(size_t max_connections) {
+        max_connections_ = max_connections;
+      }
+
+      size_t max_connections() const {
+        return max_connections_;
+      }
+
+      // A transfer which did not open a connection reused one kept by its
+      // session or its multi.
+      void count(long connections, CURLcode code) {
+        ++requests_;
+        if (connections > 0) {
+          connections_ += connections;
+        } else if (code == CURLE_OK) {
+          ++reused_;
+        }
+      }
+
+      http_share_stats stats() const {
+        return http_share_stats { requests_, connections_, reused_ };
+      }
+
+    private:
+      CURLSH* handle_;
+      std::mutex mutexes_[CURL_LOCK_DATA_LAST];
+      std::atomic<size_t> max_connections_;
+      std::atomic<size_t> requests_;
+      std::atomic<size_t> connections_;
+      std::atomic<size_t> reused_;
+
+      static void lock_cb(CURL*, curl_lock_data data, curl_lock_access, void* self) {
+        static_cast<http_share*>(self)->mutexes_[data].lock();
+      }
+
+      static void unlock_cb(CURL*, curl_lock_data data, void* self) {
+        static_cast<http_share*>(self)->mutexes_[data].unlock();
+      }
+
+      template <class T>
+      void setopt(CURLSHoption option, T parameter) {
+        check(curl_share_setopt(handle_, option, parameter));
+      }
+    };
+
+    // The instance is released by the last http_initializer before
+    // curl_global_cleanup, so it is not destroyed with the static objects.
+    std::mutex http_share_mutex;
+    std::shared_ptr<http_share>* http_share_instance = nullptr;
+
+    std::shared_ptr<http_share> get_http_share() {
+      std::lock_guard<std::mutex> lock(http_share_mutex);
+      if (!http_share_instance) {
+        http_share_instance = new std::shared_ptr<http_share>(std::make_shared<http_share>());
+      }
+      return *http_share_instance;
+    }
+
     class http_session_impl : public http_session, private noncopyable {
     public:
       http_session_impl(
@@ -45,17 +170,26 @@ namespace brigid {
           std::function<bool (const char*, size_t)> write_cb,
           bool credential,
           const std::string& username,
-          const std::string& password)
-        : handle(make_easy(check(curl_easy_init()))),
+          const std::string& password,
+          bool share)
+        : share(share ? get_http_share() : nullptr),
+          handle(make_easy(check(curl_easy_init()))),
           progress_cb(progress_cb),
           header_cb(header_cb),
           write_cb(write_cb),
           credential(credential),
           username(username),
-          password(password) {}
+          password(password),
+          last_timing() {}
 
       virtual bool request(const std::string&, const std::string&, const std::map<std::string, std::string>&, http_request_body, const char*, size_t);
 
+      virtual http_timing timing() const {
+        return last_timing;
+      }
+
+      // The share must outlive the handle.
+      std::shared_ptr<http_share> share;
       easy_t handle;
       std::function<bool (size_t, size_t)> progress_cb;
       std::function<bool (int, const std::map<std::string, std::string>&)> header_cb;
@@ -63,6 +197,7 @@ namespace brigid {
       bool credential;
       std::string username;
       std::string password;
+      http_timing last_timing;
     };
 
     class string_list : private noncopyable {
@@ -101,7 +236,7 @@ namespace brigid {
         curl_easy_reset(session_.handle.get());
       }
 
-      bool request(
+      void prepare(
           const std::string& method,
           const std::string& url,
           const std::map<std::string, std::string>& header,
@@ -111,6 +246,13 @@ namespace brigid {
         setopt(CURLOPT_FOLLOWLOCATION, 1);
         setopt(CURLOPT_MAXREDIRS, 19);
 
+        if (http_share* share = session_.share.get()) {
+          setopt(CURLOPT_SHARE, share->get());
+          if (size_t max_connections = share->max_connections()) {
+            setopt(CURLOPT_MAXCONNECTS, static_cast<long>(max_connections));
+          }
+        }
+
         setopt(CURLOPT_CUSTOMREQUEST, method.c_str());
         if (method == "HEAD") {
           setopt(CURLOPT_NOBODY, 1);
@@ -140,8 +282,26 @@ namespace brigid {
           setopt(CURLOPT_USERNAME, session_.username.c_str());
           setopt(CURLOPT_PASSWORD, session_.password.c_str());
         }
+      }
 
-        CURLcode code = curl_easy_perform(session_.handle.get());
+      bool finish(CURLcode code) {
+        // The information is cleared by curl_easy_reset, so the timing is
+        // kept on the session.
+        CURL* handle = session_.handle.get();
+        long connections = getinfo<long>(handle, CURLINFO_NUM_CONNECTS);
+        http_timing& timing = session_.last_timing;
+        timing.namelookup_time = getinfo<curl_off_t>(handle, CURLINFO_NAMELOOKUP_TIME_T);
+        timing.connect_time = getinfo<curl_off_t>(handle, CURLINFO_CONNECT_TIME_T);
+        timing.appconnect_time = getinfo<curl_off_t>(handle, CURLINFO_APPCONNECT_TIME_T);
+        timing.starttransfer_time = getinfo<curl_off_t>(handle, CURLINFO_STARTTRANSFER_TIME_T);
+        timing.total_time = getinfo<curl_off_t>(handle, CURLINFO_TOTAL_TIME_T);
+        timing.size_upload = getinfo<curl_off_t>(handle, CURLINFO_SIZE_UPLOAD_T);
+        timing.size_download = getinfo<curl_off_t>(handle, CURLINFO_SIZE_DOWNLOAD_T);
+        timing.redirect_count = getinfo<long>(handle, CURLINFO_REDIRECT_COUNT);
+        timing.reused = connections == 0 && code == CURLE_OK;
+        if (http_share* share = session_.share.get()) {
+          share->count(connections, code);
+        }
         if (canceling_) {
           return false;
         }
@@ -252,9 +412,114 @@ namespace brigid {
         const char* data,
         size_t size) {
       http_task task(*this);
-      return task.request(method, url, header, body, data, size);
+      task.prepare(method, url, header, body, data, size);
+      return task.finish(curl_easy_perform(handle.get()));
     }
 
+    class http_multi_impl : public http_multi, private noncopyable {
+    public:
+      http_multi_impl()
+        : handle_(make_multi(curl_multi_init())) {}
+
+      ~http_multi_impl() {
+        for (auto& transfer : transfers_) {
+          curl_multi_remove_handle(handle_.get(), transfer.first);
+        }
+      }
+
+      virtual void request(
+          http_session& session,
+          const std::string& method,
+          const std::string& url,
+          const std::map<std::string, std::string>& header,
+          http_request_body body,
+          const char* data,
+          size_t size,
+          std::function<void (bool, std::exception_ptr)> completion) {
+        http_session_impl& impl = static_cast<http_session_impl&>(session);
+        CURL* handle = impl.handle.get();
+        if (transfers_.find(handle) != transfers_.end()) {
+          throw BRIGID_LOGIC_ERROR("session is already requesting");
+        }
+        std::unique_ptr<http_task> task(new http_task(impl));
+        task->prepare(method, url, header, body, data, size);
+        // CURLOPT_MAXCONNECTS of the handle does not limit the connections
+        // kept by the multi.
+        if (http_share* share = impl.share.get()) {
+          if (size_t max_connections = share->max_connections()) {
+            check(curl_multi_setopt(handle_.get(), CURLMOPT_MAXCONNECTS, static_cast<long>(max_connections)));
+          }
+        }
+        check(curl_multi_add_handle(handle_.get(), handle));
+        transfers_.emplace(handle, transfer_t { std::move(task), std::move(completion) });
+      }
+
+      virtual void cancel(http_session& session) {
+        CURL* handle = static_cast<http_session_impl&>(session).handle.get();
+        auto iterator = transfers_.find(handle);
+        if (iterator != transfers_.end()) {
+          curl_multi_remove_handle(handle_.get(), handle);
+          transfers_.erase(iterator);
+        }
+      }
+
+      virtual size_t perform(int timeout) {
+        int running = 0;
+        check(curl_multi_perform(handle_.get(), &running));
+        if (!complete() && running > 0) {
+          check(curl_multi_poll(handle_.get(), nullptr, 0, timeout, nullptr));
+          check(curl_multi_perform(handle_.get(), &running));
+          complete();
+        }
+        return transfers_.size();
+      }
+
+      virtual size_t size() const {
+        return transfers_.size();
+      }
+
+    private:
+      struct transfer_t {
+        std::unique_ptr<http_task> task;
+        std::function<void (bool, std::exception_ptr)> completion;
+      };
+      multi_t handle_;
+      std::map<CURL*, transfer_t> transfers_;
+
+      // Calls the completions of the done transfers. A completion may start
+      // another request.
+      bool complete() {
+        bool completed = false;
+        int count = 0;
+        while (CURLMsg* message = curl_multi_info_read(handle_.get(), &count)) {
+          if (message->msg != CURLMSG_DONE) {
+            continue;
+          }
+          CURL* handle = message->easy_handle;
+          CURLcode code = message->data.result;
+          auto iterator = transfers_.find(handle);
+          if (iterator == transfers_.end()) {
+            continue;
+          }
+          check(curl_multi_remove_handle(handle_.get(), handle));
+          transfer_t transfer = std::move(iterator->second);
+          transfers_.erase(iterator);
+
+          bool result = false;
+          std::exception_ptr error;
+          try {
+            result = transfer.task->finish(code);
+          } catch (...) {
+            error = std::current_exception();
+          }
+          transfer.task = nullptr;
+          transfer.completion(result, error);
+          completed = true;
+        }
+        return completed;
+      }
+    };
+
     int http_initializer_count = 0;
   }
 
@@ -266,6 +531,11 @@ namespace brigid {
 
   http_initializer::~http_initializer() {
     if (--http_initializer_count == 0) {
+      {
+        std::lock_guard<std::mutex> lock(http_share_mutex);
+        delete http_share_instance;
+        http_share_instance = nullptr;
+      }
       curl_global_cleanup();
     }
   }
@@ -278,7 +548,20 @@ namespace brigid {
       std::function<bool (const char*, size_t)> write_cb,
       bool credential,
       const std::string& username,
-      const std::string& password) {
-    return std::unique_ptr<http_session>(new http_session_impl(progress_cb, header_cb, write_cb, credential, username, password));
+      const std::string& password,
+      bool share) {
+    return std::unique_ptr<http_session>(new http_session_impl(progress_cb, header_cb, write_cb, credential, username, password, share));
+  }
+
+  void set_http_share_max_connections(size_t max_connections) {
+    get_http_share()->set_max_connections(max_connections);
+  }
+
+  http_share_stats get_http_share_stats() {
+    return get_http_share()->stats();
+  }
+
+  std::unique_ptr<http_multi> make_http_multi() {
+    return std::unique_ptr<http_multi>(new http_multi_impl());
   }
 }
@@ -1,4 +1,4 @@
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -15,9 +15,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 
 namespace brigid {
   namespace {
@@ -322,4 +326,69 @@ namespace brigid {
     }
     return nullptr;
   }
+
+  namespace {
+    class http_serial_multi : public http_multi, private noncopyable {
+    public:
+      virtual void request(
+          http_session& session,
+          const std::string& method,
+          const std::string& url,
+          const std::map<std::string, std::string>& header,
+          http_request_body body,
+          const char* data,
+          size_t size,
+          std::function<void (bool, std::exception_ptr)> completion) {
+        requests_.emplace_back(request_t { &session, method, url, header, body, data, size, std::move(completion) });
+      }
+
+      virtual void cancel(http_session& session) {
+        for (auto i = requests_.begin(); i != requests_.end(); ++i) {
+          if (i->session == &session) {
+            requests_.erase(i);
+            return;
+          }
+        }
+      }
+
+      // One request is run for each call, so that the caller can start the
+      // next one.
+      virtual size_t perform(int) {
+        if (!requests_.empty()) {
+          request_t request = std::move(requests_.front());
+          requests_.pop_front();
+          bool result = false;
+          std::exception_ptr error;
+          try {
+            result = request.session->request(request.method, request.url, request.header, request.body, request.data, request.size);
+          } catch (...) {
+            error = std::current_exception();
+          }
+          request.completion(result, error);
+        }
+        return requests_.size();
+      }
+
+      virtual size_t size() const {
+        return requests_.size();
+      }
+
+    private:
+      struct request_t {
+        http_session* session;
+        std::string method;
+        std::string url;
+        std::map<std::string, std::string> header;
+        http_request_body body;
+        const char* data;
+        size_t size;
+        std::function<void (bool, std::exception_ptr)> completion;
+      };
+      std::deque<request_t> requests_;
+    };
+  }
+
+  std::unique_ptr<http_multi> make_http_serial_multi() {
+    return std::unique_ptr<http_multi>(new http_serial_multi());
+  }
 }
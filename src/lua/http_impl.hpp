@@ -1,4 +1,4 @@
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -37,6 +37,10 @@ namespace brigid {
   };
 
   std::unique_ptr<http_reader> make_http_reader(http_request_body, const char*, size_t);
+
+  // Runs the requests one by one for the backends which cannot drive many
+  // transfers on one thread.
+  std::unique_ptr<http_multi> make_http_serial_multi();
 }
 
 #endif
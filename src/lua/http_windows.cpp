@@ -1,4 +1,4 @@
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -288,7 +288,19 @@ namespace brigid {
       std::function<bool (const char*, size_t)> write_cb,
       bool credential,
       const std::string& username,
-      const std::string& password) {
+      const std::string& password,
+      bool) {
     return std::unique_ptr<http_session>(new http_session_impl(progress_cb, header_cb, write_cb, credential, username, password));
   }
+
+  // WinHTTP manages its connections by itself.
+  void set_http_share_max_connections(size_t) {}
+
+  http_share_stats get_http_share_stats() {
+    return http_share_stats();
+  }
+
+  std::unique_ptr<http_multi> make_http_multi() {
+    return make_http_serial_multi();
+  }
 }
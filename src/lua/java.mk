@@ -1,4 +1,4 @@
-# Copyright (c) 2021,2024 <dev@brigid.jp>
+# Copyright (c) 2021,2024,2026 <dev@brigid.jp>
 # This software is released under the MIT License.
 # https://opensource.org/licenses/mit-license.php
 
@@ -11,39 +11,50 @@ CFLAGS = $(shell luarocks config variables.CFLAGS)
 LUA_INCDIR = $(shell luarocks config variables.LUA_INCDIR)
 
 CPPFLAGS = "-I$(LUA_INCDIR)" "-I$(JAVA_HOME)/include" "-I$(JAVA_HOME)/include/$(UNAME)" -I../..
-CXXFLAGS = -Wall -W -Wno-missing-field-initializers -std=c++11 $(CFLAGS)
+CXXFLAGS = -Wall -W -Wno-missing-field-initializers -std=c++11 -pthread $(CFLAGS)
 
 OBJS = \
+	blake3.o \
 	common.o \
 	common_java.o \
+	crc32c.o \
 	crypto.o \
 	crypto_java.o \
 	cryptor.o \
 	data.o \
 	data_writer.o \
 	dir.o \
+	encrypted.o \
 	error.o \
 	file_writer.o \
 	function.o \
 	hasher.o \
+	hmac.o \
 	http.o \
 	http_impl.o \
 	http_java.o \
 	json.o \
+	json_encoder.o \
 	json_parse.o \
+	json_reformat.o \
+	kdf.o \
 	module.o \
 	new_decryptor.o \
 	new_encryptor.o \
+	new_hmac.o \
 	scope_exit.o \
 	stack_guard.o \
 	stdio.o \
 	stopwatch.o \
 	stopwatch_unix.o \
+	task.o \
 	thread_reference.o \
 	view.o \
+	worker_pool.o \
 	write_json_string.o \
 	write_urlencoded.o \
-	writer.o
+	writer.o \
+	xxh3.o
 TARGET = libbrigid.a
 
 all: all-recursive $(TARGET)
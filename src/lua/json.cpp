@@ -1,4 +1,4 @@
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -16,6 +16,8 @@ namespace brigid {
   }
 
   void initialize_json_parse(lua_State*);
+  void initialize_json_encoder(lua_State*);
+  void initialize_json_reformat(lua_State*);
 
   void initialize_json(lua_State* L) {
     new_metatable(L, "brigid.json.array");
@@ -30,6 +32,8 @@ namespace brigid {
       decltype(function<impl_array>())::set_field(L, -1, "array");
 
       initialize_json_parse(L);
+      initialize_json_encoder(L);
+      initialize_json_reformat(L);
     }
     lua_setfield(L, -2, "json");
   }
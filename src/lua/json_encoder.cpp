@@ -0,0 +1,237 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "error.hpp"
+#include "function.hpp"
+#include "noncopyable.hpp"
+#include "stack_guard.hpp"
+#include "thread_reference.hpp"
+#include "writer.hpp"
+
+#include <lua.hpp>
+
+#include <stddef.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace brigid {
+  namespace {
+    class string_writer_t : public writer_t, private noncopyable {
+    public:
+      explicit string_writer_t(std::string& buffer)
+        : buffer_(buffer) {}
+
+      virtual bool closed() const {
+        return false;
+      }
+
+      virtual void write(const char* data, size_t size) {
+        buffer_.append(data, size);
+      }
+
+      virtual void write(char data) {
+        buffer_ += data;
+      }
+
+    private:
+      std::string& buffer_;
+    };
+
+    class json_encoder_field_t {
+    public:
+      json_encoder_field_t(std::string&& key, std::string&& prefix)
+        : key_(std::move(key)),
+          prefix_(std::move(prefix)) {}
+
+      const std::string& key() const {
+        return key_;
+      }
+
+      const std::string& prefix() const {
+        return prefix_;
+      }
+
+      // The same order as sort_keys of write_json.
+      bool operator<(const json_encoder_field_t& that) const {
+        return std::lexicographical_compare(
+            key_.begin(), key_.end(),
+            that.key_.begin(), that.key_.end(),
+            [](char a, char b) {
+              return json_key_byte(a, false) < json_key_byte(b, false);
+            });
+      }
+
+    private:
+      std::string key_;
+      std::string prefix_;
+    };
+
+    // The key strings are kept on the stack of the referenced thread in the
+    // same order as fields_, so that they can be moved to the caller without
+    // being hashed again.
+    class json_encoder_t : private noncopyable {
+    public:
+      json_encoder_t(thread_reference&& ref, std::vector<json_encoder_field_t>&& fields, int indent, bool sort_keys)
+        : ref_(std::move(ref)),
+          fields_(std::move(fields)),
+          indent_(indent),
+          sort_keys_(sort_keys) {}
+
+      void write(lua_State* L, writer_t* writer, int index) {
+        stack_guard guard(L);
+        lua_State* T = ref_.get();
+
+        writer->write('{');
+        bool first = true;
+
+        for (size_t i = 0; i < fields_.size(); ++i) {
+          lua_pushvalue(T, static_cast<int>(i + 1));
+          lua_xmove(T, L, 1);
+          lua_rawget(L, index);
+          if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            continue;
+          }
+
+          if (first) {
+            first = false;
+          } else {
+            writer->write(',');
+          }
+          const std::string& prefix = fields_[i].prefix();
+          writer->write(prefix.data(), prefix.size());
+          write_json(L, writer, guard.top() + 1, indent_, 1, sort_keys_);
+          lua_pop(L, 1);
+        }
+
+        if (!first && indent_) {
+          writer->write('\n');
+        }
+        writer->write('}');
+      }
+
+      void close() {
+        ref_ = thread_reference();
+        fields_.clear();
+      }
+
+      bool closed() const {
+        return !ref_;
+      }
+
+    private:
+      thread_reference ref_;
+      std::vector<json_encoder_field_t> fields_;
+      int indent_;
+      bool sort_keys_;
+    };
+
+    json_encoder_t* check_json_encoder(lua_State* L, int arg, int validate = check_validate_all) {
+      json_encoder_t* self = check_udata<json_encoder_t>(L, arg, "brigid.json.encoder");
+      if (validate & check_validate_not_closed) {
+        if (self->closed()) {
+          luaL_argerror(L, arg, "attempt to use a closed brigid.json.encoder");
+        }
+      }
+      return self;
+    }
+
+    void impl_gc(lua_State* L) {
+      check_json_encoder(L, 1, check_validate_none)->~json_encoder_t();
+    }
+
+    void impl_close(lua_State* L) {
+      json_encoder_t* self = check_json_encoder(L, 1, check_validate_none);
+      if (!self->closed()) {
+        self->close();
+      }
+    }
+
+    void impl_call(lua_State* L) {
+      luaL_checktype(L, 2, LUA_TTABLE);
+
+      int indent = 0;
+      bool sort_keys = false;
+      if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        if (get_field(L, 3, "indent") != LUA_TNIL) {
+          indent = check_integer<int>(L, -1);
+        }
+        lua_pop(L, 1);
+        sort_keys = get_field(L, 3, "sort_keys") != LUA_TNIL && lua_toboolean(L, -1);
+        lua_pop(L, 1);
+      }
+
+      std::vector<json_encoder_field_t> fields;
+      for (int i = 1; ; ++i) {
+        lua_rawgeti(L, 2, i);
+        if (lua_isnil(L, -1)) {
+          lua_pop(L, 1);
+          break;
+        }
+        if (lua_type(L, -1) != LUA_TSTRING) {
+          luaL_argerror(L, 2, "array of strings expected");
+        }
+        size_t size = 0;
+        const char* data = lua_tolstring(L, -1, &size);
+        lua_pop(L, 1);
+
+        std::string prefix;
+        string_writer_t writer(prefix);
+        if (indent) {
+          writer.write('\n');
+          prefix.append(indent, ' ');
+        }
+        write_json_string(&writer, data, size);
+        writer.write(':');
+        if (indent) {
+          writer.write(' ');
+        }
+        fields.emplace_back(std::string(data, size), std::move(prefix));
+      }
+
+      if (sort_keys) {
+        std::sort(fields.begin(), fields.end());
+      }
+
+      thread_reference ref(L);
+      lua_State* T = ref.get();
+      if (!lua_checkstack(T, static_cast<int>(fields.size()))) {
+        throw BRIGID_RUNTIME_ERROR("stack overflow");
+      }
+      for (const auto& field : fields) {
+        lua_pushlstring(T, field.key().data(), field.key().size());
+      }
+
+      new_userdata<json_encoder_t>(L, "brigid.json.encoder", std::move(ref), std::move(fields), indent, sort_keys);
+    }
+
+    void impl_write(lua_State* L) {
+      json_encoder_t* self = check_json_encoder(L, 1);
+      writer_t* writer = check_writer(L, 2);
+      luaL_checktype(L, 3, LUA_TTABLE);
+      self->write(L, writer, 3);
+    }
+  }
+
+  void initialize_json_encoder(lua_State* L) {
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.json.encoder");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_gc>())::set_field(L, -1, "__gc");
+      decltype(function<impl_close>())::set_field(L, -1, "__close");
+      lua_pop(L, 1);
+
+      decltype(function<impl_call>())::set_metafield(L, -1, "__call");
+      decltype(function<impl_write>())::set_field(L, -1, "write");
+      decltype(function<impl_close>())::set_field(L, -1, "close");
+    }
+    lua_setfield(L, -2, "encoder");
+  }
+}
@@ -2,7 +2,7 @@
 #line 1 "json_parse.rl"
 // vim: syntax=ragel:
 
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -10,15 +10,30 @@
 #include "data.hpp"
 #include "error.hpp"
 #include "function.hpp"
+#include "noncopyable.hpp"
+#include "thread_reference.hpp"
 
 #include <lua.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BRIGID_JSON_PARSE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BRIGID_JSON_PARSE_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include <locale.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits>
+#include <memory>
 #include <sstream>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace brigid {
@@ -28,12 +43,120 @@ namespace brigid {
     static const lua_unsigned_t integer_max_div10 = std::numeric_limits<lua_Integer>::max() / 10;
     static const lua_unsigned_t integer_max_mod10 = std::numeric_limits<lua_Integer>::max() % 10;
 
+    // The machine consumes one byte per transition. The actions below jump
+    // over string bodies and whitespace runs with these functions, 16 bytes
+    // at a time where SSE2 or NEON is available.
+
+#if defined(BRIGID_JSON_PARSE_SSE2)
+    inline int count_trailing_zeros(unsigned int v) {
+#ifdef _MSC_VER
+      unsigned long result = 0;
+      _BitScanForward(&result, v);
+      return result;
+#else
+      return __builtin_ctz(v);
+#endif
+    }
+#elif defined(BRIGID_JSON_PARSE_NEON)
+    inline int count_trailing_zeros(uint64_t v) {
+#ifdef _MSC_VER
+      unsigned long result = 0;
+      _BitScanForward64(&result, v);
+      return result;
+#else
+      return __builtin_ctzll(v);
+#endif
+    }
+
+    // 4 bits per byte
+    inline uint64_t to_mask(uint8x16_t v) {
+      return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+    }
+#endif
+
+    inline bool is_ws(char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // Returns the first '"' or '\\' in [p, pe), or pe. The actions set p to
+    // the byte before the result, since the machine advances p after them.
+    inline const char* skip_string(const char* p, const char* pe) {
+#if defined(BRIGID_JSON_PARSE_SSE2)
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      for (; pe - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        if (int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)))) {
+          return p + count_trailing_zeros(mask);
+        }
+      }
+#elif defined(BRIGID_JSON_PARSE_NEON)
+      const uint8x16_t quote = vdupq_n_u8('"');
+      const uint8x16_t backslash = vdupq_n_u8('\\');
+      for (; pe - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        if (uint64_t mask = to_mask(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)))) {
+          return p + (count_trailing_zeros(mask) >> 2);
+        }
+      }
+#endif
+      for (; p != pe; ++p) {
+        if (*p == '"' || *p == '\\') {
+          break;
+        }
+      }
+      return p;
+    }
+
+    // Returns the first non-whitespace in [p, pe), or pe.
+    inline const char* skip_ws(const char* p, const char* pe) {
+      // compact json
+      if (p == pe || !is_ws(*p)) {
+        return p;
+      }
+#if defined(BRIGID_JSON_PARSE_SSE2)
+      const __m128i sp = _mm_set1_epi8(' ');
+      const __m128i ht = _mm_set1_epi8('\t');
+      const __m128i lf = _mm_set1_epi8('\n');
+      const __m128i cr = _mm_set1_epi8('\r');
+      for (; pe - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, ht)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        if (int mask = ~_mm_movemask_epi8(ws) & 0xFFFF) {
+          return p + count_trailing_zeros(mask);
+        }
+      }
+#elif defined(BRIGID_JSON_PARSE_NEON)
+      const uint8x16_t sp = vdupq_n_u8(' ');
+      const uint8x16_t ht = vdupq_n_u8('\t');
+      const uint8x16_t lf = vdupq_n_u8('\n');
+      const uint8x16_t cr = vdupq_n_u8('\r');
+      for (; pe - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t ws = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, sp), vceqq_u8(v, ht)),
+            vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr)));
+        if (uint64_t mask = to_mask(vmvnq_u8(ws))) {
+          return p + (count_trailing_zeros(mask) >> 2);
+        }
+      }
+#endif
+      for (; p != pe; ++p) {
+        if (!is_ws(*p)) {
+          break;
+        }
+      }
+      return p;
+    }
+
     
-#line 33 "json_parse.cxx"
+#line 156 "json_parse.cxx"
 static const int json_parser_start = 1;
 
 
-#line 220 "json_parse.rl"
+#line 343 "json_parse.rl"
 
 
 #ifdef __GNUC__
@@ -41,40 +164,58 @@ static const int json_parser_start = 1;
 #pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
 #endif
 
-    int impl_parse(lua_State* L) {
-      data_t data = check_data(L, 1);
-
-      int cs = 0;
-      int top = lua_gettop(L);
-
-      int null_index = top >= 2 ? 2 : 0;
-      luaL_getmetatable(L, "brigid.json.array");
-      int array_index = top + 1;
-
-      
-#line 56 "json_parse.cxx"
+    class json_parser_impl : private noncopyable {
+    public:
+      json_parser_impl(int null_index, int array_index)
+        : null_index_(null_index),
+          array_index_(array_index),
+          cs_(),
+          top_(),
+          position_(),
+          ps_(),
+          is_int_(),
+          decimal_point_(),
+          u_() {
+        int cs = 0;
+        int top = 0;
+        
+#line 183 "json_parse.cxx"
 	{
 	cs = json_parser_start;
 	top = 0;
 	}
 
-#line 238 "json_parse.rl"
-
-      const char* const pb = data.data();
-      const char* p = pb;
-      const char* const pe = p + data.size();
-      const char* const eof = pe;
-      std::vector<int> stack; stack.reserve(16);
-
-      const char* ps = nullptr;
-      std::vector<char> buffer;
-      std::vector<int> array_stack;
-      bool is_int = false;    // number is integer
-      char decimal_point = 0; // *localeconv()->decimal_point
-      uint32_t u = 0;         // unicode escape sequence
+#line 365 "json_parse.rl"
+        cs_ = cs;
+        top_ = top;
+        stack_.reserve(16);
+      }
 
-      
-#line 78 "json_parse.cxx"
+      // Runs the machine over at most max_size bytes from the current
+      // position. Returns true if the whole data has been parsed.
+      bool parse(lua_State* L, const char* pb, size_t size, size_t max_size) {
+        int cs = cs_;
+        int top = top_;
+        int null_index = null_index_;
+        int array_index = array_index_;
+
+        const char* p = pb + position_;
+        const char* pe = pb + size;
+        if (max_size < size - position_) {
+          pe = p + max_size;
+        }
+        const char* const eof = pe == pb + size ? pe : nullptr;
+        std::vector<int>& stack = stack_;
+
+        const char* ps = pb + ps_;
+        std::vector<char>& buffer = buffer_;
+        std::vector<int>& array_stack = array_stack_;
+        bool is_int = is_int_;
+        char decimal_point = decimal_point_;
+        uint32_t u = u_;
+
+        
+#line 219 "json_parse.cxx"
 	{
 	if ( p == pe )
 		goto _test_eof;
@@ -212,14 +353,14 @@ st0:
 cs = 0;
 	goto _out;
 tr2:
-#line 194 "json_parse.rl"
-	{ ps = p + 1; }
+#line 317 "json_parse.rl"
+	{ ps = p + 1; p = skip_string(p + 1, pe) - 1; }
 	goto st2;
 st2:
 	if ( ++p == pe )
 		goto _test_eof2;
 case 2:
-#line 223 "json_parse.cxx"
+#line 364 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr12;
 		case 92: goto tr13;
@@ -235,43 +376,43 @@ case 3:
 	}
 	goto st3;
 tr6:
-#line 208 "json_parse.rl"
-	{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); { stack.push_back(0); {stack[top++] = 88;goto st64;}} }
+#line 331 "json_parse.rl"
+	{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); p = skip_ws(p + 1, pe) - 1; { stack.push_back(0); {stack[top++] = 88;goto st64;}} }
 	goto st88;
 tr10:
-#line 207 "json_parse.rl"
-	{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); { stack.push_back(0); {stack[top++] = 88;goto st36;}} }
+#line 330 "json_parse.rl"
+	{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); p = skip_ws(p + 1, pe) - 1; { stack.push_back(0); {stack[top++] = 88;goto st36;}} }
 	goto st88;
 tr12:
-#line 195 "json_parse.rl"
-	{ lua_pushlstring(L, ps, 0); }
+#line 318 "json_parse.rl"
+	{ lua_pushlstring(L, ps, p - ps); }
 	goto st88;
 tr13:
-#line 200 "json_parse.rl"
-	{ buffer.clear(); { stack.push_back(0); {stack[top++] = 88;goto st18;}} }
+#line 323 "json_parse.rl"
+	{ buffer.assign(ps, p); { stack.push_back(0); {stack[top++] = 88;goto st18;}} }
 	goto st88;
 tr14:
-#line 197 "json_parse.rl"
+#line 320 "json_parse.rl"
 	{ lua_pushlstring(L, ps, p - ps); }
 	goto st88;
 tr15:
-#line 198 "json_parse.rl"
+#line 321 "json_parse.rl"
 	{ size_t n = p - ps; buffer.resize(n); memcpy(buffer.data(), ps, n); { stack.push_back(0); {stack[top++] = 88;goto st18;}} }
 	goto st88;
 tr24:
-#line 204 "json_parse.rl"
+#line 327 "json_parse.rl"
 	{ lua_pushboolean(L, false); }
 	goto st88;
 tr27:
-#line 205 "json_parse.rl"
+#line 328 "json_parse.rl"
 	{ if (null_index) { lua_pushvalue(L, null_index); } else { lua_pushnil(L); } }
 	goto st88;
 tr30:
-#line 206 "json_parse.rl"
+#line 329 "json_parse.rl"
 	{ lua_pushboolean(L, true); }
 	goto st88;
 tr180:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -361,7 +502,7 @@ st88:
 	if ( ++p == pe )
 		goto _test_eof88;
 case 88:
-#line 365 "json_parse.cxx"
+#line 506 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto st88;
 		case 32: goto st88;
@@ -370,28 +511,28 @@ case 88:
 		goto st88;
 	goto st0;
 tr3:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st4;
 st4:
 	if ( ++p == pe )
 		goto _test_eof4;
 case 4:
-#line 381 "json_parse.cxx"
+#line 522 "json_parse.cxx"
 	if ( (*p) == 48 )
 		goto st89;
 	if ( 49 <= (*p) && (*p) <= 57 )
 		goto st92;
 	goto st0;
 tr4:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st89;
 st89:
 	if ( ++p == pe )
 		goto _test_eof89;
 case 89:
-#line 395 "json_parse.cxx"
+#line 536 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr180;
 		case 32: goto tr180;
@@ -403,14 +544,14 @@ case 89:
 		goto tr180;
 	goto st0;
 tr181:
-#line 39 "json_parse.rl"
+#line 162 "json_parse.rl"
 	{ is_int = false; }
 	goto st5;
 st5:
 	if ( ++p == pe )
 		goto _test_eof5;
 case 5:
-#line 414 "json_parse.cxx"
+#line 555 "json_parse.cxx"
 	if ( 48 <= (*p) && (*p) <= 57 )
 		goto st90;
 	goto st0;
@@ -431,14 +572,14 @@ case 90:
 		goto tr180;
 	goto st0;
 tr182:
-#line 40 "json_parse.rl"
+#line 163 "json_parse.rl"
 	{ is_int = false; }
 	goto st6;
 st6:
 	if ( ++p == pe )
 		goto _test_eof6;
 case 6:
-#line 442 "json_parse.cxx"
+#line 583 "json_parse.cxx"
 	switch( (*p) ) {
 		case 43: goto st7;
 		case 45: goto st7;
@@ -468,14 +609,14 @@ case 91:
 		goto tr180;
 	goto st0;
 tr5:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st92;
 st92:
 	if ( ++p == pe )
 		goto _test_eof92;
 case 92:
-#line 479 "json_parse.cxx"
+#line 620 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr180;
 		case 32: goto tr180;
@@ -576,53 +717,53 @@ case 18:
 	}
 	goto st0;
 tr31:
-#line 172 "json_parse.rl"
+#line 295 "json_parse.rl"
 	{ buffer.push_back('"'); }
 	goto st19;
 tr32:
-#line 174 "json_parse.rl"
+#line 297 "json_parse.rl"
 	{ buffer.push_back('/'); }
 	goto st19;
 tr33:
-#line 173 "json_parse.rl"
+#line 296 "json_parse.rl"
 	{ buffer.push_back('\\'); }
 	goto st19;
 tr34:
-#line 175 "json_parse.rl"
+#line 298 "json_parse.rl"
 	{ buffer.push_back('\b'); }
 	goto st19;
 tr35:
-#line 176 "json_parse.rl"
+#line 299 "json_parse.rl"
 	{ buffer.push_back('\f'); }
 	goto st19;
 tr36:
-#line 177 "json_parse.rl"
+#line 300 "json_parse.rl"
 	{ buffer.push_back('\n'); }
 	goto st19;
 tr37:
-#line 178 "json_parse.rl"
+#line 301 "json_parse.rl"
 	{ buffer.push_back('\r'); }
 	goto st19;
 tr38:
-#line 179 "json_parse.rl"
+#line 302 "json_parse.rl"
 	{ buffer.push_back('\t'); }
 	goto st19;
 st19:
 	if ( ++p == pe )
 		goto _test_eof19;
 case 19:
-#line 615 "json_parse.cxx"
+#line 756 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr41;
 		case 92: goto tr42;
 	}
 	goto tr40;
 tr40:
-#line 184 "json_parse.rl"
-	{ ps = p; }
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
 	goto st20;
 tr60:
-#line 142 "json_parse.rl"
+#line 265 "json_parse.rl"
 	{
               if (u <= 0x007F) {
                 buffer.push_back(u);
@@ -638,11 +779,11 @@ tr60:
                 buffer.push_back(u3 | 0x80);
               }
             }
-#line 184 "json_parse.rl"
-	{ ps = p; }
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
 	goto st20;
 tr84:
-#line 159 "json_parse.rl"
+#line 282 "json_parse.rl"
 	{
               u = ((u >> 16) - 0xD800) << 10 | ((u & 0xFFFF) - 0xDC00) | 0x010000;
               uint8_t u4 = u & 0x3F; u >>= 6;
@@ -653,41 +794,41 @@ tr84:
               buffer.push_back(u3 | 0x80);
               buffer.push_back(u4 | 0x80);
             }
-#line 184 "json_parse.rl"
-	{ ps = p; }
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
 	goto st20;
 st20:
 	if ( ++p == pe )
 		goto _test_eof20;
 case 20:
-#line 664 "json_parse.cxx"
+#line 805 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr44;
 		case 92: goto tr45;
 	}
 	goto st20;
 tr41:
-#line 184 "json_parse.rl"
-	{ ps = p; }
-#line 185 "json_parse.rl"
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
+#line 308 "json_parse.rl"
 	{ lua_pushlstring(L, buffer.data(), buffer.size()); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st93;
 tr42:
-#line 184 "json_parse.rl"
-	{ ps = p; }
-#line 190 "json_parse.rl"
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
+#line 313 "json_parse.rl"
 	{ {goto st18;} }
 	goto st93;
 tr44:
-#line 187 "json_parse.rl"
+#line 310 "json_parse.rl"
 	{ size_t m = buffer.size(); size_t n = p - ps; buffer.resize(m + n); char* ptr = buffer.data(); memcpy(ptr + m, ps, n); lua_pushlstring(L, ptr, m + n); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st93;
 tr45:
-#line 188 "json_parse.rl"
+#line 311 "json_parse.rl"
 	{ size_t m = buffer.size(); size_t n = p - ps; buffer.resize(m + n); memcpy(buffer.data() + m, ps, n); {goto st18;} }
 	goto st93;
 tr61:
-#line 142 "json_parse.rl"
+#line 265 "json_parse.rl"
 	{
               if (u <= 0x007F) {
                 buffer.push_back(u);
@@ -703,13 +844,13 @@ tr61:
                 buffer.push_back(u3 | 0x80);
               }
             }
-#line 184 "json_parse.rl"
-	{ ps = p; }
-#line 185 "json_parse.rl"
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
+#line 308 "json_parse.rl"
 	{ lua_pushlstring(L, buffer.data(), buffer.size()); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st93;
 tr62:
-#line 142 "json_parse.rl"
+#line 265 "json_parse.rl"
 	{
               if (u <= 0x007F) {
                 buffer.push_back(u);
@@ -725,13 +866,13 @@ tr62:
                 buffer.push_back(u3 | 0x80);
               }
             }
-#line 184 "json_parse.rl"
-	{ ps = p; }
-#line 190 "json_parse.rl"
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
+#line 313 "json_parse.rl"
 	{ {goto st18;} }
 	goto st93;
 tr85:
-#line 159 "json_parse.rl"
+#line 282 "json_parse.rl"
 	{
               u = ((u >> 16) - 0xD800) << 10 | ((u & 0xFFFF) - 0xDC00) | 0x010000;
               uint8_t u4 = u & 0x3F; u >>= 6;
@@ -742,13 +883,13 @@ tr85:
               buffer.push_back(u3 | 0x80);
               buffer.push_back(u4 | 0x80);
             }
-#line 184 "json_parse.rl"
-	{ ps = p; }
-#line 185 "json_parse.rl"
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
+#line 308 "json_parse.rl"
 	{ lua_pushlstring(L, buffer.data(), buffer.size()); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st93;
 tr86:
-#line 159 "json_parse.rl"
+#line 282 "json_parse.rl"
 	{
               u = ((u >> 16) - 0xD800) << 10 | ((u & 0xFFFF) - 0xDC00) | 0x010000;
               uint8_t u4 = u & 0x3F; u >>= 6;
@@ -759,26 +900,26 @@ tr86:
               buffer.push_back(u3 | 0x80);
               buffer.push_back(u4 | 0x80);
             }
-#line 184 "json_parse.rl"
-	{ ps = p; }
-#line 190 "json_parse.rl"
+#line 307 "json_parse.rl"
+	{ ps = p; if ((*p) != '"' && (*p) != '\\') { p = skip_string(p + 1, pe) - 1; } }
+#line 313 "json_parse.rl"
 	{ {goto st18;} }
 	goto st93;
 st93:
 	if ( ++p == pe )
 		goto _test_eof93;
 case 93:
-#line 772 "json_parse.cxx"
+#line 913 "json_parse.cxx"
 	goto st0;
 tr39:
-#line 140 "json_parse.rl"
+#line 263 "json_parse.rl"
 	{ u = 0; }
 	goto st21;
 st21:
 	if ( ++p == pe )
 		goto _test_eof21;
 case 21:
-#line 782 "json_parse.cxx"
+#line 923 "json_parse.cxx"
 	switch( (*p) ) {
 		case 68: goto tr48;
 		case 100: goto tr50;
@@ -793,22 +934,22 @@ case 21:
 		goto tr47;
 	goto st0;
 tr46:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st22;
 tr47:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st22;
 tr49:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st22;
 st22:
 	if ( ++p == pe )
 		goto _test_eof22;
 case 22:
-#line 812 "json_parse.cxx"
+#line 953 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr51;
@@ -819,22 +960,22 @@ case 22:
 		goto tr52;
 	goto st0;
 tr51:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st23;
 tr52:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st23;
 tr53:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st23;
 st23:
 	if ( ++p == pe )
 		goto _test_eof23;
 case 23:
-#line 838 "json_parse.cxx"
+#line 979 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr54;
@@ -845,22 +986,22 @@ case 23:
 		goto tr55;
 	goto st0;
 tr54:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st24;
 tr55:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st24;
 tr56:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st24;
 st24:
 	if ( ++p == pe )
 		goto _test_eof24;
 case 24:
-#line 864 "json_parse.cxx"
+#line 1005 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr57;
@@ -871,40 +1012,40 @@ case 24:
 		goto tr58;
 	goto st0;
 tr57:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st25;
 tr58:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st25;
 tr59:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st25;
 st25:
 	if ( ++p == pe )
 		goto _test_eof25;
 case 25:
-#line 890 "json_parse.cxx"
+#line 1031 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr61;
 		case 92: goto tr62;
 	}
 	goto tr60;
 tr48:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st26;
 tr50:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st26;
 st26:
 	if ( ++p == pe )
 		goto _test_eof26;
 case 26:
-#line 908 "json_parse.cxx"
+#line 1049 "json_parse.cxx"
 	if ( (*p) < 56 ) {
 		if ( 48 <= (*p) && (*p) <= 55 )
 			goto tr51;
@@ -918,22 +1059,22 @@ case 26:
 		goto tr63;
 	goto st0;
 tr63:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st27;
 tr64:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st27;
 tr65:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st27;
 st27:
 	if ( ++p == pe )
 		goto _test_eof27;
 case 27:
-#line 937 "json_parse.cxx"
+#line 1078 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr66;
@@ -944,22 +1085,22 @@ case 27:
 		goto tr67;
 	goto st0;
 tr66:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st28;
 tr67:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st28;
 tr68:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st28;
 st28:
 	if ( ++p == pe )
 		goto _test_eof28;
 case 28:
-#line 963 "json_parse.cxx"
+#line 1104 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr69;
@@ -970,22 +1111,22 @@ case 28:
 		goto tr70;
 	goto st0;
 tr69:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st29;
 tr70:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st29;
 tr71:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st29;
 st29:
 	if ( ++p == pe )
 		goto _test_eof29;
 case 29:
-#line 989 "json_parse.cxx"
+#line 1130 "json_parse.cxx"
 	if ( (*p) == 92 )
 		goto st30;
 	goto st0;
@@ -1006,18 +1147,18 @@ case 31:
 	}
 	goto st0;
 tr74:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st32;
 tr75:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st32;
 st32:
 	if ( ++p == pe )
 		goto _test_eof32;
 case 32:
-#line 1021 "json_parse.cxx"
+#line 1162 "json_parse.cxx"
 	if ( (*p) > 70 ) {
 		if ( 99 <= (*p) && (*p) <= 102 )
 			goto tr77;
@@ -1025,18 +1166,18 @@ case 32:
 		goto tr76;
 	goto st0;
 tr76:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st33;
 tr77:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st33;
 st33:
 	if ( ++p == pe )
 		goto _test_eof33;
 case 33:
-#line 1040 "json_parse.cxx"
+#line 1181 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr78;
@@ -1047,22 +1188,22 @@ case 33:
 		goto tr79;
 	goto st0;
 tr78:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st34;
 tr79:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st34;
 tr80:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st34;
 st34:
 	if ( ++p == pe )
 		goto _test_eof34;
 case 34:
-#line 1066 "json_parse.cxx"
+#line 1207 "json_parse.cxx"
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
 			goto tr81;
@@ -1073,22 +1214,22 @@ case 34:
 		goto tr82;
 	goto st0;
 tr81:
-#line 134 "json_parse.rl"
+#line 257 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - '0'; }
 	goto st35;
 tr82:
-#line 135 "json_parse.rl"
+#line 258 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'A' + 10; }
 	goto st35;
 tr83:
-#line 136 "json_parse.rl"
+#line 259 "json_parse.rl"
 	{ u <<= 4; u |= (*p) - 'a' + 10; }
 	goto st35;
 st35:
 	if ( ++p == pe )
 		goto _test_eof35;
 case 35:
-#line 1092 "json_parse.cxx"
+#line 1233 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr85;
 		case 92: goto tr86;
@@ -1108,14 +1249,14 @@ case 36:
 		goto st36;
 	goto st0;
 tr88:
-#line 194 "json_parse.rl"
-	{ ps = p + 1; }
+#line 317 "json_parse.rl"
+	{ ps = p + 1; p = skip_string(p + 1, pe) - 1; }
 	goto st37;
 st37:
 	if ( ++p == pe )
 		goto _test_eof37;
 case 37:
-#line 1119 "json_parse.cxx"
+#line 1260 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr91;
 		case 92: goto tr92;
@@ -1131,26 +1272,26 @@ case 38:
 	}
 	goto st38;
 tr91:
-#line 195 "json_parse.rl"
-	{ lua_pushlstring(L, ps, 0); }
+#line 318 "json_parse.rl"
+	{ lua_pushlstring(L, ps, p - ps); }
 	goto st39;
 tr92:
-#line 200 "json_parse.rl"
-	{ buffer.clear(); { stack.push_back(0); {stack[top++] = 39;goto st18;}} }
+#line 323 "json_parse.rl"
+	{ buffer.assign(ps, p); { stack.push_back(0); {stack[top++] = 39;goto st18;}} }
 	goto st39;
 tr93:
-#line 197 "json_parse.rl"
+#line 320 "json_parse.rl"
 	{ lua_pushlstring(L, ps, p - ps); }
 	goto st39;
 tr94:
-#line 198 "json_parse.rl"
+#line 321 "json_parse.rl"
 	{ size_t n = p - ps; buffer.resize(n); memcpy(buffer.data(), ps, n); { stack.push_back(0); {stack[top++] = 39;goto st18;}} }
 	goto st39;
 st39:
 	if ( ++p == pe )
 		goto _test_eof39;
 case 39:
-#line 1154 "json_parse.cxx"
+#line 1295 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto st39;
 		case 32: goto st39;
@@ -1182,14 +1323,14 @@ case 40:
 		goto st40;
 	goto st0;
 tr97:
-#line 194 "json_parse.rl"
-	{ ps = p + 1; }
+#line 317 "json_parse.rl"
+	{ ps = p + 1; p = skip_string(p + 1, pe) - 1; }
 	goto st41;
 st41:
 	if ( ++p == pe )
 		goto _test_eof41;
 case 41:
-#line 1193 "json_parse.cxx"
+#line 1334 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr107;
 		case 92: goto tr108;
@@ -1205,46 +1346,46 @@ case 42:
 	}
 	goto st42;
 tr101:
-#line 208 "json_parse.rl"
-	{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); { stack.push_back(0); {stack[top++] = 43;goto st64;}} }
+#line 331 "json_parse.rl"
+	{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); p = skip_ws(p + 1, pe) - 1; { stack.push_back(0); {stack[top++] = 43;goto st64;}} }
 	goto st43;
 tr105:
-#line 207 "json_parse.rl"
-	{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); { stack.push_back(0); {stack[top++] = 43;goto st36;}} }
+#line 330 "json_parse.rl"
+	{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); p = skip_ws(p + 1, pe) - 1; { stack.push_back(0); {stack[top++] = 43;goto st36;}} }
 	goto st43;
 tr107:
-#line 195 "json_parse.rl"
-	{ lua_pushlstring(L, ps, 0); }
+#line 318 "json_parse.rl"
+	{ lua_pushlstring(L, ps, p - ps); }
 	goto st43;
 tr108:
-#line 200 "json_parse.rl"
-	{ buffer.clear(); { stack.push_back(0); {stack[top++] = 43;goto st18;}} }
+#line 323 "json_parse.rl"
+	{ buffer.assign(ps, p); { stack.push_back(0); {stack[top++] = 43;goto st18;}} }
 	goto st43;
 tr109:
-#line 197 "json_parse.rl"
+#line 320 "json_parse.rl"
 	{ lua_pushlstring(L, ps, p - ps); }
 	goto st43;
 tr110:
-#line 198 "json_parse.rl"
+#line 321 "json_parse.rl"
 	{ size_t n = p - ps; buffer.resize(n); memcpy(buffer.data(), ps, n); { stack.push_back(0); {stack[top++] = 43;goto st18;}} }
 	goto st43;
 tr130:
-#line 204 "json_parse.rl"
+#line 327 "json_parse.rl"
 	{ lua_pushboolean(L, false); }
 	goto st43;
 tr133:
-#line 205 "json_parse.rl"
+#line 328 "json_parse.rl"
 	{ if (null_index) { lua_pushvalue(L, null_index); } else { lua_pushnil(L); } }
 	goto st43;
 tr136:
-#line 206 "json_parse.rl"
+#line 329 "json_parse.rl"
 	{ lua_pushboolean(L, true); }
 	goto st43;
 st43:
 	if ( ++p == pe )
 		goto _test_eof43;
 case 43:
-#line 1248 "json_parse.cxx"
+#line 1389 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr111;
 		case 32: goto tr111;
@@ -1255,11 +1396,11 @@ case 43:
 		goto tr111;
 	goto st0;
 tr111:
-#line 213 "json_parse.rl"
-	{ lua_rawset(L, -3); }
+#line 336 "json_parse.rl"
+	{ lua_rawset(L, -3); p = skip_ws(p + 1, pe) - 1; }
 	goto st44;
 tr118:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -1344,14 +1485,14 @@ tr118:
               } while (false);
             }
           }
-#line 213 "json_parse.rl"
-	{ lua_rawset(L, -3); }
+#line 336 "json_parse.rl"
+	{ lua_rawset(L, -3); p = skip_ws(p + 1, pe) - 1; }
 	goto st44;
 st44:
 	if ( ++p == pe )
 		goto _test_eof44;
 case 44:
-#line 1355 "json_parse.cxx"
+#line 1496 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto st44;
 		case 32: goto st44;
@@ -1362,11 +1503,11 @@ case 44:
 		goto st44;
 	goto st0;
 tr112:
-#line 213 "json_parse.rl"
-	{ lua_rawset(L, -3); }
+#line 336 "json_parse.rl"
+	{ lua_rawset(L, -3); p = skip_ws(p + 1, pe) - 1; }
 	goto st45;
 tr119:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -1451,14 +1592,14 @@ tr119:
               } while (false);
             }
           }
-#line 213 "json_parse.rl"
-	{ lua_rawset(L, -3); }
+#line 336 "json_parse.rl"
+	{ lua_rawset(L, -3); p = skip_ws(p + 1, pe) - 1; }
 	goto st45;
 st45:
 	if ( ++p == pe )
 		goto _test_eof45;
 case 45:
-#line 1462 "json_parse.cxx"
+#line 1603 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto st45;
 		case 32: goto st45;
@@ -1468,17 +1609,17 @@ case 45:
 		goto st45;
 	goto st0;
 tr89:
-#line 214 "json_parse.rl"
+#line 337 "json_parse.rl"
 	{ {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st94;
 tr113:
-#line 213 "json_parse.rl"
-	{ lua_rawset(L, -3); }
-#line 214 "json_parse.rl"
+#line 336 "json_parse.rl"
+	{ lua_rawset(L, -3); p = skip_ws(p + 1, pe) - 1; }
+#line 337 "json_parse.rl"
 	{ {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st94;
 tr122:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -1563,40 +1704,40 @@ tr122:
               } while (false);
             }
           }
-#line 213 "json_parse.rl"
-	{ lua_rawset(L, -3); }
-#line 214 "json_parse.rl"
+#line 336 "json_parse.rl"
+	{ lua_rawset(L, -3); p = skip_ws(p + 1, pe) - 1; }
+#line 337 "json_parse.rl"
 	{ {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st94;
 st94:
 	if ( ++p == pe )
 		goto _test_eof94;
 case 94:
-#line 1576 "json_parse.cxx"
+#line 1717 "json_parse.cxx"
 	goto st0;
 tr98:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st46;
 st46:
 	if ( ++p == pe )
 		goto _test_eof46;
 case 46:
-#line 1586 "json_parse.cxx"
+#line 1727 "json_parse.cxx"
 	if ( (*p) == 48 )
 		goto st47;
 	if ( 49 <= (*p) && (*p) <= 57 )
 		goto st53;
 	goto st0;
 tr99:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st47;
 st47:
 	if ( ++p == pe )
 		goto _test_eof47;
 case 47:
-#line 1600 "json_parse.cxx"
+#line 1741 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr118;
 		case 32: goto tr118;
@@ -1610,14 +1751,14 @@ case 47:
 		goto tr118;
 	goto st0;
 tr120:
-#line 39 "json_parse.rl"
+#line 162 "json_parse.rl"
 	{ is_int = false; }
 	goto st48;
 st48:
 	if ( ++p == pe )
 		goto _test_eof48;
 case 48:
-#line 1621 "json_parse.cxx"
+#line 1762 "json_parse.cxx"
 	if ( 48 <= (*p) && (*p) <= 57 )
 		goto st49;
 	goto st0;
@@ -1640,14 +1781,14 @@ case 49:
 		goto tr118;
 	goto st0;
 tr121:
-#line 40 "json_parse.rl"
+#line 163 "json_parse.rl"
 	{ is_int = false; }
 	goto st50;
 st50:
 	if ( ++p == pe )
 		goto _test_eof50;
 case 50:
-#line 1651 "json_parse.cxx"
+#line 1792 "json_parse.cxx"
 	switch( (*p) ) {
 		case 43: goto st51;
 		case 45: goto st51;
@@ -1679,14 +1820,14 @@ case 52:
 		goto tr118;
 	goto st0;
 tr100:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st53;
 st53:
 	if ( ++p == pe )
 		goto _test_eof53;
 case 53:
-#line 1690 "json_parse.cxx"
+#line 1831 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr118;
 		case 32: goto tr118;
@@ -1796,14 +1937,14 @@ case 64:
 		goto st64;
 	goto st0;
 tr138:
-#line 194 "json_parse.rl"
-	{ ps = p + 1; }
+#line 317 "json_parse.rl"
+	{ ps = p + 1; p = skip_string(p + 1, pe) - 1; }
 	goto st65;
 st65:
 	if ( ++p == pe )
 		goto _test_eof65;
 case 65:
-#line 1807 "json_parse.cxx"
+#line 1948 "json_parse.cxx"
 	switch( (*p) ) {
 		case 34: goto tr149;
 		case 92: goto tr150;
@@ -1819,46 +1960,46 @@ case 66:
 	}
 	goto st66;
 tr142:
-#line 208 "json_parse.rl"
-	{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); { stack.push_back(0); {stack[top++] = 67;goto st64;}} }
+#line 331 "json_parse.rl"
+	{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); p = skip_ws(p + 1, pe) - 1; { stack.push_back(0); {stack[top++] = 67;goto st64;}} }
 	goto st67;
 tr147:
-#line 207 "json_parse.rl"
-	{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); { stack.push_back(0); {stack[top++] = 67;goto st36;}} }
+#line 330 "json_parse.rl"
+	{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); p = skip_ws(p + 1, pe) - 1; { stack.push_back(0); {stack[top++] = 67;goto st36;}} }
 	goto st67;
 tr149:
-#line 195 "json_parse.rl"
-	{ lua_pushlstring(L, ps, 0); }
+#line 318 "json_parse.rl"
+	{ lua_pushlstring(L, ps, p - ps); }
 	goto st67;
 tr150:
-#line 200 "json_parse.rl"
-	{ buffer.clear(); { stack.push_back(0); {stack[top++] = 67;goto st18;}} }
+#line 323 "json_parse.rl"
+	{ buffer.assign(ps, p); { stack.push_back(0); {stack[top++] = 67;goto st18;}} }
 	goto st67;
 tr151:
-#line 197 "json_parse.rl"
+#line 320 "json_parse.rl"
 	{ lua_pushlstring(L, ps, p - ps); }
 	goto st67;
 tr152:
-#line 198 "json_parse.rl"
+#line 321 "json_parse.rl"
 	{ size_t n = p - ps; buffer.resize(n); memcpy(buffer.data(), ps, n); { stack.push_back(0); {stack[top++] = 67;goto st18;}} }
 	goto st67;
 tr172:
-#line 204 "json_parse.rl"
+#line 327 "json_parse.rl"
 	{ lua_pushboolean(L, false); }
 	goto st67;
 tr175:
-#line 205 "json_parse.rl"
+#line 328 "json_parse.rl"
 	{ if (null_index) { lua_pushvalue(L, null_index); } else { lua_pushnil(L); } }
 	goto st67;
 tr178:
-#line 206 "json_parse.rl"
+#line 329 "json_parse.rl"
 	{ lua_pushboolean(L, true); }
 	goto st67;
 st67:
 	if ( ++p == pe )
 		goto _test_eof67;
 case 67:
-#line 1862 "json_parse.cxx"
+#line 2003 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr153;
 		case 32: goto tr153;
@@ -1869,11 +2010,11 @@ case 67:
 		goto tr153;
 	goto st0;
 tr153:
-#line 215 "json_parse.rl"
-	{ lua_rawseti(L, -2, ++array_stack.back()); }
+#line 338 "json_parse.rl"
+	{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(p + 1, pe) - 1; }
 	goto st68;
 tr160:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -1958,14 +2099,14 @@ tr160:
               } while (false);
             }
           }
-#line 215 "json_parse.rl"
-	{ lua_rawseti(L, -2, ++array_stack.back()); }
+#line 338 "json_parse.rl"
+	{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(p + 1, pe) - 1; }
 	goto st68;
 st68:
 	if ( ++p == pe )
 		goto _test_eof68;
 case 68:
-#line 1969 "json_parse.cxx"
+#line 2110 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto st68;
 		case 32: goto st68;
@@ -1976,11 +2117,11 @@ case 68:
 		goto st68;
 	goto st0;
 tr154:
-#line 215 "json_parse.rl"
-	{ lua_rawseti(L, -2, ++array_stack.back()); }
+#line 338 "json_parse.rl"
+	{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(p + 1, pe) - 1; }
 	goto st69;
 tr161:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -2065,14 +2206,14 @@ tr161:
               } while (false);
             }
           }
-#line 215 "json_parse.rl"
-	{ lua_rawseti(L, -2, ++array_stack.back()); }
+#line 338 "json_parse.rl"
+	{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(p + 1, pe) - 1; }
 	goto st69;
 st69:
 	if ( ++p == pe )
 		goto _test_eof69;
 case 69:
-#line 2076 "json_parse.cxx"
+#line 2217 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto st69;
 		case 32: goto st69;
@@ -2092,28 +2233,28 @@ case 69:
 		goto st69;
 	goto st0;
 tr139:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st70;
 st70:
 	if ( ++p == pe )
 		goto _test_eof70;
 case 70:
-#line 2103 "json_parse.cxx"
+#line 2244 "json_parse.cxx"
 	if ( (*p) == 48 )
 		goto st71;
 	if ( 49 <= (*p) && (*p) <= 57 )
 		goto st77;
 	goto st0;
 tr140:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st71;
 st71:
 	if ( ++p == pe )
 		goto _test_eof71;
 case 71:
-#line 2117 "json_parse.cxx"
+#line 2258 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr160;
 		case 32: goto tr160;
@@ -2127,14 +2268,14 @@ case 71:
 		goto tr160;
 	goto st0;
 tr162:
-#line 39 "json_parse.rl"
+#line 162 "json_parse.rl"
 	{ is_int = false; }
 	goto st72;
 st72:
 	if ( ++p == pe )
 		goto _test_eof72;
 case 72:
-#line 2138 "json_parse.cxx"
+#line 2279 "json_parse.cxx"
 	if ( 48 <= (*p) && (*p) <= 57 )
 		goto st73;
 	goto st0;
@@ -2157,14 +2298,14 @@ case 73:
 		goto tr160;
 	goto st0;
 tr163:
-#line 40 "json_parse.rl"
+#line 163 "json_parse.rl"
 	{ is_int = false; }
 	goto st74;
 st74:
 	if ( ++p == pe )
 		goto _test_eof74;
 case 74:
-#line 2168 "json_parse.cxx"
+#line 2309 "json_parse.cxx"
 	switch( (*p) ) {
 		case 43: goto st75;
 		case 45: goto st75;
@@ -2196,17 +2337,17 @@ case 76:
 		goto tr160;
 	goto st0;
 tr143:
-#line 216 "json_parse.rl"
+#line 339 "json_parse.rl"
 	{ lua_pushvalue(L, array_index); lua_setmetatable(L, -2); array_stack.pop_back(); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st95;
 tr155:
-#line 215 "json_parse.rl"
-	{ lua_rawseti(L, -2, ++array_stack.back()); }
-#line 216 "json_parse.rl"
+#line 338 "json_parse.rl"
+	{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(p + 1, pe) - 1; }
+#line 339 "json_parse.rl"
 	{ lua_pushvalue(L, array_index); lua_setmetatable(L, -2); array_stack.pop_back(); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st95;
 tr164:
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -2291,26 +2432,26 @@ tr164:
               } while (false);
             }
           }
-#line 215 "json_parse.rl"
-	{ lua_rawseti(L, -2, ++array_stack.back()); }
-#line 216 "json_parse.rl"
+#line 338 "json_parse.rl"
+	{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(p + 1, pe) - 1; }
+#line 339 "json_parse.rl"
 	{ lua_pushvalue(L, array_index); lua_setmetatable(L, -2); array_stack.pop_back(); {cs = stack[--top];{ stack.pop_back(); }goto _again;} }
 	goto st95;
 st95:
 	if ( ++p == pe )
 		goto _test_eof95;
 case 95:
-#line 2304 "json_parse.cxx"
+#line 2445 "json_parse.cxx"
 	goto st0;
 tr141:
-#line 42 "json_parse.rl"
+#line 165 "json_parse.rl"
 	{ ps = p; is_int = true; }
 	goto st77;
 st77:
 	if ( ++p == pe )
 		goto _test_eof77;
 case 77:
-#line 2314 "json_parse.cxx"
+#line 2455 "json_parse.cxx"
 	switch( (*p) ) {
 		case 13: goto tr160;
 		case 32: goto tr160;
@@ -2501,7 +2642,7 @@ case 87:
 	case 90: 
 	case 91: 
 	case 92: 
-#line 43 "json_parse.rl"
+#line 166 "json_parse.rl"
 	{
             lua_unsigned_t v = 0;
             lua_unsigned_t negative = 0;
@@ -2587,30 +2728,179 @@ case 87:
             }
           }
 	break;
-#line 2591 "json_parse.cxx"
+#line 2732 "json_parse.cxx"
 	}
 	}
 
 	_out: {}
 	}
 
-#line 253 "json_parse.rl"
+#line 394 "json_parse.rl"
 
-      if (cs >= 88 && stack.empty()) {
-        return 1;
+        cs_ = cs;
+        top_ = top;
+        position_ = p - pb;
+        ps_ = ps - pb;
+        is_int_ = is_int;
+        decimal_point_ = decimal_point;
+        u_ = u;
+
+        if (cs != 0 && !eof) {
+          return false;
+        }
+
+        if (cs >= 88 && stack.empty()) {
+          return true;
+        }
+
+        std::ostringstream out;
+        out << "cannot parse json at position " << (p - pb + 1);
+        throw BRIGID_RUNTIME_ERROR(out.str());
       }
 
-      std::ostringstream out;
-      out << "cannot parse json at position " << (p - pb + 1);
-      throw BRIGID_RUNTIME_ERROR(out.str());
-    }
+    private:
+      int null_index_;
+      int array_index_;
+      int cs_;
+      int top_;
+      std::vector<int> stack_;
+      size_t position_;
+      size_t ps_;
+      std::vector<char> buffer_;
+      std::vector<int> array_stack_;
+      bool is_int_;           // number is integer
+      char decimal_point_;    // *localeconv()->decimal_point
+      uint32_t u_;            // unicode escape sequence
+    };
 
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #endif
+
+    int impl_parse(lua_State* L) {
+      data_t data = check_data(L, 1);
+
+      int top = lua_gettop(L);
+      int null_index = top >= 2 ? 2 : 0;
+      luaL_getmetatable(L, "brigid.json.array");
+      int array_index = top + 1;
+
+      json_parser_impl parser(null_index, array_index);
+      parser.parse(L, data.data(), data.size(), data.size());
+      return 1;
+    }
+
+    // The partially built tree is kept on the stack of the referenced
+    // thread: 1 = null, 2 = brigid.json.array, 3 = data, 4... = tree.
+    class json_parser_t : private noncopyable {
+    public:
+      json_parser_t(thread_reference&& ref, int null_index)
+        : ref_(std::move(ref)),
+          impl_(new json_parser_impl(null_index, 2)) {}
+
+      bool step(lua_State* L, size_t max_size) {
+        lua_State* T = ref_.get();
+        data_t data = to_data(T, 3);
+        if (!data) {
+          throw BRIGID_LOGIC_ERROR("attempt to use a closed brigid.data");
+        }
+        bool result = false;
+        try {
+          result = impl_->parse(T, data.data(), data.size(), max_size);
+        } catch (...) {
+          close();
+          throw;
+        }
+        if (result) {
+          lua_xmove(T, L, 1);
+          close();
+        }
+        return result;
+      }
+
+      void close() {
+        impl_ = nullptr;
+        ref_ = thread_reference();
+      }
+
+      bool closed() const {
+        return !impl_;
+      }
+
+    private:
+      thread_reference ref_;
+      std::unique_ptr<json_parser_impl> impl_;
+    };
+
+    json_parser_t* check_json_parser(lua_State* L, int arg, int validate = check_validate_all) {
+      json_parser_t* self = check_udata<json_parser_t>(L, arg, "brigid.json.parser");
+      if (validate & check_validate_not_closed) {
+        if (self->closed()) {
+          luaL_argerror(L, arg, "attempt to use a closed brigid.json.parser");
+        }
+      }
+      return self;
+    }
+
+    void impl_gc(lua_State* L) {
+      check_json_parser(L, 1, check_validate_none)->~json_parser_t();
+    }
+
+    void impl_close(lua_State* L) {
+      json_parser_t* self = check_json_parser(L, 1, check_validate_none);
+      if (!self->closed()) {
+        self->close();
+      }
+    }
+
+    void impl_call(lua_State* L) {
+      check_data(L, 2);
+      int null_index = lua_gettop(L) >= 3 ? 1 : 0;
+
+      thread_reference ref(L);
+      lua_State* T = ref.get();
+      lua_pushvalue(L, 3);
+      lua_xmove(L, T, 1);
+      luaL_getmetatable(T, "brigid.json.array");
+      lua_pushvalue(L, 2);
+      lua_xmove(L, T, 1);
+
+      new_userdata<json_parser_t>(L, "brigid.json.parser", std::move(ref), null_index);
+    }
+
+    int impl_step(lua_State* L) {
+      json_parser_t* self = check_json_parser(L, 1);
+      size_t max_size = std::numeric_limits<size_t>::max();
+      if (!lua_isnoneornil(L, 2)) {
+        max_size = check_integer<size_t>(L, 2);
+      }
+      if (self->step(L, max_size)) {
+        lua_pushboolean(L, true);
+        lua_insert(L, -2);
+        return 2;
+      } else {
+        lua_pushboolean(L, false);
+        return 1;
+      }
+    }
   }
 
   void initialize_json_parse(lua_State* L) {
     decltype(function<impl_parse>())::set_field(L, -1, "parse");
+
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.json.parser");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_gc>())::set_field(L, -1, "__gc");
+      decltype(function<impl_close>())::set_field(L, -1, "__close");
+      lua_pop(L, 1);
+
+      decltype(function<impl_call>())::set_metafield(L, -1, "__call");
+      decltype(function<impl_step>())::set_field(L, -1, "step");
+      decltype(function<impl_close>())::set_field(L, -1, "close");
+    }
+    lua_setfield(L, -2, "parser");
   }
 }
@@ -1,6 +1,6 @@
 // vim: syntax=ragel:
 
-// Copyright (c) 2021 <dev@brigid.jp>
+// Copyright (c) 2021,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -8,15 +8,30 @@
 #include "data.hpp"
 #include "error.hpp"
 #include "function.hpp"
+#include "noncopyable.hpp"
+#include "thread_reference.hpp"
 
 #include <lua.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BRIGID_JSON_PARSE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BRIGID_JSON_PARSE_NEON
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include <locale.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits>
+#include <memory>
 #include <sstream>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace brigid {
@@ -26,6 +41,114 @@ namespace brigid {
     static const lua_unsigned_t integer_max_div10 = std::numeric_limits<lua_Integer>::max() / 10;
     static const lua_unsigned_t integer_max_mod10 = std::numeric_limits<lua_Integer>::max() % 10;
 
+    // The machine consumes one byte per transition. The actions below jump
+    // over string bodies and whitespace runs with these functions, 16 bytes
+    // at a time where SSE2 or NEON is available.
+
+#if defined(BRIGID_JSON_PARSE_SSE2)
+    inline int count_trailing_zeros(unsigned int v) {
+#ifdef _MSC_VER
+      unsigned long result = 0;
+      _BitScanForward(&result, v);
+      return result;
+#else
+      return __builtin_ctz(v);
+#endif
+    }
+#elif defined(BRIGID_JSON_PARSE_NEON)
+    inline int count_trailing_zeros(uint64_t v) {
+#ifdef _MSC_VER
+      unsigned long result = 0;
+      _BitScanForward64(&result, v);
+      return result;
+#else
+      return __builtin_ctzll(v);
+#endif
+    }
+
+    // 4 bits per byte
+    inline uint64_t to_mask(uint8x16_t v) {
+      return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+    }
+#endif
+
+    inline bool is_ws(char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // Returns the first '"' or '\\' in [p, pe), or pe. The actions set p to
+    // the byte before the result, since the machine advances p after them.
+    inline const char* skip_string(const char* p, const char* pe) {
+#if defined(BRIGID_JSON_PARSE_SSE2)
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      for (; pe - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        if (int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)))) {
+          return p + count_trailing_zeros(mask);
+        }
+      }
+#elif defined(BRIGID_JSON_PARSE_NEON)
+      const uint8x16_t quote = vdupq_n_u8('"');
+      const uint8x16_t backslash = vdupq_n_u8('\\');
+      for (; pe - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        if (uint64_t mask = to_mask(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)))) {
+          return p + (count_trailing_zeros(mask) >> 2);
+        }
+      }
+#endif
+      for (; p != pe; ++p) {
+        if (*p == '"' || *p == '\\') {
+          break;
+        }
+      }
+      return p;
+    }
+
+    // Returns the first non-whitespace in [p, pe), or pe.
+    inline const char* skip_ws(const char* p, const char* pe) {
+      // compact json
+      if (p == pe || !is_ws(*p)) {
+        return p;
+      }
+#if defined(BRIGID_JSON_PARSE_SSE2)
+      const __m128i sp = _mm_set1_epi8(' ');
+      const __m128i ht = _mm_set1_epi8('\t');
+      const __m128i lf = _mm_set1_epi8('\n');
+      const __m128i cr = _mm_set1_epi8('\r');
+      for (; pe - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, ht)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        if (int mask = ~_mm_movemask_epi8(ws) & 0xFFFF) {
+          return p + count_trailing_zeros(mask);
+        }
+      }
+#elif defined(BRIGID_JSON_PARSE_NEON)
+      const uint8x16_t sp = vdupq_n_u8(' ');
+      const uint8x16_t ht = vdupq_n_u8('\t');
+      const uint8x16_t lf = vdupq_n_u8('\n');
+      const uint8x16_t cr = vdupq_n_u8('\r');
+      for (; pe - p >= 16; p += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t ws = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, sp), vceqq_u8(v, ht)),
+            vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr)));
+        if (uint64_t mask = to_mask(vmvnq_u8(ws))) {
+          return p + (count_trailing_zeros(mask) >> 2);
+        }
+      }
+#endif
+      for (; p != pe; ++p) {
+        if (!is_ws(*p)) {
+          break;
+        }
+      }
+      return p;
+    }
+
     %%{
       machine json_parser;
 
@@ -181,7 +304,7 @@ namespace brigid {
         );
 
       string_impl :=
-        escape_sequence %{ ps = fpc; }
+        escape_sequence %{ ps = fpc; if (fc != '"' && fc != '\\') { p = skip_string(fpc + 1, pe) - 1; } }
         ( "\"" @{ lua_pushlstring(L, buffer.data(), buffer.size()); fret; }
         | unescaped+
           ( "\"" @{ size_t m = buffer.size(); size_t n = fpc - ps; buffer.resize(m + n); char* ptr = buffer.data(); memcpy(ptr + m, ps, n); lua_pushlstring(L, ptr, m + n); fret; }
@@ -191,28 +314,28 @@ namespace brigid {
         );
 
       string =
-        "\"" @{ ps = fpc + 1; }
-        ( "\"" @{ lua_pushlstring(L, ps, 0); }
+        "\"" @{ ps = fpc + 1; p = skip_string(fpc + 1, pe) - 1; }
+        ( "\"" @{ lua_pushlstring(L, ps, fpc - ps); }
         | unescaped+
           ( "\"" @{ lua_pushlstring(L, ps, fpc - ps); }
           | "\\" @{ size_t n = fpc - ps; buffer.resize(n); memcpy(buffer.data(), ps, n); fcall string_impl; }
           )
-        | "\\" @{ buffer.clear(); fcall string_impl; }
+        | "\\" @{ buffer.assign(ps, fpc); fcall string_impl; }
         );
 
       value =
         ( "false" @{ lua_pushboolean(L, false); }
         | "null" @{ if (null_index) { lua_pushvalue(L, null_index); } else { lua_pushnil(L); } }
         | "true" @{ lua_pushboolean(L, true); }
-        | "{" @{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); fcall object; }
-        | "[" @{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); fcall array; }
+        | "{" @{ lua_checkstack(L, 3); lua_createtable(L, 0, 8); p = skip_ws(fpc + 1, pe) - 1; fcall object; }
+        | "[" @{ lua_checkstack(L, 2); lua_createtable(L, 8, 0); array_stack.push_back(0); p = skip_ws(fpc + 1, pe) - 1; fcall array; }
         | number
         | string
         );
 
-      member = ws string ws ":" ws value %{ lua_rawset(L, -3); };
+      member = ws string ws ":" ws value %{ lua_rawset(L, -3); p = skip_ws(fpc + 1, pe) - 1; };
       object := (member (ws "," member)*)? ws "}" @{ fret; };
-      element = ws value %{ lua_rawseti(L, -2, ++array_stack.back()); };
+      element = ws value %{ lua_rawseti(L, -2, ++array_stack.back()); p = skip_ws(fpc + 1, pe) - 1; };
       array := (element (ws "," element)*)? ws "]" @{ lua_pushvalue(L, array_index); lua_setmetatable(L, -2); array_stack.pop_back(); fret; };
       main := ws value ws;
 
@@ -222,50 +345,217 @@ namespace brigid {
 #ifdef __GNUC__
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#endif
+
+    class json_parser_impl : private noncopyable {
+    public:
+      json_parser_impl(int null_index, int array_index)
+        : null_index_(null_index),
+          array_index_(array_index),
+          cs_(),
+          top_(),
+          position_(),
+          ps_(),
+          is_int_(),
+          decimal_point_(),
+          u_() {
+        int cs = 0;
+        int top = 0;
+        %%write init;
+        cs_ = cs;
+        top_ = top;
+        stack_.reserve(16);
+      }
+
+      // Runs the machine over at most max_size bytes from the current
+      // position. Returns true if the whole data has been parsed.
+      bool parse(lua_State* L, const char* pb, size_t size, size_t max_size) {
+        int cs = cs_;
+        int top = top_;
+        int null_index = null_index_;
+        int array_index = array_index_;
+
+        const char* p = pb + position_;
+        const char* pe = pb + size;
+        if (max_size < size - position_) {
+          pe = p + max_size;
+        }
+        const char* const eof = pe == pb + size ? pe : nullptr;
+        std::vector<int>& stack = stack_;
+
+        const char* ps = pb + ps_;
+        std::vector<char>& buffer = buffer_;
+        std::vector<int>& array_stack = array_stack_;
+        bool is_int = is_int_;
+        char decimal_point = decimal_point_;
+        uint32_t u = u_;
+
+        %%write exec;
+
+        cs_ = cs;
+        top_ = top;
+        position_ = p - pb;
+        ps_ = ps - pb;
+        is_int_ = is_int;
+        decimal_point_ = decimal_point;
+        u_ = u;
+
+        if (cs != 0 && !eof) {
+          return false;
+        }
+
+        if (cs >= %%{ write first_final; }%% && stack.empty()) {
+          return true;
+        }
+
+        std::ostringstream out;
+        out << "cannot parse json at position " << (p - pb + 1);
+        throw BRIGID_RUNTIME_ERROR(out.str());
+      }
+
+    private:
+      int null_index_;
+      int array_index_;
+      int cs_;
+      int top_;
+      std::vector<int> stack_;
+      size_t position_;
+      size_t ps_;
+      std::vector<char> buffer_;
+      std::vector<int> array_stack_;
+      bool is_int_;           // number is integer
+      char decimal_point_;    // *localeconv()->decimal_point
+      uint32_t u_;            // unicode escape sequence
+    };
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
 #endif
 
     int impl_parse(lua_State* L) {
       data_t data = check_data(L, 1);
 
-      int cs = 0;
       int top = lua_gettop(L);
-
       int null_index = top >= 2 ? 2 : 0;
       luaL_getmetatable(L, "brigid.json.array");
       int array_index = top + 1;
 
-      %%write init;
+      json_parser_impl parser(null_index, array_index);
+      parser.parse(L, data.data(), data.size(), data.size());
+      return 1;
+    }
 
-      const char* const pb = data.data();
-      const char* p = pb;
-      const char* const pe = p + data.size();
-      const char* const eof = pe;
-      std::vector<int> stack; stack.reserve(16);
+    // The partially built tree is kept on the stack of the referenced
+    // thread: 1 = null, 2 = brigid.json.array, 3 = data, 4... = tree.
+    class json_parser_t : private noncopyable {
+    public:
+      json_parser_t(thread_reference&& ref, int null_index)
+        : ref_(std::move(ref)),
+          impl_(new json_parser_impl(null_index, 2)) {}
+
+      bool step(lua_State* L, size_t max_size) {
+        lua_State* T = ref_.get();
+        data_t data = to_data(T, 3);
+        if (!data) {
+          throw BRIGID_LOGIC_ERROR("attempt to use a closed brigid.data");
+        }
+        bool result = false;
+        try {
+          result = impl_->parse(T, data.data(), data.size(), max_size);
+        } catch (...) {
+          close();
+          throw;
+        }
+        if (result) {
+          lua_xmove(T, L, 1);
+          close();
+        }
+        return result;
+      }
 
-      const char* ps = nullptr;
-      std::vector<char> buffer;
-      std::vector<int> array_stack;
-      bool is_int = false;    // number is integer
-      char decimal_point = 0; // *localeconv()->decimal_point
-      uint32_t u = 0;         // unicode escape sequence
+      void close() {
+        impl_ = nullptr;
+        ref_ = thread_reference();
+      }
 
-      %%write exec;
+      bool closed() const {
+        return !impl_;
+      }
 
-      if (cs >= %%{ write first_final; }%% && stack.empty()) {
-        return 1;
+    private:
+      thread_reference ref_;
+      std::unique_ptr<json_parser_impl> impl_;
+    };
+
+    json_parser_t* check_json_parser(lua_State* L, int arg, int validate = check_validate_all) {
+      json_parser_t* self = check_udata<json_parser_t>(L, arg, "brigid.json.parser");
+      if (validate & check_validate_not_closed) {
+        if (self->closed()) {
+          luaL_argerror(L, arg, "attempt to use a closed brigid.json.parser");
+        }
       }
+      return self;
+    }
 
-      std::ostringstream out;
-      out << "cannot parse json at position " << (p - pb + 1);
-      throw BRIGID_RUNTIME_ERROR(out.str());
+    void impl_gc(lua_State* L) {
+      check_json_parser(L, 1, check_validate_none)->~json_parser_t();
     }
 
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
+    void impl_close(lua_State* L) {
+      json_parser_t* self = check_json_parser(L, 1, check_validate_none);
+      if (!self->closed()) {
+        self->close();
+      }
+    }
+
+    void impl_call(lua_State* L) {
+      check_data(L, 2);
+      int null_index = lua_gettop(L) >= 3 ? 1 : 0;
+
+      thread_reference ref(L);
+      lua_State* T = ref.get();
+      lua_pushvalue(L, 3);
+      lua_xmove(L, T, 1);
+      luaL_getmetatable(T, "brigid.json.array");
+      lua_pushvalue(L, 2);
+      lua_xmove(L, T, 1);
+
+      new_userdata<json_parser_t>(L, "brigid.json.parser", std::move(ref), null_index);
+    }
+
+    int impl_step(lua_State* L) {
+      json_parser_t* self = check_json_parser(L, 1);
+      size_t max_size = std::numeric_limits<size_t>::max();
+      if (!lua_isnoneornil(L, 2)) {
+        max_size = check_integer<size_t>(L, 2);
+      }
+      if (self->step(L, max_size)) {
+        lua_pushboolean(L, true);
+        lua_insert(L, -2);
+        return 2;
+      } else {
+        lua_pushboolean(L, false);
+        return 1;
+      }
+    }
   }
 
   void initialize_json_parse(lua_State* L) {
     decltype(function<impl_parse>())::set_field(L, -1, "parse");
+
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.json.parser");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_gc>())::set_field(L, -1, "__gc");
+      decltype(function<impl_close>())::set_field(L, -1, "__close");
+      lua_pop(L, 1);
+
+      decltype(function<impl_call>())::set_metafield(L, -1, "__call");
+      decltype(function<impl_step>())::set_field(L, -1, "step");
+      decltype(function<impl_close>())::set_field(L, -1, "close");
+    }
+    lua_setfield(L, -2, "parser");
   }
 }
@@ -0,0 +1,346 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "data.hpp"
+#include "error.hpp"
+#include "function.hpp"
+#include "noncopyable.hpp"
+#include "writer.hpp"
+
+#include <lua.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sstream>
+#include <vector>
+
+namespace brigid {
+  namespace {
+    // Copies tokens from the input to the writer without building Lua
+    // values. Numbers and escape sequences are written verbatim; only the
+    // raw control characters that the parser accepts in strings are escaped.
+    class json_reformatter_t : private noncopyable {
+    public:
+      json_reformatter_t(writer_t* writer, const char* data, size_t size, int indent)
+        : writer_(writer),
+          pb_(data),
+          p_(data),
+          pe_(data + size),
+          indent_(indent) {}
+
+      void reformat() {
+        skip_ws();
+        while (true) {
+          if (value()) {
+            continue;
+          }
+
+          // after a value
+          while (true) {
+            skip_ws();
+            if (stack_.empty()) {
+              if (p_ != pe_) {
+                error();
+              }
+              return;
+            }
+            char close = stack_.back() == '{' ? '}' : ']';
+            if (p_ == pe_) {
+              error();
+            }
+            if (*p_ == ',') {
+              ++p_;
+              writer_->write(',');
+              write_indent(stack_.size());
+              if (stack_.back() == '{') {
+                member();
+              } else {
+                skip_ws();
+              }
+              break;
+            } else if (*p_ == close) {
+              ++p_;
+              stack_.pop_back();
+              write_indent(stack_.size());
+              writer_->write(close);
+            } else {
+              error();
+            }
+          }
+        }
+      }
+
+    private:
+      writer_t* writer_;
+      const char* pb_;
+      const char* p_;
+      const char* pe_;
+      int indent_;
+      std::vector<char> stack_;
+
+      void error() {
+        std::ostringstream out;
+        out << "cannot parse json at position " << (p_ - pb_ + 1);
+        throw BRIGID_RUNTIME_ERROR(out.str());
+      }
+
+      void skip_ws() {
+        while (p_ != pe_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+          ++p_;
+        }
+      }
+
+      void write_indent(size_t depth) {
+        if (indent_) {
+          writer_->write('\n');
+          for (int i = 0; i < indent_ * static_cast<int>(depth); ++i) {
+            writer_->write(' ');
+          }
+        }
+      }
+
+      // Returns true if a container has been opened and the next token is
+      // its first value.
+      bool value() {
+        if (p_ == pe_) {
+          error();
+        }
+        switch (*p_) {
+          case '{':
+            ++p_;
+            writer_->write('{');
+            skip_ws();
+            if (p_ != pe_ && *p_ == '}') {
+              ++p_;
+              writer_->write('}');
+              return false;
+            }
+            stack_.push_back('{');
+            write_indent(stack_.size());
+            member();
+            return true;
+
+          case '[':
+            ++p_;
+            writer_->write('[');
+            skip_ws();
+            if (p_ != pe_ && *p_ == ']') {
+              ++p_;
+              writer_->write(']');
+              return false;
+            }
+            stack_.push_back('[');
+            write_indent(stack_.size());
+            return true;
+
+          case '"':
+            string();
+            return false;
+
+          case 'f':
+            literal("false", 5);
+            return false;
+
+          case 'n':
+            literal("null", 4);
+            return false;
+
+          case 't':
+            literal("true", 4);
+            return false;
+        }
+        number();
+        return false;
+      }
+
+      void member() {
+        skip_ws();
+        if (p_ == pe_ || *p_ != '"') {
+          error();
+        }
+        string();
+        skip_ws();
+        if (p_ == pe_ || *p_ != ':') {
+          error();
+        }
+        ++p_;
+        writer_->write(':');
+        if (indent_) {
+          writer_->write(' ');
+        }
+        skip_ws();
+      }
+
+      void literal(const char* data, size_t size) {
+        for (size_t i = 0; i < size; ++i, ++p_) {
+          if (p_ == pe_ || *p_ != data[i]) {
+            error();
+          }
+        }
+        writer_->write(data, size);
+      }
+
+      bool digit() const {
+        return p_ != pe_ && '0' <= *p_ && *p_ <= '9';
+      }
+
+      void digits() {
+        if (!digit()) {
+          error();
+        }
+        do {
+          ++p_;
+        } while (digit());
+      }
+
+      void number() {
+        const char* ps = p_;
+        if (*p_ == '-') {
+          ++p_;
+        }
+        if (p_ != pe_ && *p_ == '0') {
+          ++p_;
+        } else {
+          digits();
+        }
+        if (p_ != pe_ && *p_ == '.') {
+          ++p_;
+          digits();
+        }
+        if (p_ != pe_ && (*p_ == 'e' || *p_ == 'E')) {
+          ++p_;
+          if (p_ != pe_ && (*p_ == '+' || *p_ == '-')) {
+            ++p_;
+          }
+          digits();
+        }
+        writer_->write(ps, p_ - ps);
+      }
+
+      uint32_t hex_quad() {
+        uint32_t u = 0;
+        for (int i = 0; i < 4; ++i, ++p_) {
+          if (p_ == pe_) {
+            error();
+          }
+          char c = *p_;
+          u <<= 4;
+          if ('0' <= c && c <= '9') {
+            u |= c - '0';
+          } else if ('A' <= c && c <= 'F') {
+            u |= c - 'A' + 10;
+          } else if ('a' <= c && c <= 'f') {
+            u |= c - 'a' + 10;
+          } else {
+            error();
+          }
+        }
+        return u;
+      }
+
+      void escape_sequence() {
+        if (p_ == pe_) {
+          error();
+        }
+        switch (*p_++) {
+          case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            return;
+          case 'u':
+            {
+              uint32_t u = hex_quad();
+              if (0xD800 <= u && u <= 0xDBFF) {
+                if (p_ == pe_ || *p_ != '\\') {
+                  error();
+                }
+                ++p_;
+                if (p_ == pe_ || *p_ != 'u') {
+                  error();
+                }
+                ++p_;
+                const char* ps = p_;
+                u = hex_quad();
+                if (!(0xDC00 <= u && u <= 0xDFFF)) {
+                  p_ = (u & 0xF000) == 0xD000 ? ps + 1 : ps;
+                  error();
+                }
+              } else if (0xDC00 <= u && u <= 0xDFFF) {
+                p_ -= 3;
+                error();
+              }
+            }
+            return;
+        }
+        --p_;
+        error();
+      }
+
+      void string() {
+        const char* ps = p_++;
+        while (true) {
+          while (p_ != pe_) {
+            uint8_t c = *p_;
+            if (c == '"' || c == '\\' || c < 0x20) {
+              break;
+            }
+            ++p_;
+          }
+          if (p_ == pe_) {
+            error();
+          }
+          switch (*p_) {
+            case '"':
+              ++p_;
+              writer_->write(ps, p_ - ps);
+              return;
+            case '\\':
+              ++p_;
+              escape_sequence();
+              break;
+            default:
+              // A raw control character has to be escaped.
+              writer_->write(ps, p_ - ps);
+              write_json_control(*p_++);
+              ps = p_;
+          }
+        }
+      }
+
+      void write_json_control(char c) {
+        static const char hex[] = "0123456789ABCDEF";
+        switch (c) {
+          case '\b': writer_->write("\\b", 2); return;
+          case '\t': writer_->write("\\t", 2); return;
+          case '\n': writer_->write("\\n", 2); return;
+          case '\f': writer_->write("\\f", 2); return;
+          case '\r': writer_->write("\\r", 2); return;
+        }
+        char buffer[] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+        writer_->write(buffer, sizeof(buffer));
+      }
+    };
+
+    void impl_reformat(lua_State* L) {
+      data_t data = check_data(L, 1);
+      writer_t* writer = check_writer(L, 2);
+
+      int indent = 0;
+      if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        if (get_field(L, 3, "indent") != LUA_TNIL) {
+          indent = check_integer<int>(L, -1);
+        }
+        lua_pop(L, 1);
+      }
+
+      json_reformatter_t(writer, data.data(), data.size(), indent).reformat();
+      lua_pushvalue(L, 2);
+    }
+  }
+
+  void initialize_json_reformat(lua_State* L) {
+    decltype(function<impl_reformat>())::set_field(L, -1, "reformat");
+  }
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "crypto.hpp"
+#include "data.hpp"
+#include "function.hpp"
+#include "task.hpp"
+
+#include <lua.hpp>
+
+#include <stddef.h>
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace brigid {
+  namespace {
+    std::string check_string(lua_State* L, int arg) {
+      data_t source = check_data(L, arg);
+      return std::string(source.data(), source.size());
+    }
+
+    size_t check_positive(lua_State* L, int arg) {
+      int result = check_integer<int>(L, arg);
+      if (result < 1) {
+        luaL_argerror(L, arg, "out of bounds");
+      }
+      return result;
+    }
+
+    // If the options table has async = true, the derivation is run on the
+    // worker pool and a brigid.task is returned.
+    void derive(lua_State* L, int arg, std::function<std::vector<std::string> ()> function) {
+      bool async = false;
+      if (!lua_isnoneornil(L, arg)) {
+        luaL_checktype(L, arg, LUA_TTABLE);
+        async = get_field(L, arg, "async") != LUA_TNIL && lua_toboolean(L, -1);
+        lua_pop(L, 1);
+      }
+      if (async) {
+        new_task(L, std::move(function));
+      } else {
+        for (const std::string& result : function()) {
+          lua_pushlstring(L, result.data(), result.size());
+        }
+      }
+    }
+
+    void impl_pbkdf2(lua_State* L) {
+      std::string name = luaL_checkstring(L, 1);
+      std::string password = check_string(L, 2);
+      std::string salt = check_string(L, 3);
+      size_t iterations = check_positive(L, 4);
+      size_t size = check_positive(L, 5);
+      derive(L, 6, [=]() {
+        return std::vector<std::string> { pbkdf2(name, password, salt, iterations, size) };
+      });
+    }
+
+    void impl_hkdf(lua_State* L) {
+      std::string name = luaL_checkstring(L, 1);
+      std::string key = check_string(L, 2);
+      std::string salt = check_string(L, 3);
+      std::string info = check_string(L, 4);
+      size_t size = check_positive(L, 5);
+      derive(L, 6, [=]() {
+        return std::vector<std::string> { hkdf(name, key, salt, info, size) };
+      });
+    }
+
+    void impl_bytes_to_key(lua_State* L) {
+      std::string name = luaL_checkstring(L, 1);
+      std::string password = check_string(L, 2);
+      std::string salt = check_string(L, 3);
+      size_t iterations = check_positive(L, 4);
+      size_t key_size = check_positive(L, 5);
+      size_t iv_size = check_integer<size_t>(L, 6);
+      derive(L, 7, [=]() {
+        std::string result = bytes_to_key(name, password, salt, iterations, key_size + iv_size);
+        return std::vector<std::string> { result.substr(0, key_size), result.substr(key_size) };
+      });
+    }
+  }
+
+  void initialize_kdf(lua_State* L) {
+    try {
+      open_hasher();
+    } catch (const std::exception& e) {
+      luaL_error(L, "%s", e.what());
+      return;
+    }
+
+    decltype(function<impl_pbkdf2>())::set_field(L, -1, "pbkdf2");
+    decltype(function<impl_hkdf>())::set_field(L, -1, "hkdf");
+    decltype(function<impl_bytes_to_key>())::set_field(L, -1, "bytes_to_key");
+  }
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#ifndef BRIGID_KDF_HPP
+#define BRIGID_KDF_HPP
+
+#include "error.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace brigid {
+  namespace detail {
+    // Writes through a volatile pointer so that the stores are not removed.
+    inline void cleanse(std::vector<char>& buffer) {
+      volatile char* data = buffer.data();
+      for (size_t i = 0; i < buffer.size(); ++i) {
+        data[i] = 0;
+      }
+    }
+  }
+
+  // Key derivation on a hash and an hmac of the backend, for the backends
+  // without a native implementation. T_digest(name) and T_hmac(name,
+  // key_data, key_size) throw for an unsupported name, and have size(),
+  // update(data, size) and finish(data). finish() writes size() bytes and
+  // starts the next message, with the same key for an hmac.
+
+  // RFC 8018
+  template <class T_hmac>
+  std::string pbkdf2_hmac(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    T_hmac hmac(name, password.data(), password.size());
+    size_t hmac_size = hmac.size();
+    std::vector<char> u(hmac_size);
+    std::vector<char> t(hmac_size);
+    std::string result;
+    for (uint32_t i = 1; result.size() < size; ++i) {
+      char counter[4] = {
+        static_cast<char>(i >> 24),
+        static_cast<char>(i >> 16),
+        static_cast<char>(i >> 8),
+        static_cast<char>(i),
+      };
+      hmac.update(salt.data(), salt.size());
+      hmac.update(counter, sizeof(counter));
+      hmac.finish(u.data());
+      t = u;
+      for (size_t j = 1; j < iterations; ++j) {
+        hmac.update(u.data(), hmac_size);
+        hmac.finish(u.data());
+        for (size_t k = 0; k < hmac_size; ++k) {
+          t[k] ^= u[k];
+        }
+      }
+      result.append(t.data(), std::min(hmac_size, size - result.size()));
+    }
+    detail::cleanse(u);
+    detail::cleanse(t);
+    return result;
+  }
+
+  // RFC 5869. An empty salt is a string of zeros of the hash size, which
+  // is padded to the same block as a single zero byte.
+  template <class T_hmac>
+  std::string hkdf_hmac(const std::string& name, const std::string& key, const std::string& salt, const std::string& info, size_t size) {
+    static const char zero = '\0';
+    T_hmac extract(name, salt.empty() ? &zero : salt.data(), salt.empty() ? 1 : salt.size());
+    size_t hmac_size = extract.size();
+    if (size > hmac_size * 255) {
+      throw BRIGID_LOGIC_ERROR("invalid size");
+    }
+    std::vector<char> prk(hmac_size);
+    extract.update(key.data(), key.size());
+    extract.finish(prk.data());
+
+    T_hmac expand(name, prk.data(), prk.size());
+    std::vector<char> t(hmac_size);
+    std::string result;
+    for (unsigned char i = 1; result.size() < size; ++i) {
+      if (i > 1) {
+        expand.update(t.data(), hmac_size);
+      }
+      char counter = static_cast<char>(i);
+      expand.update(info.data(), info.size());
+      expand.update(&counter, 1);
+      expand.finish(t.data());
+      result.append(t.data(), std::min(hmac_size, size - result.size()));
+    }
+    detail::cleanse(prk);
+    detail::cleanse(t);
+    return result;
+  }
+
+  // Same as EVP_BytesToKey() of OpenSSL but the size is not bound to a
+  // cipher.
+  template <class T_digest>
+  std::string bytes_to_key_digest(const std::string& name, const std::string& password, const std::string& salt, size_t iterations, size_t size) {
+    T_digest digest(name);
+    size_t digest_size = digest.size();
+    std::vector<char> buffer(digest_size);
+    std::string result;
+    while (result.size() < size) {
+      if (!result.empty()) {
+        digest.update(buffer.data(), digest_size);
+      }
+      digest.update(password.data(), password.size());
+      digest.update(salt.data(), salt.size());
+      digest.finish(buffer.data());
+      for (size_t i = 1; i < iterations; ++i) {
+        digest.update(buffer.data(), digest_size);
+        digest.finish(buffer.data());
+      }
+      result.append(buffer.data(), std::min(digest_size, size - result.size()));
+    }
+    detail::cleanse(buffer);
+    return result;
+  }
+}
+
+#endif
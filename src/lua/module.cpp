@@ -1,4 +1,4 @@
-// Copyright (c) 2019-2021,2024 <dev@brigid.jp>
+// Copyright (c) 2019-2021,2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -15,11 +15,15 @@ namespace brigid {
   void initialize_cryptor(lua_State*);
   void initialize_data_writer(lua_State*);
   void initialize_dir(lua_State*);
+  void initialize_encrypted(lua_State*);
   void initialize_file_writer(lua_State*);
   void initialize_hasher(lua_State*);
+  void initialize_hmac(lua_State*);
   void initialize_http(lua_State*);
   void initialize_json(lua_State*);
+  void initialize_kdf(lua_State*);
   void initialize_stopwatch(lua_State*);
+  void initialize_task(lua_State*);
   void initialize_view(lua_State*);
 
   void initialize(lua_State* L) {
@@ -27,11 +31,15 @@ namespace brigid {
     initialize_cryptor(L);
     initialize_data_writer(L);
     initialize_dir(L);
+    initialize_encrypted(L);
     initialize_file_writer(L);
     initialize_hasher(L);
+    initialize_hmac(L);
     initialize_http(L);
     initialize_json(L);
+    initialize_kdf(L);
     initialize_stopwatch(L);
+    initialize_task(L);
     initialize_view(L);
 
     {
@@ -2,7 +2,7 @@
 #line 1 "new_decryptor.rl"
 // vim: syntax=ragel:
 
-// Copyright (c) 2022 <dev@brigid.jp>
+// Copyright (c) 2022,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -19,7 +19,7 @@ namespace brigid {
 static const int decryptor_name_chooser_start = 1;
 
 
-#line 27 "new_decryptor.rl"
+#line 39 "new_decryptor.rl"
 
   }
 
@@ -36,7 +36,7 @@ static const int decryptor_name_chooser_start = 1;
 	cs = decryptor_name_chooser_start;
 	}
 
-#line 38 "new_decryptor.rl"
+#line 50 "new_decryptor.rl"
     const char* p = name;
     const char* pe = nullptr;
     
@@ -47,8 +47,10 @@ static const int decryptor_name_chooser_start = 1;
 	switch ( cs )
 	{
 case 1:
-	if ( (*p) == 97 )
-		goto st2;
+	switch( (*p) ) {
+		case 97: goto st2;
+		case 99: goto st38;
+	}
 	goto st0;
 st0:
 cs = 0;
@@ -80,7 +82,7 @@ st5:
 case 5:
 	switch( (*p) ) {
 		case 49: goto st6;
-		case 50: goto st19;
+		case 50: goto st26;
 	}
 	goto st0;
 st6:
@@ -89,7 +91,7 @@ st6:
 case 6:
 	switch( (*p) ) {
 		case 50: goto st7;
-		case 57: goto st13;
+		case 57: goto st18;
 	}
 	goto st0;
 st7:
@@ -110,15 +112,19 @@ st9:
 	if ( ++p == pe )
 		goto _test_eof9;
 case 9:
-	if ( (*p) == 99 )
-		goto st10;
+	switch( (*p) ) {
+		case 99: goto st10;
+		case 103: goto st15;
+	}
 	goto st0;
 st10:
 	if ( ++p == pe )
 		goto _test_eof10;
 case 10:
-	if ( (*p) == 98 )
-		goto st11;
+	switch( (*p) ) {
+		case 98: goto st11;
+		case 116: goto st13;
+	}
 	goto st0;
 st11:
 	if ( ++p == pe )
@@ -132,39 +138,63 @@ st12:
 		goto _test_eof12;
 case 12:
 	if ( (*p) == 0 )
-		goto tr14;
+		goto tr17;
 	goto st0;
-tr14:
+tr17:
 #line 20 "new_decryptor.rl"
 	{ return new_aes_128_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
-	goto st26;
-tr20:
+	goto st55;
+tr19:
+#line 32 "new_decryptor.rl"
+	{ return new_aes_128_ctr_cryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+	goto st55;
+tr22:
+#line 26 "new_decryptor.rl"
+	{ return new_aes_128_gcm_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+	goto st55;
+tr29:
 #line 22 "new_decryptor.rl"
 	{ return new_aes_192_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
-	goto st26;
-tr27:
+	goto st55;
+tr31:
+#line 34 "new_decryptor.rl"
+	{ return new_aes_192_ctr_cryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+	goto st55;
+tr40:
 #line 24 "new_decryptor.rl"
 	{ return new_aes_256_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
-	goto st26;
-st26:
+	goto st55;
+tr42:
+#line 36 "new_decryptor.rl"
+	{ return new_aes_256_ctr_cryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+	goto st55;
+tr45:
+#line 28 "new_decryptor.rl"
+	{ return new_aes_256_gcm_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+	goto st55;
+tr62:
+#line 30 "new_decryptor.rl"
+	{ return new_chacha20_poly1305_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+	goto st55;
+st55:
 	if ( ++p == pe )
-		goto _test_eof26;
-case 26:
-#line 154 "new_decryptor.cxx"
+		goto _test_eof55;
+case 55:
+#line 184 "new_decryptor.cxx"
 	goto st0;
 st13:
 	if ( ++p == pe )
 		goto _test_eof13;
 case 13:
-	if ( (*p) == 50 )
+	if ( (*p) == 114 )
 		goto st14;
 	goto st0;
 st14:
 	if ( ++p == pe )
 		goto _test_eof14;
 case 14:
-	if ( (*p) == 45 )
-		goto st15;
+	if ( (*p) == 0 )
+		goto tr19;
 	goto st0;
 st15:
 	if ( ++p == pe )
@@ -177,43 +207,45 @@ st16:
 	if ( ++p == pe )
 		goto _test_eof16;
 case 16:
-	if ( (*p) == 98 )
+	if ( (*p) == 109 )
 		goto st17;
 	goto st0;
 st17:
 	if ( ++p == pe )
 		goto _test_eof17;
 case 17:
-	if ( (*p) == 99 )
-		goto st18;
+	if ( (*p) == 0 )
+		goto tr22;
 	goto st0;
 st18:
 	if ( ++p == pe )
 		goto _test_eof18;
 case 18:
-	if ( (*p) == 0 )
-		goto tr20;
+	if ( (*p) == 50 )
+		goto st19;
 	goto st0;
 st19:
 	if ( ++p == pe )
 		goto _test_eof19;
 case 19:
-	if ( (*p) == 53 )
+	if ( (*p) == 45 )
 		goto st20;
 	goto st0;
 st20:
 	if ( ++p == pe )
 		goto _test_eof20;
 case 20:
-	if ( (*p) == 54 )
+	if ( (*p) == 99 )
 		goto st21;
 	goto st0;
 st21:
 	if ( ++p == pe )
 		goto _test_eof21;
 case 21:
-	if ( (*p) == 45 )
-		goto st22;
+	switch( (*p) ) {
+		case 98: goto st22;
+		case 116: goto st24;
+	}
 	goto st0;
 st22:
 	if ( ++p == pe )
@@ -226,14 +258,14 @@ st23:
 	if ( ++p == pe )
 		goto _test_eof23;
 case 23:
-	if ( (*p) == 98 )
-		goto st24;
+	if ( (*p) == 0 )
+		goto tr29;
 	goto st0;
 st24:
 	if ( ++p == pe )
 		goto _test_eof24;
 case 24:
-	if ( (*p) == 99 )
+	if ( (*p) == 114 )
 		goto st25;
 	goto st0;
 st25:
@@ -241,7 +273,214 @@ st25:
 		goto _test_eof25;
 case 25:
 	if ( (*p) == 0 )
-		goto tr27;
+		goto tr31;
+	goto st0;
+st26:
+	if ( ++p == pe )
+		goto _test_eof26;
+case 26:
+	if ( (*p) == 53 )
+		goto st27;
+	goto st0;
+st27:
+	if ( ++p == pe )
+		goto _test_eof27;
+case 27:
+	if ( (*p) == 54 )
+		goto st28;
+	goto st0;
+st28:
+	if ( ++p == pe )
+		goto _test_eof28;
+case 28:
+	if ( (*p) == 45 )
+		goto st29;
+	goto st0;
+st29:
+	if ( ++p == pe )
+		goto _test_eof29;
+case 29:
+	switch( (*p) ) {
+		case 99: goto st30;
+		case 103: goto st35;
+	}
+	goto st0;
+st30:
+	if ( ++p == pe )
+		goto _test_eof30;
+case 30:
+	switch( (*p) ) {
+		case 98: goto st31;
+		case 116: goto st33;
+	}
+	goto st0;
+st31:
+	if ( ++p == pe )
+		goto _test_eof31;
+case 31:
+	if ( (*p) == 99 )
+		goto st32;
+	goto st0;
+st32:
+	if ( ++p == pe )
+		goto _test_eof32;
+case 32:
+	if ( (*p) == 0 )
+		goto tr40;
+	goto st0;
+st33:
+	if ( ++p == pe )
+		goto _test_eof33;
+case 33:
+	if ( (*p) == 114 )
+		goto st34;
+	goto st0;
+st34:
+	if ( ++p == pe )
+		goto _test_eof34;
+case 34:
+	if ( (*p) == 0 )
+		goto tr42;
+	goto st0;
+st35:
+	if ( ++p == pe )
+		goto _test_eof35;
+case 35:
+	if ( (*p) == 99 )
+		goto st36;
+	goto st0;
+st36:
+	if ( ++p == pe )
+		goto _test_eof36;
+case 36:
+	if ( (*p) == 109 )
+		goto st37;
+	goto st0;
+st37:
+	if ( ++p == pe )
+		goto _test_eof37;
+case 37:
+	if ( (*p) == 0 )
+		goto tr45;
+	goto st0;
+st38:
+	if ( ++p == pe )
+		goto _test_eof38;
+case 38:
+	if ( (*p) == 104 )
+		goto st39;
+	goto st0;
+st39:
+	if ( ++p == pe )
+		goto _test_eof39;
+case 39:
+	if ( (*p) == 97 )
+		goto st40;
+	goto st0;
+st40:
+	if ( ++p == pe )
+		goto _test_eof40;
+case 40:
+	if ( (*p) == 99 )
+		goto st41;
+	goto st0;
+st41:
+	if ( ++p == pe )
+		goto _test_eof41;
+case 41:
+	if ( (*p) == 104 )
+		goto st42;
+	goto st0;
+st42:
+	if ( ++p == pe )
+		goto _test_eof42;
+case 42:
+	if ( (*p) == 97 )
+		goto st43;
+	goto st0;
+st43:
+	if ( ++p == pe )
+		goto _test_eof43;
+case 43:
+	if ( (*p) == 50 )
+		goto st44;
+	goto st0;
+st44:
+	if ( ++p == pe )
+		goto _test_eof44;
+case 44:
+	if ( (*p) == 48 )
+		goto st45;
+	goto st0;
+st45:
+	if ( ++p == pe )
+		goto _test_eof45;
+case 45:
+	if ( (*p) == 45 )
+		goto st46;
+	goto st0;
+st46:
+	if ( ++p == pe )
+		goto _test_eof46;
+case 46:
+	if ( (*p) == 112 )
+		goto st47;
+	goto st0;
+st47:
+	if ( ++p == pe )
+		goto _test_eof47;
+case 47:
+	if ( (*p) == 111 )
+		goto st48;
+	goto st0;
+st48:
+	if ( ++p == pe )
+		goto _test_eof48;
+case 48:
+	if ( (*p) == 108 )
+		goto st49;
+	goto st0;
+st49:
+	if ( ++p == pe )
+		goto _test_eof49;
+case 49:
+	if ( (*p) == 121 )
+		goto st50;
+	goto st0;
+st50:
+	if ( ++p == pe )
+		goto _test_eof50;
+case 50:
+	if ( (*p) == 49 )
+		goto st51;
+	goto st0;
+st51:
+	if ( ++p == pe )
+		goto _test_eof51;
+case 51:
+	if ( (*p) == 51 )
+		goto st52;
+	goto st0;
+st52:
+	if ( ++p == pe )
+		goto _test_eof52;
+case 52:
+	if ( (*p) == 48 )
+		goto st53;
+	goto st0;
+st53:
+	if ( ++p == pe )
+		goto _test_eof53;
+case 53:
+	if ( (*p) == 53 )
+		goto st54;
+	goto st0;
+st54:
+	if ( ++p == pe )
+		goto _test_eof54;
+case 54:
+	if ( (*p) == 0 )
+		goto tr62;
 	goto st0;
 	}
 	_test_eof2: cs = 2; goto _test_eof; 
@@ -255,7 +494,7 @@ case 25:
 	_test_eof10: cs = 10; goto _test_eof; 
 	_test_eof11: cs = 11; goto _test_eof; 
 	_test_eof12: cs = 12; goto _test_eof; 
-	_test_eof26: cs = 26; goto _test_eof; 
+	_test_eof55: cs = 55; goto _test_eof; 
 	_test_eof13: cs = 13; goto _test_eof; 
 	_test_eof14: cs = 14; goto _test_eof; 
 	_test_eof15: cs = 15; goto _test_eof; 
@@ -269,12 +508,41 @@ case 25:
 	_test_eof23: cs = 23; goto _test_eof; 
 	_test_eof24: cs = 24; goto _test_eof; 
 	_test_eof25: cs = 25; goto _test_eof; 
+	_test_eof26: cs = 26; goto _test_eof; 
+	_test_eof27: cs = 27; goto _test_eof; 
+	_test_eof28: cs = 28; goto _test_eof; 
+	_test_eof29: cs = 29; goto _test_eof; 
+	_test_eof30: cs = 30; goto _test_eof; 
+	_test_eof31: cs = 31; goto _test_eof; 
+	_test_eof32: cs = 32; goto _test_eof; 
+	_test_eof33: cs = 33; goto _test_eof; 
+	_test_eof34: cs = 34; goto _test_eof; 
+	_test_eof35: cs = 35; goto _test_eof; 
+	_test_eof36: cs = 36; goto _test_eof; 
+	_test_eof37: cs = 37; goto _test_eof; 
+	_test_eof38: cs = 38; goto _test_eof; 
+	_test_eof39: cs = 39; goto _test_eof; 
+	_test_eof40: cs = 40; goto _test_eof; 
+	_test_eof41: cs = 41; goto _test_eof; 
+	_test_eof42: cs = 42; goto _test_eof; 
+	_test_eof43: cs = 43; goto _test_eof; 
+	_test_eof44: cs = 44; goto _test_eof; 
+	_test_eof45: cs = 45; goto _test_eof; 
+	_test_eof46: cs = 46; goto _test_eof; 
+	_test_eof47: cs = 47; goto _test_eof; 
+	_test_eof48: cs = 48; goto _test_eof; 
+	_test_eof49: cs = 49; goto _test_eof; 
+	_test_eof50: cs = 50; goto _test_eof; 
+	_test_eof51: cs = 51; goto _test_eof; 
+	_test_eof52: cs = 52; goto _test_eof; 
+	_test_eof53: cs = 53; goto _test_eof; 
+	_test_eof54: cs = 54; goto _test_eof; 
 
 	_test_eof: {}
 	_out: {}
 	}
 
-#line 41 "new_decryptor.rl"
+#line 53 "new_decryptor.rl"
     return nullptr;
   }
 
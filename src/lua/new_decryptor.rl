@@ -1,6 +1,6 @@
 // vim: syntax=ragel:
 
-// Copyright (c) 2022 <dev@brigid.jp>
+// Copyright (c) 2022,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -22,6 +22,18 @@ namespace brigid {
           @{ return new_aes_192_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
         | "aes-256-cbc\0"
           @{ return new_aes_256_cbc_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+        | "aes-128-gcm\0"
+          @{ return new_aes_128_gcm_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+        | "aes-256-gcm\0"
+          @{ return new_aes_256_gcm_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+        | "chacha20-poly1305\0"
+          @{ return new_chacha20_poly1305_decryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+        | "aes-128-ctr\0"
+          @{ return new_aes_128_ctr_cryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+        | "aes-192-ctr\0"
+          @{ return new_aes_192_ctr_cryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
+        | "aes-256-ctr\0"
+          @{ return new_aes_256_ctr_cryptor(L, key_data, key_size, iv_data, iv_size, std::move(ref)); }
         );
       write data noerror nofinal noentry;
     }%%
@@ -0,0 +1,171 @@
+
+#line 1 "new_hmac.rl"
+// vim: syntax=ragel:
+
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "crypto.hpp"
+
+#include <lua.hpp>
+
+#include <stddef.h>
+
+namespace brigid {
+  namespace {
+    
+#line 19 "new_hmac.cxx"
+static const int hmac_name_chooser_start = 1;
+
+
+#line 27 "new_hmac.rl"
+
+  }
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#endif
+
+  hasher* new_hmac(lua_State* L, const char* name, const char* key_data, size_t key_size) {
+    int cs = 0;
+    
+#line 35 "new_hmac.cxx"
+	{
+	cs = hmac_name_chooser_start;
+	}
+
+#line 38 "new_hmac.rl"
+    const char* p = name;
+    const char* pe = nullptr;
+    
+#line 44 "new_hmac.cxx"
+	{
+	if ( p == pe )
+		goto _test_eof;
+	switch ( cs )
+	{
+case 1:
+	if ( (*p) == 115 )
+		goto st2;
+	goto st0;
+st0:
+cs = 0;
+	goto _out;
+st2:
+	if ( ++p == pe )
+		goto _test_eof2;
+case 2:
+	if ( (*p) == 104 )
+		goto st3;
+	goto st0;
+st3:
+	if ( ++p == pe )
+		goto _test_eof3;
+case 3:
+	if ( (*p) == 97 )
+		goto st4;
+	goto st0;
+st4:
+	if ( ++p == pe )
+		goto _test_eof4;
+case 4:
+	switch( (*p) ) {
+		case 49: goto st5;
+		case 50: goto st6;
+		case 53: goto st9;
+	}
+	goto st0;
+st5:
+	if ( ++p == pe )
+		goto _test_eof5;
+case 5:
+	if ( (*p) == 0 )
+		goto tr7;
+	goto st0;
+tr7:
+#line 20 "new_hmac.rl"
+	{ return new_sha1_hmac(L, key_data, key_size); }
+	goto st12;
+tr10:
+#line 22 "new_hmac.rl"
+	{ return new_sha256_hmac(L, key_data, key_size); }
+	goto st12;
+tr13:
+#line 24 "new_hmac.rl"
+	{ return new_sha512_hmac(L, key_data, key_size); }
+	goto st12;
+st12:
+	if ( ++p == pe )
+		goto _test_eof12;
+case 12:
+#line 104 "new_hmac.cxx"
+	goto st0;
+st6:
+	if ( ++p == pe )
+		goto _test_eof6;
+case 6:
+	if ( (*p) == 53 )
+		goto st7;
+	goto st0;
+st7:
+	if ( ++p == pe )
+		goto _test_eof7;
+case 7:
+	if ( (*p) == 54 )
+		goto st8;
+	goto st0;
+st8:
+	if ( ++p == pe )
+		goto _test_eof8;
+case 8:
+	if ( (*p) == 0 )
+		goto tr10;
+	goto st0;
+st9:
+	if ( ++p == pe )
+		goto _test_eof9;
+case 9:
+	if ( (*p) == 49 )
+		goto st10;
+	goto st0;
+st10:
+	if ( ++p == pe )
+		goto _test_eof10;
+case 10:
+	if ( (*p) == 50 )
+		goto st11;
+	goto st0;
+st11:
+	if ( ++p == pe )
+		goto _test_eof11;
+case 11:
+	if ( (*p) == 0 )
+		goto tr13;
+	goto st0;
+	}
+	_test_eof2: cs = 2; goto _test_eof; 
+	_test_eof3: cs = 3; goto _test_eof; 
+	_test_eof4: cs = 4; goto _test_eof; 
+	_test_eof5: cs = 5; goto _test_eof; 
+	_test_eof12: cs = 12; goto _test_eof; 
+	_test_eof6: cs = 6; goto _test_eof; 
+	_test_eof7: cs = 7; goto _test_eof; 
+	_test_eof8: cs = 8; goto _test_eof; 
+	_test_eof9: cs = 9; goto _test_eof; 
+	_test_eof10: cs = 10; goto _test_eof; 
+	_test_eof11: cs = 11; goto _test_eof; 
+
+	_test_eof: {}
+	_out: {}
+	}
+
+#line 41 "new_hmac.rl"
+    return nullptr;
+  }
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+}
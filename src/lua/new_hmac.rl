@@ -0,0 +1,47 @@
+// vim: syntax=ragel:
+
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "crypto.hpp"
+
+#include <lua.hpp>
+
+#include <stddef.h>
+
+namespace brigid {
+  namespace {
+    %%{
+      machine hmac_name_chooser;
+
+      main :=
+        ( "sha1\0"
+          @{ return new_sha1_hmac(L, key_data, key_size); }
+        | "sha256\0"
+          @{ return new_sha256_hmac(L, key_data, key_size); }
+        | "sha512\0"
+          @{ return new_sha512_hmac(L, key_data, key_size); }
+        );
+      write data noerror nofinal noentry;
+    }%%
+  }
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#endif
+
+  hasher* new_hmac(lua_State* L, const char* name, const char* key_data, size_t key_size) {
+    int cs = 0;
+    %%write init;
+    const char* p = name;
+    const char* pe = nullptr;
+    %%write exec;
+    return nullptr;
+  }
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "data.hpp"
+#include "function.hpp"
+#include "noncopyable.hpp"
+#include "scope_exit.hpp"
+#include "task.hpp"
+#include "thread_reference.hpp"
+#include "worker_pool.hpp"
+
+#include <lua.hpp>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace brigid {
+  namespace {
+    // The state is shared with the worker, so that a task can be collected
+    // before it is done. A task which keeps values for the worker waits for it
+    // when collected.
+    class task_t : private noncopyable {
+    public:
+      task_t(std::function<std::vector<std::string> ()> function, std::function<void ()> complete, thread_reference&& ref)
+        : state_(std::make_shared<state_t>()),
+          complete_(std::move(complete)),
+          ref_(std::move(ref)) {
+        std::shared_ptr<state_t> state = state_;
+        get_worker_pool()->submit([state, function]() {
+          std::vector<std::string> results;
+          std::exception_ptr error;
+          try {
+            results = function();
+          } catch (...) {
+            error = std::current_exception();
+          }
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->results = std::move(results);
+          state->error = error;
+          state->done = true;
+          state->condition.notify_all();
+        });
+      }
+
+      // A task collected without task:get() still calls the completion, so
+      // that the object which started it is not left running. Its error
+      // cannot be raised from the finalizer and is discarded.
+      ~task_t() {
+        if (ref_) {
+          wait();
+        }
+        if (complete_) {
+          try {
+            complete();
+          } catch (...) {}
+        }
+      }
+
+      bool ready() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->done;
+      }
+
+      void get(lua_State* L) {
+        wait();
+        if (complete_) {
+          complete();
+        }
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->error) {
+          std::rethrow_exception(state_->error);
+        }
+        luaL_checkstack(L, static_cast<int>(state_->results.size()), nullptr);
+        for (const std::string& result : state_->results) {
+          lua_pushlstring(L, result.data(), result.size());
+        }
+      }
+
+    private:
+      struct state_t {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+        std::vector<std::string> results;
+        std::exception_ptr error;
+      };
+      std::shared_ptr<state_t> state_;
+      std::function<void ()> complete_;
+      thread_reference ref_;
+
+      void wait() const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->condition.wait(lock, [&]() { return state_->done; });
+      }
+
+      void complete() {
+        std::function<void ()> complete = std::move(complete_);
+        complete_ = nullptr;
+        scope_exit scope_guard([&]() {
+          ref_ = thread_reference();
+        });
+        complete();
+      }
+    };
+
+    task_t* check_task(lua_State* L, int arg) {
+      return check_udata<task_t>(L, arg, "brigid.task");
+    }
+
+    void impl_gc(lua_State* L) {
+      check_task(L, 1)->~task_t();
+    }
+
+    void impl_ready(lua_State* L) {
+      lua_pushboolean(L, check_task(L, 1)->ready());
+    }
+
+    void impl_get(lua_State* L) {
+      check_task(L, 1)->get(L);
+    }
+  }
+
+  void new_task(lua_State* L, std::function<std::vector<std::string> ()> function) {
+    new_userdata<task_t>(L, "brigid.task", std::move(function), nullptr, thread_reference());
+  }
+
+  void new_task(lua_State* L, std::function<std::vector<std::string> ()> function, std::function<void ()> complete, thread_reference&& ref) {
+    new_userdata<task_t>(L, "brigid.task", std::move(function), std::move(complete), std::move(ref));
+  }
+
+  data_t pin_data(lua_State* L, int arg, const thread_reference& ref) {
+    data_t source = check_data(L, arg);
+    if (lua_type(L, arg) == LUA_TSTRING) {
+      lua_pushvalue(L, arg);
+      lua_xmove(L, ref.get(), 1);
+      return source;
+    }
+    lua_pushlstring(ref.get(), source.data(), source.size());
+    return to_data(ref.get(), -1);
+  }
+
+  void initialize_task(lua_State* L) {
+    lua_newtable(L);
+    {
+      new_metatable(L, "brigid.task");
+      lua_pushvalue(L, -2);
+      lua_setfield(L, -2, "__index");
+      decltype(function<impl_gc>())::set_field(L, -1, "__gc");
+      lua_pop(L, 1);
+
+      decltype(function<impl_ready>())::set_field(L, -1, "ready");
+      decltype(function<impl_get>())::set_field(L, -1, "get");
+    }
+    lua_setfield(L, -2, "task");
+  }
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#ifndef BRIGID_TASK_HPP
+#define BRIGID_TASK_HPP
+
+#include "data.hpp"
+#include "thread_reference.hpp"
+
+#include <lua.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace brigid {
+  // Runs the function on the worker pool and pushes a brigid.task. The
+  // function must not touch the Lua state. Its results are returned by
+  // task:get() as strings, and its exception is raised by task:get().
+  void new_task(lua_State*, std::function<std::vector<std::string> ()>);
+
+  // The values on the reference are kept until the function is done, so that
+  // the function can use their memory. The completion is called by the first
+  // task:get() on the Lua thread before the results are returned, or when the
+  // task is collected.
+  void new_task(lua_State*, std::function<std::vector<std::string> ()>, std::function<void ()>, thread_reference&&);
+
+  // Keeps the data argument on the reference for a task. A string is kept as
+  // is, and other data, which may be modified or closed, is copied to a new
+  // string.
+  data_t pin_data(lua_State*, int, const thread_reference&);
+}
+
+#endif
@@ -0,0 +1,116 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "worker_pool.hpp"
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace brigid {
+  worker_pool::worker_pool(size_t size)
+    : stopped_() {
+    for (size_t i = 0; i < size; ++i) {
+      threads_.emplace_back(&worker_pool::run, this);
+    }
+  }
+
+  worker_pool::~worker_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    condition_.notify_all();
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  size_t worker_pool::size() const {
+    return threads_.size();
+  }
+
+  void worker_pool::submit(std::function<void ()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(task));
+    }
+    condition_.notify_one();
+  }
+
+  // Runs function(0) ... function(n - 1) on the workers and the calling
+  // thread and returns when all of them are done. The calling thread takes
+  // part and never waits for a worker that has not started, so that this can
+  // be called from a task. The function must not throw.
+  void worker_pool::parallel_for(size_t n, const std::function<void (size_t)>& function) {
+    size_t m = std::min(n > 0 ? n - 1 : 0, threads_.size());
+    if (m == 0) {
+      for (size_t i = 0; i < n; ++i) {
+        function(i);
+      }
+      return;
+    }
+
+    struct state_t {
+      std::atomic<size_t> next;
+      std::mutex mutex;
+      std::condition_variable condition;
+      size_t done;
+    };
+    std::shared_ptr<state_t> state = std::make_shared<state_t>();
+    state->next = 0;
+    state->done = 0;
+
+    const std::function<void (size_t)>* f = &function;
+    auto task = [state, f, n]() {
+      size_t count = 0;
+      for (size_t i = state->next++; i < n; i = state->next++) {
+        (*f)(i);
+        ++count;
+      }
+      if (count > 0) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done += count;
+        if (state->done == n) {
+          state->condition.notify_one();
+        }
+      }
+    };
+
+    for (size_t i = 0; i < m; ++i) {
+      submit(task);
+    }
+
+    task();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&]() { return state->done == n; });
+  }
+
+  void worker_pool::run() {
+    while (true) {
+      std::function<void ()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [&]() { return stopped_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        task = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      task();
+    }
+  }
+
+  worker_pool* get_worker_pool() {
+    static worker_pool instance(std::max(std::thread::hardware_concurrency(), 2U) - 1);
+    return &instance;
+  }
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#ifndef BRIGID_WORKER_POOL_HPP
+#define BRIGID_WORKER_POOL_HPP
+
+#include "noncopyable.hpp"
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace brigid {
+  class worker_pool : private noncopyable {
+  public:
+    explicit worker_pool(size_t);
+    ~worker_pool();
+    size_t size() const;
+    void submit(std::function<void ()>);
+    void parallel_for(size_t, const std::function<void (size_t)>&);
+  private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void ()> > queue_;
+    std::vector<std::thread> threads_;
+    bool stopped_;
+
+    void run();
+  };
+
+  worker_pool* get_worker_pool();
+}
+
+#endif
@@ -1,4 +1,4 @@
-// Copyright (c) 2024 <dev@brigid.jp>
+// Copyright (c) 2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -12,41 +12,32 @@
 #include <lua.hpp>
 
 #include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <cmath>
 #include <algorithm>
 #include <vector>
 
 namespace brigid {
-  void write_json_string(writer_t*, const char* data, size_t size);
   void write_urlencoded(writer_t*, const data_t&);
 
   namespace {
     writer_t* check_writer_impl(lua_State* L, int arg) {
-      if (writer_t* self = to_writer_data_writer(L, arg)) {
-        return self;
-      } else if (writer_t* self = to_writer_file_writer(L, arg)) {
+      if (writer_t* self = to_writer(L, arg)) {
         return self;
       }
       luaL_argerror(L, arg, "brigid.writer expected");
       throw BRIGID_LOGIC_ERROR("unreachable");
     }
 
-    writer_t* check_writer(lua_State* L, int arg) {
-      writer_t* self = check_writer_impl(L, arg);
-      if (!self->closed()) {
-        return self;
-      }
-      luaL_argerror(L, arg, "attempt to use a closed brigid.writer");
-      throw BRIGID_LOGIC_ERROR("unreachable");
-    }
-
-    template <class T>
-    int snprintf_wrapper(char* buffer, size_t size, const char* format, T value) {
+    template <class... T>
+    int snprintf_wrapper(char* buffer, size_t size, const char* format, T... value) {
 #ifdef _MSC_VER
-        return _snprintf_s(buffer, size, size - 1, format, value);
+        return _snprintf_s(buffer, size, size - 1, format, value...);
 #else
-        return snprintf(buffer, size, format, value);
+        return snprintf(buffer, size, format, value...);
 #endif
     }
 
@@ -94,6 +85,123 @@ namespace brigid {
       self->write(buffer, size);
     }
 
+    // ECMAScript Number.prototype.toString() as required by RFC 8785: the
+    // shortest digits that round-trip, laid out by the decimal exponent.
+    void write_json_number_canonical(lua_State* L, writer_t* self, int index) {
+#if LUA_VERSION_NUM >= 502
+      int result = 0;
+      lua_Number value = lua_tonumberx(L, index, &result);
+#else
+      lua_Number value = lua_tonumber(L, index);
+      int result = value != 0 || lua_isnumber(L, index);
+#endif
+      if (!result) {
+        throw BRIGID_LOGIC_ERROR("number expected");
+      }
+      if (!(std::isfinite)(value)) {
+        throw BRIGID_LOGIC_ERROR("inf or nan");
+      }
+
+      if (value == 0) { // check for both zero and minus zero
+        self->write('0');
+        return;
+      }
+      if (value < 0) {
+        self->write('-');
+        value = -value;
+      }
+
+      char buffer[64] = {};
+      char digits[32] = {};
+      int k = 0;
+      int e = 0;
+      for (int precision = 1; precision <= 17; ++precision) {
+        int size = snprintf_wrapper(buffer, sizeof(buffer), "%.*e", precision - 1, static_cast<double>(value));
+        if (size < 0) {
+          throw BRIGID_SYSTEM_ERROR();
+        }
+        // 小数点はロケールに依存するので数字と指数だけを取りだす。
+        k = 0;
+        const char* p = buffer;
+        for (; *p != 'e'; ++p) {
+          if ('0' <= *p && *p <= '9') {
+            digits[k++] = *p;
+          }
+        }
+        e = atoi(p + 1);
+        while (k > 1 && digits[k - 1] == '0') {
+          --k;
+        }
+        // 小数点を含まない表記で読みもどせばロケールに依存しない。
+        snprintf_wrapper(buffer, sizeof(buffer), "%.*se%d", k, digits, e - k + 1);
+        if (strtod(buffer, nullptr) == value) {
+          break;
+        }
+      }
+
+      int n = e + 1;
+      if (k <= n && n <= 21) {
+        self->write(digits, k);
+        for (int i = k; i < n; ++i) {
+          self->write('0');
+        }
+      } else if (0 < n && n <= 21) {
+        self->write(digits, n);
+        self->write('.');
+        self->write(digits + n, k - n);
+      } else if (-6 < n && n <= 0) {
+        self->write("0.", 2);
+        for (int i = n; i < 0; ++i) {
+          self->write('0');
+        }
+        self->write(digits, k);
+      } else {
+        self->write(digits[0]);
+        if (k > 1) {
+          self->write('.');
+          self->write(digits + 1, k - 1);
+        }
+        int size = snprintf_wrapper(buffer, sizeof(buffer), "e%+d", n - 1);
+        if (size < 0) {
+          throw BRIGID_SYSTEM_ERROR();
+        }
+        self->write(buffer, size);
+      }
+    }
+
+    // JSON.stringify() の文字列エスケープ。
+    void write_json_string_canonical(writer_t* self, const char* data, size_t size) {
+      static const char hex[] = "0123456789abcdef";
+
+      self->write('"');
+      const char* ps = data;
+      const char* const pe = data + size;
+      for (const char* p = data; p != pe; ++p) {
+        unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+          continue;
+        }
+        self->write(ps, p - ps);
+        ps = p + 1;
+        switch (c) {
+          case '"': self->write("\\\"", 2); break;
+          case '\\': self->write("\\\\", 2); break;
+          case '\b': self->write("\\b", 2); break;
+          case '\t': self->write("\\t", 2); break;
+          case '\n': self->write("\\n", 2); break;
+          case '\f': self->write("\\f", 2); break;
+          case '\r': self->write("\\r", 2); break;
+          default:
+            {
+              char buffer[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+              self->write(buffer, sizeof(buffer));
+            }
+        }
+      }
+      self->write(ps, pe - ps);
+      self->write('"');
+    }
+
     void write_json_indent(writer_t* self, int indent, int depth) {
       self->write('\n');
       for (int i = 0; i < indent * depth; ++i) {
@@ -103,7 +211,20 @@ namespace brigid {
 
     class json_key_t {
     public:
-      json_key_t(const char* data, size_t size) : data_(data), size_(size) {}
+      json_key_t(const char* data, size_t size, int slot, bool canonical)
+        : data_(data),
+          size_(size),
+          slot_(slot),
+          canonical_(canonical),
+          prefix_() {
+        // 先頭8バイトをビッグエンディアンの整数にして比較の大半を済ませる。
+        for (size_t i = 0; i < 8; ++i) {
+          prefix_ <<= 8;
+          if (i < size) {
+            prefix_ |= json_key_byte(data[i], canonical);
+          }
+        }
+      }
 
       const char* data() const {
         return data_;
@@ -113,20 +234,49 @@ namespace brigid {
         return size_;
       }
 
+      int slot() const {
+        return slot_;
+      }
+
       bool operator<(const json_key_t& that) const {
-        return std::lexicographical_compare(data_, data_ + size_, that.data_, that.data_ + that.size_);
+        if (prefix_ != that.prefix_) {
+          return prefix_ < that.prefix_;
+        }
+        size_t n = std::min<size_t>(8, std::min(size_, that.size_));
+        bool canonical = canonical_;
+        return std::lexicographical_compare(
+            data_ + n, data_ + size_,
+            that.data_ + n, that.data_ + that.size_,
+            [canonical](char a, char b) {
+              return json_key_byte(a, canonical) < json_key_byte(b, canonical);
+            });
       }
 
     private:
       const char* data_;
       size_t size_;
+      int slot_;
+      bool canonical_;
+      uint64_t prefix_;
     };
 
     using json_keys_t = std::vector<json_key_t>;
 
-    void write_json(lua_State*, writer_t*, int, int, int, bool);
+    void write_json_value(lua_State*, writer_t*, int, int, int, bool, bool);
+
+    void write_json_key(writer_t* self, const char* data, size_t size, int indent, bool canonical) {
+      if (canonical) {
+        write_json_string_canonical(self, data, size);
+      } else {
+        write_json_string(self, data, size);
+      }
+      self->write(':');
+      if (indent) {
+        self->write(' ');
+      }
+    }
 
-    bool write_json_array(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys) {
+    bool write_json_array(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys, bool canonical) {
       stack_guard guard(L);
 
 #if LUA_VERSION_NUM >= 502
@@ -150,7 +300,7 @@ namespace brigid {
         write_json_indent(self, indent, depth + 1);
       }
       lua_rawgeti(L, index, 1);
-      write_json(L, self, guard.top() + 1, indent, depth + 1, sort_keys);
+      write_json_value(L, self, guard.top() + 1, indent, depth + 1, sort_keys, canonical);
       lua_pop(L, 1);
 
       for (size_t i = 2; i <= size; ++i) {
@@ -159,7 +309,7 @@ namespace brigid {
           write_json_indent(self, indent, depth + 1);
         }
         lua_rawgeti(L, index, i);
-        write_json(L, self, guard.top() + 1, indent, depth + 1, sort_keys);
+        write_json_value(L, self, guard.top() + 1, indent, depth + 1, sort_keys, canonical);
         lua_pop(L, 1);
       }
 
@@ -190,29 +340,21 @@ namespace brigid {
         if (lua_type(L, guard.top() + 1) == LUA_TSTRING) {
           size_t size = 0;
           if (const char* data = lua_tolstring(L, guard.top() + 1, &size)) {
-            write_json_string(self, data, size);
+            write_json_key(self, data, size, indent, false);
           } else {
             throw BRIGID_LOGIC_ERROR("string expected");
           }
-          self->write(':');
-          if (indent) {
-            self->write(' ');
-          }
-          write_json(L, self, guard.top() + 2, indent, depth + 1, sort_keys);
+          write_json_value(L, self, guard.top() + 2, indent, depth + 1, sort_keys, false);
           lua_pop(L, 1);
         } else {
           // 数値が文字列に変換される場合を考慮してコピーをスタックに積む。
           lua_pushvalue(L, guard.top() + 1);
           if (data_t data = to_data(L, guard.top() + 3)) {
-            write_json_string(self, data.data(), data.size());
+            write_json_key(self, data.data(), data.size(), indent, false);
           } else {
             throw BRIGID_LOGIC_ERROR("brigid.data expected");
           }
-          self->write(':');
-          if (indent) {
-            self->write(' ');
-          }
-          write_json(L, self, guard.top() + 2, indent, depth + 1, sort_keys);
+          write_json_value(L, self, guard.top() + 2, indent, depth + 1, sort_keys, false);
           lua_pop(L, 2);
         }
       }
@@ -223,23 +365,45 @@ namespace brigid {
       self->write('}');
     }
 
-    void write_json_object_sort_keys(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys) {
+    // 一度だけ走査し、値は作業用テーブルの配列部分に退避して引きなおさずに
+    // 出力する。キーの数にかかわらずスタックは定数個しか使わない。
+    void write_json_object_sort_keys(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys, bool canonical) {
       stack_guard guard(L);
 
       self->write('{');
       bool first = true;
       json_keys_t keys;
 
+      // 値を退避するテーブルと、文字列に変換したキーを保持するテーブル
+      int values = guard.top() + 1;
+      int strings = guard.top() + 2;
+      lua_newtable(L);
+      lua_newtable(L);
+
       lua_pushnil(L);
       while (lua_next(L, index)) {
-        if (lua_type(L, guard.top() + 1) == LUA_TSTRING) {
+        int top = lua_gettop(L);
+
+        if (lua_type(L, top - 1) == LUA_TSTRING) {
           size_t size = 0;
-          if (const char* data = lua_tolstring(L, guard.top() + 1, &size)) {
-            keys.emplace_back(data, size);
+          if (const char* data = lua_tolstring(L, top - 1, &size)) {
+            int slot = static_cast<int>(keys.size() + 1);
+            keys.emplace_back(data, size, slot, canonical);
+            lua_rawseti(L, values, slot);
           } else {
             throw BRIGID_LOGIC_ERROR("string expected");
           }
-          lua_pop(L, 1);
+        } else if (canonical) {
+          // 文字列に変換したコピーも残しておく
+          lua_pushvalue(L, top - 1);
+          if (data_t data = to_data(L, top + 1)) {
+            int slot = static_cast<int>(keys.size() + 1);
+            keys.emplace_back(data.data(), data.size(), slot, canonical);
+            lua_rawseti(L, strings, slot);
+            lua_rawseti(L, values, slot);
+          } else {
+            throw BRIGID_LOGIC_ERROR("brigid.data expected");
+          }
         } else {
           // 文字列キー以外は出力してしまう
           if (first) {
@@ -252,17 +416,13 @@ namespace brigid {
           }
 
           // 数値が文字列に変換される場合を考慮してコピーをスタックに積む。
-          lua_pushvalue(L, guard.top() + 1);
-          if (data_t data = to_data(L, guard.top() + 3)) {
-            write_json_string(self, data.data(), data.size());
+          lua_pushvalue(L, top - 1);
+          if (data_t data = to_data(L, top + 1)) {
+            write_json_key(self, data.data(), data.size(), indent, false);
           } else {
             throw BRIGID_LOGIC_ERROR("brigid.data expected");
           }
-          self->write(':');
-          if (indent) {
-            self->write(' ');
-          }
-          write_json(L, self, guard.top() + 2, indent, depth + 1, sort_keys);
+          write_json_value(L, self, top, indent, depth + 1, sort_keys, false);
           lua_pop(L, 2);
         }
       }
@@ -278,16 +438,9 @@ namespace brigid {
         if (indent) {
           write_json_indent(self, indent, depth + 1);
         }
-
-        write_json_string(self, key.data(), key.size());
-        self->write(':');
-        if (indent) {
-          self->write(' ');
-        }
-
-        lua_pushlstring(L, key.data(), key.size());
-        lua_gettable(L, index);
-        write_json(L, self, guard.top() + 1, indent, depth + 1, sort_keys);
+        write_json_key(self, key.data(), key.size(), indent, canonical);
+        lua_rawgeti(L, values, key.slot());
+        write_json_value(L, self, guard.top() + 3, indent, depth + 1, sort_keys, canonical);
         lua_pop(L, 1);
       }
 
@@ -297,25 +450,29 @@ namespace brigid {
       self->write('}');
     }
 
-    void write_json_table(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys) {
-      if (write_json_array(L, self, index, indent, depth, sort_keys)) {
+    void write_json_table(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys, bool canonical) {
+      if (write_json_array(L, self, index, indent, depth, sort_keys, canonical)) {
         return;
       }
-      if (sort_keys) {
-        write_json_object_sort_keys(L, self, index, indent, depth, sort_keys);
+      if (sort_keys || canonical) {
+        write_json_object_sort_keys(L, self, index, indent, depth, sort_keys, canonical);
       } else {
         write_json_object(L, self, index, indent, depth, sort_keys);
       }
     }
 
-    void write_json(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys) {
+    void write_json_value(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys, bool canonical) {
       switch (lua_type(L, index)) {
         case LUA_TNIL:
           self->write("null", 4);
           return;
 
         case LUA_TNUMBER:
-          write_json_number(L, self, index);
+          if (canonical) {
+            write_json_number_canonical(L, self, index);
+          } else {
+            write_json_number(L, self, index);
+          }
           return;
 
         case LUA_TBOOLEAN:
@@ -330,7 +487,11 @@ namespace brigid {
           {
             size_t size = 0;
             if (const char* data = lua_tolstring(L, index, &size)) {
-              write_json_string(self, data, size);
+              if (canonical) {
+                write_json_string_canonical(self, data, size);
+              } else {
+                write_json_string(self, data, size);
+              }
             } else {
               throw BRIGID_LOGIC_ERROR("string expected");
             }
@@ -338,7 +499,7 @@ namespace brigid {
           return;
 
         case LUA_TTABLE:
-          write_json_table(L, self, index, indent, depth, sort_keys);
+          write_json_table(L, self, index, indent, depth, sort_keys, canonical);
           return;
 
         case LUA_TLIGHTUSERDATA:
@@ -350,7 +511,11 @@ namespace brigid {
       }
 
       if (data_t data = to_data(L, index)) {
-        write_json_string(self, data.data(), data.size());
+        if (canonical) {
+          write_json_string_canonical(self, data.data(), data.size());
+        } else {
+          write_json_string(self, data.data(), data.size());
+        }
       } else {
         throw BRIGID_LOGIC_ERROR("brigid.data expected");
       }
@@ -374,6 +539,11 @@ namespace brigid {
       write_json(L, self, 2, indent, 0, sort_keys);
     }
 
+    void impl_write_json_canonical(lua_State* L) {
+      writer_t* self = check_writer(L, 1);
+      write_json_value(L, self, 2, 0, 0, true, true);
+    }
+
     void impl_write_urlencoded(lua_State* L) {
       writer_t* self = check_writer(L, 1);
       data_t data = check_data(L, 2);
@@ -383,10 +553,39 @@ namespace brigid {
 
   writer_t::~writer_t() {}
 
+  writer_t* to_writer(lua_State* L, int arg) {
+    if (writer_t* self = to_writer_data_writer(L, arg)) {
+      return self;
+    } else if (writer_t* self = to_writer_file_writer(L, arg)) {
+      return self;
+    } else if (writer_t* self = to_writer_hasher(L, arg)) {
+      return self;
+    } else if (writer_t* self = to_writer_cryptor(L, arg)) {
+      return self;
+    } else if (writer_t* self = to_writer_encrypted_writer(L, arg)) {
+      return self;
+    }
+    return nullptr;
+  }
+
+  writer_t* check_writer(lua_State* L, int arg) {
+    writer_t* self = check_writer_impl(L, arg);
+    if (!self->closed()) {
+      return self;
+    }
+    luaL_argerror(L, arg, "attempt to use a closed brigid.writer");
+    throw BRIGID_LOGIC_ERROR("unreachable");
+  }
+
+  void write_json(lua_State* L, writer_t* self, int index, int indent, int depth, bool sort_keys) {
+    write_json_value(L, self, index, indent, depth, sort_keys, false);
+  }
+
   void initialize_writer(lua_State* L) {
     decltype(function<impl_write_json_number>())::set_field(L, -1, "write_json_number");
     decltype(function<impl_write_json_string>())::set_field(L, -1, "write_json_string");
     decltype(function<impl_write_json>())::set_field(L, -1, "write_json");
+    decltype(function<impl_write_json_canonical>())::set_field(L, -1, "write_json_canonical");
     decltype(function<impl_write_urlencoded>())::set_field(L, -1, "write_urlencoded");
   }
 }
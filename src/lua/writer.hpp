@@ -1,4 +1,4 @@
-// Copyright (c) 2024 <dev@brigid.jp>
+// Copyright (c) 2024,2026 <dev@brigid.jp>
 // This software is released under the MIT License.
 // https://opensource.org/licenses/mit-license.php
 
@@ -10,6 +10,8 @@
 #include <lua.hpp>
 
 #include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
 
 namespace brigid {
   class writer_t {
@@ -22,7 +24,30 @@ namespace brigid {
 
   writer_t* to_writer_data_writer(lua_State*, int);
   writer_t* to_writer_file_writer(lua_State*, int);
+  writer_t* to_writer_hasher(lua_State*, int);
+  writer_t* to_writer_cryptor(lua_State*, int);
+  writer_t* to_writer_encrypted_writer(lua_State*, int);
+  writer_t* to_writer(lua_State*, int);
+  writer_t* check_writer(lua_State*, int);
+  void write_json(lua_State*, writer_t*, int, int, int, bool);
+  void write_json_string(writer_t*, const char*, size_t);
   void initialize_writer(lua_State*);
+
+  // RFC 8785 はキーを UTF-16 のコードユニット順で比較する。UTF-8 のバイト
+  // 順と異なるのは U+E000..U+FFFF と補助面の間だけなので、前者の先頭
+  // バイト (0xEE, 0xEF) を補助面の先頭バイト (0xF0..0xF4) より後ろに
+  // 写像すれば、バイト列の比較でコードユニット順が得られる。
+  // sort_keys は従来どおり char の比較順を保つ。
+  inline uint8_t json_key_byte(char c, bool canonical) {
+    if (canonical) {
+      uint8_t byte = static_cast<uint8_t>(c);
+      if (byte == 0xEE || byte == 0xEF) {
+        return byte + 8;
+      }
+      return byte;
+    }
+    return static_cast<uint8_t>(c - CHAR_MIN);
+  }
 }
 
 #endif
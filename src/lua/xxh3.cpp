@@ -0,0 +1,505 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+#include "common.hpp"
+#include "crypto.hpp"
+#include "noncopyable.hpp"
+
+#include <lua.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BRIGID_XXH3_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace brigid {
+  namespace {
+    // XXH3 with the default secret and no seed, as specified by xxHash 0.8.
+    // Inputs up to 240 bytes are kept in the buffer and hashed by the short
+    // input algorithms; longer inputs are accumulated stripe by stripe.
+
+    const uint8_t secret[192] = {
+      0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+      0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+      0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+      0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+      0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+      0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+      0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+      0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+      0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+      0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+      0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+      0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+    };
+
+    const uint32_t prime32_1 = 0x9E3779B1U;
+    const uint32_t prime32_2 = 0x85EBCA77U;
+    const uint32_t prime32_3 = 0xC2B2AE3DU;
+    const uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+    const uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+    const uint64_t prime_mx1 = 0x165667919E3779F9ULL;
+    const uint64_t prime_mx2 = 0x9FB21C651E98DF25ULL;
+
+    const size_t stripe_size = 64;
+    const size_t buffer_size = 256;
+    const size_t midsize_max = 240;
+    const size_t secret_limit = sizeof(secret) - stripe_size;
+    const size_t stripes_per_block = secret_limit / 8;
+
+    struct uint128_t {
+      uint64_t low;
+      uint64_t high;
+    };
+
+    inline uint32_t read32(const uint8_t* p) {
+      return static_cast<uint32_t>(p[0])
+          | static_cast<uint32_t>(p[1]) << 8
+          | static_cast<uint32_t>(p[2]) << 16
+          | static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    inline uint64_t read64(const uint8_t* p) {
+      return static_cast<uint64_t>(read32(p)) | static_cast<uint64_t>(read32(p + 4)) << 32;
+    }
+
+    inline uint32_t swap32(uint32_t x) {
+      return (x << 24) | ((x << 8) & 0x00FF0000U) | ((x >> 8) & 0x0000FF00U) | (x >> 24);
+    }
+
+    inline uint64_t swap64(uint64_t x) {
+      return static_cast<uint64_t>(swap32(static_cast<uint32_t>(x))) << 32 | swap32(static_cast<uint32_t>(x >> 32));
+    }
+
+    inline uint32_t rotl32(uint32_t x, int r) {
+      return (x << r) | (x >> (32 - r));
+    }
+
+    inline uint64_t rotl64(uint64_t x, int r) {
+      return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint128_t mult64to128(uint64_t lhs, uint64_t rhs) {
+#if defined(__SIZEOF_INT128__)
+      unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+      uint128_t result = { static_cast<uint64_t>(product), static_cast<uint64_t>(product >> 64) };
+      return result;
+#else
+      uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+      uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+      uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+      uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+      uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+      uint128_t result = { (cross << 32) | (lo_lo & 0xFFFFFFFF), (hi_lo >> 32) + (cross >> 32) + hi_hi };
+      return result;
+#endif
+    }
+
+    inline uint64_t mul128_fold64(uint64_t lhs, uint64_t rhs) {
+      uint128_t product = mult64to128(lhs, rhs);
+      return product.low ^ product.high;
+    }
+
+    inline uint64_t xorshift64(uint64_t x, int shift) {
+      return x ^ (x >> shift);
+    }
+
+    uint64_t xxh64_avalanche(uint64_t h) {
+      h ^= h >> 33;
+      h *= prime64_2;
+      h ^= h >> 29;
+      h *= prime64_3;
+      h ^= h >> 32;
+      return h;
+    }
+
+    uint64_t avalanche(uint64_t h) {
+      h = xorshift64(h, 37);
+      h *= prime_mx1;
+      return xorshift64(h, 32);
+    }
+
+    uint64_t rrmxmx(uint64_t h, uint64_t size) {
+      h ^= rotl64(h, 49) ^ rotl64(h, 24);
+      h *= prime_mx2;
+      h ^= (h >> 35) + size;
+      h *= prime_mx2;
+      return xorshift64(h, 28);
+    }
+
+    inline uint64_t mix16(const uint8_t* p, const uint8_t* s) {
+      return mul128_fold64(read64(p) ^ read64(s), read64(p + 8) ^ read64(s + 8));
+    }
+
+    uint64_t hash64_short(const uint8_t* p, size_t size) {
+      if (size > 128) {
+        uint64_t acc = size * prime64_1;
+        for (size_t i = 0; i < 8; ++i) {
+          acc += mix16(p + 16 * i, secret + 16 * i);
+        }
+        acc = avalanche(acc);
+        uint64_t acc_end = mix16(p + size - 16, secret + 136 - 17);
+        for (size_t i = 8; i < size / 16; ++i) {
+          acc_end += mix16(p + 16 * i, secret + 16 * (i - 8) + 3);
+        }
+        return avalanche(acc + acc_end);
+      } else if (size > 16) {
+        uint64_t acc = size * prime64_1;
+        if (size > 32) {
+          if (size > 64) {
+            if (size > 96) {
+              acc += mix16(p + 48, secret + 96);
+              acc += mix16(p + size - 64, secret + 112);
+            }
+            acc += mix16(p + 32, secret + 64);
+            acc += mix16(p + size - 48, secret + 80);
+          }
+          acc += mix16(p + 16, secret + 32);
+          acc += mix16(p + size - 32, secret + 48);
+        }
+        acc += mix16(p, secret);
+        acc += mix16(p + size - 16, secret + 16);
+        return avalanche(acc);
+      } else if (size > 8) {
+        uint64_t lo = read64(p) ^ (read64(secret + 24) ^ read64(secret + 32));
+        uint64_t hi = read64(p + size - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+        return avalanche(size + swap64(lo) + hi + mul128_fold64(lo, hi));
+      } else if (size >= 4) {
+        uint64_t input = read32(p + size - 4) + (static_cast<uint64_t>(read32(p)) << 32);
+        return rrmxmx(input ^ (read64(secret + 8) ^ read64(secret + 16)), size);
+      } else if (size > 0) {
+        uint32_t combined = static_cast<uint32_t>(p[0]) << 16
+            | static_cast<uint32_t>(p[size >> 1]) << 24
+            | static_cast<uint32_t>(p[size - 1])
+            | static_cast<uint32_t>(size) << 8;
+        return xxh64_avalanche(combined ^ static_cast<uint64_t>(read32(secret) ^ read32(secret + 4)));
+      }
+      return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+    }
+
+    inline void mix32(uint128_t& acc, const uint8_t* p1, const uint8_t* p2, const uint8_t* s) {
+      acc.low += mix16(p1, s);
+      acc.low ^= read64(p2) + read64(p2 + 8);
+      acc.high += mix16(p2, s + 16);
+      acc.high ^= read64(p1) + read64(p1 + 8);
+    }
+
+    uint128_t hash128_short(const uint8_t* p, size_t size) {
+      if (size > 16) {
+        uint128_t acc = { size * prime64_1, 0 };
+        if (size > 128) {
+          for (size_t i = 32; i < 160; i += 32) {
+            mix32(acc, p + i - 32, p + i - 16, secret + i - 32);
+          }
+          acc.low = avalanche(acc.low);
+          acc.high = avalanche(acc.high);
+          for (size_t i = 160; i <= size; i += 32) {
+            mix32(acc, p + i - 32, p + i - 16, secret + 3 + i - 160);
+          }
+          mix32(acc, p + size - 16, p + size - 32, secret + 136 - 17 - 16);
+        } else {
+          if (size > 32) {
+            if (size > 64) {
+              if (size > 96) {
+                mix32(acc, p + 48, p + size - 64, secret + 96);
+              }
+              mix32(acc, p + 32, p + size - 48, secret + 64);
+            }
+            mix32(acc, p + 16, p + size - 32, secret + 32);
+          }
+          mix32(acc, p, p + size - 16, secret);
+        }
+        uint128_t result = {
+          avalanche(acc.low + acc.high),
+          0 - avalanche(acc.low * prime64_1 + acc.high * prime64_4 + size * prime64_2),
+        };
+        return result;
+      } else if (size > 8) {
+        uint64_t lo = read64(p);
+        uint64_t hi = read64(p + size - 8);
+        uint128_t m = mult64to128(lo ^ hi ^ (read64(secret + 32) ^ read64(secret + 40)), prime64_1);
+        m.low += static_cast<uint64_t>(size - 1) << 54;
+        hi ^= read64(secret + 48) ^ read64(secret + 56);
+        m.high += hi + static_cast<uint64_t>(static_cast<uint32_t>(hi)) * (prime32_2 - 1);
+        m.low ^= swap64(m.high);
+        uint128_t h = mult64to128(m.low, prime64_2);
+        h.high += m.high * prime64_2;
+        h.low = avalanche(h.low);
+        h.high = avalanche(h.high);
+        return h;
+      } else if (size >= 4) {
+        uint64_t input = read32(p) + (static_cast<uint64_t>(read32(p + size - 4)) << 32);
+        uint64_t keyed = input ^ (read64(secret + 16) ^ read64(secret + 24));
+        uint128_t m = mult64to128(keyed, prime64_1 + (size << 2));
+        m.high += m.low << 1;
+        m.low ^= m.high >> 3;
+        m.low = xorshift64(m.low, 35);
+        m.low *= prime_mx2;
+        m.low = xorshift64(m.low, 28);
+        m.high = avalanche(m.high);
+        return m;
+      } else if (size > 0) {
+        uint32_t combined_lo = static_cast<uint32_t>(p[0]) << 16
+            | static_cast<uint32_t>(p[size >> 1]) << 24
+            | static_cast<uint32_t>(p[size - 1])
+            | static_cast<uint32_t>(size) << 8;
+        uint32_t combined_hi = rotl32(swap32(combined_lo), 13);
+        uint128_t result = {
+          xxh64_avalanche(combined_lo ^ static_cast<uint64_t>(read32(secret) ^ read32(secret + 4))),
+          xxh64_avalanche(combined_hi ^ static_cast<uint64_t>(read32(secret + 8) ^ read32(secret + 12))),
+        };
+        return result;
+      }
+      uint128_t result = {
+        xxh64_avalanche(read64(secret + 64) ^ read64(secret + 72)),
+        xxh64_avalanche(read64(secret + 80) ^ read64(secret + 88)),
+      };
+      return result;
+    }
+
+#ifdef BRIGID_XXH3_SSE2
+    inline void accumulate_stripe(uint64_t* acc, const uint8_t* p, const uint8_t* s) {
+      for (size_t i = 0; i < 4; ++i) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc) + i);
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p) + i);
+        __m128i key = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s) + i));
+        __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i sum = _mm_add_epi64(a, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc) + i, _mm_add_epi64(product, sum));
+      }
+    }
+
+    inline void scramble(uint64_t* acc, const uint8_t* s) {
+      const __m128i prime = _mm_set1_epi32(static_cast<int>(prime32_1));
+      for (size_t i = 0; i < 4; ++i) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc) + i);
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s) + i));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc) + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+      }
+    }
+#else
+    inline void accumulate_stripe(uint64_t* acc, const uint8_t* p, const uint8_t* s) {
+      for (size_t i = 0; i < 8; ++i) {
+        uint64_t data = read64(p + i * 8);
+        uint64_t key = data ^ read64(s + i * 8);
+        acc[i ^ 1] += data;
+        acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+      }
+    }
+
+    inline void scramble(uint64_t* acc, const uint8_t* s) {
+      for (size_t i = 0; i < 8; ++i) {
+        uint64_t a = xorshift64(acc[i], 47) ^ read64(s + i * 8);
+        acc[i] = a * prime32_1;
+      }
+    }
+#endif
+
+    uint64_t merge(const uint64_t* acc, const uint8_t* s, uint64_t start) {
+      uint64_t result = start;
+      for (size_t i = 0; i < 4; ++i) {
+        result += mul128_fold64(acc[2 * i] ^ read64(s + 16 * i), acc[2 * i + 1] ^ read64(s + 16 * i + 8));
+      }
+      return avalanche(result);
+    }
+
+    void write64(char* buffer, uint64_t value) {
+      for (int i = 7; i >= 0; --i) {
+        buffer[i] = static_cast<char>(value & 0xFF);
+        value >>= 8;
+      }
+    }
+
+    class xxh3_t {
+    public:
+      xxh3_t() {
+        reset();
+      }
+
+      void reset() {
+        acc_[0] = prime32_3;
+        acc_[1] = prime64_1;
+        acc_[2] = prime64_2;
+        acc_[3] = prime64_3;
+        acc_[4] = prime64_4;
+        acc_[5] = prime32_2;
+        acc_[6] = prime64_5;
+        acc_[7] = prime32_1;
+        buffered_size_ = 0;
+        stripes_ = 0;
+        total_size_ = 0;
+      }
+
+      void update(const uint8_t* p, size_t size) {
+        total_size_ += size;
+        if (size <= buffer_size - buffered_size_) {
+          memcpy(buffer_ + buffered_size_, p, size);
+          buffered_size_ += size;
+          return;
+        }
+
+        // At least one byte is always kept in the buffer for the last stripe.
+        const uint8_t* pe = p + size;
+        if (buffered_size_) {
+          size_t n = buffer_size - buffered_size_;
+          memcpy(buffer_ + buffered_size_, p, n);
+          p += n;
+          consume(acc_, stripes_, buffer_, buffer_size / stripe_size);
+          buffered_size_ = 0;
+        }
+        if (static_cast<size_t>(pe - p) > buffer_size) {
+          size_t n = (pe - p - 1) / stripe_size;
+          consume(acc_, stripes_, p, n);
+          p += n * stripe_size;
+          memcpy(buffer_ + buffer_size - stripe_size, p - stripe_size, stripe_size);
+        }
+        buffered_size_ = pe - p;
+        memcpy(buffer_, p, buffered_size_);
+      }
+
+      uint64_t digest64() const {
+        if (total_size_ <= midsize_max) {
+          return hash64_short(buffer_, static_cast<size_t>(total_size_));
+        }
+        uint64_t acc[8];
+        digest_long(acc);
+        return merge(acc, secret + 11, total_size_ * prime64_1);
+      }
+
+      uint128_t digest128() const {
+        if (total_size_ <= midsize_max) {
+          return hash128_short(buffer_, static_cast<size_t>(total_size_));
+        }
+        uint64_t acc[8];
+        digest_long(acc);
+        uint128_t result = {
+          merge(acc, secret + 11, total_size_ * prime64_1),
+          merge(acc, secret + sizeof(secret) - 64 - 11, ~(total_size_ * prime64_2)),
+        };
+        return result;
+      }
+
+    private:
+      uint64_t acc_[8];
+      uint8_t buffer_[buffer_size];
+      size_t buffered_size_;
+      size_t stripes_;
+      uint64_t total_size_;
+
+      static void consume(uint64_t* acc, size_t& stripes, const uint8_t* p, size_t n) {
+        while (n > 0) {
+          size_t m = stripes_per_block - stripes;
+          if (m > n) {
+            m = n;
+          }
+          for (size_t i = 0; i < m; ++i) {
+            accumulate_stripe(acc, p + i * stripe_size, secret + (stripes + i) * 8);
+          }
+          p += m * stripe_size;
+          n -= m;
+          stripes += m;
+          if (stripes == stripes_per_block) {
+            scramble(acc, secret + secret_limit);
+            stripes = 0;
+          }
+        }
+      }
+
+      void digest_long(uint64_t* acc) const {
+        memcpy(acc, acc_, sizeof(acc_));
+        uint8_t last[stripe_size];
+        const uint8_t* p = nullptr;
+        if (buffered_size_ >= stripe_size) {
+          size_t stripes = stripes_;
+          consume(acc, stripes, buffer_, (buffered_size_ - 1) / stripe_size);
+          p = buffer_ + buffered_size_ - stripe_size;
+        } else {
+          size_t n = stripe_size - buffered_size_;
+          memcpy(last, buffer_ + buffer_size - n, n);
+          memcpy(last + n, buffer_, buffered_size_);
+          p = last;
+        }
+        accumulate_stripe(acc, p, secret + secret_limit - 7);
+      }
+    };
+
+    class xxh3_64_hasher_impl : public hasher, private noncopyable {
+    public:
+      xxh3_64_hasher_impl() {}
+
+      explicit xxh3_64_hasher_impl(const xxh3_t& state)
+        : state_(state) {}
+
+      virtual void update(const char* data, size_t size) {
+        state_.update(reinterpret_cast<const uint8_t*>(data), size);
+      }
+
+      virtual void digest(lua_State* L) {
+        char buffer[8] = {};
+        write64(buffer, state_.digest64());
+        lua_pushlstring(L, buffer, sizeof(buffer));
+      }
+
+      virtual void reset() {
+        state_.reset();
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<xxh3_64_hasher_impl>(L, "brigid.hasher", state_);
+      }
+
+    private:
+      xxh3_t state_;
+    };
+
+    class xxh3_128_hasher_impl : public hasher, private noncopyable {
+    public:
+      xxh3_128_hasher_impl() {}
+
+      explicit xxh3_128_hasher_impl(const xxh3_t& state)
+        : state_(state) {}
+
+      virtual void update(const char* data, size_t size) {
+        state_.update(reinterpret_cast<const uint8_t*>(data), size);
+      }
+
+      virtual void digest(lua_State* L) {
+        uint128_t result = state_.digest128();
+        char buffer[16] = {};
+        write64(buffer, result.high);
+        write64(buffer + 8, result.low);
+        lua_pushlstring(L, buffer, sizeof(buffer));
+      }
+
+      virtual void reset() {
+        state_.reset();
+      }
+
+      virtual hasher* clone(lua_State* L) const {
+        return new_userdata<xxh3_128_hasher_impl>(L, "brigid.hasher", state_);
+      }
+
+    private:
+      xxh3_t state_;
+    };
+  }
+
+  hasher* new_xxh3_64_hasher(lua_State* L) {
+    return new_userdata<xxh3_64_hasher_impl>(L, "brigid.hasher");
+  }
+
+  hasher* new_xxh3_128_hasher(lua_State* L) {
+    return new_userdata<xxh3_128_hasher_impl>(L, "brigid.hasher");
+  }
+}
@@ -1,8 +1,9 @@
 @echo off
 
-REM Copyright (c) 2021 <dev@brigid.jp>
+REM Copyright (c) 2021,2026 <dev@brigid.jp>
 REM This software is released under the MIT License.
 REM https://opensource.org/licenses/mit-license.php
 
 SET LUA_CPATH=..\..\?.dll;;
 lua5.1 bench.lua
+lua5.1 bench_crypto.lua "" bench_crypto.json
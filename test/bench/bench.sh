@@ -1,6 +1,6 @@
 #! /bin/sh -e
 
-# Copyright (c) 2021 <dev@brigid.jp>
+# Copyright (c) 2021,2026 <dev@brigid.jp>
 # This software is released under the MIT License.
 # https://opensource.org/licenses/mit-license.php
 
@@ -8,6 +8,15 @@ LUA_CPATH="../../src/lua/.libs/?.so;;"
 export LUA_CPATH
 
 case X$# in
-  X0) lua bench.lua;;
-  *) "$@" bench.lua;;
+  X0) set lua;;
 esac
+
+"$@" bench.lua
+
+if test -x bench_openssl.exe
+then
+  ./bench_openssl.exe >bench_openssl.json
+  "$@" bench_crypto.lua "" bench_crypto.json bench_openssl.json
+else
+  "$@" bench_crypto.lua "" bench_crypto.json
+fi
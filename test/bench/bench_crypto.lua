@@ -0,0 +1,315 @@
+-- Copyright (c) 2026 <dev@brigid.jp>
+-- This software is released under the MIT License.
+-- https://opensource.org/licenses/mit-license.php
+
+-- Measures hashers and cryptors and writes the results as JSON to compare
+-- builds and backends. The baseline is the output of bench_openssl.exe, which
+-- runs the same loops without the binding. If it is given, the difference is
+-- written as the overhead of the binding.
+--
+-- usage: lua bench_crypto.lua [label [output [baseline [total_size]]]]
+
+local brigid = require "brigid"
+
+local label = arg[1] or ""
+local output = arg[2]
+local baseline = arg[3]
+local total_size = tonumber(arg[4]) or 64 * 1024 * 1024
+local max_count = 1000000
+local setup_count = 100000
+
+local sizes = {
+  16,
+  256,
+  4 * 1024,
+  64 * 1024,
+  1024 * 1024,
+  16 * 1024 * 1024,
+  64 * 1024 * 1024,
+}
+
+local t = brigid.stopwatch()
+local iv = ("i"):rep(16)
+local function callback() end
+
+local messages = {}
+for _, size in ipairs(sizes) do
+  messages[size] = ("x"):rep(size)
+end
+
+local function round(value)
+  return math.floor(value + 0.5)
+end
+
+local function read_baseline(path)
+  local handle = assert(io.open(path, "rb"))
+  local source = handle:read "*a"
+  handle:close()
+  local data = assert(brigid.json.parse(source))
+  local items = {}
+  for _, item in ipairs(data.hashers) do
+    items[item.name] = item
+  end
+  for _, item in ipairs(data.cryptors) do
+    items[item.name .. " " .. item.operation] = item
+  end
+  return { version = data.version, items = items }
+end
+
+if baseline then
+  baseline = read_baseline(baseline)
+end
+
+-- Sets the baseline and the overhead of each field from the item of the same
+-- name in the output of bench_openssl.exe.
+local function compare(result, key)
+  if not baseline then
+    return
+  end
+  local item = baseline.items[key]
+  if not item then
+    return
+  end
+  local baseline_results = {}
+  for _, v in ipairs(item.results) do
+    baseline_results[v.size] = v
+  end
+  for _, v in ipairs(result.results) do
+    local u = baseline_results[v.size]
+    if u then
+      v.baseline_ns_per_op = u.ns_per_op
+      v.overhead_ns = v.ns_per_op - u.ns_per_op
+    end
+  end
+  for _, name in ipairs { "setup_ns", "oneshot_ns", "reset_ns" } do
+    if result[name] and item[name] then
+      result["baseline_" .. name] = item[name]
+      result["overhead_" .. name] = result[name] - item[name]
+    end
+  end
+end
+
+-- new() returns a hasher or a cryptor for each run and finish(object)
+-- completes it.
+local function measure(new, finish)
+  local results = {}
+  for _, size in ipairs(sizes) do
+    local message = messages[size]
+    local count = math.max(1, math.min(max_count, math.floor(total_size / size)))
+    collectgarbage()
+    local object = new()
+    t:start()
+    for _ = 1, count do
+      object:update(message)
+    end
+    finish(object)
+    t:stop()
+    local elapsed = t:get_elapsed()
+    results[#results + 1] = {
+      size = size;
+      count = count;
+      ns_per_op = round(elapsed / count);
+      bytes_per_second = round(size * count * 1000000000 / elapsed);
+    }
+  end
+  return { results = results }
+end
+
+local function measure_setup(f)
+  collectgarbage()
+  t:start()
+  for _ = 1, setup_count do
+    f()
+  end
+  t:stop()
+  return round(t:get_elapsed() / setup_count)
+end
+
+local function measure_throughput(size, f)
+  collectgarbage()
+  t:start()
+  f()
+  t:stop()
+  return round(size * 1000000000 / t:get_elapsed())
+end
+
+local hashers = {}
+for _, name in ipairs { "sha1", "sha256", "sha512" } do
+  local message = messages[16]
+  local result = measure(function ()
+    return brigid.hasher(name)
+  end, function (hasher)
+    hasher:digest()
+  end)
+  result.name = name
+  result.setup_ns = measure_setup(function ()
+    brigid.hasher(name)
+  end)
+  -- Creating a hasher for each message of 16 bytes.
+  result.oneshot_ns = measure_setup(function ()
+    brigid.hasher(name):update(message):digest()
+  end)
+  compare(result, name)
+  hashers[#hashers + 1] = result
+end
+
+local cryptors = {}
+for _, name in ipairs { "aes-128-cbc", "aes-192-cbc", "aes-256-cbc" } do
+  local key = ("k"):rep(tonumber(name:match "%d+") / 8)
+  local ciphertext = assert(brigid.encrypt(name, key, iv, messages[16]))
+  for _, operation in ipairs { "encryptor", "decryptor" } do
+    local new_cryptor = brigid[operation]
+    -- Decrypting the repeated plaintext is as costly as decrypting a real
+    -- ciphertext, but the padding is not checked.
+    local result = measure(function ()
+      return assert(new_cryptor(name, key, iv, callback))
+    end, function (cryptor)
+      cryptor:close()
+    end)
+    result.name = name
+    result.operation = operation
+    result.setup_ns = measure_setup(function ()
+      new_cryptor(name, key, iv, callback)
+    end)
+    -- Reusing a cryptor for a message of 16 bytes.
+    local cryptor = assert(new_cryptor(name, key, iv, callback))
+    local message = operation == "encryptor" and messages[16] or ciphertext
+    result.reset_ns = measure_setup(function ()
+      cryptor:reset(iv)
+      cryptor:update(message, true)
+    end)
+    compare(result, name .. " " .. operation)
+    cryptors[#cryptors + 1] = result
+  end
+end
+
+-- Hashing small blobs one by one and in a batch.
+local hashes = {}
+do
+  local source = {}
+  for i = 1, 1000 do
+    source[i] = ("%064d"):format(i)
+  end
+  local n = #source
+  local count = setup_count / n
+  for _, name in ipairs { "sha1", "sha256", "sha512", "xxh3_64", "xxh3_128", "crc32c" } do
+    local result = { name = name }
+    result.hasher_ns = measure_setup(function ()
+      brigid.hasher(name):update(source[1]):digest()
+    end)
+    result.hash_ns = measure_setup(function ()
+      brigid.hash(name, source[1])
+    end)
+    collectgarbage()
+    t:start()
+    for _ = 1, count do
+      brigid.hash_many(name, source)
+    end
+    t:stop()
+    result.hash_many_ns = round(t:get_elapsed() / (count * n))
+    hashes[#hashes + 1] = result
+  end
+end
+
+local hash_files = {}
+do
+  local path = os.tmpname()
+  local handle = assert(io.open(path, "wb"))
+  local block = messages[64 * 1024]
+  local size = 0
+  while size < total_size do
+    handle:write(block)
+    size = size + #block
+  end
+  handle:close()
+  for _, name in ipairs { "sha256", "sha512", "blake3", "xxh3_64", "crc32c" } do
+    hash_files[#hash_files + 1] = {
+      name = name;
+      bytes_per_second = measure_throughput(size, function ()
+        assert(brigid.hash_file(path, name))
+      end);
+    }
+  end
+  os.remove(path)
+end
+
+-- A new cryptor, cryptor:reset and brigid.encrypt for each record of 64
+-- bytes, and a Lua callback and a brigid.writer as the output of a cryptor.
+local records = {}
+do
+  local key = ("k"):rep(32)
+  local record = ("x"):rep(64)
+  local chunk = messages[256]
+  for _, name in ipairs { "aes-256-cbc", "aes-256-gcm" } do
+    local record_iv = iv:sub(1, name == "aes-256-gcm" and 12 or 16)
+    local writer = brigid.data_writer()
+    local result = { name = name }
+    result.new_ns = measure_setup(function ()
+      local cryptor = brigid.encryptor(name, key, record_iv, writer)
+      cryptor:update(record, true)
+      cryptor:close()
+    end)
+    local cryptor = brigid.encryptor(name, key, record_iv, writer)
+    result.reset_ns = measure_setup(function ()
+      cryptor:reset(record_iv)
+      cryptor:update(record, true)
+    end)
+    result.encrypt_ns = measure_setup(function ()
+      brigid.encrypt(name, key, record_iv, record)
+    end)
+
+    local cryptor = assert(brigid.encryptor(name, key, record_iv, callback))
+    result.callback_ns = measure_setup(function ()
+      cryptor:update(chunk)
+    end)
+    local cryptor = assert(brigid.encryptor(name, key, record_iv, brigid.hasher "crc32c"))
+    result.writer_ns = measure_setup(function ()
+      cryptor:update(chunk)
+    end)
+    records[#records + 1] = result
+  end
+end
+
+-- brigid.decrypt with a number of threads.
+local decrypts = {}
+do
+  local key = ("k"):rep(32)
+  local plaintext = messages[64 * 1024]:rep(math.max(1, math.floor(total_size / (64 * 1024))))
+  for _, name in ipairs { "aes-256-cbc", "aes-256-ctr" } do
+    local ciphertext = assert(brigid.encrypt(name, key, iv, plaintext))
+    for _, threads in ipairs { 1, 2, 4, 8 } do
+      local result
+      decrypts[#decrypts + 1] = {
+        name = name;
+        threads = threads;
+        bytes_per_second = measure_throughput(#plaintext, function ()
+          result = assert(brigid.decrypt(name, key, iv, ciphertext, { threads = threads }))
+        end);
+      }
+      assert(result == plaintext)
+    end
+  end
+end
+
+local writer = brigid.data_writer()
+writer:write_json({
+  label = label;
+  version = brigid.get_version();
+  lua = _VERSION;
+  baseline = baseline and baseline.version;
+  hashers = hashers;
+  cryptors = cryptors;
+  hashes = hashes;
+  hash_files = hash_files;
+  records = records;
+  decrypts = decrypts;
+}, 2, true)
+writer:write "\n"
+
+if output then
+  local out = assert(io.open(output, "wb"))
+  out:write(writer:get_string())
+  out:close()
+else
+  io.write(writer:get_string())
+end
@@ -0,0 +1,236 @@
+// Copyright (c) 2026 <dev@brigid.jp>
+// This software is released under the MIT License.
+// https://opensource.org/licenses/mit-license.php
+
+// Runs the loops of bench_crypto.lua against OpenSSL without the binding and
+// writes the results as JSON. bench_crypto.lua reads it as the baseline and
+// reports the difference as the overhead of the binding.
+//
+// usage: bench_openssl.exe [total_size]
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+#define BRIGID_OPENSSL_SHA_CTX
+#endif
+
+namespace brigid {
+  namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    const size_t max_count = 1000000;
+    const size_t setup_count = 100000;
+
+    const size_t sizes[] = {
+      16,
+      256,
+      4 * 1024,
+      64 * 1024,
+      1024 * 1024,
+      16 * 1024 * 1024,
+      64 * 1024 * 1024,
+    };
+
+    const unsigned char key[32] = {
+      'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k',
+      'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k', 'k',
+    };
+
+    const unsigned char iv[16] = {
+      'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i', 'i',
+    };
+
+    double elapsed_ns(clock_type::time_point started) {
+      return std::chrono::duration<double, std::nano>(clock_type::now() - started).count();
+    }
+
+    long long round(double value) {
+      return static_cast<long long>(value + 0.5);
+    }
+
+    template <class T>
+    long long measure_setup(T f) {
+      clock_type::time_point started = clock_type::now();
+      for (size_t i = 0; i < setup_count; ++i) {
+        f();
+      }
+      return round(elapsed_ns(started) / setup_count);
+    }
+
+    // update(data, size) is called for each message and finish() completes
+    // the run, as measure() of bench_crypto.lua does.
+    template <class T_init, class T_update, class T_finish>
+    void measure(const std::vector<unsigned char>& buffer, size_t total_size, T_init init, T_update update, T_finish finish) {
+      std::cout << "      \"results\": [\n";
+      for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t size = sizes[i];
+        size_t count = std::max<size_t>(1, std::min(max_count, total_size / size));
+        init();
+        clock_type::time_point started = clock_type::now();
+        for (size_t j = 0; j < count; ++j) {
+          update(buffer.data(), size);
+        }
+        finish();
+        double elapsed = elapsed_ns(started);
+        std::cout
+            << "        {\n"
+            << "          \"count\": " << count << ",\n"
+            << "          \"ns_per_op\": " << round(elapsed / count) << ",\n"
+            << "          \"size\": " << size << "\n"
+            << "        }" << (i + 1 < sizeof(sizes) / sizeof(sizes[0]) ? "," : "") << "\n";
+      }
+      std::cout << "      ],\n";
+    }
+
+#ifdef BRIGID_OPENSSL_SHA_CTX
+    template <class T, int (*T_init)(T*), int (*T_update)(T*, const void*, size_t), int (*T_final)(unsigned char*, T*)>
+    void bench_hasher(const char* name, const std::vector<unsigned char>& buffer, size_t total_size, bool last) {
+      unsigned char digest[EVP_MAX_MD_SIZE] = {};
+      T ctx;
+
+      std::cout << "    {\n";
+      measure(buffer, total_size,
+        [&]() { T_init(&ctx); },
+        [&](const unsigned char* data, size_t size) { T_update(&ctx, data, size); },
+        [&]() { T_final(digest, &ctx); });
+      std::cout
+          << "      \"name\": \"" << name << "\",\n"
+          << "      \"setup_ns\": " << measure_setup([&]() {
+            T_init(&ctx);
+          }) << ",\n"
+          << "      \"oneshot_ns\": " << measure_setup([&]() {
+            T_init(&ctx);
+            T_update(&ctx, buffer.data(), 16);
+            T_final(digest, &ctx);
+          }) << "\n"
+          << "    }" << (last ? "" : ",") << "\n";
+    }
+#else
+    void bench_hasher(const char* name, const std::vector<unsigned char>& buffer, size_t total_size, bool last) {
+      unsigned char digest[EVP_MAX_MD_SIZE] = {};
+      unsigned int digest_size = 0;
+      EVP_MD* md = EVP_MD_fetch(nullptr, name, nullptr);
+      EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+
+      std::cout << "    {\n";
+      measure(buffer, total_size,
+        [&]() { EVP_DigestInit_ex(ctx, md, nullptr); },
+        [&](const unsigned char* data, size_t size) { EVP_DigestUpdate(ctx, data, size); },
+        [&]() { EVP_DigestFinal_ex(ctx, digest, &digest_size); });
+      std::cout
+          << "      \"name\": \"" << name << "\",\n"
+          << "      \"setup_ns\": " << measure_setup([&]() {
+            EVP_DigestInit_ex(ctx, md, nullptr);
+          }) << ",\n"
+          << "      \"oneshot_ns\": " << measure_setup([&]() {
+            EVP_DigestInit_ex(ctx, md, nullptr);
+            EVP_DigestUpdate(ctx, buffer.data(), 16);
+            EVP_DigestFinal_ex(ctx, digest, &digest_size);
+          }) << "\n"
+          << "    }" << (last ? "" : ",") << "\n";
+
+      EVP_MD_CTX_free(ctx);
+      EVP_MD_free(md);
+    }
+#endif
+
+    // Decrypting the repeated plaintext is as costly as decrypting a real
+    // ciphertext. The decryptor is not finished since the padding would not
+    // match, as close() of bench_crypto.lua does not check it either.
+    void bench_cryptor(const char* name, const std::vector<unsigned char>& buffer, size_t total_size, bool last) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      EVP_CIPHER* cipher = EVP_CIPHER_fetch(nullptr, name, nullptr);
+#else
+      const EVP_CIPHER* cipher = EVP_get_cipherbyname(name);
+#endif
+      std::vector<unsigned char> out(buffer.size() + EVP_MAX_BLOCK_LENGTH);
+      int out_size = 0;
+
+      // The ciphertext of a message of 16 bytes for the reset of a decryptor.
+      unsigned char ciphertext[16 + EVP_MAX_BLOCK_LENGTH] = {};
+      int ciphertext_size = 0;
+      {
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        EVP_CipherInit_ex(ctx, cipher, nullptr, key, iv, 1);
+        EVP_CipherUpdate(ctx, ciphertext, &out_size, buffer.data(), 16);
+        EVP_CipherFinal_ex(ctx, ciphertext + out_size, &ciphertext_size);
+        ciphertext_size += out_size;
+        EVP_CIPHER_CTX_free(ctx);
+      }
+
+      for (int encrypt = 1; encrypt >= 0; --encrypt) {
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        std::cout << "    {\n";
+        measure(buffer, total_size,
+          [&]() { EVP_CipherInit_ex(ctx, cipher, nullptr, key, iv, encrypt); },
+          [&](const unsigned char* data, size_t size) { EVP_CipherUpdate(ctx, out.data(), &out_size, data, static_cast<int>(size)); },
+          [&]() {
+            if (encrypt) {
+              EVP_CipherFinal_ex(ctx, out.data(), &out_size);
+            }
+          });
+        std::cout
+            << "      \"name\": \"" << name << "\",\n"
+            << "      \"operation\": \"" << (encrypt ? "encryptor" : "decryptor") << "\",\n"
+            << "      \"setup_ns\": " << measure_setup([&]() {
+              EVP_CIPHER_CTX* setup_ctx = EVP_CIPHER_CTX_new();
+              EVP_CipherInit_ex(setup_ctx, cipher, nullptr, key, iv, encrypt);
+              EVP_CIPHER_CTX_free(setup_ctx);
+            }) << ",\n"
+            << "      \"reset_ns\": " << measure_setup([&]() {
+              EVP_CipherInit_ex(ctx, nullptr, nullptr, nullptr, iv, encrypt);
+              if (encrypt) {
+                EVP_CipherUpdate(ctx, out.data(), &out_size, buffer.data(), 16);
+              } else {
+                EVP_CipherUpdate(ctx, out.data(), &out_size, ciphertext, ciphertext_size);
+              }
+              EVP_CipherFinal_ex(ctx, out.data() + out_size, &out_size);
+            }) << "\n"
+            << "    }" << (last && !encrypt ? "" : ",") << "\n";
+        EVP_CIPHER_CTX_free(ctx);
+      }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      EVP_CIPHER_free(cipher);
+#endif
+    }
+
+    void bench(int ac, char* av[]) {
+      size_t total_size = 64 * 1024 * 1024;
+      if (ac > 1) {
+        total_size = strtoul(av[1], nullptr, 10);
+      }
+      std::vector<unsigned char> buffer(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1], 'x');
+
+      std::cout << "{\n" << "  \"hashers\": [\n";
+#ifdef BRIGID_OPENSSL_SHA_CTX
+      bench_hasher<SHA_CTX, SHA1_Init, SHA1_Update, SHA1_Final>("sha1", buffer, total_size, false);
+      bench_hasher<SHA256_CTX, SHA256_Init, SHA256_Update, SHA256_Final>("sha256", buffer, total_size, false);
+      bench_hasher<SHA512_CTX, SHA512_Init, SHA512_Update, SHA512_Final>("sha512", buffer, total_size, true);
+#else
+      bench_hasher("sha1", buffer, total_size, false);
+      bench_hasher("sha256", buffer, total_size, false);
+      bench_hasher("sha512", buffer, total_size, true);
+#endif
+      std::cout << "  ],\n" << "  \"cryptors\": [\n";
+      bench_cryptor("aes-128-cbc", buffer, total_size, false);
+      bench_cryptor("aes-192-cbc", buffer, total_size, false);
+      bench_cryptor("aes-256-cbc", buffer, total_size, true);
+      std::cout << "  ],\n" << "  \"version\": \"" << OpenSSL_version(OPENSSL_VERSION) << "\"\n" << "}\n";
+    }
+  }
+}
+
+int main(int ac, char* av[]) {
+  brigid::bench(ac, av);
+  return 0;
+}
@@ -1,4 +1,4 @@
-# Copyright (c) 2021 <dev@brigid.jp>
+# Copyright (c) 2021,2026 <dev@brigid.jp>
 # This software is released under the MIT License.
 # https://opensource.org/licenses/mit-license.php
 
@@ -10,8 +10,8 @@ LUA_INCDIR = $(shell luarocks config variables.LUA_INCDIR)
 LUA_LIBDIR = $(shell luarocks config variables.LUA_LIBDIR)
 
 CPPFLAGS = "-I$(LUA_INCDIR)" "-I$(JAVA_HOME)/include" "-I$(JAVA_HOME)/include/$(UNAME)" -I../..
-CXXFLAGS = -Wall -W -Wno-missing-field-initializers -std=c++11 $(CFLAGS)
-LDFLAGS = -shared "-L$(LUA_LIBDIR)" "-Wl,-rpath,$(LUA_LIBDIR)"
+CXXFLAGS = -Wall -W -Wno-missing-field-initializers -std=c++11 -pthread $(CFLAGS)
+LDFLAGS = -shared -pthread "-L$(LUA_LIBDIR)" "-Wl,-rpath,$(LUA_LIBDIR)"
 
 ifeq ($(UNAME),darwin)
 	TARGET_SUFFIX = .dylib
@@ -1,4 +1,4 @@
--- Copyright (c) 2019,2021,2022,2024 <dev@brigid.jp>
+-- Copyright (c) 2019,2021,2022,2024,2026 <dev@brigid.jp>
 -- This software is released under the MIT License.
 -- https://opensource.org/licenses/mit-license.php
 
@@ -44,6 +44,127 @@ local ciphertexts = {
   };
 }
 
+local aead_vectors = {
+  ["aes-128-gcm"] = {
+    key = table.concat {
+      "\254\255\233\146\134\101\115\028";
+      "\109\106\143\148\103\048\131\008";
+    };
+    iv = table.concat {
+      "\202\254\186\190\250\206\219\173";
+      "\222\202\248\136";
+    };
+    aad = table.concat {
+      "\254\237\250\206\222\173\190\239";
+      "\254\237\250\206\222\173\190\239";
+      "\171\173\218\210";
+    };
+    plaintext = table.concat {
+      "\217\049\050\037\248\132\006\229";
+      "\165\089\009\197\175\245\038\154";
+      "\134\167\169\083\021\052\247\218";
+      "\046\076\048\061\138\049\138\114";
+      "\028\060\012\149\149\104\009\083";
+      "\047\207\014\036\073\166\181\037";
+      "\177\106\237\245\170\013\230\087";
+      "\186\099\123\057";
+    };
+    ciphertext = table.concat {
+      "\066\131\030\194\033\119\116\036";
+      "\075\114\033\183\132\208\212\156";
+      "\227\170\033\047\044\002\164\224";
+      "\053\193\126\035\041\172\161\046";
+      "\033\213\020\178\084\102\147\028";
+      "\125\143\106\090\172\132\170\005";
+      "\027\163\011\057\106\010\172\151";
+      "\061\088\224\145";
+    };
+    tag = table.concat {
+      "\091\201\079\188\050\033\165\219";
+      "\148\250\233\090\231\018\026\071";
+    };
+  };
+  ["aes-256-gcm"] = {
+    key = table.concat {
+      "\254\255\233\146\134\101\115\028";
+      "\109\106\143\148\103\048\131\008";
+      "\254\255\233\146\134\101\115\028";
+      "\109\106\143\148\103\048\131\008";
+    };
+    iv = table.concat {
+      "\202\254\186\190\250\206\219\173";
+      "\222\202\248\136";
+    };
+    aad = table.concat {
+      "\254\237\250\206\222\173\190\239";
+      "\254\237\250\206\222\173\190\239";
+      "\171\173\218\210";
+    };
+    plaintext = table.concat {
+      "\217\049\050\037\248\132\006\229";
+      "\165\089\009\197\175\245\038\154";
+      "\134\167\169\083\021\052\247\218";
+      "\046\076\048\061\138\049\138\114";
+      "\028\060\012\149\149\104\009\083";
+      "\047\207\014\036\073\166\181\037";
+      "\177\106\237\245\170\013\230\087";
+      "\186\099\123\057";
+    };
+    ciphertext = table.concat {
+      "\082\045\193\240\153\086\125\007";
+      "\244\127\055\163\042\132\066\125";
+      "\100\058\140\220\191\229\192\201";
+      "\117\152\162\189\037\085\209\170";
+      "\140\176\142\072\089\013\187\061";
+      "\167\176\139\016\086\130\136\056";
+      "\197\246\030\099\147\186\122\010";
+      "\188\201\246\098";
+    };
+    tag = table.concat {
+      "\118\252\110\206\015\078\023\104";
+      "\205\223\136\083\187\045\085\027";
+    };
+  };
+  ["chacha20-poly1305"] = {
+    key = table.concat {
+      "\128\129\130\131\132\133\134\135";
+      "\136\137\138\139\140\141\142\143";
+      "\144\145\146\147\148\149\150\151";
+      "\152\153\154\155\156\157\158\159";
+    };
+    iv = table.concat {
+      "\007\000\000\000\064\065\066\067";
+      "\068\069\070\071";
+    };
+    aad = table.concat {
+      "\080\081\082\083\192\193\194\195";
+      "\196\197\198\199";
+    };
+    plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    ciphertext = table.concat {
+      "\211\026\141\052\100\142\096\219";
+      "\123\134\175\188\083\239\126\194";
+      "\164\173\237\081\041\110\008\254";
+      "\169\226\181\167\054\238\098\214";
+      "\061\190\164\094\140\169\103\018";
+      "\130\250\251\105\218\146\114\139";
+      "\026\113\222\010\158\006\011\041";
+      "\005\214\165\182\126\205\059\054";
+      "\146\221\189\127\045\119\139\140";
+      "\152\003\174\227\040\009\027\088";
+      "\250\179\036\228\250\214\117\148";
+      "\085\133\128\139\072\049\215\188";
+      "\063\244\222\240\142\075\122\157";
+      "\229\118\210\101\134\206\198\075";
+      "\097\022";
+    };
+    tag = table.concat {
+      "\026\225\011\089\079\009\226\106";
+      "\126\144\046\203\208\096\006\145";
+    };
+  };
+}
+
 local function encrypt(cipher, key, iv, plaintext)
   local result = {}
   local cryptor = assert(brigid.encryptor(cipher, key, iv, function (view)
@@ -91,6 +212,458 @@ for i = 1, #ciphers do
   end
 end
 
+for name, v in pairs(aead_vectors) do
+  local function update(cryptor, data)
+    for i = 1, #data, 7 do
+      assert(cryptor:update(data:sub(i, i + 6)))
+    end
+    return cryptor:update("", true)
+  end
+
+  suite["test_aead_" .. name:gsub("%-", "_")] = function ()
+    if not pcall(brigid.encryptor, name, v.key, v.iv, function () end) then
+      return test_skip()
+    end
+
+    local result = {}
+    local function callback(view)
+      result[#result + 1] = view:get_string()
+    end
+
+    local cryptor = assert(brigid.encryptor(name, v.key, v.iv, callback))
+    assert(cryptor:update_aad(v.aad))
+    assert(update(cryptor, v.plaintext))
+    assert(table.concat(result) == v.ciphertext)
+    assert(cryptor:get_tag() == v.tag)
+
+    result = {}
+    local cryptor = assert(brigid.decryptor(name, v.key, v.iv, callback))
+    assert(cryptor:update_aad(v.aad))
+    assert(cryptor:set_tag(v.tag))
+    assert(update(cryptor, v.ciphertext))
+    assert(table.concat(result) == v.plaintext)
+
+    local tag = v.tag:sub(1, -2) .. string.char((v.tag:byte(-1) + 1) % 256)
+    local cryptor = assert(brigid.decryptor(name, v.key, v.iv, callback))
+    assert(cryptor:update_aad(v.aad))
+    assert(cryptor:set_tag(tag))
+    local result, message = update(cryptor, v.ciphertext)
+    assert(not result)
+    assert(message:find "authentication failed")
+
+    -- A truncated tag is rejected.
+    local cryptor = assert(brigid.decryptor(name, v.key, v.iv, callback))
+    assert(not pcall(cryptor.set_tag, cryptor, v.tag:sub(1, 12)))
+    assert(not pcall(cryptor.set_tag, cryptor, ""))
+    assert(not pcall(cryptor.set_tag, cryptor, v.tag .. "x"))
+
+    local cryptor = assert(brigid.decryptor(name, v.key, v.iv, callback))
+    assert(not pcall(cryptor.update, cryptor, v.ciphertext, true))
+    assert(not pcall(cryptor.get_tag, cryptor))
+    assert(not pcall(brigid.encryptor, name, v.key:sub(2), v.iv, callback))
+  end
+
+  suite["test_encrypt_decrypt_" .. name:gsub("%-", "_")] = function ()
+    if not pcall(brigid.encryptor, name, v.key, v.iv, function () end) then
+      return test_skip()
+    end
+
+    -- The one-shot API appends the tag to the ciphertext.
+    local writer = brigid.data_writer()
+    local cryptor = assert(brigid.encryptor(name, v.key, v.iv, writer))
+    assert(cryptor:update(v.plaintext, true))
+    local ciphertext = brigid.encrypt(name, v.key, v.iv, v.plaintext)
+    assert(ciphertext == writer:get_string() .. cryptor:get_tag())
+    assert(brigid.decrypt(name, v.key, v.iv, ciphertext) == v.plaintext)
+    assert(brigid.decrypt(name, v.key, v.iv, ciphertext, { threads = 4 }) == v.plaintext)
+
+    local ciphertext = brigid.encrypt(name, v.key, v.iv, "")
+    assert(#ciphertext == 16)
+    assert(brigid.decrypt(name, v.key, v.iv, ciphertext) == "")
+
+    local ciphertext = brigid.encrypt(name, v.key, v.iv, v.plaintext)
+    local tampered = ciphertext:sub(1, -2) .. string.char((ciphertext:byte(-1) + 1) % 256)
+    local result, message = brigid.decrypt(name, v.key, v.iv, tampered)
+    assert(not result)
+    assert(message:find "authentication failed")
+    assert(not brigid.decrypt(name, v.key, v.iv, ciphertext:sub(1, 15)))
+  end
+end
+
+function suite:test_cryptor_writer1()
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, writer))
+  for i = 1, #plaintext, 5 do
+    assert(cryptor:update(plaintext:sub(i, i + 4)))
+  end
+  assert(cryptor:update("", true))
+  assert(writer:get_string() == ciphertext)
+
+  local hasher = brigid.hasher "sha256"
+  local decryptor = assert(brigid.decryptor(cipher, key, iv, hasher))
+  local encryptor = assert(brigid.encryptor(cipher, key, iv, decryptor))
+  assert(encryptor:update(plaintext):update("", true))
+  assert(decryptor:update("", true))
+  assert(hasher:digest() == brigid.hash("sha256", plaintext))
+end
+
+function suite:test_cryptor_writer2()
+  local source = { foo = 42, bar = { "baz", true } }
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, writer))
+  assert(cryptor:write_json(source):update("", true))
+  assert(decrypt(cipher, key, iv, writer:get_string()) == brigid.data_writer():write_json(source):get_string())
+
+  local path = test_cwd .. "/test.dat"
+  local file_writer = assert(brigid.file_writer(path))
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, file_writer))
+  assert(cryptor:update(plaintext))
+  assert(file_writer:close())
+  local result, message = pcall(cryptor.update, cryptor, plaintext, true)
+  assert(not result)
+  assert(message:find "closed")
+  os.remove(path)
+
+  assert(not pcall(brigid.encryptor, cipher, key, iv, {}))
+end
+
+function suite:test_aead_cbc()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, function () end))
+  assert(not pcall(cryptor.update_aad, cryptor, ""))
+  assert(cryptor:update(plaintext, true))
+  assert(not pcall(cryptor.get_tag, cryptor))
+end
+
+function suite:test_cryptor_reset()
+  local iv2 = iv:reverse()
+  local key2 = key:reverse()
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, writer))
+  assert(cryptor:update(plaintext, true))
+  assert(writer:get_string() == ciphertext)
+
+  writer:close()
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, writer))
+  assert(cryptor:update(plaintext, true))
+  assert(cryptor:reset(iv2))
+  assert(cryptor:update(plaintext:sub(1, 10)):update(plaintext:sub(11), true))
+  assert(cryptor:reset(iv2, key2))
+  assert(cryptor:update(plaintext, true))
+  assert(cryptor:reset(iv))
+  assert(cryptor:update(plaintext:sub(1, 20)))
+  assert(cryptor:reset(iv, key))
+  assert(cryptor:update(plaintext, true))
+  assert(writer:get_string() == table.concat {
+    ciphertext;
+    encrypt(cipher, key, iv2, plaintext);
+    encrypt(cipher, key2, iv2, plaintext);
+    encrypt(cipher, key2, iv, plaintext):sub(1, 16);
+    ciphertext;
+  })
+
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.decryptor(cipher, key, iv, writer))
+  assert(cryptor:update(ciphertext:sub(1, 10)))
+  assert(cryptor:reset(iv))
+  assert(cryptor:update(ciphertext, true))
+  assert(cryptor:reset(iv2, key2))
+  assert(cryptor:update(encrypt(cipher, key2, iv2, plaintext), true))
+  assert(writer:get_string() == plaintext .. plaintext)
+
+  assert(not pcall(cryptor.reset, cryptor, "0123"))
+  assert(not pcall(cryptor.reset, cryptor, iv, "0123"))
+
+  for name, v in pairs(aead_vectors) do
+    if pcall(brigid.encryptor, name, v.key, v.iv, function () end) then
+      local writer = brigid.data_writer()
+      local cryptor = assert(brigid.encryptor(name, v.key, v.iv, writer))
+      assert(cryptor:update(plaintext, true))
+      assert(cryptor:reset(v.iv))
+      assert(cryptor:update_aad(v.aad))
+      assert(cryptor:update(v.plaintext, true))
+      assert(writer:get_string():sub(#plaintext + 1) == v.ciphertext)
+      assert(cryptor:get_tag() == v.tag)
+    end
+  end
+end
+
+function suite:test_aes_ctr()
+  -- NIST SP 800-38A F.5.1
+  local key = table.concat {
+    "\043\126\021\022\040\174\210\166";
+    "\171\247\021\136\009\207\079\060";
+  }
+  local iv = table.concat {
+    "\240\241\242\243\244\245\246\247";
+    "\248\249\250\251\252\253\254\255";
+  }
+  local plaintext = table.concat {
+    "\107\193\190\226\046\064\159\150";
+    "\233\061\126\017\115\147\023\042";
+    "\174\045\138\087\030\003\172\156";
+    "\158\183\111\172\069\175\142\081";
+  }
+  local ciphertext = table.concat {
+    "\135\077\097\145\182\032\227\038";
+    "\027\239\104\100\153\013\182\206";
+    "\152\006\246\107\121\112\253\255";
+    "\134\023\024\123\185\255\253\255";
+  }
+  if not pcall(brigid.encryptor, "aes-128-ctr", key, iv, function () end) then
+    return test_skip()
+  end
+
+  assert(encrypt("aes-128-ctr", key, iv, plaintext) == ciphertext)
+  assert(decrypt("aes-128-ctr", key, iv, ciphertext) == plaintext)
+  assert(brigid.encrypt("aes-128-ctr", key, iv, plaintext) == ciphertext)
+  assert(brigid.decrypt("aes-128-ctr", key, iv, ciphertext) == plaintext)
+  assert(encrypt("aes-128-ctr", key, iv, plaintext:sub(1, 21)) == ciphertext:sub(1, 21))
+
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor("aes-128-ctr", key, iv, writer))
+  assert(cryptor:update(plaintext:sub(1, 21)))
+  assert(cryptor:reset(iv))
+  assert(cryptor:update(plaintext, true))
+  assert(writer:get_string() == ciphertext:sub(1, 21) .. ciphertext)
+  assert(not pcall(brigid.encryptor, "aes-128-ctr", key:sub(2), iv, function () end))
+end
+
+function suite:test_encrypt_decrypt()
+  assert(brigid.encrypt(cipher, key, iv, plaintext) == ciphertext)
+  assert(brigid.decrypt(cipher, key, iv, ciphertext) == plaintext)
+  assert(brigid.decrypt(cipher, key, iv, ciphertext, { threads = 4 }) == plaintext)
+  assert(not pcall(brigid.decrypt, cipher, key, iv, ciphertext, { threads = 0 }))
+  local result, message = brigid.decrypt(cipher, key, iv, ciphertext:sub(1, -2))
+  assert(not result)
+  print(message)
+end
+
+function suite:test_decrypt_threads()
+  local data = {}
+  for i = 1, 65536 do
+    data[i] = ("%08x%07d\n"):format(i * 2654435761 % 4294967296, i)
+  end
+  local plaintext = table.concat(data) .. "foo"
+
+  local ciphertext = encrypt(cipher, key, iv, plaintext)
+  assert(#ciphertext == #plaintext + 13)
+  assert(brigid.decrypt(cipher, key, iv, ciphertext, { threads = 4 }) == plaintext)
+  assert(brigid.decrypt(cipher, key, iv, ciphertext, { threads = 7 }) == plaintext)
+
+  local result, message = brigid.decrypt(cipher, key:reverse(), iv, ciphertext, { threads = 4 })
+  assert(not result)
+  print(message)
+
+  -- the counter carries into the upper half of the initialization vector
+  local cipher = "aes-256-ctr"
+  local iv = ("\0"):rep(8) .. ("\255"):rep(7) .. "\240"
+  if not pcall(brigid.encryptor, cipher, key, iv, function () end) then
+    return test_skip()
+  end
+  local ciphertext = encrypt(cipher, key, iv, plaintext)
+  assert(#ciphertext == #plaintext)
+  assert(brigid.encrypt(cipher, key, iv, plaintext, { threads = 4 }) == ciphertext)
+  assert(brigid.decrypt(cipher, key, iv, ciphertext, { threads = 3 }) == plaintext)
+end
+
+function suite:test_encrypted1()
+  local data = {}
+  for i = 1, 1000 do
+    data[i] = ("%07d\n"):format(i)
+  end
+  local plaintext = table.concat(data)
+
+  for _, size in ipairs { 0, 1, 999, 1000, 1001, 4000, 8000 } do
+    local plaintext = plaintext:sub(1, size)
+    local writer = brigid.data_writer()
+    local encrypted_writer = assert(brigid.encrypted_writer(key, writer, { segment_size = 1000, iterations = 1000 }))
+    for i = 1, #plaintext, 333 do
+      assert(encrypted_writer:write(plaintext:sub(i, i + 332)))
+    end
+    assert(encrypted_writer:close())
+    assert(writer:get_size() == 40 + #plaintext + math.max(math.ceil(#plaintext / 1000), 1) * 16)
+
+    local reader = assert(brigid.encrypted_reader(key, writer))
+    assert(reader:get_size() == #plaintext)
+    assert(reader:read() == plaintext)
+    assert(reader:read(0, #plaintext, { threads = 4 }) == plaintext)
+    assert(reader:read(500, 1000) == plaintext:sub(501, 1500))
+    assert(reader:read(999, 2, { threads = 2 }) == plaintext:sub(1000, 1001))
+    assert(reader:read(#plaintext + 1, 10) == "")
+  end
+
+  local writer = brigid.data_writer()
+  local encrypted_writer = assert(brigid.encrypted_writer(key, writer))
+  assert(encrypted_writer:write_json { foo = 42 })
+  assert(encrypted_writer:close())
+  local encoded = writer:get_string()
+  assert(encoded:byte(7) == 2)
+  assert(encoded:byte(13) == 1)
+  assert(encoded:sub(14, 17) == "\0\9\39\192") -- 600000 iterations
+  assert(brigid.encrypted_reader(key, encoded):read() == [[{"foo":42}]])
+end
+
+function suite:test_encrypted2()
+  local plaintext = ("0123456789"):rep(400)
+  local writer = brigid.data_writer()
+  local encrypted_writer = assert(brigid.encrypted_writer(key, writer, { segment_size = 1000, iterations = 1000 }))
+  assert(encrypted_writer:write(plaintext))
+  local encoded = writer:get_string()
+
+  -- not closed
+  local reader = assert(brigid.encrypted_reader(key, encoded))
+  assert(reader:read(0, 1000) == plaintext:sub(1, 1000))
+  local result, message = reader:read(2000)
+  assert(not result)
+  print(message)
+
+  assert(encrypted_writer:close())
+  local encoded = writer:get_string()
+
+  -- modified
+  local position = 40 + 1016 + 10
+  local modified = encoded:sub(1, position - 1) .. "X" .. encoded:sub(position + 1)
+  local reader = assert(brigid.encrypted_reader(key, modified))
+  assert(reader:read(0, 1000) == plaintext:sub(1, 1000))
+  assert(reader:read(2000, 2000, { threads = 4 }) == plaintext:sub(2001, 4000))
+  assert(not reader:read(1000, 1000))
+  assert(not reader:read(0, 4000, { threads = 4 }))
+
+  -- truncated
+  local reader = assert(brigid.encrypted_reader(key, encoded:sub(1, 40 + 1016 * 3)))
+  assert(reader:get_size() == 3000)
+  assert(not reader:read(2000))
+
+  -- wrong key
+  local reader = assert(brigid.encrypted_reader(key:reverse(), encoded))
+  assert(not reader:read(0, 1))
+
+  assert(not brigid.encrypted_reader(key, encoded:sub(1, 44)))
+  assert(not brigid.encrypted_reader(key, "X" .. encoded:sub(2)))
+  assert(not pcall(brigid.encrypted_writer, key, writer, { cipher = "aes-256-cbc" }))
+
+  -- the iterations are read from the header and limited
+  assert(encoded:sub(14, 17) == "\0\0\3\232")
+  local function with_iterations(iterations)
+    return encoded:sub(1, 13) .. iterations .. encoded:sub(18)
+  end
+  local reader = assert(brigid.encrypted_reader(key, with_iterations "\0\0\3\233"))
+  assert(not reader:read(0, 1))
+  assert(not brigid.encrypted_reader(key, with_iterations "\0\0\0\0"))
+  assert(not brigid.encrypted_reader(key, with_iterations "\255\255\255\255"))
+  assert(not pcall(brigid.encrypted_writer, key, writer, { iterations = 0 }))
+
+  if pcall(brigid.encryptor, "chacha20-poly1305", key, ("\0"):rep(12), function () end) then
+    local writer = brigid.data_writer()
+    local encrypted_writer = assert(brigid.encrypted_writer(key, writer, { cipher = "chacha20-poly1305", segment_size = 1000, iterations = 1000 }))
+    assert(encrypted_writer:write(plaintext):close())
+    assert(brigid.encrypted_reader(key, writer):read(1500, 1000) == plaintext:sub(1501, 2500))
+  end
+end
+
+function suite:test_encrypted_gc()
+  local plaintext = ("0123456789"):rep(250)
+  local writer = brigid.data_writer()
+  brigid.encrypted_writer(key, writer, { segment_size = 1000, iterations = 1000 }):write(plaintext)
+  collectgarbage()
+  collectgarbage()
+  assert(brigid.encrypted_reader(key, writer):read() == plaintext)
+
+  -- the salts and the nonce prefixes differ
+  local a = brigid.data_writer()
+  local b = brigid.data_writer()
+  assert(brigid.encrypted_writer(key, a, { iterations = 1000 }):close())
+  assert(brigid.encrypted_writer(key, b, { iterations = 1000 }):close())
+  assert(a:get_string():sub(18, 40) ~= b:get_string():sub(18, 40))
+end
+
+function suite:test_pbkdf2()
+  if not pcall(brigid.pbkdf2, "sha256", "password", "salt", 1, 32) then
+    return test_skip()
+  end
+
+  -- RFC 6070
+  assert(brigid.pbkdf2("sha1", "password", "salt", 1, 20) == table.concat {
+    "\012\096\200\015\150\031\014\113";
+    "\243\169\181\036\175\096\018\006";
+    "\047\224\055\166";
+  })
+
+  local expect = table.concat {
+    "\197\228\120\213\146\136\200\065";
+    "\170\083\013\182\132\092\076\141";
+    "\150\040\147\160\001\206\078\017";
+    "\164\150\056\115\170\152\019\074";
+  }
+  assert(brigid.pbkdf2("sha256", "password", "salt", 4096, 32) == expect)
+  local task = assert(brigid.pbkdf2("sha256", "password", "salt", 4096, 32, { async = true }))
+  assert(task:get() == expect)
+  assert(task:ready())
+
+  assert(not pcall(brigid.pbkdf2, "sha256", "password", "salt", 0, 32))
+  assert(not pcall(brigid.pbkdf2, "md5", "password", "salt", 1, 32))
+  local task = assert(brigid.pbkdf2("md5", "password", "salt", 1, 32, { async = true }))
+  assert(not pcall(task.get, task))
+end
+
+function suite:test_hkdf()
+  if not pcall(brigid.hkdf, "sha256", "key", "", "", 32) then
+    return test_skip()
+  end
+
+  -- RFC 5869 A.1
+  local key = ("\011"):rep(22)
+  local salt = "\000\001\002\003\004\005\006\007\008\009\010\011\012"
+  local info = "\240\241\242\243\244\245\246\247\248\249"
+  local expect = table.concat {
+    "\060\178\095\037\250\172\213\122";
+    "\144\067\079\100\208\054\047\042";
+    "\045\045\010\144\207\026\090\076";
+    "\093\176\045\086\236\196\197\191";
+    "\052\000\114\008\213\184\135\024";
+    "\088\101";
+  }
+  assert(brigid.hkdf("sha256", key, salt, info, 42) == expect)
+  assert(brigid.hkdf("sha256", key, salt, info, 42, { async = true }):get() == expect)
+  assert(brigid.hkdf("sha256", key, salt, info, 10) == expect:sub(1, 10))
+  assert(not pcall(brigid.hkdf, "sha256", key, salt, info, 32 * 255 + 1))
+end
+
+function suite:test_bytes_to_key()
+  if not pcall(brigid.bytes_to_key, "sha256", "password", "", 1, 32, 16) then
+    return test_skip()
+  end
+
+  -- openssl enc -aes-256-cbc -md sha256 -pass pass:password -S 0102030405060708 -P
+  local salt = "\001\002\003\004\005\006\007\008"
+  local key, iv = brigid.bytes_to_key("sha256", "password", salt, 1, 32, 16)
+  assert(key == table.concat {
+    "\036\053\023\127\020\016\083\107";
+    "\170\210\172\193\085\192\249\071";
+    "\131\213\131\132\087\060\176\247";
+    "\033\087\068\054\006\040\093\063";
+  })
+  assert(iv == table.concat {
+    "\249\110\252\004\078\015\022\019";
+    "\191\050\066\069\201\094\116\017";
+  })
+  local task = assert(brigid.bytes_to_key("sha256", "password", salt, 1, 32, 16, { async = true }))
+  local key2, iv2 = task:get()
+  assert(key2 == key)
+  assert(iv2 == iv)
+
+  local key, iv = brigid.bytes_to_key("sha256", "password", salt, 1000, 32, 16)
+  assert(key .. iv == table.concat {
+    "\160\245\062\095\164\180\177\239";
+    "\114\009\227\218\171\218\133\230";
+    "\092\009\205\050\212\224\070\036";
+    "\197\106\047\020\003\226\150\016";
+    "\096\047\179\069\136\149\244\069";
+    "\031\059\165\032\082\129\244\047";
+  })
+end
+
 function suite:test_sha1_1()
   local result = brigid.hasher "sha1":update "":digest()
   assert(result == table.concat {
@@ -157,4 +730,291 @@ function suite:test_sha512_2()
   })
 end
 
+function suite:test_hasher_reset()
+  local hasher = brigid.hasher "sha256"
+  local expect = hasher:update "The quick brown fox jumps over the lazy dog":digest()
+  hasher:update "garbage"
+  assert(hasher:reset():update "The quick brown fox jumps over the lazy dog":digest() == expect)
+end
+
+function suite:test_hasher_clone()
+  for _, name in ipairs { "sha1", "sha256", "sha512" } do
+    local hasher1 = brigid.hasher(name):update "The quick brown fox "
+    local hasher2 = hasher1:clone()
+    local result1 = hasher1:update "jumps over the lazy dog":digest()
+    local result2 = hasher2:update "jumps over the lazy cat":digest()
+    assert(result1 == brigid.hasher(name):update "The quick brown fox jumps over the lazy dog":digest())
+    assert(result2 == brigid.hasher(name):update "The quick brown fox jumps over the lazy cat":digest())
+  end
+end
+
+function suite:test_hash()
+  for _, name in ipairs { "sha1", "sha256", "sha512" } do
+    for i = 1, 2 do
+      assert(brigid.hash(name, "") == brigid.hasher(name):digest())
+      assert(brigid.hash(name, "The quick brown fox jumps over the lazy dog") == brigid.hasher(name):update "The quick brown fox jumps over the lazy dog":digest())
+    end
+  end
+  assert(not pcall(brigid.hash, "md5", ""))
+end
+
+function suite:test_hash_many()
+  local source = { "", "The quick brown fox jumps over the lazy dog", brigid.data_writer():write(("x"):rep(1000)) }
+  for _, name in ipairs { "sha1", "sha256", "sha512" } do
+    local result = brigid.hash_many(name, source)
+    assert(#result == 3)
+    for i, v in ipairs(result) do
+      assert(v == brigid.hasher(name):update(source[i]):digest())
+    end
+    assert(#brigid.hash_many(name, {}) == 0)
+  end
+  assert(not pcall(brigid.hash_many, "sha256", { "", {} }))
+end
+
+function suite:test_hmac1()
+  local expect = {
+    sha1 = table.concat {
+      "\239\252\223\106\229\235\047\162";
+      "\210\116\022\213\241\132\223\156";
+      "\037\154\124\121";
+    };
+    sha256 = table.concat {
+      "\091\220\193\070\191\096\117\078";
+      "\106\004\036\038\008\149\117\199";
+      "\090\000\063\008\157\039\057\131";
+      "\157\236\088\185\100\236\056\067";
+    };
+    sha512 = table.concat {
+      "\022\075\122\123\252\248\025\226";
+      "\227\149\251\231\059\086\224\163";
+      "\135\189\100\034\046\131\031\214";
+      "\016\039\012\215\234\037\005\084";
+      "\151\088\191\117\192\090\153\074";
+      "\109\003\079\101\248\240\230\253";
+      "\202\234\177\163\077\074\107\075";
+      "\099\110\007\010\056\188\231\055";
+    };
+  }
+  for name, v in pairs(expect) do
+    local hmac = brigid.hmac(name, "Jefe")
+    for i = 1, 2 do
+      assert(hmac:update "what do ya ":update "want for nothing?":digest() == v)
+    end
+    assert(hmac:update "garbage":reset():update "what do ya want for nothing?":digest() == v)
+    assert(brigid.hmac_digest(name, "Jefe", "what do ya want for nothing?") == v)
+  end
+end
+
+function suite:test_hmac2()
+  local key = ("\170"):rep(131)
+  local data = "Test Using Larger Than Block-Size Key - Hash Key First"
+  local expect = table.concat {
+    "\096\228\049\089\030\224\182\127";
+    "\013\138\038\170\203\245\183\127";
+    "\142\011\198\033\055\040\197\020";
+    "\005\070\004\015\014\227\127\084";
+  }
+  local hmac = brigid.hmac("sha256", key):update "Test Using Larger "
+  local clone = hmac:clone()
+  assert(hmac:update "Than Block-Size Key - Hash Key First":digest() == expect)
+  assert(clone:update "Than Block-Size Key - Hash Key First":digest() == expect)
+  assert(clone:update(data):digest() == expect)
+  assert(#brigid.hmac_digest("sha256", "", "") == 32)
+  assert(not pcall(brigid.hmac, "md5", key))
+  assert(not pcall(brigid.hmac_digest, "md5", key, data))
+end
+
+function suite:test_hmac_digest_key()
+  local data = "what do ya want for nothing?"
+  for _, key in ipairs { "Jefe", "Jeff", "Jefe", "", ("k"):rep(200), "Jefe" } do
+    for i = 1, 2 do
+      assert(brigid.hmac_digest("sha256", key, data) == brigid.hmac("sha256", key):update(data):digest())
+    end
+  end
+
+  -- The key is not kept in the registry.
+  local key = "secret key of test_hmac_digest_key"
+  brigid.hmac_digest("sha256", key, data)
+  local visited = {}
+  local function find(t)
+    if visited[t] then
+      return false
+    end
+    visited[t] = true
+    for k, v in pairs(t) do
+      if k == key or v == key then
+        return true
+      end
+      if type(k) == "table" and find(k) or type(v) == "table" and find(v) then
+        return true
+      end
+    end
+    return false
+  end
+  assert(not find(debug.getregistry()))
+end
+
+function suite:test_hmac_update_async()
+  local data = ("x"):rep(1024 * 1024)
+  local hmac = brigid.hmac("sha256", "key")
+  local task = assert(hmac:update_async(data))
+  assert(not pcall(hmac.update, hmac, data))
+  assert(not pcall(hmac.digest, hmac))
+  assert(not pcall(hmac.reset, hmac))
+  assert(not pcall(hmac.clone, hmac))
+  assert(task:get() == task)
+  assert(hmac:update(data):digest() == brigid.hmac_digest("sha256", "key", data .. data))
+end
+
+function suite:test_xxh3()
+  assert(brigid.hash("xxh3_64", "") == "\045\006\128\005\056\211\148\194")
+  assert(brigid.hash("xxh3_128", "") == table.concat {
+    "\153\170\006\211\001\071\152\216";
+    "\096\001\195\036\070\141\073\127";
+  })
+  assert(brigid.hash("crc32c", "123456789") == "\227\006\146\131")
+  local data = {}
+  for i = 1, 5000 do
+    data[i] = string.char(i % 251)
+  end
+  data = table.concat(data)
+  for _, name in ipairs { "xxh3_64", "xxh3_128", "crc32c" } do
+    for _, n in ipairs { 0, 1, 3, 16, 17, 128, 129, 240, 241, 1024, 1025, 5000 } do
+      local expect = brigid.hash(name, data:sub(1, n))
+      local hasher = brigid.hasher(name)
+      for i = 1, n, 7 do
+        hasher:update(data:sub(i, math.min(i + 6, n)))
+      end
+      local clone = hasher:clone()
+      assert(hasher:digest() == expect)
+      assert(clone:digest() == expect)
+      assert(hasher:reset():update(data:sub(1, n)):digest() == expect)
+    end
+  end
+end
+
+function suite:test_blake3()
+  local data = {}
+  for i = 1, 200000 do
+    data[i] = string.char((i - 1) % 251)
+  end
+  data = table.concat(data)
+  local expect = table.concat {
+    "\085\064\145\066\204\237\046\199";
+    "\152\151\069\159\023\011\109\034";
+    "\086\093\175\136\055\016\180\173";
+    "\122\238\221\174\245\066\068\180";
+  }
+  assert(brigid.hash("blake3", "") == table.concat {
+    "\175\019\073\185\245\249\161\166";
+    "\160\064\077\234\054\220\201\073";
+    "\155\203\037\201\173\193\018\183";
+    "\204\154\147\202\228\031\050\098";
+  })
+  assert(brigid.hash("blake3", data) == expect)
+  for _, n in ipairs { 1000, 65536, 65537 } do
+    local hasher = brigid.hasher "blake3"
+    for i = 1, #data, n do
+      hasher:update(data:sub(i, i + n - 1))
+    end
+    assert(hasher:clone():digest() == expect)
+    assert(hasher:digest() == expect)
+  end
+end
+
+function suite:test_hash_file()
+  local path = test_cwd .. "/test.dat"
+  local data = ("0123456789abcdef"):rep(65536)
+  local handle = assert(io.open(path, "wb"))
+  handle:write(data)
+  handle:close()
+  for _, name in ipairs { "sha256", "blake3" } do
+    assert(brigid.hash_file(path, name) == brigid.hash(name, data))
+  end
+  os.remove(path)
+  assert(not brigid.hash_file(path, "sha256"))
+  assert(not pcall(brigid.hash_file, path, "md5"))
+end
+
+function suite:test_hasher_writer()
+  local source = { foo = 42, bar = { "baz", true } }
+  local expect = brigid.data_writer():write_json(source):get_string()
+  for _, name in ipairs { "sha256", "xxh3_64", "crc32c" } do
+    local hasher = brigid.hasher(name):write_json(source)
+    assert(hasher:digest() == brigid.hash(name, expect))
+  end
+end
+
+function suite:test_hasher_update_async()
+  local data = ("x"):rep(1024 * 1024)
+  local hasher = brigid.hasher "sha256"
+  local task = assert(hasher:update_async(data))
+  assert(not pcall(hasher.update, hasher, data))
+  assert(not pcall(hasher.digest, hasher))
+  assert(not pcall(hasher.write_json, hasher, {}))
+  while not task:ready() do end
+  assert(task:get() == task)
+  assert(hasher:update(data):digest() == brigid.hash("sha256", data .. data))
+
+  local writer = brigid.data_writer():write(data)
+  local hasher = brigid.hasher "sha256"
+  local task = assert(hasher:update_async(writer))
+  writer:write "x"
+  task:get()
+  assert(hasher:digest() == brigid.hash("sha256", data))
+end
+
+function suite:test_cryptor_update_async()
+  local cipher = "aes-256-cbc"
+  local key = ("k"):rep(32)
+  local iv = ("i"):rep(16)
+  local data = ("x"):rep(1024 * 1024)
+  local expect = assert(brigid.encrypt(cipher, key, iv, data .. data))
+
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, writer))
+  local task = assert(cryptor:update_async(data))
+  assert(not pcall(cryptor.update, cryptor, data))
+  assert(not pcall(cryptor.close, cryptor))
+
+  -- A coroutine waits for the task without blocking the Lua thread.
+  local thread = coroutine.wrap(function ()
+    while not task:ready() do
+      coroutine.yield()
+    end
+    task:get()
+    assert(cryptor:update_async(data, true)):get()
+    return writer:get_string()
+  end)
+  local result
+  repeat
+    result = thread()
+  until result
+  assert(result == expect)
+
+  local cryptor = assert(brigid.decryptor(cipher, key, iv, function () error "boom" end))
+  local task = assert(cryptor:update_async(expect, true))
+  assert(not task:get())
+  assert(cryptor:close())
+end
+
+function suite:test_update_async_gc()
+  local cipher = "aes-256-cbc"
+  local key = ("k"):rep(32)
+  local iv = ("i"):rep(16)
+  local data = ("x"):rep(1024 * 1024)
+
+  local hasher = brigid.hasher "sha256"
+  assert(hasher:update_async(data))
+  local writer = brigid.data_writer()
+  local cryptor = assert(brigid.encryptor(cipher, key, iv, writer))
+  assert(cryptor:update_async(data))
+  collectgarbage()
+  collectgarbage()
+
+  assert(hasher:update(data):digest() == brigid.hash("sha256", data .. data))
+  assert(cryptor:update(data, true))
+  assert(writer:get_string() == brigid.encrypt(cipher, key, iv, data .. data))
+end
+
 return suite
@@ -1,4 +1,4 @@
--- Copyright (c) 2021,2024 <dev@brigid.jp>
+-- Copyright (c) 2021,2024,2026 <dev@brigid.jp>
 -- This software is released under the MIT License.
 -- https://opensource.org/licenses/mit-license.php
 
@@ -339,6 +339,63 @@ function suite:test_write_json3()
   assert(result == expect1)
 end
 
+function suite:test_write_json_canonical1()
+  local source = {
+    numbers = {
+      333333333.33333329, 1e30, 4.50, 2e-3, 1e-27, -0.0, 0,
+      1e21, 1e20, 1e-6, 1e-7, 0.1, -17, 5e-324, 1.7976931348623157e308,
+      9007199254740992, 123456789012345680000,
+    };
+    string = "\226\130\172$\15\10A'B\"\\\\\"/\127";
+    literals = { brigid.null, true, false };
+  }
+  local result = brigid.data_writer():write_json_canonical(source):get_string()
+  if debug then print(result) end
+  assert(result == [[{"literals":[null,true,false],"numbers":[333333333.3333333,1e+30,4.5,0.002,1e-27,0,0,1e+21,100000000000000000000,0.000001,1e-7,0.1,-17,5e-324,1.7976931348623157e+308,9007199254740992,123456789012345680000],"string":"]] .. "\226\130\172$\\u000f\\nA'B\\\"\\\\\\\\\\\"/\127" .. [["}]])
+end
+
+function suite:test_write_json_canonical2()
+  local source = {
+    ["\226\130\172"] = "Euro Sign";
+    ["\r"] = "Carriage Return";
+    ["\239\172\179"] = "Hebrew Letter Dalet With Dagesh";
+    ["1"] = "One";
+    ["\240\159\152\128"] = "Emoji: Grinning Face";
+    ["\194\128"] = "Control";
+    ["\195\182"] = "Latin Small Letter O With Diaeresis";
+    [2] = "Two";
+    ["abcdefgh"] = 1;
+    ["abcdefghi"] = 2;
+    ["abcdefg"] = 3;
+  }
+  local result = brigid.data_writer():write_json_canonical(source):get_string()
+  if debug then print(result) end
+  assert(result == '{"\\r":"Carriage Return","1":"One","2":"Two","abcdefg":3,"abcdefgh":1,"abcdefghi":2,"\194\128":"Control","\195\182":"Latin Small Letter O With Diaeresis","\226\130\172":"Euro Sign","\240\159\152\128":"Emoji: Grinning Face","\239\172\179":"Hebrew Letter Dalet With Dagesh"}')
+end
+
+function suite:test_write_json_sort_keys_order()
+  local source = { b = 1, a = 2, ["\127"] = 3, ["\128"] = 4, ["\255"] = 5 }
+  local result = brigid.data_writer():write_json(source, 0, true):get_string()
+  if debug then print(result) end
+  -- sort_keys compares the keys as char, which is signed on most platforms.
+  assert(result == '{"\128":4,"\255":5,"a":2,"b":1,"\\u007F":3}' or result == '{"a":2,"b":1,"\\u007F":3,"\128":4,"\255":5}')
+end
+
+function suite:test_write_json_sort_keys_many()
+  local n = 600000
+  local source = {}
+  for i = 1, n do
+    source["k" .. i] = i
+  end
+  local writer = brigid.data_writer()
+  writer:write_json(source, 0, true)
+  assert(writer:get_string():find('^{"k1":1,"k10":10,"k100":100,'))
+
+  local writer = brigid.data_writer()
+  writer:write_json_canonical(source)
+  assert(writer:get_string():find('"k99999":99999}$'))
+end
+
 function suite:test_write_json4()
   local source = {
     { [0] = "foo" };
@@ -1,4 +1,4 @@
--- Copyright (c) 2019,2021 <dev@brigid.jp>
+-- Copyright (c) 2019,2021,2026 <dev@brigid.jp>
 -- This software is released under the MIT License.
 -- https://opensource.org/licenses/mit-license.php
 
@@ -282,6 +282,146 @@ function suite:test29()
   assert(canceling == 1)
 end
 
+function suite:test_http_multi()
+  local requests = {}
+  local bodies = {}
+  for i = 1, 4 do
+    local body = {}
+    bodies[i] = body
+    requests[i] = {
+      session = brigid.http_session {
+        header = function (code)
+          body.code = code
+        end;
+        write = function (view)
+          body[#body + 1] = view:get_string()
+        end;
+      };
+      url = "https://brigid.jp/test/cgi/env.cgi?" .. i;
+    }
+  end
+  requests[4].url = "https://no-such-host.brigid.jp/"
+
+  local results = assert(brigid.http_multi(requests, { max_concurrency = 2 }))
+  for i = 1, 3 do
+    assert(results[i] == true)
+    assert(bodies[i].code == 200)
+    assert(table.concat(bodies[i]):find("QUERY_STRING=" .. i .. "\n", 1, true))
+  end
+  assert(type(results[4]) == "string")
+
+  assert(not pcall(brigid.http_multi, { requests[1], requests[1] }))
+  assert(#brigid.http_multi {} == 0)
+end
+
+function suite:test_request_async()
+  local bodies = {}
+  for i = 1, 3 do
+    local body = {}
+    bodies[i] = body
+    local session = brigid.http_session {
+      write = function (view)
+        body[#body + 1] = view:get_string()
+      end;
+    }
+    coroutine.wrap(function ()
+      local request = assert(session:request_async { url = "https://brigid.jp/test/cgi/env.cgi?" .. i })
+      assert(not pcall(session.request, session, { url = "https://brigid.jp/" }))
+      body.result = request:wait()
+      assert(request:ready())
+    end)()
+  end
+  while brigid.http_poll(100) > 0 do end
+  for i = 1, 3 do
+    assert(bodies[i].result == true)
+    assert(table.concat(bodies[i]):find("QUERY_STRING=" .. i .. "\n", 1, true))
+  end
+
+  -- the main thread waits without a coroutine
+  local session = brigid.http_session {}
+  local result, message = session:request_async { url = "https://no-such-host.brigid.jp/" }:wait()
+  assert(not result)
+  assert(message)
+end
+
+function suite:test_request_async_error()
+  local sessions = setmetatable({}, { __mode = "k" })
+  local session = brigid.http_session {}
+  sessions[session] = true
+  local result, message = session:request_async { method = "PUT", url = "http://127.0.0.1/", file = "no-such-file" }
+  assert(not result)
+  assert(message)
+  assert(brigid.http_poll(0) == 0)
+  session = nil
+  collectgarbage()
+  collectgarbage()
+  assert(not next(sessions))
+end
+
+function suite:test_http_share()
+  brigid.http_share { max_connections = 4 }
+
+  -- a session keeps its connection for the next request
+  local stats = brigid.http_share_stats()
+  local session = brigid.http_session { share = true }
+  for i = 1, 3 do
+    assert(session:request { url = "https://brigid.jp/" })
+  end
+  local result = brigid.http_share_stats()
+  assert(result.requests == stats.requests + 3)
+  assert(result.connections + result.reused >= stats.connections + stats.reused + 3)
+  assert(result.reused >= stats.reused + 2)
+
+  -- the multi of request_async keeps the connections of its sessions
+  local stats = result
+  for i = 1, 2 do
+    local session = brigid.http_session { share = true }
+    assert(session:request_async { url = "https://brigid.jp/" }:wait())
+  end
+  local result = brigid.http_share_stats()
+  assert(result.requests == stats.requests + 2)
+  assert(result.reused >= stats.reused + 1)
+end
+
+function suite:test_sink()
+  local count = 0
+  local session = brigid.http_session {
+    write = function (view)
+      count = count + #view
+    end;
+  }
+  local writer = brigid.data_writer()
+  assert(session:request { url = "https://brigid.jp/test/cgi/env.cgi?sink", sink = writer })
+  assert(writer:get_string():find("QUERY_STRING=sink\n", 1, true))
+  assert(count == #writer)
+
+  local hasher = brigid.hasher "sha256"
+  assert(brigid.http_session {}:request { url = "https://brigid.jp/test/cgi/env.cgi?sink", sink = hasher })
+  assert(#hasher:digest() == 32)
+
+  assert(not pcall(session.request, session, { url = "https://brigid.jp/", sink = {} }))
+end
+
+function suite:test_timing()
+  local session = brigid.http_session {}
+  local result, timing = session:request { url = "https://brigid.jp/test/cgi/redirect.cgi?count=1", timing = true }
+  assert(result == session)
+  assert(timing.redirect_count == 1)
+  assert(timing.namelookup_time <= timing.connect_time)
+  assert(timing.connect_time <= timing.appconnect_time)
+  assert(timing.appconnect_time <= timing.starttransfer_time)
+  assert(timing.starttransfer_time <= timing.total_time)
+  assert(timing.size_upload == 0)
+  assert(type(timing.reused) == "boolean")
+
+  local result, timing = session:request_async { url = "https://brigid.jp/", timing = true }:wait()
+  assert(result == true)
+  assert(timing.total_time > 0)
+
+  local results = brigid.http_multi { { session = session, url = "https://brigid.jp/", timing = true } }
+  assert(results[1].total_time > 0)
+end
+
 function suite:test_remove_data()
   os.remove(test_cwd .. "/test.dat")
 end
@@ -1,4 +1,4 @@
--- Copyright (c) 2021,2024 <dev@brigid.jp>
+-- Copyright (c) 2021,2024,2026 <dev@brigid.jp>
 -- This software is released under the MIT License.
 -- https://opensource.org/licenses/mit-license.php
 
@@ -195,6 +195,17 @@ function suite:test_json_parse_string6()
   assert(equal(brigid.json.parse [["\nfoo\nbar\nbaz\n"]], "\nfoo\nbar\nbaz\n"))
 end
 
+function suite:test_json_parse_string7()
+  for n = 0, 40 do
+    local a = ("x"):rep(n)
+    assert(equal(brigid.json.parse('"' .. a .. '"'), a))
+    assert(equal(brigid.json.parse('"' .. a .. '\\n' .. a .. '"'), a .. "\n" .. a))
+    assert(equal(brigid.json.parse('"\\t' .. a .. '\\u3042' .. a .. '\\\\"'), "\t" .. a .. "あ" .. a .. "\\"))
+    assert(equal(brigid.json.parse('[' .. (" "):rep(n) .. '"' .. a .. '"' .. ("\n"):rep(n) .. ']'), { a }))
+    assert(equal(brigid.json.parse('{' .. ("\r\n\t "):rep(n) .. '"' .. a .. '":' .. (" "):rep(n) .. '1' .. (" "):rep(n) .. '}'), { [a] = 1 }))
+  end
+end
+
 local source = [[
 {
   "Image": {
@@ -469,6 +480,213 @@ function suite:test_json_parse_deep_object()
   assert(u == depth)
 end
 
+function suite:test_json_parser1()
+  local source = [[
+{
+  "Image": {
+      "Width":  800,
+      "Height": 600,
+      "Title":  "View from 15th Floor",
+      "Thumbnail": {
+          "Url":    "http://www.example.com/image/481989943",
+          "Height": 125,
+          "Width":  100
+      },
+      "Animated" : false,
+      "IDs": [116, 943, 234, 38793],
+      "Escaped": "foo\nbar\u3042"
+    }
+}
+]]
+  local expect = assert(brigid.json.parse(source))
+
+  for n = 1, 8 do
+    local parser = brigid.json.parser(source)
+    local count = 0
+    while true do
+      count = count + 1
+      local complete, result = parser:step(n)
+      if complete then
+        assert(equal(result, expect))
+        break
+      end
+      assert(complete == false)
+    end
+    assert(count >= #source / n)
+    local result, message = pcall(parser.step, parser, 1)
+    if debug then print(message) end
+    assert(not result)
+  end
+end
+
+function suite:test_json_parser2()
+  local parser = brigid.json.parser("[ 1, null, 3 ]", false)
+  local complete, result = parser:step()
+  assert(complete)
+  assert(equal(result, { 1, false, 3 }))
+
+  local parser = brigid.json.parser("42.25", brigid.null)
+  assert(parser:step(2) == false)
+  local complete, result = parser:step(3)
+  assert(complete)
+  assert(result == 42.25)
+
+  local parser = brigid.json.parser "null"
+  local complete, result = parser:step()
+  assert(complete)
+  assert(result == nil)
+end
+
+function suite:test_json_parser3()
+  local parser = brigid.json.parser " [ 1, 2, nan ] "
+  assert(parser:step(8) == false)
+  local result, message = parser:step(8)
+  if debug then print(message) end
+  assert(result == nil)
+  assert(message:find "position 11")
+
+  local parser = brigid.json.parser " { "
+  assert(parser:step(2) == false)
+  local result, message = parser:step(2)
+  if debug then print(message) end
+  assert(result == nil)
+
+  local parser = brigid.json.parser "[1,2,3]"
+  assert(parser:step(3) == false)
+  assert(parser:close())
+  local result, message = pcall(parser.step, parser)
+  if debug then print(message) end
+  assert(not result)
+end
+
+function suite:test_json_encoder1()
+  local encoder = brigid.json.encoder { "ts", "host", "latency", "tags" }
+  local data_writer = brigid.data_writer()
+  assert(encoder:write(data_writer, { ts = 1; host = "a\"b"; latency = 0.5; tags = { "x", "y" } }))
+  data_writer:write "\n"
+  encoder:write(data_writer, { host = "c"; other = true })
+  data_writer:write "\n"
+  encoder:write(data_writer, {})
+  local result = data_writer:get_string()
+  if debug then print(result) end
+  assert(result == [[
+{"ts":1,"host":"a\"b","latency":0.5,"tags":["x","y"]}
+{"host":"c"}
+{}]])
+end
+
+function suite:test_json_encoder2()
+  local encoder = brigid.json.encoder({ "z", "a", "m" }, { indent = 2, sort_keys = true })
+  local result = brigid.data_writer()
+  encoder:write(result, { z = 1; a = { y = 2, b = 3 }; m = brigid.json.array() })
+  result = result:get_string()
+  if debug then print(result) end
+  assert(result == [[
+{
+  "a": {
+    "b": 3,
+    "y": 2
+  },
+  "m": [],
+  "z": 1
+}]])
+end
+
+function suite:test_json_encoder_sort_keys()
+  local data = { ["\195\169"] = 1; b = 2; A = 3; ["\127"] = 4 }
+  local encoder = brigid.json.encoder({ "b", "\195\169", "A", "\127" }, { sort_keys = true })
+  local result = brigid.data_writer()
+  encoder:write(result, data)
+  local expect = brigid.data_writer()
+  expect:write_json(data, 0, true)
+  if debug then print(result:get_string()) end
+  assert(result:get_string() == expect:get_string())
+end
+
+function suite:test_json_encoder3()
+  local result, message = pcall(brigid.json.encoder, { "a", 1 })
+  if debug then print(message) end
+  assert(not result)
+
+  local encoder = brigid.json.encoder { "a" }
+  local data_writer = brigid.data_writer()
+  encoder:write(data_writer, { a = "a" })
+  assert(data_writer:get_string() == [[{"a":"a"}]])
+  assert(encoder:close())
+  local result, message = pcall(encoder.write, encoder, data_writer, { a = "a" })
+  if debug then print(message) end
+  assert(not result)
+end
+
+function suite:test_json_reformat1()
+  local source = [==[
+ { "a" : [ 1 , -0.50 , 2E+10, true, false, null, [ ], { }, [[ ]] ],
+   "b\"\u00e9\ud83d\ude00" : { "c" : "x\ty" } } ]==]
+
+  local result = brigid.json.reformat(source, brigid.data_writer()):get_string()
+  if debug then print(result) end
+  assert(result == [==[{"a":[1,-0.50,2E+10,true,false,null,[],{},[[]]],"b\"\u00e9\ud83d\ude00":{"c":"x\ty"}}]==])
+
+  local result = brigid.json.reformat(source, brigid.data_writer(), { indent = 2 }):get_string()
+  if debug then print(result) end
+  assert(result == [==[
+{
+  "a": [
+    1,
+    -0.50,
+    2E+10,
+    true,
+    false,
+    null,
+    [],
+    {},
+    [
+      []
+    ]
+  ],
+  "b\"\u00e9\ud83d\ude00": {
+    "c": "x\ty"
+  }
+}]==])
+
+  local result = brigid.json.reformat(result, brigid.data_writer()):get_string()
+  assert(equal(brigid.json.parse(result), brigid.json.parse(source)))
+
+  local result = brigid.json.reformat("\"\t\n\1\"", brigid.data_writer()):get_string()
+  if debug then print(result) end
+  assert(result == [["\t\n\u0001"]])
+  assert(brigid.json.parse(result) == "\t\n\1")
+end
+
+function suite:test_json_reformat2()
+  for _, source in ipairs {
+    "";
+    " [ 1, 2, nan ] ";
+    "[1,]";
+    "{\"a\" 1}";
+    "{\"a\":1,}";
+    "[1 2]";
+    "01";
+    "1.";
+    "-";
+    "\"\\x\"";
+    "\"\\ud83d\"";
+    "\"\\ud83d\\u0041\"";
+    "\"\\ud83d\\ud800\"";
+    "\"\\ude00\"";
+    "\"abc";
+    "[1]]";
+    "tru";
+  } do
+    local result, message = brigid.json.reformat(source, brigid.data_writer())
+    if debug then print(message) end
+    assert(result == nil)
+    local result, message2 = brigid.json.parse(source)
+    assert(result == nil)
+    assert(message:match "position %d+" == message2:match "position %d+")
+  end
+end
+
 function suite:test_json_write_and_parse1()
   local source = {
     Image = {
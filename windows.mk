@@ -6,36 +6,47 @@ CPPFLAGS = /I$(LUA_INCDIR) /I. /D_CRT_SECURE_NO_WARNINGS
 CXXFLAGS = $(CFLAGS) /W3 /EHsc
 
 OBJS = \
+	src\lua\blake3.obj \
 	src\lua\common.obj \
 	src\lua\common_windows.obj \
+	src\lua\crc32c.obj \
 	src\lua\crypto.obj \
 	src\lua\crypto_windows.obj \
 	src\lua\cryptor.obj \
 	src\lua\data.obj \
 	src\lua\data_writer.obj \
 	src\lua\dir.obj \
+	src\lua\encrypted.obj \
 	src\lua\error.obj \
 	src\lua\file_writer.obj \
 	src\lua\function.obj \
 	src\lua\hasher.obj \
+	src\lua\hmac.obj \
 	src\lua\http.obj \
 	src\lua\http_impl.obj \
 	src\lua\http_windows.obj \
 	src\lua\json.obj \
+	src\lua\json_encoder.obj \
 	src\lua\json_parse.obj \
+	src\lua\json_reformat.obj \
+	src\lua\kdf.obj \
 	src\lua\module.obj \
 	src\lua\new_decryptor.obj \
 	src\lua\new_encryptor.obj \
+	src\lua\new_hmac.obj \
 	src\lua\scope_exit.obj \
 	src\lua\stack_guard.obj \
 	src\lua\stdio.obj \
 	src\lua\stopwatch.obj \
 	src\lua\stopwatch_windows.obj \
+	src\lua\task.obj \
 	src\lua\thread_reference.obj \
 	src\lua\view.obj \
+	src\lua\worker_pool.obj \
 	src\lua\write_json_string.obj \
 	src\lua\write_urlencoded.obj \
-	src\lua\writer.obj
+	src\lua\writer.obj \
+	src\lua\xxh3.obj
 TARGET = brigid.dll
 
 all: $(TARGET)